@@ -34,6 +34,9 @@ typedef enum __attribute__((__packed__)) EVENT_TYPE_E {
     EVENT_TYPE_GAME_UNLOAD,
     EVENT_TYPE_GAME_STATE,
     EVENT_TYPE_GAME_MOVE,
+    EVENT_TYPE_GAME_TIMECTL, // clients request a time control for their lobby, the server broadcasts the one in effect
+    EVENT_TYPE_GAME_CLOCK, // server authoritative clock of one player, clients only ever render these
+    EVENT_TYPE_GAME_FLAG, // same layout as clock, the player ran out of time, moves are rejected until the game is reset
     //TODO EVENT_TYPE_GAME_SYNC,
     // client only events
     EVENT_TYPE_FRONTEND_LOAD,
@@ -42,6 +45,7 @@ typedef enum __attribute__((__packed__)) EVENT_TYPE_E {
     //STUB EVENT_TYPE_ENGINE_UNLOAD,
     // networking events: internal events
     EVENT_TYPE_NETWORK_INTERNAL_SSL_WRITE,
+    EVENT_TYPE_NETWORK_INTERNAL_SEND_SERIALIZED, // send pre serialized bytes shared between many recipients
     // networking events: adapter events; work with adapter<->main_queue
     EVENT_TYPE_NETWORK_ADAPTER_LOAD,
     EVENT_TYPE_NETWORK_ADAPTER_UNLOAD,
@@ -58,13 +62,25 @@ typedef enum __attribute__((__packed__)) EVENT_TYPE_E {
     EVENT_TYPE_NETWORK_PROTOCOL_PING,
     EVENT_TYPE_NETWORK_PROTOCOL_PONG,
     EVENT_TYPE_NETWORK_PROTOCOL_CLIENT_ID_SET,
+    EVENT_TYPE_NETWORK_PROTOCOL_RECONNECT, // server is restarting, clients keep their session and reconnect to the same address, forwarded to the main queue
     // user events: deal with the general user information on the connected server
     EVENT_TYPE_USER_AUTHINFO,
     EVENT_TYPE_USER_AUTHN,
+    EVENT_TYPE_USER_REGISTER, // same layout as authn, creates the account and logs in, fails if the name is taken
     EVENT_TYPE_USER_AUTHFAIL,
+    // user events: internal events, results of the server side auth workers
+    EVENT_TYPE_USER_INTERNAL_AUTHN, // same layout as authn, password is always NULL
+    EVENT_TYPE_USER_INTERNAL_AUTHFAIL, // same layout as authfail
     // lobby events: deal with client/server communication
+    EVENT_TYPE_LOBBY_JOIN, // join the lobby given in base.lobby_id, leaves the current lobby if any
+    EVENT_TYPE_LOBBY_LEAVE,
+    EVENT_TYPE_LOBBY_CLOSE, // close the lobby given in base.lobby_id, only accepted from the server itself
     EVENT_TYPE_LOBBY_CHAT_MSG,
     EVENT_TYPE_LOBBY_CHAT_DEL,
+    EVENT_TYPE_LOBBY_SEEK_ADD, // client offers a game, unless it matches an open seek the server broadcasts it with its seek id to subscribers
+    EVENT_TYPE_LOBBY_SEEK_REMOVE, // same layout as add, only seek_id is used, clients cancel their own seeks, the server announces seeks leaving the book
+    EVENT_TYPE_LOBBY_SEEK_SUBSCRIBE, // the current book is sent as adds, then all changes to it, owners always get adds/removes of their seeks with base.client_id == owner_client_id
+    EVENT_TYPE_LOBBY_SEEK_UNSUBSCRIBE,
 
     EVENT_TYPE_DYNAMIC, // dynamically typed json event encapsulation
 
@@ -171,6 +187,25 @@ typedef struct event_game_move_s {
 
 void event_create_game_move(event_any* e, uint32_t sync, player_id player, move_code code);
 
+typedef struct event_game_timectl_s {
+    event base;
+    uint32_t initial_ms; // 0 disables the clocks
+    uint32_t increment_ms; // added to the clock of the player who just moved
+    uint32_t delay_ms; // every turn the clock only starts counting down after this
+} event_game_timectl;
+
+void event_create_game_timectl(event_any* e, uint32_t initial_ms, uint32_t increment_ms, uint32_t delay_ms);
+
+typedef struct event_game_clock_s {
+    event base;
+    player_id player;
+    bool running;
+    uint32_t remaining_ms; // as of sending
+    uint32_t delay_ms; // delay left for this turn as of sending, only for the running clock
+} event_game_clock;
+
+void event_create_game_clock(event_any* e, EVENT_TYPE type, player_id player, bool running, uint32_t remaining_ms, uint32_t delay_ms);
+
 typedef struct event_frontend_load_s {
     event base;
     void* frontend;
@@ -189,6 +224,30 @@ void event_create_ssl_thumbprint(event_any* e, EVENT_TYPE type);
 
 //TODO for with thumbprint
 
+// refcounted, immutable buffer holding one serialized event (including its size prefix)
+// used to serialize a broadcast once and hand the same bytes to every recipient connection
+typedef struct event_serialized_s {
+    uint32_t refcount;
+    size_t size;
+    void* data;
+} event_serialized;
+
+// serializes e into a new buffer with refcount 1, e is not modified
+event_serialized* event_serialized_create(event_any* e);
+// copies already serialized bytes, e.g. multiple concatenated events, into a new buffer with refcount 1
+event_serialized* event_serialized_create_raw(const void* data, size_t size);
+void event_serialized_ref(event_serialized* s);
+// frees the buffer once the last reference is released
+void event_serialized_unref(event_serialized* s);
+
+typedef struct event_send_serialized_s {
+    event base;
+    event_serialized* buf;
+} event_send_serialized;
+
+// takes a new reference on buf, destroying or copying the event manages it accordingly
+void event_create_send_serialized(event_any* e, uint32_t client_id, event_serialized* buf);
+
 typedef struct event_auth_s {
     event base;
     bool is_guest;
@@ -205,6 +264,14 @@ typedef struct event_auth_fail_s {
 
 void event_create_auth_fail(event_any* e, uint32_t client_id, const char* reason);
 
+typedef struct event_lobby_join_s {
+    event base;
+    bool spectate; // join as viewer only, spectators do not count towards max users
+    uint8_t seat; // user slot + 1 to take back after a server restart, 0 for the first free one, only honoured from the server itself
+} event_lobby_join;
+
+void event_create_lobby_join(event_any* e, uint32_t client_id, uint32_t lobby_id, bool spectate);
+
 typedef struct event_chat_msg_s {
     event base;
     uint32_t msg_id;
@@ -222,6 +289,21 @@ typedef struct event_chat_del_s {
 
 void event_create_chat_del(event_any* e, uint32_t msg_id);
 
+typedef struct event_seek_s {
+    event base;
+    uint32_t seek_id; // assigned by the server
+    uint32_t owner_client_id;
+    char* base_name;
+    char* variant_name;
+    char* impl_name;
+    char* options; // may be NULL
+    uint32_t initial_ms; // time control, all 0 for untimed
+    uint32_t increment_ms;
+    uint32_t delay_ms;
+} event_seek;
+
+void event_create_seek(event_any* e, EVENT_TYPE type, uint32_t seek_id, uint32_t owner_client_id, const char* base_name, const char* variant_name, const char* impl_name, const char* options, uint32_t initial_ms, uint32_t increment_ms, uint32_t delay_ms);
+
 typedef struct event_dynamic_s {
     event base;
     uint32_t dyn_type;
@@ -241,12 +323,17 @@ typedef union event_any_u {
     event_game_load_methods game_load_methods;
     event_game_state game_state;
     event_game_move game_move;
+    event_game_timectl game_timectl;
+    event_game_clock game_clock;
     event_frontend_load frontend_load;
     event_ssl_thumbprint ssl_thumbprint;
+    event_send_serialized send_serialized;
     event_auth auth;
     event_auth_fail auth_fail;
+    event_lobby_join lobby_join;
     event_chat_msg chat_msg;
     event_chat_del chat_del;
+    event_seek seek;
     event_dynamic dynamic;
 } event_any;
 
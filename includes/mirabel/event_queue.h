@@ -9,9 +9,19 @@ extern "C" {
 #endif
 
 typedef struct event_queue_s {
-    char _padding[168];
+    char _padding[576];
 } event_queue;
 
+// every queue remembers the last few events popped from it, for diagnostics
+static const uint32_t EVENT_QUEUE_HISTORY_SIZE = 16;
+
+typedef struct event_queue_history_entry_s {
+    uint64_t time_ms; // steady clock, when it was popped
+    uint32_t type;
+    uint32_t client_id;
+    uint32_t lobby_id;
+} event_queue_history_entry;
+
 void event_queue_create(event_queue* eq);
 
 void event_queue_destroy(event_queue* eq);
@@ -22,6 +32,13 @@ void event_queue_push(event_queue* eq, event_any* e);
 // wait until timeout or event to pop available, non blocking if 0, returns NULL event if none available
 void event_queue_pop(event_queue* eq, event_any* e, uint32_t t);
 
+// number of queued events, lock free and only approximate while others push or pop
+uint32_t event_queue_size(event_queue* eq);
+
+// copies up to EVENT_QUEUE_HISTORY_SIZE of the last popped events to out, oldest first, returns the number copied
+// lock free so it can be used from a watchdog while the owner is stuck, entries may be torn while the owner pops concurrently
+uint32_t event_queue_history(event_queue* eq, event_queue_history_entry* out);
+
 #ifdef __cplusplus
 }
 #endif
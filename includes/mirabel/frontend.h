@@ -20,7 +20,7 @@ extern "C" {
 #endif
 
 //NOTE: updates to {config, event_queue, event, frontend, imgui_c_thin, job_queue, log, sound} will incur a version increase here
-static const uint64_t MIRABEL_FRONTEND_API_VERSION = 15;
+static const uint64_t MIRABEL_FRONTEND_API_VERSION = 26;
 
 //TODO this mirrors a lot of the info that will be stored in the client lobby
 typedef struct /*grand_unified_*/ frontend_display_data_s {
@@ -0,0 +1,326 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "mirabel/event_queue.h"
+#include "mirabel/event.h"
+#include "control/server_metrics.hpp"
+#include "control/server.hpp"
+#include "control/thread_runtime.hpp"
+#include "network/protocol.hpp"
+
+#include "control/admin_socket.hpp"
+
+namespace Control {
+
+    static uint64_t now_ms()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void json_field(std::string& out, const char* name, uint64_t value, bool last = false)
+    {
+        char buf[96];
+        sprintf(buf, "\"%s\":%lu%s", name, (unsigned long)value, last ? "" : ",");
+        out += buf;
+    }
+
+    AdminSocket::AdminSocket(Server* server):
+        server(server),
+        quit(false)
+    {}
+
+    AdminSocket::~AdminSocket()
+    {
+        close();
+    }
+
+    bool AdminSocket::open()
+    {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(addr.sun_path)) {
+            printf("[ERROR] admin socket path too long: %s\n", socket_path.c_str());
+            return false;
+        }
+        strcpy(addr.sun_path, socket_path.c_str());
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            printf("[ERROR] failed to create admin socket\n");
+            return false;
+        }
+        unlink(socket_path.c_str()); // stale socket from a previous run
+        // owner only from the moment it exists, this can drop clients and close lobbies, a chmod afterwards leaves a window
+        mode_t old_mask = umask(077);
+        int bind_res = bind(listen_fd, (sockaddr*)&addr, sizeof(addr));
+        umask(old_mask);
+        if (bind_res != 0 || listen(listen_fd, 4) != 0) {
+            printf("[ERROR] failed to bind admin socket %s\n", socket_path.c_str());
+            ::close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+        open_ms = now_ms();
+        sample_ms = open_ms;
+        sample_events_in = 0;
+        sample_events_out = 0;
+        quit.store(false);
+        runner = thread_runtime.spawn("admin", [this]() { loop(); });
+        printf("[INFO] admin socket listening on %s\n", socket_path.c_str());
+        return true;
+    }
+
+    void AdminSocket::close()
+    {
+        if (!runner.joinable()) {
+            return;
+        }
+        quit.store(true);
+        runner.join();
+        ::close(listen_fd);
+        listen_fd = -1;
+        unlink(socket_path.c_str());
+    }
+
+    void AdminSocket::loop()
+    {
+        while (!quit.load()) {
+            pollfd pfd;
+            pfd.fd = listen_fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            int ready = poll(&pfd, 1, 250);
+            uint64_t now = now_ms();
+            if (now - sample_ms >= 1000) {
+                sample_rates(now);
+            }
+            if (ready <= 0 || !(pfd.revents & POLLIN)) {
+                continue;
+            }
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd < 0) {
+                continue;
+            }
+            handle_connection(fd);
+            ::close(fd);
+        }
+    }
+
+    void AdminSocket::sample_rates(uint64_t now)
+    {
+        uint64_t events_in = server->metrics.events_in.load(std::memory_order_relaxed);
+        uint64_t events_out = server->metrics.events_out.load(std::memory_order_relaxed);
+        double elapsed_s = (now - sample_ms) / 1000.0;
+        events_in_per_s = (events_in - sample_events_in) / elapsed_s;
+        events_out_per_s = (events_out - sample_events_out) / elapsed_s;
+        sample_events_in = events_in;
+        sample_events_out = events_out;
+        sample_ms = now;
+    }
+
+    void AdminSocket::handle_connection(int fd)
+    {
+        // a slow or silent peer only ever stalls the admin thread, never the server
+        timeval tv;
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        char line[256];
+        size_t line_len = 0;
+        while (line_len < sizeof(line) - 1) {
+            ssize_t rd = read(fd, line + line_len, sizeof(line) - 1 - line_len);
+            if (rd <= 0) {
+                break;
+            }
+            line_len += rd;
+            if (memchr(line, '\n', line_len) != NULL) {
+                break;
+            }
+        }
+        line[line_len] = '\0';
+        char* line_end = strpbrk(line, "\r\n");
+        if (line_end != NULL) {
+            *line_end = '\0';
+        }
+        std::string reply = command(line);
+        size_t written = 0;
+        while (written < reply.size()) {
+            ssize_t wr = write(fd, reply.data() + written, reply.size() - written);
+            if (wr <= 0) {
+                break;
+            }
+            written += wr;
+        }
+    }
+
+    std::string AdminSocket::command(const char* line)
+    {
+        char cmd[16] = "";
+        unsigned int id = 0;
+        int argc = sscanf(line, "%15s %u", cmd, &id);
+        if (argc <= 0 || strcmp(cmd, "stats") == 0) {
+            return stats_json();
+        }
+        if (strcmp(cmd, "drop") == 0 && argc == 2) {
+            if (id == EVENT_CLIENT_NONE || id == EVENT_CLIENT_SERVER) {
+                return "error: invalid client id\n";
+            }
+            if (server->t_network == NULL) {
+                // offline, or the adapter is not up yet
+                return "error: no network server\n";
+            }
+            // the network server closes the connection even if the peer lingers, its disconnect event then frees the lobby seat and name
+            server->t_network->drop_client(id);
+            printf("[INFO] admin dropped client %u\n", id);
+            return "ok\n";
+        }
+        if (strcmp(cmd, "close") == 0 && argc == 2) {
+            if (id == EVENT_LOBBY_NONE) {
+                return "error: invalid lobby id\n";
+            }
+            // lobbies belong to the main thread, it closes them like any other event
+            event_any es;
+            event_create_type(&es, EVENT_TYPE_LOBBY_CLOSE);
+            es.base.lobby_id = id;
+            event_queue_push(&server->inbox, &es);
+            printf("[INFO] admin requested close of lobby #%u\n", id);
+            return "ok\n";
+        }
+        if (strcmp(cmd, "restart") == 0) {
+            // the main thread does the actual shutdown, main then re-executes the binary, which may have been replaced by now
+            server->restart_requested.store(true);
+            event_any es;
+            event_create_type(&es, EVENT_TYPE_EXIT);
+            event_queue_push(&server->inbox, &es);
+            printf("[INFO] admin requested restart\n");
+            return "ok\n";
+        }
+        return "error: unknown command, use: stats | drop <client_id> | close <lobby_id> | restart\n";
+    }
+
+    std::string AdminSocket::stats_json()
+    {
+        server_metrics& m = server->metrics;
+        std::string out = "{";
+        char buf[128];
+        json_field(out, "uptime_ms", now_ms() - open_ms);
+
+        out += "\"clients\":{";
+        // same order as PROTOCOL_CONNECTION_STATE
+        static const char* state_names[Network::PROTOCOL_CONNECTION_STATE_COUNT] = {
+            "preclose",
+            "none",
+            "initializing",
+            "warnheld",
+            "accepted",
+        };
+        for (int i = 0; i < Network::PROTOCOL_CONNECTION_STATE_COUNT; i++) {
+            int32_t cnt = m.clients_by_state[i].load(std::memory_order_relaxed);
+            // counters race with the network threads, never show a transient negative
+            json_field(out, state_names[i], cnt < 0 ? 0 : cnt, i == Network::PROTOCOL_CONNECTION_STATE_COUNT - 1);
+        }
+        out += "},";
+
+        out += "\"events\":{";
+        json_field(out, "in", m.events_in.load(std::memory_order_relaxed));
+        json_field(out, "out", m.events_out.load(std::memory_order_relaxed));
+        sprintf(buf, "\"in_per_s\":%.1f,\"out_per_s\":%.1f", events_in_per_s, events_out_per_s);
+        out += buf;
+        out += "},";
+
+        uint64_t loop_events = m.loop_events.load(std::memory_order_relaxed);
+        out += "\"server_loop\":{";
+        json_field(out, "events", loop_events);
+        json_field(out, "avg_us", loop_events > 0 ? m.loop_us_total.load(std::memory_order_relaxed) / loop_events : 0);
+        json_field(out, "max_us", m.loop_us_max.load(std::memory_order_relaxed), true);
+        out += "},";
+
+        out += "\"tls_handshakes\":{";
+        json_field(out, "started", m.tls_handshakes_started.load(std::memory_order_relaxed));
+        json_field(out, "completed", m.tls_handshakes_completed.load(std::memory_order_relaxed));
+        json_field(out, "failed", m.tls_handshakes_failed.load(std::memory_order_relaxed), true);
+        out += "},";
+
+        out += "\"queues\":{";
+        json_field(out, "server_inbox", event_queue_size(&server->inbox));
+        json_field(out, "network_send", server->t_network != NULL ? event_queue_size(&server->t_network->send_queue) : 0);
+        json_field(out, "auth_pending", server->auth_mgr.PendingCount());
+        out += "\"lobby_workers\":[";
+        std::vector<uint32_t> depths;
+        server->lobby_mgr.GetQueueDepths(&depths);
+        for (size_t i = 0; i < depths.size(); i++) {
+            sprintf(buf, "%s%u", i > 0 ? "," : "", depths[i]);
+            out += buf;
+        }
+        out += "]},";
+
+        // cpu percentages are relative to the previous stats request
+        out += "\"threads\":[";
+        std::vector<thread_sample> threads;
+        thread_runtime.sample(&threads);
+        for (size_t i = 0; i < threads.size(); i++) {
+            out += (i > 0 ? ",{" : "{");
+            out += "\"name\":\"" + threads[i].name + "\",";
+            json_field(out, "cpu_ms", threads[i].cpu_ms);
+            sprintf(buf, "\"cpu_percent\":%.1f}", threads[i].cpu_percent);
+            out += buf;
+        }
+        out += "],";
+
+        out += "\"lobbies\":[";
+        std::vector<std::shared_ptr<lobby_stats>> lobbies;
+        server->lobby_mgr.GetLobbyStats(&lobbies);
+        for (size_t i = 0; i < lobbies.size(); i++) {
+            lobby_stats& ls = *lobbies[i];
+            uint64_t moves = ls.moves.load(std::memory_order_relaxed);
+            uint64_t latency_total = ls.move_latency_us_total.load(std::memory_order_relaxed);
+            out += (i > 0 ? ",{" : "{");
+            json_field(out, "id", ls.lobby_id);
+            json_field(out, "users", ls.users.load(std::memory_order_relaxed));
+            json_field(out, "spectators", ls.spectators.load(std::memory_order_relaxed));
+            json_field(out, "moves", moves);
+            json_field(out, "journal_failures", ls.journal_failures.load(std::memory_order_relaxed));
+            out += "\"move_latency_us\":{";
+            json_field(out, "last", ls.move_latency_us_last.load(std::memory_order_relaxed));
+            json_field(out, "avg", moves > 0 ? latency_total / moves : 0);
+            json_field(out, "max", ls.move_latency_us_max.load(std::memory_order_relaxed), true);
+            out += "}}";
+        }
+        out += "],";
+
+        // sizes in pages, see proc(5)
+        unsigned long vm_pages = 0;
+        unsigned long rss_pages = 0;
+        FILE* statm = fopen("/proc/self/statm", "r");
+        if (statm != NULL) {
+            if (fscanf(statm, "%lu %lu", &vm_pages, &rss_pages) != 2) {
+                vm_pages = 0;
+                rss_pages = 0;
+            }
+            fclose(statm);
+        }
+        uint64_t page_size = sysconf(_SC_PAGESIZE);
+        out += "\"memory\":{";
+        json_field(out, "rss_bytes", rss_pages * page_size);
+        json_field(out, "vm_bytes", vm_pages * page_size, true);
+        out += "}}\n";
+        return out;
+    }
+
+} // namespace Control
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace Control {
+
+    class Server;
+
+    // local only unix domain socket for operators, one command per connection, the reply is written and the connection closed
+    //   stats (or empty)  -> json snapshot of the server metrics
+    //   drop <client_id>  -> pre-close the connection and disconnect the client from the server
+    //   close <lobby_id>  -> close the lobby, its members are sent an unload
+    //   restart           -> clients are told to reconnect, lobbies are journaled and the binary is executed again
+    // e.g.: echo stats | socat - UNIX-CONNECT:./mirabel_admin.sock
+    class AdminSocket {
+      private:
+
+        Server* server;
+
+        int listen_fd = -1;
+        std::thread runner;
+        std::atomic<bool> quit;
+
+        uint64_t open_ms;
+        // rates are sampled by the runner once per second
+        uint64_t sample_ms;
+        uint64_t sample_events_in;
+        uint64_t sample_events_out;
+        double events_in_per_s = 0;
+        double events_out_per_s = 0;
+
+        void loop();
+        void sample_rates(uint64_t now_ms);
+        void handle_connection(int fd);
+        std::string command(const char* line);
+        std::string stats_json();
+
+      public:
+
+        std::string socket_path = "./mirabel_admin.sock";
+
+        AdminSocket(Server* server);
+        ~AdminSocket();
+
+        bool open();
+        void close();
+    };
+
+} // namespace Control
@@ -1,22 +1,155 @@
 #include "mirabel/event_queue.h"
 #include "mirabel/event.h"
 
+#include <atomic>
 #include <cstddef>
 #include <cstdbool>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "control/thread_runtime.hpp"
+#include "control/user_manager.hpp"
 
 #include "control/auth_manager.hpp"
 
 namespace Control {
 
-    AuthManager::AuthManager()
+    AuthManager::AuthManager(UserManager* user_mgr, event_queue* result_queue):
+        user_mgr(user_mgr),
+        result_queue(result_queue),
+        pending(0),
+        send_queue(NULL)
     {
-        //TODO
+        event_queue_create(&work_queue);
     }
 
     AuthManager::~AuthManager()
     {
-        //TODO
+        stop();
+        event_queue_destroy(&work_queue);
+    }
+
+    void AuthManager::start(uint32_t worker_count)
+    {
+        if (worker_count == 0) {
+            worker_count = std::thread::hardware_concurrency() / 4;
+            if (worker_count == 0) {
+                worker_count = 1;
+            }
+        }
+        for (uint32_t i = 0; i < worker_count; i++) {
+            workers.push_back(thread_runtime.spawn("auth" + std::to_string(i), [this]() { worker_loop(); }));
+        }
+        printf("[INFO] auth manager started %u workers\n", worker_count);
+    }
+
+    void AuthManager::stop()
+    {
+        event_any es;
+        for (size_t i = 0; i < workers.size(); i++) {
+            event_create_type(&es, EVENT_TYPE_EXIT);
+            event_queue_push(&work_queue, &es);
+        }
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+        workers.clear();
+    }
+
+    const char* AuthManager::check_username(const char* username)
+    {
+        if (username == NULL) {
+            return "name NULL";
+        }
+        size_t len = strlen(username);
+        // validate that username uses only allowed characters
+        for (size_t i = 0; i < len; i++) {
+            if (!strchr("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_-", username[i])) {
+                return "name contains illegal characters";
+            }
+        }
+        if (len > 0 && len < 3) {
+            return "name < 3 characters";
+        }
+        if (len > 31) {
+            return "name > 31 characters";
+        }
+        return NULL;
+    }
+
+    void AuthManager::Authenticate(event_any* e)
+    {
+        event_any es;
+        if (pending.load() >= MAX_PENDING) {
+            event_create_auth_fail(&es, e->base.client_id, "server busy, try again");
+            es.base.type = EVENT_TYPE_USER_INTERNAL_AUTHFAIL;
+            event_queue_push(result_queue, &es);
+            return; // e stays with the caller, it destroys it
+        }
+        pending++;
+        event_queue_push(&work_queue, e);
+    }
+
+    uint32_t AuthManager::PendingCount()
+    {
+        return pending.load(std::memory_order_relaxed);
+    }
+
+    void AuthManager::worker_loop()
+    {
+        bool quit = false;
+        while (!quit) {
+            event_any e;
+            event_queue_pop(&work_queue, &e, UINT32_MAX);
+            switch (e.base.type) {
+                case EVENT_TYPE_EXIT: {
+                    quit = true;
+                } break;
+                case EVENT_TYPE_USER_AUTHN:
+                case EVENT_TYPE_USER_REGISTER: {
+                    event_any es;
+                    const char* username = e.auth.username;
+                    const char* password = e.auth.password;
+                    const char* fail_reason = check_username(username);
+                    if (fail_reason == NULL && strlen(username) == 0) {
+                        fail_reason = "name empty";
+                    }
+                    if (fail_reason == NULL && (password == NULL || strlen(password) == 0)) {
+                        fail_reason = "password empty";
+                    }
+                    uint64_t user_id = USER_ID_NONE;
+                    if (fail_reason == NULL && e.base.type == EVENT_TYPE_USER_REGISTER) {
+                        // only an explicit register creates accounts, a mistyped login name just fails
+                        user_id = user_mgr->create_user(username, password, false);
+                        if (user_id == USER_ID_NONE) {
+                            fail_reason = "name already registered";
+                        } else {
+                            printf("[INFO] registered new user %s\n", username);
+                        }
+                    } else if (fail_reason == NULL) {
+                        user_id = user_mgr->authenticate_user(username, password, false);
+                        if (user_id == USER_ID_NONE) {
+                            fail_reason = "wrong username or password";
+                        }
+                    }
+                    if (fail_reason != NULL) {
+                        event_create_auth_fail(&es, e.base.client_id, fail_reason);
+                        es.base.type = EVENT_TYPE_USER_INTERNAL_AUTHFAIL;
+                    } else {
+                        event_create_auth(&es, EVENT_TYPE_USER_INTERNAL_AUTHN, e.base.client_id, false, username, NULL);
+                    }
+                    event_queue_push(result_queue, &es);
+                    pending--;
+                } break;
+                default: {
+                    printf("[WARN] auth worker received unexpected event, type: %d\n", e.base.type);
+                } break;
+            }
+            event_destroy(&e);
+        }
     }
 
 } // namespace Control
@@ -3,21 +3,51 @@
 #include "mirabel/event_queue.h"
 #include "mirabel/event.h"
 
+#include <atomic>
 #include <cstddef>
 #include <cstdbool>
 #include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "control/user_manager.hpp"
 
 namespace Control {
 
+    // user logins run the password kdf on a small worker pool, so they never block the server main thread or the lobby workers
+    // takes USER_AUTHN for existing accounts and USER_REGISTER for new ones
+    // results come back to the result queue as USER_INTERNAL_AUTHN / USER_INTERNAL_AUTHFAIL events for the same client
     class AuthManager {
       private:
 
+        UserManager* user_mgr;
+        event_queue* result_queue;
+
+        std::vector<std::thread> workers;
+        event_queue work_queue;
+        std::atomic<uint32_t> pending;
+
+        void worker_loop();
+
       public:
 
+        static const uint32_t MAX_PENDING = 256; // logins beyond this fail right away instead of piling up behind the kdf
+
         event_queue* send_queue;
 
-        AuthManager();
+        AuthManager(UserManager* user_mgr, event_queue* result_queue);
         ~AuthManager();
+
+        void start(uint32_t worker_count); // 0 uses a quarter of the hardware threads, at least one
+        void stop();
+
+        // returns NULL if the name is acceptable, otherwise the reason why not
+        static const char* check_username(const char* username);
+
+        // takes ownership of the client authn event, first login with a new name registers it
+        void Authenticate(event_any* e);
+
+        uint32_t PendingCount(); // logins queued or being hashed right now
     };
 
 } // namespace Control
@@ -2,7 +2,6 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
-#include <set>
 #include <unordered_map>
 
 #include <GL/glew.h>
@@ -24,11 +23,14 @@
 #include "mirabel/frontend.h"
 #include "surena/move_history.h"
 #include "control/plugins.hpp"
+#include "control/thread_runtime.hpp"
 #include "control/timeout_crash.hpp"
 #include "frontends/frontend_catalogue.hpp"
 #include "games/game_catalogue.hpp"
 #include "meta_gui/meta_gui.hpp"
+#include "network/network_loopback.hpp"
 #include "network/protocol.hpp"
+#include "control/server.hpp"
 
 #include "control/client.hpp"
 
@@ -197,6 +199,9 @@ namespace Control {
 
         // init engine manager with a context queue to our inbox
         engine_mgr = new Engines::EngineManager(&inbox);
+
+        // plugins loaded from the plugins window are swapped in when rebuilt
+        plugin_mgr.watch_plugins();
     }
 
     Client::~Client()
@@ -207,6 +212,7 @@ namespace Control {
             t_network->close();
             delete t_network;
         }
+        stop_offline_server();
 
         delete engine_mgr;
 
@@ -285,6 +291,10 @@ namespace Control {
 
             dd.ms_tick = timestamp_get_ms64();
 
+            if (reconnect_deadline != 0 && t_network == NULL && dd.ms_tick >= reconnect_next_try) {
+                try_reconnect();
+            }
+
             event_any e;
             event_queue_pop(&inbox, &e, 0);
             while (e.base.type != EVENT_TYPE_NULL) {
@@ -303,14 +313,18 @@ namespace Control {
                     } break;
                     case EVENT_TYPE_GAME_LOAD: {
                         // reset everything in case we can't find the game later on
+                        clocks.clear();
                         event_any se;
                         event_create_type(&se, EVENT_TYPE_GAME_UNLOAD);
                         the_frontend->methods->process_event(the_frontend, se);
                         if (the_game) {
+                            the_game_impl.destroy_runtime(MetaGui::game_runtime_options);
+                            MetaGui::game_runtime_options = NULL;
                             the_game->methods->destroy(the_game);
                             free(the_game);
                         }
                         the_game = NULL;
+                        the_game_impl.plugin.reset();
                         // find game in games catalogue by provided strings
                         const char* base_name = e.game_load.base_name;
                         const char* variant_name = e.game_load.variant_name;
@@ -322,14 +336,19 @@ namespace Control {
                         }
                         // set meta gui combo boxes, in case this was a network event, others are already set
                         MetaGui::game_impl_idx = impl_idx;
-                        // actually load the game
-                        the_game = plugin_mgr.impl_lookup[impl_idx]->new_game(e.game_load.init_info);
+                        // actually load the game, the copy of the impl keeps it usable even if its plugin is reloaded while the game runs
+                        if (!plugin_mgr.resolve_impl(impl_idx)) {
+                            MetaGui::logf("#W guithread: failed to open game: %s.%s.%s\n", base_name, variant_name, impl_name);
+                            break;
+                        }
+                        the_game_impl = plugin_mgr.view().get_impl(impl_idx);
+                        the_game = the_game_impl.new_game(e.game_load.init_info);
                         if (the_game == NULL) {
                             MetaGui::logf("#W guithread: failed to create game: %s.%s.%s\n", base_name, variant_name, impl_name);
                             break;
                         }
                         // create runtime opts for metagui
-                        plugin_mgr.impl_lookup[impl_idx]->create_runtime(the_game, &MetaGui::game_runtime_options);
+                        the_game_impl.create_runtime(the_game, &MetaGui::game_runtime_options);
                         game_step++;
                         engine_mgr->game_load(the_game);
                         if (the_frontend->methods->is_game_compatible(the_game->methods) != ERR_OK) {
@@ -346,12 +365,13 @@ namespace Control {
                         }
                     } break;
                     case EVENT_TYPE_GAME_UNLOAD: {
-                        if (MetaGui::game_impl_idx > 0) {
-                            // create runtime opts for metagui
-                            plugin_mgr.impl_lookup[MetaGui::game_impl_idx]->destroy_runtime(MetaGui::game_runtime_options); //HACK dont use metagui game impl idx here for game unloading
+                        if (the_game) {
+                            // destroy runtime opts for metagui
+                            the_game_impl.destroy_runtime(MetaGui::game_runtime_options);
                             MetaGui::game_runtime_options = NULL;
                         }
                         engine_mgr->game_load(NULL);
+                        clocks.clear();
                         event_any se;
                         event_create_type(&se, EVENT_TYPE_GAME_UNLOAD);
                         the_frontend->methods->process_event(the_frontend, se);
@@ -360,6 +380,7 @@ namespace Control {
                             free(the_game);
                         }
                         the_game = NULL;
+                        the_game_impl.plugin.reset();
                         game_step++;
                         // everything successful, pass to server
                         if (network_send_queue && e.base.client_id == EVENT_CLIENT_NONE) {
@@ -419,6 +440,8 @@ namespace Control {
                             free(the_frontend);
                         }
                         the_frontend = (frontend*)e.frontend_load.frontend;
+                        the_frontend_impl = loading_frontend_impl;
+                        loading_frontend_impl.plugin.reset();
                         if (the_game) {
                             // send frontend game load copy of running game
                             size_t size_fill;
@@ -455,6 +478,7 @@ namespace Control {
                             free(the_frontend);
                         }
                         the_frontend = empty_fe;
+                        the_frontend_impl.plugin.reset();
                         MetaGui::running_fem_idx = 0;
                     } break;
                     case EVENT_TYPE_LOBBY_CHAT_MSG: {
@@ -463,18 +487,82 @@ namespace Control {
                     case EVENT_TYPE_LOBBY_CHAT_DEL: {
                         MetaGui::chat_msg_del(e.chat_del.msg_id);
                     } break;
+                    case EVENT_TYPE_LOBBY_SEEK_ADD: {
+                        open_seek& s = seeks[e.seek.seek_id];
+                        // the book sent on subscribe is the same for everyone, ownership is only known from the echo addressed to us
+                        s.own = (s.own || e.base.client_id == e.seek.owner_client_id);
+                        s.base_name = (e.seek.base_name ? e.seek.base_name : "");
+                        s.variant_name = (e.seek.variant_name ? e.seek.variant_name : "");
+                        s.impl_name = (e.seek.impl_name ? e.seek.impl_name : "");
+                        s.options = (e.seek.options ? e.seek.options : "");
+                        s.initial_ms = e.seek.initial_ms;
+                        s.increment_ms = e.seek.increment_ms;
+                        s.delay_ms = e.seek.delay_ms;
+                    } break;
+                    case EVENT_TYPE_LOBBY_SEEK_REMOVE: {
+                        seeks.erase(e.seek.seek_id);
+                    } break;
+                    case EVENT_TYPE_GAME_TIMECTL: {
+                        // only ever comes from the server, the timectl window sends straight to it
+                        timectl_initial_ms = e.game_timectl.initial_ms;
+                        timectl_increment_ms = e.game_timectl.increment_ms;
+                        timectl_delay_ms = e.game_timectl.delay_ms;
+                        clocks.clear();
+                    } break;
+                    case EVENT_TYPE_GAME_CLOCK:
+                    case EVENT_TYPE_GAME_FLAG: {
+                        if (e.game_clock.player == PLAYER_NONE) {
+                            break;
+                        }
+                        if (clocks.size() < e.game_clock.player) {
+                            clocks.resize(e.game_clock.player, game_clock{});
+                        }
+                        game_clock& gc = clocks[e.game_clock.player - 1];
+                        gc.running = e.game_clock.running;
+                        gc.flagged = (e.base.type == EVENT_TYPE_GAME_FLAG);
+                        gc.remaining_ms = e.game_clock.remaining_ms;
+                        gc.delay_ms = e.game_clock.delay_ms;
+                        gc.received_ms = timestamp_get_ms64();
+                        if (gc.flagged) {
+                            MetaGui::logf("#I player %u lost on time\n", e.game_clock.player);
+                        }
+                    } break;
                     /* skip EVENT_TYPE_NETWORK_ADAPTER_LOAD, t_network gets filled by the metagui connection window*/
                     case EVENT_TYPE_NETWORK_ADAPTER_SOCKET_CLOSED: // died while trying to connect
                     case EVENT_TYPE_NETWORK_ADAPTER_UNLOAD: { // metagui wants to disconnect
-                        if (t_network == NULL) {
+                        if (t_network == NULL && t_loopback == NULL) {
                             // need this to catch adapter recv runner socket close after proper unload
                             break;
                         }
+                        if (e.base.type == EVENT_TYPE_NETWORK_ADAPTER_SOCKET_CLOSED && reconnect_deadline != 0 && t_network != NULL) {
+                            // server is restarting, keep address and credentials and retry until it is back
+                            // seeks do not survive the restart, the lobby window subscribes again once connected
+                            seeks.clear();
+                            seeks_subscribed = false;
+                            network_send_queue = NULL;
+                            t_network->close();
+                            delete t_network;
+                            t_network = NULL;
+                            MetaGui::conn_info.adapter = MetaGui::RUNNING_STATE_ONGOING;
+                            MetaGui::conn_info.connection = MetaGui::RUNNING_STATE_NONE;
+                            MetaGui::conn_info.auth_info = false;
+                            MetaGui::conn_info.authentication = MetaGui::RUNNING_STATE_NONE;
+                            reconnect_next_try = timestamp_get_ms64() + RECONNECT_RETRY_MS;
+                            break;
+                        }
+                        reconnect_deadline = 0;
                         network_send_queue = NULL;
-                        t_network->close();
-                        delete t_network;
-                        t_network = NULL;
+                        if (t_network) {
+                            t_network->close();
+                            delete t_network;
+                            t_network = NULL;
+                        }
+                        stop_offline_server();
                         MetaGui::chat_clear();
+                        timectl_initial_ms = 0;
+                        clocks.clear();
+                        seeks.clear();
+                        seeks_subscribed = false;
                         MetaGui::connection_info_reset();
                     } break;
                     case EVENT_TYPE_NETWORK_ADAPTER_SOCKET_OPENED: {
@@ -492,7 +580,7 @@ namespace Control {
                         // request auth info from server
                         event_any es;
                         event_create_auth(&es, EVENT_TYPE_USER_AUTHINFO, EVENT_CLIENT_NONE, true, NULL, NULL);
-                        event_queue_push(&t_network->send_queue, &es);
+                        event_queue_push(adapter_send_queue(), &es);
                     } break;
                     case EVENT_TYPE_NETWORK_ADAPTER_CONNECTION_VERIFAIL: {
                         free(MetaGui::conn_info.server_cert_thumbprint);
@@ -504,7 +592,7 @@ namespace Control {
                     } break;
                     case EVENT_TYPE_NETWORK_ADAPTER_CLIENT_CONNECTED: {
                         // finalize connection by setting the sending queue, this transitions from initialization into usage
-                        network_send_queue = &(t_network->send_queue);
+                        network_send_queue = adapter_send_queue();
                         // server sends its state as sync automatically, //TODO maybe we should reset it ourselves anyway?
                         MetaGui::chat_clear();
                     } break;
@@ -523,10 +611,21 @@ namespace Control {
                         MetaGui::conn_info.auth_want_guest_pw = (e.auth.password != NULL);
                         // if the server does not accept user AND guest logins wait for user to press guest login, enable pw input if wanted
                         MetaGui::conn_info.auth_info = true;
+                        if (reconnect_deadline != 0) {
+                            reconnect_deadline = 0;
+                            if (strlen(MetaGui::conn_info.username) > 0) {
+                                // back after a server restart, log in again just like before
+                                event_any es;
+                                event_create_auth(&es, EVENT_TYPE_USER_AUTHN, EVENT_CLIENT_NONE, reconnect_as_guest, MetaGui::conn_info.username, MetaGui::conn_info.password);
+                                event_queue_push(adapter_send_queue(), &es);
+                                MetaGui::conn_info.authentication = MetaGui::RUNNING_STATE_ONGOING;
+                            }
+                        }
                     } break;
                     case EVENT_TYPE_USER_AUTHN: {
                         // we received our authn credentials from the server
                         strcpy(MetaGui::conn_info.username, e.auth.username); // set username in authinfo, as received, may be assigned guest name
+                        reconnect_as_guest = e.auth.is_guest;
                         //TODO should probably store it somewhere else too
                         MetaGui::conn_info.authentication = MetaGui::RUNNING_STATE_DONE;
                         event_any es;
@@ -545,6 +644,17 @@ namespace Control {
                         event_create_type(&es, EVENT_TYPE_NETWORK_ADAPTER_CLIENT_DISCONNECTED);
                         event_queue_push(&inbox, &es);
                     } break;
+                    case EVENT_TYPE_NETWORK_PROTOCOL_RECONNECT: {
+                        if (t_network == NULL) {
+                            break;
+                        }
+                        reconnect_deadline = timestamp_get_ms64() + RECONNECT_WINDOW_MS;
+                        MetaGui::log("#I server is restarting, reconnecting once it is back\n");
+                    } break;
+                    case EVENT_TYPE_NETWORK_PROTOCOL_NOK: {
+                        // server rejected something we sent, e.g. an illegal move, it resyncs the game right after
+                        MetaGui::log("#W server rejected the last action\n");
+                    } break;
                     default: {
                         MetaGui::logf("#W guithread: received unexpected event, type: %d\n", e.base.type);
                     } break;
@@ -552,6 +662,8 @@ namespace Control {
                 event_destroy(&e);
                 event_queue_pop(&inbox, &e, 0);
             }
+            // rebuilt plugins are swapped in here, just one failing read per frame if nothing changed
+            plugin_mgr.poll_plugins();
 
             // work through interface events: clicks, key presses, gui commands structs for updating interface elems
             SDL_Event event; //TODO need to free this later somewhere?
@@ -746,6 +858,22 @@ namespace Control {
                 if (MetaGui::show_lobby_window) {
                     MetaGui::lobby_window(&MetaGui::show_lobby_window);
                 }
+                if (!MetaGui::show_lobby_window && seeks_subscribed) {
+                    // nobody is looking at the seeks anymore, stop the diffs, own seeks still come through
+                    if (network_send_queue) {
+                        event_any es;
+                        event_create_type(&es, EVENT_TYPE_LOBBY_SEEK_UNSUBSCRIBE);
+                        event_queue_push(network_send_queue, &es);
+                    }
+                    seeks_subscribed = false;
+                    for (std::map<uint32_t, open_seek>::iterator it = seeks.begin(); it != seeks.end();) {
+                        if (it->second.own) {
+                            ++it;
+                        } else {
+                            it = seeks.erase(it);
+                        }
+                    }
+                }
             }
 
             //TODO put this in the sdl resize event, make a resize function on the context app
@@ -784,4 +912,73 @@ namespace Control {
         }
     }
 
+    bool Client::start_offline_server()
+    {
+        if (t_network || t_loopback) {
+            return false;
+        }
+        t_loopback = new Network::NetworkLoopback(&t_tc);
+        t_loopback->recv_queue = &inbox;
+        // the server hooks itself up to the loopback, so its adapter load is already queued when the loopback opens
+        offline_server = new Server(t_loopback);
+        Server* server = offline_server;
+        offline_runner = thread_runtime.spawn("server", [server]() { server->loop(); });
+        if (!t_loopback->open()) {
+            stop_offline_server();
+            return false;
+        }
+        MetaGui::log("#I offline server started\n");
+        return true;
+    }
+
+    void Client::stop_offline_server()
+    {
+        if (offline_server == NULL) {
+            return;
+        }
+        // disconnect first so the server still sees the client leave, then stop the server before the loopback goes away
+        t_loopback->close();
+        event_any es;
+        event_create_type(&es, EVENT_TYPE_EXIT);
+        event_queue_push(&offline_server->inbox, &es);
+        offline_runner.join();
+        delete offline_server;
+        offline_server = NULL;
+        delete t_loopback;
+        t_loopback = NULL;
+        MetaGui::log("#I offline server stopped\n");
+    }
+
+    void Client::try_reconnect()
+    {
+        uint64_t now = timestamp_get_ms64();
+        if (now >= reconnect_deadline) {
+            MetaGui::log("#W server did not come back, giving up on reconnecting\n");
+            reconnect_deadline = 0;
+            MetaGui::chat_clear();
+            MetaGui::connection_info_reset();
+            return;
+        }
+        reconnect_next_try = now + RECONNECT_RETRY_MS;
+        Network::NetworkClient* net_client = new Network::NetworkClient(&t_tc);
+        net_client->recv_queue = &inbox;
+        if (!net_client->open(MetaGui::conn_info.server_address, MetaGui::conn_info.server_port)) {
+            delete net_client;
+            return;
+        }
+        t_network = net_client;
+        MetaGui::log("#I reconnecting\n");
+    }
+
+    event_queue* Client::adapter_send_queue()
+    {
+        if (t_network) {
+            return &t_network->send_queue;
+        }
+        if (t_loopback) {
+            return &t_loopback->send_queue;
+        }
+        return NULL;
+    }
+
 } // namespace Control
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <map>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
@@ -15,9 +18,12 @@
 #include "control/timeout_crash.hpp"
 #include "engines/engine_manager.hpp"
 #include "network/network_client.hpp"
+#include "network/network_loopback.hpp"
 
 namespace Control {
 
+    class Server;
+
     extern const semver client_version;
 
     class Client {
@@ -29,7 +35,16 @@ namespace Control {
 
         Network::NetworkClient* t_network = NULL;
         event_queue* network_send_queue = NULL;
-        // offline server likely somewhere here
+        // offline server runs on its own thread and is connected through the loopback instead of t_network
+        Network::NetworkLoopback* t_loopback = NULL;
+        Server* offline_server = NULL;
+        std::thread offline_runner;
+        // set once the server announced a restart, losing the connection then retries the same address until the deadline instead of resetting
+        static const uint64_t RECONNECT_WINDOW_MS = 30000;
+        static const uint64_t RECONNECT_RETRY_MS = 500;
+        uint64_t reconnect_deadline = 0;
+        uint64_t reconnect_next_try = 0;
+        bool reconnect_as_guest = true; // how the last login was made, it is repeated after reconnecting
 
         SDL_Window* sdl_window;
         SDL_GLContext sdl_glcontext;
@@ -39,15 +54,43 @@ namespace Control {
         event_queue inbox;
 
         game* the_game = NULL;
+        BaseGameVariantImpl the_game_impl = BaseGameVariantImpl((const game_methods*)NULL); // created the_game, holding it keeps its plugin open
         uint32_t game_sync = 1; //TODO use and use in server
         uint64_t game_step = 1;
-        //TODO game_timectl
+        // time control and clocks as announced by the server, the server is authoritative, these are only for display
+        struct game_clock {
+            bool running;
+            bool flagged;
+            uint32_t remaining_ms;
+            uint32_t delay_ms; // delay left before remaining starts to run down
+            uint64_t received_ms; // local monotonic time of arrival, the running clock is interpolated from here
+        };
+        uint32_t timectl_initial_ms = 0; // 0 is untimed
+        uint32_t timectl_increment_ms = 0;
+        uint32_t timectl_delay_ms = 0;
+        std::vector<game_clock> clocks; // index is player-1
+
+        // open seeks on the server, kept up to date by its diffs while subscribed (own seeks always)
+        struct open_seek {
+            bool own;
+            std::string base_name;
+            std::string variant_name;
+            std::string impl_name;
+            std::string options;
+            uint32_t initial_ms;
+            uint32_t increment_ms;
+            uint32_t delay_ms;
+        };
+        std::map<uint32_t, open_seek> seeks; // seek_id -> seek, ids are handed out in order so this is oldest first
+        bool seeks_subscribed = false;
         //TODO game_history
 
         PluginManager plugin_mgr;
 
         frontend_display_data dd;
         frontend* the_frontend;
+        FrontendImpl the_frontend_impl = FrontendImpl((const frontend_methods*)NULL); // same for the_frontend, unused for the empty one
+        FrontendImpl loading_frontend_impl = FrontendImpl((const frontend_methods*)NULL); // set by whoever sends a frontend load, becomes the_frontend_impl with it
         frontend* empty_fe;
         Engines::EngineManager* engine_mgr;
 
@@ -56,6 +99,12 @@ namespace Control {
         Client();
         ~Client();
         void loop();
+
+        bool start_offline_server();
+        void stop_offline_server();
+        void try_reconnect();
+        // send queue of whichever adapter is loaded, also usable before the connection is finalized
+        event_queue* adapter_send_queue();
     };
 
     extern Client* main_client;
@@ -57,6 +57,21 @@ const serialization_layout sl_game_move[] = {
     {SL_TYPE_STOP},
 };
 
+const serialization_layout sl_game_timectl[] = {
+    {SL_TYPE_U32, offsetof(event_game_timectl, initial_ms)},
+    {SL_TYPE_U32, offsetof(event_game_timectl, increment_ms)},
+    {SL_TYPE_U32, offsetof(event_game_timectl, delay_ms)},
+    {SL_TYPE_STOP},
+};
+
+const serialization_layout sl_game_clock[] = {
+    {SL_TYPE_U8, offsetof(event_game_clock, player)},
+    {SL_TYPE_BOOL, offsetof(event_game_clock, running)},
+    {SL_TYPE_U32, offsetof(event_game_clock, remaining_ms)},
+    {SL_TYPE_U32, offsetof(event_game_clock, delay_ms)},
+    {SL_TYPE_STOP},
+};
+
 //BUG currently this just leaks memory
 const serialization_layout sl_ssl_thumbprint[] = {
     // {SL_TYPE_SIZE, offsetof(event_ssl_thumbprint, thumbprint_len)},
@@ -64,6 +79,49 @@ const serialization_layout sl_ssl_thumbprint[] = {
     {SL_TYPE_STOP},
 };
 
+size_t sl_eventserializedptr_serializer(GSIT itype, void* obj_in, void* obj_out, void* buf, void* buf_end)
+{
+    event_serialized** es_in = (event_serialized**)obj_in;
+    event_serialized** es_out = (event_serialized**)obj_out;
+    switch (itype) {
+        case GSIT_NONE: {
+            assert(0);
+        } break;
+        case GSIT_INITZERO: {
+            *es_in = NULL;
+        } break;
+        case GSIT_SIZE: {
+            return *es_in ? (*es_in)->size : 0;
+        } break;
+        case GSIT_SERIALIZE:
+        case GSIT_DESERIALIZE: {
+            // internal only, the buffer itself is what goes over the wire
+            return LS_ERR;
+        } break;
+        case GSIT_COPY: {
+            *es_out = *es_in;
+            if (*es_out) {
+                event_serialized_ref(*es_out);
+            }
+        } break;
+        case GSIT_DESTROY: {
+            if (*es_in) {
+                event_serialized_unref(*es_in);
+            }
+        } break;
+        case GSIT_COUNT:
+        case GSIT_SIZE_MAX: {
+            assert(0);
+        } break;
+    }
+    return 0;
+}
+
+const serialization_layout sl_send_serialized[] = {
+    {SL_TYPE_CUSTOM, offsetof(event_send_serialized, buf), .ext.serializer = sl_eventserializedptr_serializer},
+    {SL_TYPE_STOP},
+};
+
 const serialization_layout sl_auth[] = {
     {SL_TYPE_BOOL, offsetof(event_auth, is_guest)},
     {SL_TYPE_STRING, offsetof(event_auth, username)},
@@ -76,6 +134,12 @@ const serialization_layout sl_auth_fail[] = {
     {SL_TYPE_STOP},
 };
 
+const serialization_layout sl_lobby_join[] = {
+    {SL_TYPE_BOOL, offsetof(event_lobby_join, spectate)},
+    {SL_TYPE_U8, offsetof(event_lobby_join, seat)},
+    {SL_TYPE_STOP},
+};
+
 const serialization_layout sl_chat_msg[] = {
     {SL_TYPE_U32, offsetof(event_chat_msg, msg_id)},
     {SL_TYPE_U32, offsetof(event_chat_msg, author_client_id)},
@@ -89,6 +153,19 @@ const serialization_layout sl_chat_del[] = {
     {SL_TYPE_STOP},
 };
 
+const serialization_layout sl_seek[] = {
+    {SL_TYPE_U32, offsetof(event_seek, seek_id)},
+    {SL_TYPE_U32, offsetof(event_seek, owner_client_id)},
+    {SL_TYPE_STRING, offsetof(event_seek, base_name)},
+    {SL_TYPE_STRING, offsetof(event_seek, variant_name)},
+    {SL_TYPE_STRING, offsetof(event_seek, impl_name)},
+    {SL_TYPE_STRING, offsetof(event_seek, options)},
+    {SL_TYPE_U32, offsetof(event_seek, initial_ms)},
+    {SL_TYPE_U32, offsetof(event_seek, increment_ms)},
+    {SL_TYPE_U32, offsetof(event_seek, delay_ms)},
+    {SL_TYPE_STOP},
+};
+
 size_t sl_cjovacptr_serializer(GSIT itype, void* obj_in, void* obj_out, void* buf, void* buf_end)
 {
     cj_ovac** ovac_in = (cj_ovac**)obj_in;
@@ -150,11 +227,15 @@ const serialization_layout* event_serialization_layouts[EVENT_TYPE_COUNT] = {
     [EVENT_TYPE_GAME_UNLOAD] = sl_baseonly,
     [EVENT_TYPE_GAME_STATE] = sl_game_state,
     [EVENT_TYPE_GAME_MOVE] = sl_game_move,
+    [EVENT_TYPE_GAME_TIMECTL] = sl_game_timectl,
+    [EVENT_TYPE_GAME_CLOCK] = sl_game_clock,
+    [EVENT_TYPE_GAME_FLAG] = sl_game_clock,
 
     [EVENT_TYPE_FRONTEND_LOAD] = sl_baseonly,
     [EVENT_TYPE_FRONTEND_UNLOAD] = sl_baseonly,
 
     [EVENT_TYPE_NETWORK_INTERNAL_SSL_WRITE] = sl_baseonly,
+    [EVENT_TYPE_NETWORK_INTERNAL_SEND_SERIALIZED] = sl_send_serialized,
 
     [EVENT_TYPE_NETWORK_ADAPTER_LOAD] = sl_baseonly,
     [EVENT_TYPE_NETWORK_ADAPTER_UNLOAD] = sl_baseonly,
@@ -171,13 +252,24 @@ const serialization_layout* event_serialization_layouts[EVENT_TYPE_COUNT] = {
     [EVENT_TYPE_NETWORK_PROTOCOL_PING] = sl_baseonly,
     [EVENT_TYPE_NETWORK_PROTOCOL_PONG] = sl_baseonly,
     [EVENT_TYPE_NETWORK_PROTOCOL_CLIENT_ID_SET] = sl_baseonly,
+    [EVENT_TYPE_NETWORK_PROTOCOL_RECONNECT] = sl_baseonly,
 
     [EVENT_TYPE_USER_AUTHINFO] = sl_auth,
     [EVENT_TYPE_USER_AUTHN] = sl_auth,
+    [EVENT_TYPE_USER_REGISTER] = sl_auth,
     [EVENT_TYPE_USER_AUTHFAIL] = sl_auth_fail,
+    [EVENT_TYPE_USER_INTERNAL_AUTHN] = sl_auth,
+    [EVENT_TYPE_USER_INTERNAL_AUTHFAIL] = sl_auth_fail,
 
+    [EVENT_TYPE_LOBBY_JOIN] = sl_lobby_join,
+    [EVENT_TYPE_LOBBY_LEAVE] = sl_baseonly,
+    [EVENT_TYPE_LOBBY_CLOSE] = sl_baseonly,
     [EVENT_TYPE_LOBBY_CHAT_MSG] = sl_chat_msg,
     [EVENT_TYPE_LOBBY_CHAT_DEL] = sl_chat_del,
+    [EVENT_TYPE_LOBBY_SEEK_ADD] = sl_seek,
+    [EVENT_TYPE_LOBBY_SEEK_REMOVE] = sl_seek,
+    [EVENT_TYPE_LOBBY_SEEK_SUBSCRIBE] = sl_baseonly,
+    [EVENT_TYPE_LOBBY_SEEK_UNSUBSCRIBE] = sl_baseonly,
 
     [EVENT_TYPE_DYNAMIC] = sl_dynamic,
 };
@@ -330,6 +422,23 @@ void event_create_game_move(event_any* e, uint32_t sync, player_id player, move_
     e->game_move.code = code;
 }
 
+void event_create_game_timectl(event_any* e, uint32_t initial_ms, uint32_t increment_ms, uint32_t delay_ms)
+{
+    event_create_type(e, EVENT_TYPE_GAME_TIMECTL);
+    e->game_timectl.initial_ms = initial_ms;
+    e->game_timectl.increment_ms = increment_ms;
+    e->game_timectl.delay_ms = delay_ms;
+}
+
+void event_create_game_clock(event_any* e, EVENT_TYPE type, player_id player, bool running, uint32_t remaining_ms, uint32_t delay_ms)
+{
+    event_create_type(e, type);
+    e->game_clock.player = player;
+    e->game_clock.running = running;
+    e->game_clock.remaining_ms = remaining_ms;
+    e->game_clock.delay_ms = delay_ms;
+}
+
 void event_create_frontend_load(event_any* e, void* frontend)
 {
     event_create_type(e, EVENT_TYPE_FRONTEND_LOAD);
@@ -343,6 +452,47 @@ void event_create_ssl_thumbprint(event_any* e, EVENT_TYPE type)
     e->ssl_thumbprint.thumbprint = NULL;
 }
 
+event_serialized* event_serialized_create(event_any* e)
+{
+    size_t size = event_size(e);
+    // single allocation, data follows the header
+    event_serialized* s = (event_serialized*)malloc(sizeof(event_serialized) + size);
+    s->refcount = 1;
+    s->size = size;
+    s->data = s + 1;
+    event_serialize(e, s->data);
+    return s;
+}
+
+event_serialized* event_serialized_create_raw(const void* data, size_t size)
+{
+    event_serialized* s = (event_serialized*)malloc(sizeof(event_serialized) + size);
+    s->refcount = 1;
+    s->size = size;
+    s->data = s + 1;
+    memcpy(s->data, data, size);
+    return s;
+}
+
+void event_serialized_ref(event_serialized* s)
+{
+    __atomic_add_fetch(&s->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void event_serialized_unref(event_serialized* s)
+{
+    if (__atomic_sub_fetch(&s->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(s);
+    }
+}
+
+void event_create_send_serialized(event_any* e, uint32_t client_id, event_serialized* buf)
+{
+    event_create_type_client(e, EVENT_TYPE_NETWORK_INTERNAL_SEND_SERIALIZED, client_id);
+    e->send_serialized.buf = buf;
+    event_serialized_ref(buf);
+}
+
 void event_create_auth(event_any* e, EVENT_TYPE type, uint32_t client_id, bool is_guest, const char* username, const char* password)
 {
     event_create_type_client(e, type, client_id);
@@ -357,6 +507,14 @@ void event_create_auth_fail(event_any* e, uint32_t client_id, const char* reason
     e->auth_fail.reason = reason ? strdup(reason) : NULL;
 }
 
+void event_create_lobby_join(event_any* e, uint32_t client_id, uint32_t lobby_id, bool spectate)
+{
+    event_create_type_client(e, EVENT_TYPE_LOBBY_JOIN, client_id);
+    e->base.lobby_id = lobby_id;
+    e->lobby_join.spectate = spectate;
+    e->lobby_join.seat = 0;
+}
+
 void event_create_chat_msg(event_any* e, uint32_t msg_id, uint32_t author_client_id, uint64_t timestamp, const char* text)
 {
     event_create_type(e, EVENT_TYPE_LOBBY_CHAT_MSG);
@@ -371,3 +529,17 @@ void event_create_chat_del(event_any* e, uint32_t msg_id)
     event_create_type(e, EVENT_TYPE_LOBBY_CHAT_DEL);
     e->chat_del.msg_id = msg_id;
 }
+
+void event_create_seek(event_any* e, EVENT_TYPE type, uint32_t seek_id, uint32_t owner_client_id, const char* base_name, const char* variant_name, const char* impl_name, const char* options, uint32_t initial_ms, uint32_t increment_ms, uint32_t delay_ms)
+{
+    event_create_type(e, type);
+    e->seek.seek_id = seek_id;
+    e->seek.owner_client_id = owner_client_id;
+    e->seek.base_name = base_name ? strdup(base_name) : NULL;
+    e->seek.variant_name = variant_name ? strdup(variant_name) : NULL;
+    e->seek.impl_name = impl_name ? strdup(impl_name) : NULL;
+    e->seek.options = options ? strdup(options) : NULL;
+    e->seek.initial_ms = initial_ms;
+    e->seek.increment_ms = increment_ms;
+    e->seek.delay_ms = delay_ms;
+}
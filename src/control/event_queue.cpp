@@ -1,3 +1,4 @@
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <cstdint>
@@ -18,6 +19,9 @@ struct event_queue_impl {
     std::mutex m;
     std::deque<event_any> q;
     std::condition_variable cv;
+    std::atomic<uint32_t> size; // mirrors q.size(), so it can be read without the lock
+    event_queue_history_entry history[EVENT_QUEUE_HISTORY_SIZE]; // ring, written under the lock by pop
+    std::atomic<uint32_t> history_count; // total popped, the newest entry is at (history_count - 1) % EVENT_QUEUE_HISTORY_SIZE
 };
 
 static_assert(sizeof(event_queue) >= sizeof(event_queue_impl), "event_queue impl size missmatch");
@@ -26,6 +30,8 @@ void event_queue_create(event_queue* eq)
 {
     event_queue_impl* eqi = (event_queue_impl*)eq;
     new (eqi) event_queue_impl();
+    eqi->size.store(0, std::memory_order_relaxed);
+    eqi->history_count.store(0, std::memory_order_relaxed);
 }
 
 void event_queue_destroy(event_queue* eq)
@@ -39,6 +45,7 @@ void event_queue_push(event_queue* eq, event_any* e)
     event_queue_impl* eqi = (event_queue_impl*)eq;
     eqi->m.lock();
     eqi->q.emplace_back(*e);
+    eqi->size.fetch_add(1, std::memory_order_relaxed);
     eqi->cv.notify_all();
     eqi->m.unlock();
     e->base.type = EVENT_TYPE_NULL;
@@ -61,6 +68,31 @@ void event_queue_pop(event_queue* eq, event_any* e, uint32_t t)
     }
     *e = eqi->q.front();
     eqi->q.pop_front();
+    eqi->size.fetch_sub(1, std::memory_order_relaxed);
+    uint32_t history_idx = eqi->history_count.load(std::memory_order_relaxed);
+    event_queue_history_entry& entry = eqi->history[history_idx % EVENT_QUEUE_HISTORY_SIZE];
+    entry.time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    entry.type = e->base.type;
+    entry.client_id = e->base.client_id;
+    entry.lobby_id = e->base.lobby_id;
+    eqi->history_count.store(history_idx + 1, std::memory_order_release);
+}
+
+uint32_t event_queue_size(event_queue* eq)
+{
+    event_queue_impl* eqi = (event_queue_impl*)eq;
+    return eqi->size.load(std::memory_order_relaxed);
+}
+
+uint32_t event_queue_history(event_queue* eq, event_queue_history_entry* out)
+{
+    event_queue_impl* eqi = (event_queue_impl*)eq;
+    uint32_t history_count = eqi->history_count.load(std::memory_order_acquire);
+    uint32_t cnt = (history_count < EVENT_QUEUE_HISTORY_SIZE ? history_count : EVENT_QUEUE_HISTORY_SIZE);
+    for (uint32_t i = 0; i < cnt; i++) {
+        out[i] = eqi->history[(history_count - cnt + i) % EVENT_QUEUE_HISTORY_SIZE];
+    }
+    return cnt;
 }
 
 #ifdef __cplusplus
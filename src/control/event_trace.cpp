@@ -0,0 +1,147 @@
+#include <chrono>
+#include <cstdbool>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "mirabel/event.h"
+
+#include "control/event_trace.hpp"
+
+namespace Control {
+
+    static uint64_t wall_us()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    EventTrace::EventTrace()
+    {}
+
+    EventTrace::~EventTrace()
+    {
+        close();
+    }
+
+    bool EventTrace::open_write(const char* path)
+    {
+        close();
+        f = fopen(path, "ab");
+        if (f == NULL) {
+            printf("[ERROR] trace failed to open %s\n", path);
+            return false;
+        }
+        chmod(path, 0600); // contains chat and usernames
+        writing = true;
+        last_flush_us = wall_us();
+        fseek(f, 0, SEEK_END);
+        if (ftell(f) == 0) {
+            uint64_t magic = TRACE_MAGIC;
+            fwrite(&magic, sizeof(magic), 1, f);
+        }
+        return true;
+    }
+
+    bool EventTrace::open_read(const char* path)
+    {
+        close();
+        f = fopen(path, "rb");
+        if (f == NULL) {
+            printf("[ERROR] trace failed to open %s\n", path);
+            return false;
+        }
+        writing = false;
+        uint64_t magic;
+        if (fread(&magic, sizeof(magic), 1, f) != 1 || magic != TRACE_MAGIC) {
+            printf("[ERROR] not a trace: %s\n", path);
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void EventTrace::close()
+    {
+        if (f == NULL) {
+            return;
+        }
+        fclose(f);
+        f = NULL;
+    }
+
+    bool EventTrace::is_open()
+    {
+        return f != NULL;
+    }
+
+    void EventTrace::record(event_any* e)
+    {
+        if (f == NULL || !writing) {
+            return;
+        }
+        switch (e->base.type) {
+            case EVENT_TYPE_HEARTBEAT:
+            case EVENT_TYPE_HEARTBEAT_PREQUIT:
+            case EVENT_TYPE_HEARTBEAT_RESET: {
+                return;
+            } break;
+            default: {
+            } break;
+        }
+        event_any redacted;
+        event_any* re = e;
+        if ((e->base.type == EVENT_TYPE_USER_AUTHN || e->base.type == EVENT_TYPE_USER_REGISTER) && e->auth.password != NULL) {
+            event_copy(&redacted, e);
+            free(redacted.auth.password);
+            redacted.auth.password = NULL;
+            re = &redacted;
+        }
+        uint64_t now = wall_us();
+        buf.resize(sizeof(now) + event_size(re));
+        memcpy(buf.data(), &now, sizeof(now));
+        event_serialize(re, buf.data() + sizeof(now));
+        fwrite(buf.data(), buf.size(), 1, f);
+        if (re == &redacted) {
+            event_destroy(&redacted);
+        }
+        // buffered, a crash loses at most the last interval
+        if (now - last_flush_us >= FLUSH_INTERVAL_US) {
+            fflush(f);
+            last_flush_us = now;
+        }
+    }
+
+    bool EventTrace::read(event_any* e, uint64_t* time_us)
+    {
+        if (f == NULL || writing) {
+            return false;
+        }
+        uint64_t head[2]; // time and event size, the size is part of the serialized event
+        if (fread(head, sizeof(head), 1, f) != 1) {
+            return false;
+        }
+        size_t record_size = event_read_size(&head[1]);
+        if (record_size <= sizeof(size_t)) {
+            printf("[WARN] trace has a corrupt record\n");
+            return false;
+        }
+        buf.resize(record_size);
+        memcpy(buf.data(), &head[1], sizeof(size_t));
+        if (fread(buf.data() + sizeof(size_t), record_size - sizeof(size_t), 1, f) != 1) {
+            printf("[WARN] trace has a torn record\n");
+            return false;
+        }
+        event_deserialize(e, buf.data(), buf.data() + record_size);
+        if (e->base.type == EVENT_TYPE_NULL) {
+            printf("[WARN] trace has an unreadable record\n");
+            return false;
+        }
+        *time_us = head[0];
+        return true;
+    }
+
+} // namespace Control
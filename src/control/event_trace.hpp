@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdbool>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "mirabel/event.h"
+
+namespace Control {
+
+    // binary trace of the events handled by a server loop, for reproducing and benchmarking against real traffic
+    // after a header every record is the wall clock time in us followed by the serialized event, size prefixed as on the wire
+    // recording appends to an existing trace, so a restarted server keeps writing to the same file
+    class EventTrace {
+      private:
+
+        static const uint64_t TRACE_MAGIC = 0x31454352544C424DULL; // "MBLTRCE1"
+        static const uint64_t FLUSH_INTERVAL_US = 1000000;
+
+        FILE* f = NULL;
+        bool writing;
+        uint64_t last_flush_us;
+        std::vector<uint8_t> buf; // reused for every record
+
+      public:
+
+        EventTrace();
+        ~EventTrace();
+
+        // returns false on failure, a trace is only ever opened for either writing or reading
+        bool open_write(const char* path);
+        bool open_read(const char* path);
+        void close();
+        bool is_open();
+
+        // heartbeats are skipped, they only mean something to the watchdog of the recording process
+        // passwords are never written, authn events are recorded without them
+        void record(event_any* e);
+        // returns false once the end (or a torn trailing record) is reached
+        bool read(event_any* e, uint64_t* time_us);
+    };
+
+} // namespace Control
@@ -1,76 +1,105 @@
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <memory>
+#include <unordered_set>
+#include <vector>
 
 #include <SDL2/SDL.h>
 
+#include "rosalia/rand.h"
 #include "surena/game.h"
 
 #include "mirabel/event_queue.h"
 #include "mirabel/event.h"
+#include "control/lobby_journal.hpp"
 #include "control/plugins.hpp"
+#include "control/timer_wheel.hpp"
 #include "games/game_catalogue.hpp"
 
 #include "control/lobby.hpp"
 
 namespace Control {
 
-    Lobby::Lobby(PluginManager* plugin_mgr, event_queue* send_queue, uint16_t max_users):
+    bool LegalMoveSet::contains(player_id player, move_code code) const
+    {
+        std::unordered_map<player_id, std::unordered_set<move_code>>::const_iterator player_moves = moves.find(player);
+        if (player_moves == moves.end()) {
+            return false;
+        }
+        return player_moves->second.count(code) > 0;
+    }
+
+    Lobby::Lobby(PluginManager* plugin_mgr, event_queue* send_queue, uint32_t id, uint16_t max_users):
         plugin_mgr(plugin_mgr),
         send_queue(send_queue),
+        id(id),
         the_game(NULL),
+        loaded_impl((const game_methods*)NULL),
         game_base(NULL),
         game_variant(NULL),
         game_impl(NULL),
+        game_options(NULL),
         max_users(max_users),
-        user_client_ids(static_cast<uint32_t*>(malloc(max_users * sizeof(uint32_t))))
+        user_client_ids(static_cast<uint32_t*>(malloc(max_users * sizeof(uint32_t)))),
+        stats(std::make_shared<lobby_stats>(id))
     {
         for (uint32_t i = 0; i < max_users; i++) {
             user_client_ids[i] = EVENT_CLIENT_NONE;
         }
+        clock_timer.data = this;
+        fprng_srand(&random_rng, std::chrono::steady_clock::now().time_since_epoch().count() ^ id);
     }
 
     Lobby::~Lobby()
     {
+        if (timers) {
+            timers->cancel(&clock_timer);
+        }
+        if (join_snapshot) {
+            event_serialized_unref(join_snapshot);
+        }
+        if (join_tail_buf) {
+            event_serialized_unref(join_tail_buf);
+        }
+        for (uint32_t i = 0; i < CHAT_HISTORY_SIZE; i++) {
+            if (chat_history[i]) {
+                event_serialized_unref(chat_history[i]);
+            }
+        }
+        if (chat_history_buf) {
+            event_serialized_unref(chat_history_buf);
+        }
         free(user_client_ids);
         free(game_impl);
         free(game_variant);
         free(game_base);
-        delete the_game;
+        // before loaded_impl goes, the plugin may be closed with it
+        if (the_game) {
+            the_game->methods->destroy(the_game);
+            free(the_game);
+        }
     }
 
-    void Lobby::AddUser(uint32_t client_id)
+    void Lobby::AddUser(uint32_t client_id, uint8_t seat)
     {
-        for (uint32_t i = 0; i < max_users; i++) {
+        for (uint32_t t = 0; t < max_users; t++) {
+            // try the preferred slot first, then the rest in order
+            uint32_t i = (seat > 0 && seat <= max_users ? (seat - 1 + t) % max_users : t);
             if (user_client_ids[i] == EVENT_CLIENT_NONE) {
                 user_client_ids[i] = client_id;
+                user_cnt++;
+                stats->users.fetch_add(1, std::memory_order_relaxed);
+                SendJoinSync(client_id);
+                SendChatHistory(client_id);
                 event_any es;
-                if (the_game) {
-                    // send sync info to user, load + state import
-                    es.base.client_id = client_id;
-                    event_queue_push(send_queue, &es);
-                    size_t game_state_buffer_len = the_game->sizer.state_str;
-                    char* game_state_buffer = (char*)malloc(game_state_buffer_len);
-                    the_game->methods->export_state(the_game, &game_state_buffer_len, game_state_buffer);
-                    game_init init_info = (game_init){
-                        .source_type = GAME_INIT_SOURCE_TYPE_STANDARD,
-                        .source = {
-                            .standard{
-                                .opts = game_options,
-                                .legacy = NULL,
-                                .state = game_state_buffer,
-                            },
-                        },
-                    };
-                    event_create_game_load(&es, game_base, game_variant, game_impl, init_info);
-                } else {
-                    event_create_type_client(&es, EVENT_TYPE_GAME_UNLOAD, client_id);
-                    event_queue_push(send_queue, &es);
-                }
                 char* msg_buf = (char*)malloc(32);
                 sprintf(msg_buf, "client joined: %d\n", client_id);
                 event_create_chat_msg(&es, lobby_msg_id_ctr++, EVENT_CLIENT_SERVER, SDL_GetTicks64(), msg_buf);
-                SendToAllButOne(es, EVENT_CLIENT_NONE);
+                SendChat(es);
+                event_destroy(&es);
                 free(msg_buf);
                 return;
             }
@@ -78,16 +107,44 @@ namespace Control {
         printf("[ERROR] could not add user to lobby\n");
     }
 
+    void Lobby::AddSpectator(uint32_t client_id)
+    {
+        if (spectator_idx.find(client_id) != spectator_idx.end()) {
+            return;
+        }
+        // existing spectators must get their pending events before the new one gets a snapshot that already contains them
+        FlushSpectatorBatch();
+        spectator_idx[client_id] = spectator_client_ids.size();
+        spectator_client_ids.push_back(client_id);
+        stats->spectators.fetch_add(1, std::memory_order_relaxed);
+        SendJoinSync(client_id);
+        SendChatHistory(client_id);
+    }
+
     void Lobby::RemoveUser(uint32_t client_id)
     {
+        std::unordered_map<uint32_t, uint32_t>::iterator si = spectator_idx.find(client_id);
+        if (si != spectator_idx.end()) {
+            // swap remove to keep the spectator list compact
+            uint32_t last_client_id = spectator_client_ids.back();
+            spectator_client_ids[si->second] = last_client_id;
+            spectator_idx[last_client_id] = si->second;
+            spectator_client_ids.pop_back();
+            spectator_idx.erase(client_id);
+            stats->spectators.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
         for (uint32_t i = 0; i < max_users; i++) {
             if (user_client_ids[i] == client_id) {
                 user_client_ids[i] = EVENT_CLIENT_NONE;
+                user_cnt--;
+                stats->users.fetch_sub(1, std::memory_order_relaxed);
                 char* msg_buf = (char*)malloc(32);
                 sprintf(msg_buf, "client left: %d\n", client_id);
                 event_any es;
                 event_create_chat_msg(&es, lobby_msg_id_ctr++, EVENT_CLIENT_SERVER, SDL_GetTicks64(), msg_buf);
-                SendToAllButOne(es, EVENT_CLIENT_NONE);
+                SendChat(es);
+                event_destroy(&es);
                 free(msg_buf);
                 return;
             }
@@ -95,8 +152,152 @@ namespace Control {
         printf("[ERROR] could not find user to remove from lobby\n");
     }
 
+    void Lobby::Close()
+    {
+        event_any es;
+        char* msg_buf = (char*)malloc(32);
+        sprintf(msg_buf, "lobby #%u closed\n", id);
+        event_create_chat_msg(&es, lobby_msg_id_ctr++, EVENT_CLIENT_SERVER, SDL_GetTicks64(), msg_buf);
+        SendToAllButOne(es, EVENT_CLIENT_NONE);
+        event_destroy(&es);
+        free(msg_buf);
+        // members are left without a game, the lobby is gone from the manager already so they can only join another one
+        event_create_type(&es, EVENT_TYPE_GAME_UNLOAD);
+        SendToAllButOne(es, EVENT_CLIENT_NONE);
+        event_destroy(&es);
+        FlushSpectatorBatch();
+    }
+
+    event_serialized* Lobby::GetJoinSnapshot()
+    {
+        if (join_snapshot && join_snapshot_step == game_step) {
+            return join_snapshot;
+        }
+        if (join_snapshot) {
+            event_serialized_unref(join_snapshot);
+        }
+        // new snapshot contains every move so far
+        join_tail.clear();
+        join_tail_moves = 0;
+        event_any es;
+        if (the_game) {
+            size_t game_state_buffer_len = the_game->sizer.state_str;
+            char* game_state_buffer = (char*)malloc(game_state_buffer_len);
+            the_game->methods->export_state(the_game, &game_state_buffer_len, game_state_buffer);
+            game_init init_info = (game_init){
+                .source_type = GAME_INIT_SOURCE_TYPE_STANDARD,
+                .source = {
+                    .standard{
+                        .opts = game_options,
+                        .legacy = NULL,
+                        .state = game_state_buffer,
+                    },
+                },
+            };
+            event_create_game_load(&es, game_base, game_variant, game_impl, init_info);
+            free(game_state_buffer);
+        } else {
+            event_create_type(&es, EVENT_TYPE_GAME_UNLOAD);
+        }
+        es.base.client_id = EVENT_CLIENT_SERVER;
+        es.base.lobby_id = id;
+        join_snapshot = event_serialized_create(&es);
+        join_snapshot_step = game_step;
+        event_destroy(&es);
+        return join_snapshot;
+    }
+
+    void Lobby::SendJoinSync(uint32_t client_id)
+    {
+        // send sync info to user, load + state import or unload if there is no game, then all moves since
+        event_any es;
+        event_create_send_serialized(&es, client_id, GetJoinSnapshot());
+        event_queue_push(send_queue, &es);
+        if (timectl_initial_ms > 0) {
+            event_create_game_timectl(&es, timectl_initial_ms, timectl_increment_ms, timectl_delay_ms);
+            es.base.client_id = client_id;
+            es.base.lobby_id = id;
+            event_queue_push(send_queue, &es);
+        }
+        SendClocks(client_id);
+        if (join_tail_moves == 0) {
+            return;
+        }
+        if (join_tail_buf == NULL || join_tail_buf_moves != join_tail_moves) {
+            if (join_tail_buf) {
+                event_serialized_unref(join_tail_buf);
+            }
+            join_tail_buf = event_serialized_create_raw(join_tail.data(), join_tail.size());
+            join_tail_buf_moves = join_tail_moves;
+        }
+        event_create_send_serialized(&es, client_id, join_tail_buf);
+        event_queue_push(send_queue, &es);
+    }
+
     void Lobby::HandleEvent(event_any e)
     {
+        uint64_t now_ms = SDL_GetTicks64();
+        switch (e.base.type) {
+            case EVENT_TYPE_GAME_LOAD:
+            case EVENT_TYPE_GAME_UNLOAD:
+            case EVENT_TYPE_GAME_STATE:
+            case EVENT_TYPE_GAME_MOVE:
+            case EVENT_TYPE_GAME_TIMECTL: {
+                if (spectator_idx.find(e.base.client_id) != spectator_idx.end()) {
+                    printf("[WARN] spectator %d attempted to change the game, event type %d dropped\n", e.base.client_id, e.base.type);
+                    return;
+                }
+            } break;
+            default: {
+                // pass
+            } break;
+        }
+        if (e.base.type == EVENT_TYPE_GAME_MOVE && !replaying && clock_flagged) {
+            // flag fell, the game is over on time until it gets reset
+            RejectMove(e);
+            return;
+        }
+        if (e.base.type == EVENT_TYPE_GAME_MOVE && !replaying && !MayMoveFor(e.base.client_id, e.game_move.player)) {
+            printf("[WARN] client %u is not seated as player %u\n", e.base.client_id, e.game_move.player);
+            RejectMove(e);
+            return;
+        }
+        if (e.base.type == EVENT_TYPE_GAME_MOVE && !IsLegalMove(e.game_move.player, e.game_move.code)) {
+            RejectMove(e);
+            return;
+        }
+        if (e.base.type == EVENT_TYPE_GAME_MOVE && !replaying && !ChargeClock(e.game_move.player, now_ms)) {
+            // the move came in after the time ran out, but before the timer fired
+            RejectMove(e);
+            return;
+        }
+        switch (e.base.type) {
+            case EVENT_TYPE_GAME_LOAD:
+            case EVENT_TYPE_GAME_UNLOAD:
+            case EVENT_TYPE_GAME_STATE:
+            case EVENT_TYPE_GAME_MOVE: {
+                position++;
+            } break;
+            default: {
+                // pass
+            } break;
+        }
+        switch (e.base.type) {
+            case EVENT_TYPE_GAME_LOAD:
+            case EVENT_TYPE_GAME_UNLOAD:
+            case EVENT_TYPE_GAME_STATE: {
+                game_step++;
+            } break;
+            case EVENT_TYPE_GAME_MOVE: {
+                // moves are appended to the join tail, only re-snapshot once that gets long
+                if (join_tail_moves >= JOIN_TAIL_MAX_MOVES) {
+                    game_step++;
+                }
+            } break;
+            default: {
+                // pass
+            } break;
+        }
         switch (e.base.type) {
             //TODO code for LOAD+UNLOAD+IMPORT_STATE+MOVE is ripped from client, so comments may not match for now
             case EVENT_TYPE_GAME_LOAD: {
@@ -106,26 +307,29 @@ namespace Control {
                     free(the_game);
                 }
                 the_game = NULL;
-                // find game in games catalogue by provided strings
+                loaded_impl.plugin.reset();
+                // nothing before a load is needed to rebuild the game, so restores do not replay the whole history of the lobby
+                StartJournalSegment();
+                // find game in games catalogue by provided strings, a reloaded plugin serves new games while running ones stay on their version
                 const char* base_name = e.game_load.base_name;
                 const char* variant_name = e.game_load.variant_name;
                 const char* impl_name = e.game_load.impl_name;
-                uint32_t impl_idx = 0;
-                if (!plugin_mgr->get_game_impl_idx(base_name, variant_name, impl_name, NULL, NULL, &impl_idx)) {
+                if (!plugin_mgr->acquire_game_impl(base_name, variant_name, impl_name, &loaded_impl)) {
                     printf("[WARN] failed to find game: %s.%s.%s\n", base_name, variant_name, impl_name);
                     break;
                 }
-                the_game = plugin_mgr->impl_lookup[impl_idx]->new_game(e.game_load.init_info);
+                the_game = loaded_impl.new_game(e.game_load.init_info);
                 if (the_game == NULL) {
                     printf("[WARN] failed to create game: %s.%s.%s\n", base_name, variant_name, impl_name);
                     // as server, need to inform of failed create, unload all clients games
                     event_any s1;
                     event_create_type(&s1, EVENT_TYPE_GAME_UNLOAD);
-                    SendToAllButOne(s1, EVENT_CLIENT_NONE);
+                    JournalAndSend(s1, EVENT_CLIENT_NONE);
                     event_destroy(&s1);
                     break;
                 }
                 // export opts from the loaded game
+                free(game_options);
                 game_options = NULL;
                 if (the_game->methods->features.options) {
                     size_t size_fill;
@@ -133,6 +337,9 @@ namespace Control {
                     the_game->methods->export_options(the_game, &size_fill, game_options);
                 }
                 // update game name strings
+                free(game_base);
+                free(game_variant);
+                free(game_impl);
                 game_base = strdup(base_name);
                 game_variant = strdup(variant_name);
                 game_impl = strdup(impl_name);
@@ -143,7 +350,7 @@ namespace Control {
                     printf("\n");
                 }
                 // pass event to other clients in lobby
-                SendToAllButOne(e, e.base.client_id);
+                JournalAndSend(e, e.base.client_id);
             } break;
             case EVENT_TYPE_GAME_UNLOAD: {
                 if (the_game) {
@@ -151,15 +358,18 @@ namespace Control {
                     free(the_game);
                 }
                 the_game = NULL;
+                loaded_impl.plugin.reset();
                 free(game_base);
                 free(game_variant);
+                free(game_impl);
                 free(game_options);
                 game_base = NULL;
                 game_variant = NULL;
+                game_impl = NULL;
                 game_options = NULL;
                 printf("[INFO] game unloaded\n");
                 // pass event to other clients in lobby
-                SendToAllButOne(e, e.base.client_id);
+                JournalAndSend(e, e.base.client_id);
             } break;
             case EVENT_TYPE_GAME_STATE: {
                 if (!the_game) {
@@ -169,19 +379,31 @@ namespace Control {
                 the_game->methods->import_state(the_game, e.game_state.state);
                 printf("[INFO] game state imported: %s\n", e.game_state.state);
                 // pass event to other clients in lobby
-                SendToAllButOne(e, e.base.client_id);
+                JournalAndSend(e, e.base.client_id);
             } break;
             case EVENT_TYPE_GAME_MOVE: {
                 if (!the_game) {
                     printf("[WARN] attempted move on null game\n");
                     break;
                 }
+                // already validated against the legal move set
+                the_game->methods->make_move(the_game, e.game_move.player, e.game_move.code);
                 player_id pbuf[253];
                 uint8_t pbuf_cnt = 253;
-                the_game->methods->players_to_move(the_game, &pbuf_cnt, pbuf); //FIXME ptm
-                the_game->methods->make_move(the_game, pbuf[0], e.game_move.code);
                 the_game->methods->players_to_move(the_game, &pbuf_cnt, pbuf);
                 printf("[INFO] game move made\n");
+                clock_moves++;
+                if (!replaying && timectl_initial_ms > 0) {
+                    if (pbuf_cnt == 0) {
+                        // game over, the clocks stay where they are
+                        if (timers) {
+                            timers->cancel(&clock_timer);
+                        }
+                        clock_running = PLAYER_NONE;
+                    } else if (clock_running == PLAYER_NONE) {
+                        StartClock(pbuf[0], now_ms);
+                    }
+                }
                 if (pbuf_cnt == 0) {
                     the_game->methods->get_results(the_game, &pbuf_cnt, pbuf);
                     if (pbuf_cnt == 0) {
@@ -189,8 +411,55 @@ namespace Control {
                     }
                     printf("[INFO] game done: winner is player %d\n", pbuf[0]);
                 }
-                // pass event to other clients in lobby
-                SendToAllButOne(e, e.base.client_id);
+                // pass event to other clients in lobby and keep it for joiners if the snapshot is still current
+                event_serialized* buf = SerializeBroadcast(e);
+                if (!replaying && journal.is_open()) {
+                    JournalAppend(buf);
+                }
+                if (join_snapshot && join_snapshot_step == game_step) {
+                    join_tail.insert(join_tail.end(), (uint8_t*)buf->data, (uint8_t*)buf->data + buf->size);
+                    join_tail_moves++;
+                }
+                SendSerialized(buf, e.base.client_id);
+                event_serialized_unref(buf);
+                // clock state goes out right behind every move
+                JournalClocks();
+                SendClocks(EVENT_CLIENT_NONE);
+            } break;
+            case EVENT_TYPE_GAME_TIMECTL: {
+                if (!replaying && the_game != NULL && clock_moves > 0) {
+                    // the clocks of a running game are never changed under the players, the sender gets the one in effect back
+                    printf("[WARN] lobby #%u rejected time control change mid game from client %u\n", id, e.base.client_id);
+                    event_any es;
+                    event_create_game_timectl(&es, timectl_initial_ms, timectl_increment_ms, timectl_delay_ms);
+                    es.base.client_id = e.base.client_id;
+                    es.base.lobby_id = id;
+                    event_queue_push(send_queue, &es);
+                    // keep the clocks running as they are
+                    return;
+                }
+                if (e.game_timectl.initial_ms > TIMECTL_MAX_MS || e.game_timectl.increment_ms > TIMECTL_MAX_MS || e.game_timectl.delay_ms > TIMECTL_MAX_MS) {
+                    printf("[WARN] lobby #%u rejected time control out of range\n", id);
+                    break;
+                }
+                timectl_initial_ms = e.game_timectl.initial_ms;
+                timectl_increment_ms = e.game_timectl.increment_ms;
+                timectl_delay_ms = e.game_timectl.delay_ms;
+                printf("[INFO] lobby #%u time control: %ums + %ums, %ums delay\n", id, timectl_initial_ms, timectl_increment_ms, timectl_delay_ms);
+                // the sender gets it too, as confirmation of what is in effect now
+                JournalAndSend(e, EVENT_CLIENT_NONE);
+            } break;
+            case EVENT_TYPE_GAME_CLOCK:
+            case EVENT_TYPE_GAME_FLAG: {
+                // clocks only ever come from the journal, the live ones are computed here
+                if (!replaying || e.game_clock.player == PLAYER_NONE || e.game_clock.player > clock_remaining_ms.size()) {
+                    printf("[WARN] lobby #%u dropped clock event for player %u\n", id, e.game_clock.player);
+                    break;
+                }
+                clock_remaining_ms[e.game_clock.player - 1] = e.game_clock.remaining_ms;
+                if (e.base.type == EVENT_TYPE_GAME_FLAG) {
+                    clock_flagged = true;
+                }
             } break;
             case EVENT_TYPE_LOBBY_CHAT_MSG: {
                 printf("[INFO] chat message received from %d, broadcasting: %s\n", e.base.client_id, e.chat_msg.text);
@@ -198,28 +467,476 @@ namespace Control {
                 e.chat_msg.author_client_id = e.base.client_id;
                 e.chat_msg.timestamp = SDL_GetTicks64(); //TODO replace by non sdl function and something that is actually useful as a timestamp
                 // send message to everyone
-                SendToAllButOne(e, EVENT_CLIENT_NONE);
+                SendChat(e);
             } break;
             case EVENT_TYPE_LOBBY_CHAT_DEL: {
+                DeleteChat(e.chat_del.msg_id);
                 SendToAllButOne(e, EVENT_CLIENT_NONE);
             } break;
             default: {
                 printf("[WARN] lobby received unexpected event type %d\n", e.base.type);
             } break;
         }
+        switch (e.base.type) {
+            case EVENT_TYPE_GAME_LOAD:
+            case EVENT_TYPE_GAME_UNLOAD:
+            case EVENT_TYPE_GAME_STATE:
+            case EVENT_TYPE_GAME_TIMECTL: {
+                ResetClocks();
+                SendClocks(EVENT_CLIENT_NONE);
+            } break;
+            default: {
+                // pass
+            } break;
+        }
+        switch (e.base.type) {
+            case EVENT_TYPE_GAME_LOAD:
+            case EVENT_TYPE_GAME_UNLOAD:
+            case EVENT_TYPE_GAME_STATE:
+            case EVENT_TYPE_GAME_MOVE: {
+                uint8_t pbuf_cnt = 0;
+                if (the_game) {
+                    player_id pbuf[253];
+                    pbuf_cnt = 253;
+                    the_game->methods->players_to_move(the_game, &pbuf_cnt, pbuf);
+                }
+                stats->game_over.store(pbuf_cnt == 0, std::memory_order_relaxed);
+                if (pbuf_cnt > 0) {
+                    MakeRandomMoves();
+                }
+            } break;
+            default: {
+                // pass
+            } break;
+        }
     }
 
-    void Lobby::SendToAllButOne(event_any e, uint32_t excluded_client_id)
+    void Lobby::ResetClocks()
+    {
+        if (timers) {
+            timers->cancel(&clock_timer);
+        }
+        clock_running = PLAYER_NONE;
+        clock_flagged = false;
+        clock_moves = 0;
+        clock_remaining_ms.assign(the_game && timectl_initial_ms > 0 ? the_game->sizer.player_count : 0, timectl_initial_ms);
+    }
+
+    bool Lobby::ChargeClock(player_id player, uint64_t now_ms)
+    {
+        if (clock_running == PLAYER_NONE || clock_running != player) {
+            return true;
+        }
+        if (timers) {
+            timers->cancel(&clock_timer);
+        }
+        clock_running = PLAYER_NONE;
+        uint64_t elapsed = now_ms - clock_turn_start_ms;
+        uint64_t charged = (elapsed > timectl_delay_ms ? elapsed - timectl_delay_ms : 0);
+        uint32_t& remaining = clock_remaining_ms[player - 1];
+        if (charged < remaining) {
+            remaining = remaining - charged + timectl_increment_ms;
+            return true;
+        }
+        remaining = 0;
+        clock_flagged = true;
+        printf("[INFO] lobby #%u player %u flagged\n", id, player);
+        event_any es;
+        event_create_game_clock(&es, EVENT_TYPE_GAME_FLAG, player, false, 0, 0);
+        JournalAndSend(es, EVENT_CLIENT_NONE);
+        event_destroy(&es);
+        return false;
+    }
+
+    void Lobby::StartClock(player_id player, uint64_t now_ms)
+    {
+        if (player == PLAYER_NONE || player > clock_remaining_ms.size()) {
+            return;
+        }
+        clock_running = player;
+        clock_turn_start_ms = now_ms;
+        if (timers) {
+            uint64_t deadline_ms = now_ms + timectl_delay_ms + clock_remaining_ms[player - 1];
+            timers->schedule(&clock_timer, (deadline_ms + TimerWheel::TICK_MS - 1) / TimerWheel::TICK_MS);
+        }
+    }
+
+    void Lobby::ClockExpired()
+    {
+        if (clock_running == PLAYER_NONE) {
+            return;
+        }
+        uint64_t now_ms = SDL_GetTicks64();
+        uint64_t deadline_ms = clock_turn_start_ms + timectl_delay_ms + clock_remaining_ms[clock_running - 1];
+        if (now_ms < deadline_ms) {
+            // tick rounding, not quite there yet
+            timers->schedule(&clock_timer, (deadline_ms + TimerWheel::TICK_MS - 1) / TimerWheel::TICK_MS);
+            return;
+        }
+        ChargeClock(clock_running, now_ms);
+    }
+
+    void Lobby::JournalClocks()
     {
+        if (replaying || !journal.is_open() || clock_remaining_ms.size() == 0) {
+            return;
+        }
+        event_any es;
+        for (uint32_t p = 1; p <= clock_remaining_ms.size(); p++) {
+            event_create_game_clock(&es, EVENT_TYPE_GAME_CLOCK, p, p == clock_running, clock_remaining_ms[p - 1], 0);
+            event_serialized* buf = SerializeBroadcast(es);
+            JournalAppend(buf);
+            event_serialized_unref(buf);
+            event_destroy(&es);
+        }
+    }
+
+    void Lobby::SendClocks(uint32_t client_id)
+    {
+        if (replaying || clock_remaining_ms.size() == 0) {
+            return;
+        }
+        // all clocks go out concatenated in one buffer, projected to now so receivers only need to count down from arrival
+        uint64_t now_ms = SDL_GetTicks64();
+        std::vector<uint8_t> clock_buf;
+        event_any es;
+        for (uint32_t p = 1; p <= clock_remaining_ms.size(); p++) {
+            bool running = (p == clock_running);
+            uint32_t remaining = clock_remaining_ms[p - 1];
+            uint32_t delay_left = 0;
+            if (running) {
+                uint64_t elapsed = now_ms - clock_turn_start_ms;
+                if (elapsed < timectl_delay_ms) {
+                    delay_left = timectl_delay_ms - elapsed;
+                } else {
+                    uint64_t charged = elapsed - timectl_delay_ms;
+                    remaining = (charged >= remaining ? 0 : remaining - charged);
+                }
+            }
+            event_create_game_clock(&es, EVENT_TYPE_GAME_CLOCK, p, running, remaining, delay_left);
+            event_serialized* buf = SerializeBroadcast(es);
+            clock_buf.insert(clock_buf.end(), (uint8_t*)buf->data, (uint8_t*)buf->data + buf->size);
+            event_serialized_unref(buf);
+            event_destroy(&es);
+        }
+        event_serialized* buf = event_serialized_create_raw(clock_buf.data(), clock_buf.size());
+        if (client_id == EVENT_CLIENT_NONE) {
+            SendSerialized(buf, EVENT_CLIENT_NONE);
+        } else {
+            event_create_send_serialized(&es, client_id, buf);
+            event_queue_push(send_queue, &es);
+        }
+        event_serialized_unref(buf);
+    }
+
+    void Lobby::SendChat(event_any e)
+    {
+        event_serialized* buf = SerializeBroadcast(e);
+        SendSerialized(buf, EVENT_CLIENT_NONE);
+        // overwrites the oldest message, the ring holds exactly the last CHAT_HISTORY_SIZE ids
+        uint32_t slot = e.chat_msg.msg_id % CHAT_HISTORY_SIZE;
+        if (chat_history[slot]) {
+            event_serialized_unref(chat_history[slot]);
+        }
+        chat_history[slot] = buf;
+        chat_history_ids[slot] = e.chat_msg.msg_id;
+        if (chat_history_buf) {
+            event_serialized_unref(chat_history_buf);
+            chat_history_buf = NULL;
+        }
+    }
+
+    void Lobby::DeleteChat(uint32_t msg_id)
+    {
+        uint32_t slot = msg_id % CHAT_HISTORY_SIZE;
+        if (chat_history[slot] == NULL || chat_history_ids[slot] != msg_id) {
+            return; // already out of the history
+        }
+        event_serialized_unref(chat_history[slot]);
+        chat_history[slot] = NULL;
+        if (chat_history_buf) {
+            event_serialized_unref(chat_history_buf);
+            chat_history_buf = NULL;
+        }
+    }
+
+    event_serialized* Lobby::GetChatHistory()
+    {
+        if (chat_history_buf) {
+            return chat_history_buf;
+        }
+        // oldest first, the ids below the counter are exactly the ones that can still be in the ring
+        std::vector<uint8_t> chat_buf;
+        uint32_t first_id = (lobby_msg_id_ctr > CHAT_HISTORY_SIZE ? lobby_msg_id_ctr - CHAT_HISTORY_SIZE : 0);
+        for (uint32_t msg_id = first_id; msg_id < lobby_msg_id_ctr; msg_id++) {
+            uint32_t slot = msg_id % CHAT_HISTORY_SIZE;
+            if (chat_history[slot] == NULL || chat_history_ids[slot] != msg_id) {
+                continue;
+            }
+            chat_buf.insert(chat_buf.end(), (uint8_t*)chat_history[slot]->data, (uint8_t*)chat_history[slot]->data + chat_history[slot]->size);
+        }
+        if (chat_buf.size() == 0) {
+            return NULL;
+        }
+        chat_history_buf = event_serialized_create_raw(chat_buf.data(), chat_buf.size());
+        return chat_history_buf;
+    }
+
+    void Lobby::SendChatHistory(uint32_t client_id)
+    {
+        event_serialized* chat_buf = GetChatHistory();
+        if (chat_buf == NULL) {
+            return;
+        }
+        event_any es;
+        event_create_send_serialized(&es, client_id, chat_buf);
+        event_queue_push(send_queue, &es);
+    }
+
+    void Lobby::Tick()
+    {
+        if (clock_running != PLAYER_NONE && !clock_timer.scheduled && timers) {
+            // a clock resumed by the replay, the timer wheel was not ours yet back then
+            StartClock(clock_running, clock_turn_start_ms);
+        }
+        FlushSpectatorBatch();
+        // group commit everything journaled during this tick
+        journal.commit();
+    }
+
+    void Lobby::Replay()
+    {
+        if (!journal.is_open()) {
+            return;
+        }
+        replaying = true;
+        uint32_t replay_cnt = 0;
+        event_any e;
+        journal.rewind();
+        while (journal.read_event(&e)) {
+            HandleEvent(e);
+            event_destroy(&e);
+            replay_cnt++;
+        }
+        replaying = false;
+        printf("[INFO] lobby #%u replayed %u journal events\n", id, replay_cnt);
+        if (the_game == NULL || clock_remaining_ms.size() == 0 || clock_flagged || clock_moves == 0) {
+            return;
+        }
+        // the player to move continues with the time journaled for this turn, the downtime is not charged
+        player_id pbuf[253];
+        uint8_t pbuf_cnt = 253;
+        the_game->methods->players_to_move(the_game, &pbuf_cnt, pbuf);
+        if (pbuf_cnt > 0) {
+            StartClock(pbuf[0], SDL_GetTicks64());
+        }
+    }
+
+    std::shared_ptr<const LegalMoveSet> Lobby::GetLegalMoves()
+    {
+        if (the_game == NULL) {
+            return NULL;
+        }
+        if (legal_moves && legal_moves->position == position) {
+            return legal_moves;
+        }
+        LegalMoveSet* lms = new LegalMoveSet();
+        lms->position = position;
+        player_id pbuf[253];
+        uint8_t pbuf_cnt = 253;
+        the_game->methods->players_to_move(the_game, &pbuf_cnt, pbuf);
+        lms->players_to_move.assign(pbuf, pbuf + pbuf_cnt);
+        lms->enumerated = !the_game->methods->features.big_moves;
+        if (lms->enumerated) {
+            legal_moves_buf.resize(the_game->sizer.max_moves);
+            for (uint8_t i = 0; i < pbuf_cnt; i++) {
+                uint32_t move_cnt = 0;
+                if (the_game->methods->get_concrete_moves(the_game, pbuf[i], &move_cnt, legal_moves_buf.data()) != ERR_OK) {
+                    // fall back to asking the game for every move
+                    lms->enumerated = false;
+                    lms->moves.clear();
+                    break;
+                }
+                std::unordered_set<move_code>& player_moves = lms->moves[pbuf[i]];
+                player_moves.reserve(move_cnt);
+                player_moves.insert(legal_moves_buf.begin(), legal_moves_buf.begin() + move_cnt);
+            }
+        }
+        legal_moves = std::shared_ptr<const LegalMoveSet>(lms);
+        return legal_moves;
+    }
+
+    bool Lobby::IsLegalMove(player_id player, move_code code)
+    {
+        std::shared_ptr<const LegalMoveSet> lms = GetLegalMoves();
+        if (!lms) {
+            return false;
+        }
+        if (std::find(lms->players_to_move.begin(), lms->players_to_move.end(), player) == lms->players_to_move.end()) {
+            return false;
+        }
+        if (lms->enumerated) {
+            return lms->contains(player, code);
+        }
+        return the_game->methods->is_legal_move(the_game, player, code) == ERR_OK;
+    }
+
+    player_id Lobby::GetSeat(uint32_t client_id)
+    {
+        if (the_game == NULL) {
+            return PLAYER_NONE;
+        }
+        for (uint32_t i = 0; i < max_users && i < the_game->sizer.player_count; i++) {
+            if (user_client_ids[i] == client_id) {
+                return i + 1;
+            }
+        }
+        return PLAYER_NONE;
+    }
+
+    bool Lobby::MayMoveFor(uint32_t client_id, player_id player)
+    {
+        if (player == PLAYER_RAND) {
+            // nobody gets to choose random outcomes, the server rolls them
+            return client_id == EVENT_CLIENT_SERVER;
+        }
+        if (hot_seat && user_cnt == 1) {
+            // offline a lone user plays every side, there is nobody to cheat against
+            return true;
+        }
+        player_id seat = GetSeat(client_id);
+        return seat != PLAYER_NONE && player == seat;
+    }
+
+    void Lobby::MakeRandomMoves()
+    {
+        if (replaying) {
+            // rolled moves are journaled like any other, a replay just applies them
+            return;
+        }
+        std::shared_ptr<const LegalMoveSet> lms = GetLegalMoves();
+        if (!lms || std::find(lms->players_to_move.begin(), lms->players_to_move.end(), PLAYER_RAND) == lms->players_to_move.end()) {
+            return;
+        }
+        legal_moves_buf.resize(the_game->sizer.max_moves);
+        uint32_t move_cnt = 0;
+        if (the_game->methods->get_concrete_moves(the_game, PLAYER_RAND, &move_cnt, legal_moves_buf.data()) != ERR_OK || move_cnt == 0) {
+            printf("[WARN] lobby #%u could not list random moves\n", id);
+            return;
+        }
+        event_any es;
+        event_create_game_move(&es, EVENT_GAME_SYNC_DEFAULT, PLAYER_RAND, legal_moves_buf[fprng_rand(&random_rng) % move_cnt]);
+        es.base.client_id = EVENT_CLIENT_SERVER;
+        es.base.lobby_id = id;
+        // goes out to everyone, if the next turn is random again this rolls once more
+        HandleEvent(es);
+        event_destroy(&es);
+    }
+
+    void Lobby::RejectMove(event_any e)
+    {
+        printf("[WARN] lobby #%u rejected illegal move %lu by player %d from client %d\n", id, (unsigned long)e.game_move.code, e.game_move.player, e.base.client_id);
+        if (replaying) {
+            return;
+        }
+        // the sender already made the move on its own board, tell it and send the actual game again
+        event_any es;
+        event_create_type_client(&es, EVENT_TYPE_NETWORK_PROTOCOL_NOK, e.base.client_id);
+        es.base.lobby_id = id;
+        event_queue_push(send_queue, &es);
+        SendJoinSync(e.base.client_id);
+    }
+
+    event_serialized* Lobby::SerializeBroadcast(event_any e)
+    {
+        e.base.client_id = EVENT_CLIENT_SERVER;
+        e.base.lobby_id = id;
+        return event_serialized_create(&e);
+    }
+
+    void Lobby::SendSerialized(event_serialized* buf, uint32_t excluded_client_id)
+    {
+        // every recipient only gets a reference to the shared bytes
+        event_any es;
         for (uint32_t i = 0; i < max_users; i++) {
             if (user_client_ids[i] == EVENT_CLIENT_NONE || user_client_ids[i] == excluded_client_id) {
                 continue;
             }
-            e.base.client_id = user_client_ids[i];
+            event_create_send_serialized(&es, user_client_ids[i], buf);
+            event_queue_push(send_queue, &es);
+        }
+        // keep appending while a batch is pending, so the order is kept if the audience shrinks
+        if (spectator_client_ids.size() >= SPECTATOR_COALESCE_THRESHOLD || spectator_batch.size() > 0) {
+            spectator_batch.insert(spectator_batch.end(), (uint8_t*)buf->data, (uint8_t*)buf->data + buf->size);
+            return;
+        }
+        for (uint32_t client_id : spectator_client_ids) {
+            if (client_id == excluded_client_id) {
+                continue;
+            }
+            event_create_send_serialized(&es, client_id, buf);
+            event_queue_push(send_queue, &es);
+        }
+    }
+
+    void Lobby::SendToAllButOne(event_any e, uint32_t excluded_client_id)
+    {
+        event_serialized* buf = SerializeBroadcast(e);
+        SendSerialized(buf, excluded_client_id);
+        event_serialized_unref(buf);
+    }
+
+    void Lobby::JournalAndSend(event_any e, uint32_t excluded_client_id)
+    {
+        event_serialized* buf = SerializeBroadcast(e);
+        if (!replaying && journal.is_open()) {
+            JournalAppend(buf);
+        }
+        SendSerialized(buf, excluded_client_id);
+        event_serialized_unref(buf);
+    }
+
+    void Lobby::JournalAppend(event_serialized* buf)
+    {
+        if (journal.append(buf)) {
+            return;
+        }
+        if (stats->journal_failures.fetch_add(1, std::memory_order_relaxed) == 0) {
+            // once is enough for the log, the count is in the stats
+            printf("[ERROR] lobby #%u failed to journal an event, a restore will not have it\n", id);
+        }
+    }
+
+    void Lobby::StartJournalSegment()
+    {
+        if (replaying || !journal.is_open()) {
+            return;
+        }
+        journal.reset();
+        if (timectl_initial_ms > 0) {
             event_any es;
-            event_copy(&es, &e);
+            event_create_game_timectl(&es, timectl_initial_ms, timectl_increment_ms, timectl_delay_ms);
+            event_serialized* buf = SerializeBroadcast(es);
+            JournalAppend(buf);
+            event_serialized_unref(buf);
+            event_destroy(&es);
+        }
+    }
+
+    void Lobby::FlushSpectatorBatch()
+    {
+        if (spectator_batch.size() == 0) {
+            return;
+        }
+        // the batch is just concatenated events, receivers read it like any other event stream
+        event_serialized* buf = event_serialized_create_raw(spectator_batch.data(), spectator_batch.size());
+        spectator_batch.clear();
+        event_any es;
+        for (uint32_t client_id : spectator_client_ids) {
+            event_create_send_serialized(&es, client_id, buf);
             event_queue_push(send_queue, &es);
         }
+        event_serialized_unref(buf);
     }
 
 } // namespace Control
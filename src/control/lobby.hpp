@@ -2,42 +2,146 @@
 //TODO maybe put client and server+this into specific directories, then control holds only general control logic
 
 #include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include "rosalia/rand.h"
 #include "surena/game.h"
 
 #include "mirabel/event_queue.h"
 #include "mirabel/event.h"
+#include "control/lobby_journal.hpp"
 #include "control/plugins.hpp"
+#include "control/server_metrics.hpp"
+#include "control/timer_wheel.hpp"
 
 namespace Control {
 
+    // legal moves of one position, computed once and immutable afterwards, so it can be shared with anyone in the process
+    struct LegalMoveSet {
+        uint64_t position; // lobby position this set was computed for
+        bool enumerated; // false if the game can't list its moves (big moves), then only is_legal_move can decide
+        std::vector<player_id> players_to_move;
+        std::unordered_map<player_id, std::unordered_set<move_code>> moves;
+
+        bool contains(player_id player, move_code code) const;
+    };
+
     class Lobby {
       public:
 
         PluginManager* plugin_mgr;
         event_queue* send_queue;
 
-        // uint64_t id;
+        uint32_t id;
         char* game_base;
         char* game_variant;
         char* game_impl;
         char* game_options;
         game* the_game;
+        BaseGameVariantImpl loaded_impl; // the impl the_game was created from, holding it keeps its plugin open
         // bool game_trusted; // true if full game has only ever been on the server, i.e. no hidden state leaked, false if game is loaded from a user
         uint16_t max_users;
         uint32_t* user_client_ids; //TODO should use some user struct, for now just stores client ids of connected clients
+        uint16_t user_cnt = 0;
+        bool hot_seat = false; // a lone seated user plays every side, only for the offline server where nobody else can join
+        fast_prng random_rng; // random moves are rolled here, never by clients
 
         uint32_t lobby_msg_id_ctr = 1;
+        // the last chat messages, serialized for broadcast, msg ids are handed out in order so the slot of a msg is msg_id % CHAT_HISTORY_SIZE
+        static const uint32_t CHAT_HISTORY_SIZE = 64;
+        event_serialized* chat_history[CHAT_HISTORY_SIZE] = {}; // NULL for empty or deleted
+        uint32_t chat_history_ids[CHAT_HISTORY_SIZE] = {};
+        event_serialized* chat_history_buf = NULL; // all of the history concatenated for joiners, rebuilt lazily after changes
+
+        // spectators only view, they are unbounded and kept compact, spectator_idx maps client id -> index
+        std::vector<uint32_t> spectator_client_ids;
+        std::unordered_map<uint32_t, uint32_t> spectator_idx;
+        // for large audiences outgoing events are concatenated here and flushed as one buffer per tick
+        static const uint32_t SPECTATOR_COALESCE_THRESHOLD = 32;
+        static const uint32_t TICK_MS = 100;
+        std::vector<uint8_t> spectator_batch;
+
+        // bumped on every load/unload/state import (and after long move tails), the join snapshot is only valid for the step it was made at
+        uint64_t game_step = 0;
+        uint64_t join_snapshot_step = 0;
+        event_serialized* join_snapshot = NULL; // serialized load+state (or unload) sent to joining users
+        // serialized moves made since the snapshot, joiners get these after the snapshot
+        static const uint32_t JOIN_TAIL_MAX_MOVES = 64;
+        std::vector<uint8_t> join_tail;
+        uint32_t join_tail_moves = 0;
+        event_serialized* join_tail_buf = NULL;
+        uint32_t join_tail_buf_moves = 0;
+
+        // bumped on every load/unload/state/move, the legal move set is recomputed lazily once per position
+        uint64_t position = 0;
+        std::shared_ptr<const LegalMoveSet> legal_moves;
+        std::vector<move_code> legal_moves_buf;
+
+        std::shared_ptr<lobby_stats> stats; // shared with the lobby manager, read by the admin socket
 
-        Lobby(PluginManager* plugin_mgr, event_queue* send_queue, uint16_t max_users);
+        // time control, the clocks only ever run here, clients get their state with every move and just render it
+        static const uint32_t TIMECTL_MAX_MS = 24 * 60 * 60 * 1000;
+        uint32_t timectl_initial_ms = 0; // 0 means no clocks
+        uint32_t timectl_increment_ms = 0;
+        uint32_t timectl_delay_ms = 0;
+        std::vector<uint32_t> clock_remaining_ms; // per player, index is player id - 1, as of the start of the current turn
+        player_id clock_running = PLAYER_NONE; //TODO simultaneous moves, only the first player to move is timed
+        uint64_t clock_turn_start_ms = 0; // the delay counts from here
+        bool clock_flagged = false;
+        uint32_t clock_moves = 0; // moves since the clocks were reset, the time control is fixed once this is non zero
+        TimerWheel* timers = NULL; // owned by the worker this lobby is pinned to
+        TimerWheel::timer clock_timer; // fires when the running clock reaches 0
+
+        // every applied game load/unload/state/move is appended here, replaying it rebuilds the game
+        LobbyJournal journal;
+        bool replaying = false;
+
+        Lobby(PluginManager* plugin_mgr, event_queue* send_queue, uint32_t id, uint16_t max_users);
         ~Lobby();
 
-        void AddUser(uint32_t client_id);
-        void RemoveUser(uint32_t client_id);
+        void AddUser(uint32_t client_id, uint8_t seat); // seat is the preferred slot + 1, 0 or taken seats get the first free slot
+        void AddSpectator(uint32_t client_id);
+        void RemoveUser(uint32_t client_id); // also removes spectators
+        void Close(); // tell everyone the lobby is gone, the owner deletes it afterwards
 
         void HandleEvent(event_any e); // handle events that are specifically assigned to this lobby
+        void Tick(); // called every TICK_MS by the owning worker
+        void Replay(); // rebuild the game from the journal, must happen before any users join
+
+        std::shared_ptr<const LegalMoveSet> GetLegalMoves(); // NULL if there is no game
+        bool IsLegalMove(player_id player, move_code code);
+        // users are seated in join order, the user in slot i plays player i + 1, PLAYER_NONE for spectators and surplus users
+        player_id GetSeat(uint32_t client_id);
+        bool MayMoveFor(uint32_t client_id, player_id player);
+        void MakeRandomMoves(); // while PLAYER_RAND is to move the server picks its move and handles it like any other
+        void RejectMove(event_any e); // NOK to the sender and resync it
+
+        void ResetClocks(); // full time for everyone and nothing running, the next move starts the clocks
+        bool ChargeClock(player_id player, uint64_t now_ms); // ends the turn of player, flags and returns false if it ran out of time
+        void StartClock(player_id player, uint64_t now_ms);
+        void ClockExpired(); // clock_timer fired
+        void SendClocks(uint32_t client_id); // all clocks, EVENT_CLIENT_NONE sends to everyone
+        void JournalClocks(); // remaining times as of the start of the current turn, replayed instead of recomputed
+
+        void SendChat(event_any e); // broadcast and keep in the history, e must have its msg id assigned already
+        void DeleteChat(uint32_t msg_id);
+        event_serialized* GetChatHistory(); // NULL if there is none
+        void SendChatHistory(uint32_t client_id); // once per join, resyncs after a rejected move do not repeat it
+
+        event_serialized* GetJoinSnapshot();
+        void SendJoinSync(uint32_t client_id); // game, clocks and moves, no chat
 
+        // broadcasts go to all users and spectators
+        event_serialized* SerializeBroadcast(event_any e);
+        void SendSerialized(event_serialized* buf, uint32_t excluded_client_id);
         void SendToAllButOne(event_any e, uint32_t excluded_client_id);
+        void JournalAndSend(event_any e, uint32_t excluded_client_id); // for game events that change the game
+        void JournalAppend(event_serialized* buf); // failures are logged and counted in the stats, the game goes on without them
+        void StartJournalSegment(); // drops everything journaled so far, keeps only what outlives a game load
+        void FlushSpectatorBatch();
     };
 
 } // namespace Control
@@ -0,0 +1,224 @@
+#include <cstddef>
+#include <cstdbool>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mirabel/event.h"
+
+#include "control/lobby_journal.hpp"
+
+namespace Control {
+
+    LobbyJournal::LobbyJournal()
+    {}
+
+    LobbyJournal::~LobbyJournal()
+    {
+        close();
+    }
+
+    LobbyJournal::journal_header* LobbyJournal::header()
+    {
+        return reinterpret_cast<journal_header*>(map);
+    }
+
+    bool LobbyJournal::remap(size_t new_capacity)
+    {
+        // the old mapping stays usable until the new one is in place, a failed growth keeps the journal as it is
+        if (!read_only && new_capacity > capacity && ftruncate(fd, new_capacity) != 0) {
+            printf("[ERROR] journal failed to resize to %zu bytes\n", new_capacity);
+            return false;
+        }
+        void* new_map = mmap(NULL, new_capacity, read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (new_map == MAP_FAILED) {
+            printf("[ERROR] journal failed to map %zu bytes\n", new_capacity);
+            return false;
+        }
+        if (map) {
+            munmap(map, capacity);
+        }
+        map = (uint8_t*)new_map;
+        capacity = new_capacity;
+        return true;
+    }
+
+    bool LobbyJournal::open(const char* path, bool read_only)
+    {
+        close();
+        this->read_only = read_only;
+        fd = ::open(path, read_only ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            printf("[ERROR] journal failed to open %s\n", path);
+            return false;
+        }
+        struct stat st;
+        fstat(fd, &st);
+        size_t file_size = st.st_size;
+        if (file_size == 0 && read_only) {
+            printf("[ERROR] journal is empty: %s\n", path);
+            close();
+            return false;
+        }
+        size_t initial_capacity = file_size;
+        if (!read_only && initial_capacity < JOURNAL_MIN_CAPACITY) {
+            initial_capacity = JOURNAL_MIN_CAPACITY;
+        }
+        if (!remap(initial_capacity)) {
+            close();
+            return false;
+        }
+        if (file_size == 0) {
+            header()->magic = JOURNAL_MAGIC;
+            header()->used = sizeof(journal_header);
+            header()->flags = 0;
+            header()->max_users = 0;
+            header()->reserved = 0;
+        } else if (file_size < sizeof(journal_header) || header()->magic != JOURNAL_MAGIC || header()->used > file_size) {
+            printf("[ERROR] journal is corrupt: %s\n", path);
+            close();
+            return false;
+        }
+        committed = header()->used;
+        read_offset = sizeof(journal_header);
+        return true;
+    }
+
+    void LobbyJournal::close()
+    {
+        if (fd < 0) {
+            return;
+        }
+        size_t used = 0;
+        if (map) {
+            used = header()->used;
+            if (!read_only) {
+                commit();
+            }
+            munmap(map, capacity);
+            map = NULL;
+        }
+        // drop the preallocated tail so the file is exactly the journal
+        if (!read_only && used > 0) {
+            ftruncate(fd, used);
+        }
+        ::close(fd);
+        fd = -1;
+        capacity = 0;
+    }
+
+    bool LobbyJournal::is_open()
+    {
+        return map != NULL;
+    }
+
+    void LobbyJournal::set_meta(uint16_t max_users, uint32_t flags)
+    {
+        if (map == NULL || read_only) {
+            return;
+        }
+        header()->max_users = max_users;
+        header()->flags = flags;
+        // the header page is only synced by a commit that starts in it
+        committed = 0;
+    }
+
+    uint16_t LobbyJournal::get_max_users()
+    {
+        return map == NULL ? 0 : header()->max_users;
+    }
+
+    uint32_t LobbyJournal::get_flags()
+    {
+        return map == NULL ? 0 : header()->flags;
+    }
+
+    bool LobbyJournal::append(const void* data, size_t size)
+    {
+        if (map == NULL || read_only) {
+            return false;
+        }
+        size_t used = header()->used;
+        if (used + size > capacity) {
+            size_t new_capacity = capacity * 2;
+            while (used + size > new_capacity) {
+                new_capacity *= 2;
+            }
+            if (!remap(new_capacity)) {
+                return false;
+            }
+        }
+        memcpy(map + used, data, size);
+        // only publish the record once it is complete, a torn write is never part of the journal
+        header()->used = used + size;
+        return true;
+    }
+
+    bool LobbyJournal::append(event_serialized* buf)
+    {
+        return append(buf->data, buf->size);
+    }
+
+    void LobbyJournal::commit()
+    {
+        if (map == NULL || read_only) {
+            return;
+        }
+        size_t used = header()->used;
+        if (used == committed) {
+            return;
+        }
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        size_t sync_from = committed / page_size * page_size;
+        msync(map + sync_from, used - sync_from, MS_SYNC);
+        // header lives in the first page, it is only covered above if the sync started there
+        if (sync_from > 0) {
+            msync(map, page_size, MS_SYNC);
+        }
+        committed = used;
+    }
+
+    void LobbyJournal::reset()
+    {
+        if (map == NULL || read_only) {
+            return;
+        }
+        header()->used = sizeof(journal_header);
+        // forces the next commit to sync from the header on
+        committed = 0;
+    }
+
+    void LobbyJournal::rewind()
+    {
+        read_offset = sizeof(journal_header);
+    }
+
+    bool LobbyJournal::read_event(event_any* e)
+    {
+        if (map == NULL) {
+            return false;
+        }
+        size_t used = header()->used;
+        if (read_offset + sizeof(size_t) > used) {
+            return false;
+        }
+        size_t event_size = event_read_size(map + read_offset);
+        if (event_size < sizeof(size_t) || read_offset + event_size > used) {
+            printf("[WARN] journal has a torn record at offset %zu\n", read_offset);
+            return false;
+        }
+        event_deserialize(e, map + read_offset, map + read_offset + event_size);
+        read_offset += event_size;
+        if (e->base.type == EVENT_TYPE_NULL) {
+            printf("[WARN] journal has an unreadable record at offset %zu\n", read_offset - event_size);
+            return false;
+        }
+        return true;
+    }
+
+} // namespace Control
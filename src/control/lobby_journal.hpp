@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdbool>
+#include <cstdint>
+
+#include "mirabel/event.h"
+
+namespace Control {
+
+    // append only, memory mapped log of serialized events (size prefixed, exactly as they go over the wire)
+    // appends land in the shared mapping, so they survive a process crash; commit() msyncs everything appended since the last commit
+    class LobbyJournal {
+      private:
+
+        struct journal_header {
+            uint64_t magic;
+            uint64_t used; // bytes in use, including this header
+            uint32_t flags;
+            uint16_t max_users; // of the lobby, restores recreate it with the same size
+            uint16_t reserved;
+        };
+
+        static const uint64_t JOURNAL_MAGIC = 0x324C4E524A4C424DULL; // "MBLJRNL2"
+        static const size_t JOURNAL_MIN_CAPACITY = 1 << 20;
+
+        int fd = -1;
+        bool read_only;
+        uint8_t* map = NULL;
+        size_t capacity = 0;
+        size_t committed = 0; // everything before this offset is synced to disk
+        size_t read_offset = sizeof(journal_header);
+
+        journal_header* header();
+        bool remap(size_t new_capacity);
+
+      public:
+
+        static const uint32_t JOURNAL_FLAG_DEFAULT_LOBBY = 1 << 0;
+        static const uint32_t JOURNAL_FLAG_CLOSE_WHEN_EMPTY = 1 << 1;
+
+        LobbyJournal();
+        ~LobbyJournal();
+
+        // creates the file if it does not exist, returns false on failure
+        bool open(const char* path, bool read_only);
+        void close();
+        bool is_open();
+
+        // lobby properties kept in the header, set right after creating the journal
+        void set_meta(uint16_t max_users, uint32_t flags);
+        uint16_t get_max_users();
+        uint32_t get_flags();
+
+        // false if the journal could not grow, it stays open and intact up to the failed record
+        bool append(const void* data, size_t size);
+        bool append(event_serialized* buf);
+        // group commit, syncs all appends since the last commit
+        void commit();
+        // drop all records and start a fresh segment, e.g. once a game load made everything before it irrelevant
+        void reset();
+
+        // sequential replay, returns false once the end (or a torn trailing record) is reached
+        void rewind();
+        bool read_event(event_any* e);
+    };
+
+} // namespace Control
@@ -1,22 +1,473 @@
 #include "mirabel/event_queue.h"
 #include "mirabel/event.h"
 
+#include <chrono>
 #include <cstddef>
 #include <cstdbool>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <SDL2/SDL.h>
+#include "surena/game.h"
+
+#include "control/lobby.hpp"
+#include "control/plugins.hpp"
+#include "control/server_metrics.hpp"
+#include "control/thread_runtime.hpp"
+#include "control/timeout_crash.hpp"
 
 #include "control/lobby_manager.hpp"
 
 namespace Control {
 
-    LobbyManager::LobbyManager()
+    LobbyManager::LobbyManager(PluginManager* plugin_mgr, TimeoutCrash* tc):
+        plugin_mgr(plugin_mgr),
+        tc(tc),
+        send_queue(NULL)
+    {}
+
+    LobbyManager::~LobbyManager()
     {
-        //TODO
+        stop();
     }
 
-    LobbyManager::~LobbyManager()
+    void LobbyManager::start(uint32_t worker_count)
+    {
+        if (worker_count == 0) {
+            worker_count = std::thread::hardware_concurrency();
+        }
+        if (worker_count == 0) {
+            worker_count = 1;
+        }
+        for (uint32_t i = 0; i < worker_count; i++) {
+            lobby_worker* w = new lobby_worker();
+            w->idx = i;
+            event_queue_create(&w->inbox);
+            char tc_name[32];
+            sprintf(tc_name, "lobbyworker%u", i);
+            w->tc_info = tc->register_timeout_item(&w->inbox, tc_name, 3000, 1000);
+            w->runner = thread_runtime.spawn("lobby" + std::to_string(i), [this, w]() { worker_loop(w); });
+            workers.push_back(w);
+        }
+        printf("[INFO] lobby manager started %u workers\n", worker_count);
+    }
+
+    void LobbyManager::stop()
+    {
+        if (workers.size() == 0) {
+            return;
+        }
+        for (lobby_worker* w : workers) {
+            w->tc_info.pre_quit(2000);
+            event_any es;
+            event_create_type(&es, EVENT_TYPE_EXIT);
+            event_queue_push(&w->inbox, &es);
+        }
+        stopped_members.clear();
+        for (lobby_worker* w : workers) {
+            w->runner.join();
+            tc->unregister_timeout_item(w->tc_info.id);
+            for (std::pair<const uint32_t, Lobby*>& lobby : w->lobbies) {
+                // the worker is gone, so reading the lobby from here is safe
+                Lobby* l = lobby.second;
+                for (uint32_t i = 0; i < l->max_users; i++) {
+                    if (l->user_client_ids[i] != EVENT_CLIENT_NONE) {
+                        stopped_members.push_back(lobby_member{l->user_client_ids[i], l->id, false, (uint8_t)(i + 1)});
+                    }
+                }
+                for (uint32_t client_id : l->spectator_client_ids) {
+                    stopped_members.push_back(lobby_member{client_id, l->id, true, 0});
+                }
+                delete l;
+            }
+            event_queue_destroy(&w->inbox);
+            delete w;
+        }
+        workers.clear();
+        lobby_workers.clear();
+        client_lobbies.clear();
+        spectating_clients.clear();
+        lobby_member_cnt.clear();
+        lobby_max_users.clear();
+        lobby_user_cnt.clear();
+        close_when_empty.clear();
+        stats_m.lock();
+        stats.clear();
+        stats_m.unlock();
+    }
+
+    Lobby* LobbyManager::new_lobby(uint32_t lobby_id, uint16_t max_users, bool is_default, bool close_empty)
+    {
+        Lobby* lobby = new Lobby(plugin_mgr, send_queue, lobby_id, max_users);
+        lobby->hot_seat = hot_seat;
+        lobby_max_users[lobby_id] = max_users;
+        if (journal_dir.size() > 0) {
+            if (lobby->journal.open(journal_path(lobby_id).c_str(), false)) {
+                lobby->journal.set_meta(max_users, (is_default ? LobbyJournal::JOURNAL_FLAG_DEFAULT_LOBBY : 0) | (close_empty ? LobbyJournal::JOURNAL_FLAG_CLOSE_WHEN_EMPTY : 0));
+            } else {
+                printf("[WARN] lobby #%u runs without journal\n", lobby_id);
+            }
+        }
+        if (close_empty) {
+            close_when_empty.insert(lobby_id);
+        }
+        return lobby;
+    }
+
+    void LobbyManager::pin_lobby(Lobby* lobby)
+    {
+        //TODO pin to the least loaded worker instead of round robin
+        lobby_worker* w = workers[lobby->id % workers.size()];
+        lobby->timers = &w->timers;
+        w->m.lock();
+        w->lobbies[lobby->id] = lobby;
+        w->m.unlock();
+        lobby_workers[lobby->id] = w->idx;
+        stats_m.lock();
+        stats[lobby->id] = lobby->stats;
+        stats_m.unlock();
+        printf("[INFO] lobby #%u created on worker %u\n", lobby->id, w->idx);
+    }
+
+    uint32_t LobbyManager::CreateLobby(uint16_t max_users, bool is_default, bool close_empty)
+    {
+        if (workers.size() == 0) {
+            printf("[ERROR] can not create lobby without workers\n");
+            return EVENT_LOBBY_NONE;
+        }
+        Lobby* lobby = new_lobby(next_lobby_id++, max_users, is_default, close_empty);
+        pin_lobby(lobby);
+        if (is_default) {
+            default_lobby_id = lobby->id;
+        }
+        return lobby->id;
+    }
+
+    uint32_t LobbyManager::RestoreLobbies()
+    {
+        if (workers.size() == 0 || journal_dir.size() == 0) {
+            return 0;
+        }
+        DIR* dir = opendir(journal_dir.c_str());
+        if (dir == NULL) {
+            mkdir(journal_dir.c_str(), 0755);
+            return 0;
+        }
+        uint32_t restore_cnt = 0;
+        struct dirent* dp;
+        while ((dp = readdir(dir)) != NULL) {
+            uint32_t lobby_id;
+            char suffix[5];
+            if (sscanf(dp->d_name, "lobby_%u.%4s", &lobby_id, suffix) != 2 || strcmp(suffix, "mjl") != 0) {
+                continue;
+            }
+            if (lobby_id == EVENT_LOBBY_NONE || lobby_workers.find(lobby_id) != lobby_workers.end()) {
+                continue;
+            }
+            // the lobby size is needed before the lobby exists, so peek at the header first
+            LobbyJournal meta;
+            if (!meta.open(journal_path(lobby_id).c_str(), true) || meta.get_max_users() == 0) {
+                printf("[WARN] skipping unreadable journal %s\n", dp->d_name);
+                continue;
+            }
+            uint16_t max_users = meta.get_max_users();
+            bool is_default = (meta.get_flags() & LobbyJournal::JOURNAL_FLAG_DEFAULT_LOBBY);
+            bool close_empty = (meta.get_flags() & LobbyJournal::JOURNAL_FLAG_CLOSE_WHEN_EMPTY);
+            meta.close();
+            Lobby* lobby = new_lobby(lobby_id, max_users, is_default, close_empty);
+            // lobby is not pinned yet, so replaying here on the main thread is safe
+            lobby->Replay();
+            pin_lobby(lobby);
+            if (is_default) {
+                default_lobby_id = lobby_id;
+            }
+            if (lobby_id >= next_lobby_id) {
+                next_lobby_id = lobby_id + 1;
+            }
+            restore_cnt++;
+        }
+        closedir(dir);
+        return restore_cnt;
+    }
+
+    void LobbyManager::CloseLobby(uint32_t lobby_id)
+    {
+        if (lobby_workers.find(lobby_id) == lobby_workers.end()) {
+            printf("[WARN] can not close unknown lobby #%u\n", lobby_id);
+            return;
+        }
+        // the worker tells the members and deletes the lobby, from here on nothing new is routed to it
+        event_any es;
+        event_create_type(&es, EVENT_TYPE_LOBBY_CLOSE);
+        push_to_lobby(lobby_id, &es);
+        lobby_workers.erase(lobby_id);
+        lobby_member_cnt.erase(lobby_id);
+        lobby_max_users.erase(lobby_id);
+        lobby_user_cnt.erase(lobby_id);
+        close_when_empty.erase(lobby_id);
+        for (std::unordered_map<uint32_t, uint32_t>::iterator it = client_lobbies.begin(); it != client_lobbies.end();) {
+            if (it->second == lobby_id) {
+                spectating_clients.erase(it->first);
+                it = client_lobbies.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        stats_m.lock();
+        stats.erase(lobby_id);
+        stats_m.unlock();
+        printf("[INFO] lobby #%u closed\n", lobby_id);
+        if (default_lobby_id == lobby_id) {
+            // any other lobby may be a two seat match, new clients get a fresh default instead
+            default_lobby_id = EVENT_LOBBY_NONE;
+            CreateLobby(DEFAULT_LOBBY_MAX_USERS, true, false);
+        }
+    }
+
+    void LobbyManager::CloseEmptyLobbies()
+    {
+        std::vector<uint32_t> empty;
+        for (uint32_t lobby_id : close_when_empty) {
+            if (lobby_member_cnt[lobby_id] == 0) {
+                empty.push_back(lobby_id);
+            }
+        }
+        for (uint32_t lobby_id : empty) {
+            CloseLobby(lobby_id);
+        }
+    }
+
+    bool LobbyManager::HasLobby(uint32_t lobby_id)
+    {
+        return lobby_workers.find(lobby_id) != lobby_workers.end();
+    }
+
+    bool LobbyManager::AddUser(uint32_t client_id, uint32_t lobby_id, bool spectate, uint8_t seat)
+    {
+        if (!HasLobby(lobby_id)) {
+            printf("[WARN] client %u tried to join unknown lobby #%u\n", client_id, lobby_id);
+            return false;
+        }
+        std::unordered_map<uint32_t, uint32_t>::iterator current = client_lobbies.find(client_id);
+        if (current != client_lobbies.end() && current->second == lobby_id) {
+            return true;
+        }
+        if (!spectate && lobby_user_cnt[lobby_id] >= lobby_max_users[lobby_id]) {
+            // the worker handles joins and leaves in order, so it never has fewer free seats than counted here
+            printf("[WARN] client %u tried to join full lobby #%u\n", client_id, lobby_id);
+            event_any es;
+            event_create_type_client(&es, EVENT_TYPE_NETWORK_PROTOCOL_NOK, client_id);
+            es.base.lobby_id = lobby_id;
+            event_queue_push(send_queue, &es);
+            return false;
+        }
+        if (current != client_lobbies.end()) {
+            RemoveUser(client_id);
+        }
+        client_lobbies[client_id] = lobby_id;
+        if (spectate) {
+            spectating_clients.insert(client_id);
+        } else {
+            lobby_user_cnt[lobby_id]++;
+        }
+        lobby_member_cnt[lobby_id]++;
+        event_any es;
+        event_create_lobby_join(&es, client_id, lobby_id, spectate);
+        es.lobby_join.seat = seat;
+        push_to_lobby(lobby_id, &es);
+        return true;
+    }
+
+    void LobbyManager::StartGame(uint32_t lobby_id, const char* base_name, const char* variant_name, const char* impl_name, const char* options, uint32_t initial_ms, uint32_t increment_ms, uint32_t delay_ms)
+    {
+        // time control first, so the load already resets the clocks to it
+        event_any es;
+        event_create_game_timectl(&es, initial_ms, increment_ms, delay_ms);
+        push_to_lobby(lobby_id, &es);
+        game_init init_info = (game_init){
+            .source_type = GAME_INIT_SOURCE_TYPE_STANDARD,
+            .source = {
+                .standard{
+                    .opts = options,
+                    .legacy = NULL,
+                    .state = NULL,
+                },
+            },
+        };
+        event_create_game_load(&es, base_name, variant_name, impl_name, init_info);
+        push_to_lobby(lobby_id, &es);
+    }
+
+    void LobbyManager::RemoveUser(uint32_t client_id)
+    {
+        std::unordered_map<uint32_t, uint32_t>::iterator current = client_lobbies.find(client_id);
+        if (current == client_lobbies.end()) {
+            return;
+        }
+        uint32_t lobby_id = current->second;
+        client_lobbies.erase(current);
+        if (spectating_clients.erase(client_id) == 0) {
+            lobby_user_cnt[lobby_id]--;
+        }
+        event_any es;
+        event_create_type_client(&es, EVENT_TYPE_LOBBY_LEAVE, client_id);
+        push_to_lobby(lobby_id, &es);
+        if (--lobby_member_cnt[lobby_id] == 0 && close_when_empty.find(lobby_id) != close_when_empty.end()) {
+            // e.g. a finished match, both players went elsewhere
+            CloseLobby(lobby_id);
+        }
+    }
+
+    bool LobbyManager::InRunningMatch(uint32_t client_id)
+    {
+        std::unordered_map<uint32_t, uint32_t>::iterator current = client_lobbies.find(client_id);
+        if (current == client_lobbies.end() || spectating_clients.count(client_id) > 0 || close_when_empty.count(current->second) == 0) {
+            return false;
+        }
+        // only this thread changes the map, the lock is for the readers
+        std::unordered_map<uint32_t, std::shared_ptr<lobby_stats>>::iterator ls = stats.find(current->second);
+        return ls != stats.end() && !ls->second->game_over.load(std::memory_order_relaxed);
+    }
+
+    void LobbyManager::HandleEvent(event_any* e)
+    {
+        std::unordered_map<uint32_t, uint32_t>::iterator current = client_lobbies.find(e->base.client_id);
+        if (current == client_lobbies.end()) {
+            printf("[WARN] client %u sent lobby event type %d without being in a lobby\n", e->base.client_id, e->base.type);
+            return;
+        }
+        if (e->base.lobby_id == EVENT_LOBBY_NONE) {
+            e->base.lobby_id = current->second;
+        } else if (e->base.lobby_id != current->second) {
+            printf("[WARN] client %u sent event for lobby #%u it is not in\n", e->base.client_id, e->base.lobby_id);
+            return;
+        }
+        push_to_lobby(e->base.lobby_id, e);
+    }
+
+    void LobbyManager::push_to_lobby(uint32_t lobby_id, event_any* e)
+    {
+        std::unordered_map<uint32_t, uint32_t>::iterator lw = lobby_workers.find(lobby_id);
+        if (lw == lobby_workers.end()) {
+            printf("[WARN] dropping event type %d for unknown lobby #%u\n", e->base.type, lobby_id);
+            return;
+        }
+        e->base.lobby_id = lobby_id;
+        event_queue_push(&workers[lw->second]->inbox, e);
+    }
+
+    std::string LobbyManager::journal_path(uint32_t lobby_id)
+    {
+        return journal_dir + "lobby_" + std::to_string(lobby_id) + ".mjl";
+    }
+
+    void LobbyManager::GetLobbyStats(std::vector<std::shared_ptr<lobby_stats>>* out)
+    {
+        std::lock_guard<std::mutex> lock(stats_m);
+        out->reserve(out->size() + stats.size());
+        for (std::pair<const uint32_t, std::shared_ptr<lobby_stats>>& ls : stats) {
+            out->push_back(ls.second);
+        }
+    }
+
+    void LobbyManager::GetQueueDepths(std::vector<uint32_t>* out)
+    {
+        // workers only change in start/stop
+        for (lobby_worker* w : workers) {
+            out->push_back(event_queue_size(&w->inbox));
+        }
+    }
+
+    void LobbyManager::worker_loop(lobby_worker* w)
     {
-        //TODO
+        event_any e;
+        bool quit = false;
+        w->last_tick = SDL_GetTicks64();
+        while (!quit) {
+            // running clocks need the finer timer resolution, otherwise the lobby tick is enough
+            event_queue_pop(&w->inbox, &e, w->timers.size() > 0 ? TimerWheel::TICK_MS : Lobby::TICK_MS);
+            switch (e.base.type) {
+                case EVENT_TYPE_NULL: {
+                    // pass
+                } break;
+                case EVENT_TYPE_EXIT: {
+                    quit = true;
+                } break;
+                case EVENT_TYPE_HEARTBEAT: {
+                    w->tc_info.send_heartbeat();
+                } break;
+                default: {
+                    w->m.lock();
+                    std::unordered_map<uint32_t, Lobby*>::iterator li = w->lobbies.find(e.base.lobby_id);
+                    Lobby* lobby = (li == w->lobbies.end() ? NULL : li->second);
+                    w->m.unlock();
+                    if (lobby == NULL) {
+                        printf("[WARN] lobby worker %u received event for unknown lobby #%u\n", w->idx, e.base.lobby_id);
+                        break;
+                    }
+                    switch (e.base.type) {
+                        case EVENT_TYPE_LOBBY_JOIN: {
+                            if (e.lobby_join.spectate) {
+                                lobby->AddSpectator(e.base.client_id);
+                            } else {
+                                lobby->AddUser(e.base.client_id, e.lobby_join.seat);
+                            }
+                        } break;
+                        case EVENT_TYPE_LOBBY_LEAVE: {
+                            lobby->RemoveUser(e.base.client_id);
+                        } break;
+                        case EVENT_TYPE_LOBBY_CLOSE: {
+                            lobby->Close();
+                            w->m.lock();
+                            w->lobbies.erase(e.base.lobby_id);
+                            w->m.unlock();
+                            delete lobby;
+                            if (journal_dir.size() > 0) {
+                                remove(journal_path(e.base.lobby_id).c_str());
+                            }
+                        } break;
+                        case EVENT_TYPE_GAME_MOVE: {
+                            std::chrono::steady_clock::time_point move_start = std::chrono::steady_clock::now();
+                            lobby->HandleEvent(e);
+                            lobby->stats->record_move(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - move_start).count());
+                        } break;
+                        default: {
+                            lobby->HandleEvent(e);
+                        } break;
+                    }
+                } break;
+            }
+            event_destroy(&e);
+            uint64_t now = SDL_GetTicks64();
+            w->timers.advance(now / TimerWheel::TICK_MS, &w->fired_timers);
+            for (TimerWheel::timer* t : w->fired_timers) {
+                ((Lobby*)t->data)->ClockExpired();
+            }
+            w->fired_timers.clear();
+            if (now - w->last_tick >= Lobby::TICK_MS) {
+                w->last_tick = now;
+                // only this worker erases lobbies, so the pointers stay valid once m is released
+                // ticks may msync journals, the main thread must not wait on that to pin a new lobby
+                w->m.lock();
+                for (std::pair<const uint32_t, Lobby*>& lobby : w->lobbies) {
+                    w->tick_lobbies.push_back(lobby.second);
+                }
+                w->m.unlock();
+                for (Lobby* lobby : w->tick_lobbies) {
+                    lobby->Tick();
+                }
+                w->tick_lobbies.clear();
+            }
+        }
     }
 
 } // namespace Control
@@ -6,18 +6,114 @@
 #include <cstddef>
 #include <cstdbool>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "control/lobby.hpp"
+#include "control/plugins.hpp"
+#include "control/server_metrics.hpp"
+#include "control/timeout_crash.hpp"
+#include "control/timer_wheel.hpp"
 
 namespace Control {
 
+    // lobbies are pinned to one worker each, so every lobby is only ever touched by a single thread
+    // all public methods are expected to be called from the server main thread only
     class LobbyManager {
       private:
 
+        struct lobby_worker {
+            uint32_t idx;
+            std::thread runner;
+            event_queue inbox;
+            TimeoutCrash::timeout_info tc_info;
+            std::mutex m; // guards lobbies against inserts from the main thread
+            std::unordered_map<uint32_t, Lobby*> lobbies;
+            uint64_t last_tick;
+            TimerWheel timers; // game clocks of all lobbies on this worker
+            std::vector<TimerWheel::timer*> fired_timers;
+            std::vector<Lobby*> tick_lobbies; // snapshot of lobbies, ticked without holding m
+        };
+
+        PluginManager* plugin_mgr;
+        TimeoutCrash* tc;
+
+        std::vector<lobby_worker*> workers;
+
+        uint32_t next_lobby_id = 1; // start at 1, 0 is EVENT_LOBBY_NONE
+        std::unordered_map<uint32_t, uint32_t> lobby_workers; // lobby_id -> worker idx
+        std::unordered_map<uint32_t, uint32_t> client_lobbies; // client_id -> lobby_id
+        std::unordered_set<uint32_t> spectating_clients; // clients in client_lobbies that joined to spectate
+        std::unordered_map<uint32_t, uint32_t> lobby_member_cnt; // lobby_id -> users and spectators routed there
+        // seats are counted here, so joins into a full lobby are refused before the client leaves its current one
+        std::unordered_map<uint32_t, uint16_t> lobby_max_users; // lobby_id -> seats
+        std::unordered_map<uint32_t, uint16_t> lobby_user_cnt; // lobby_id -> seated users routed there
+        std::unordered_set<uint32_t> close_when_empty; // lobbies closed once their last member leaves
+
+        // stats of all pinned lobbies, only locked on lobby create/close and by stats readers, never per event
+        std::mutex stats_m;
+        std::unordered_map<uint32_t, std::shared_ptr<lobby_stats>> stats;
+
+        Lobby* new_lobby(uint32_t lobby_id, uint16_t max_users, bool is_default, bool close_empty);
+        void pin_lobby(Lobby* lobby);
+        void worker_loop(lobby_worker* w);
+        void push_to_lobby(uint32_t lobby_id, event_any* e);
+        std::string journal_path(uint32_t lobby_id);
+
       public:
 
+        static const uint16_t DEFAULT_LOBBY_MAX_USERS = 8;
+
+        struct lobby_member {
+            uint32_t client_id;
+            uint32_t lobby_id;
+            bool spectate;
+            uint8_t seat; // slot + 1, 0 for spectators
+        };
+
         event_queue* send_queue;
+        uint32_t default_lobby_id = EVENT_LOBBY_NONE; // new clients go here
+        std::string journal_dir = "./journals/"; // one journal file per lobby, empty to disable journaling
+        bool hot_seat = false; // offline only, lone users may move for every player, see Lobby::hot_seat
 
-        LobbyManager();
+        LobbyManager(PluginManager* plugin_mgr, TimeoutCrash* tc);
         ~LobbyManager();
+
+        void start(uint32_t worker_count); // 0 uses one worker per hardware thread
+        void stop(); // fills stopped_members
+        std::vector<lobby_member> stopped_members; // who was where when the workers stopped, a restarted server seats them there again
+
+        // the default lobby replaces the current one for new clients, close_empty lobbies go away with their last member
+        // both flags are journaled so restores keep them
+        uint32_t CreateLobby(uint16_t max_users, bool is_default, bool close_empty);
+        // recreate all lobbies that have a journal in journal_dir by replaying it, returns the number restored
+        uint32_t RestoreLobbies();
+
+        // members get an unload and are out of any lobby afterwards, the journal is removed
+        // closing the default lobby creates a fresh one in its place
+        void CloseLobby(uint32_t lobby_id);
+        // close_empty lobbies nobody came back to after a restore, their members would have left them otherwise
+        void CloseEmptyLobbies();
+
+        bool HasLobby(uint32_t lobby_id);
+        // seat as in event_lobby_join, false if the lobby is unknown or has no free seat, the client then stays where it is
+        bool AddUser(uint32_t client_id, uint32_t lobby_id, bool spectate, uint8_t seat);
+        // load a game with the time control into the lobby on behalf of the server, e.g. for a matched seek
+        void StartGame(uint32_t lobby_id, const char* base_name, const char* variant_name, const char* impl_name, const char* options, uint32_t initial_ms, uint32_t increment_ms, uint32_t delay_ms);
+        void RemoveUser(uint32_t client_id);
+        bool InRunningMatch(uint32_t client_id); // seated in a close_empty lobby whose game did not end yet
+
+        // route an event to the lobby in its lobby_id, or the lobby of its client if none is set
+        void HandleEvent(event_any* e);
+
+        // threadsafe, for monitoring
+        void GetLobbyStats(std::vector<std::shared_ptr<lobby_stats>>* out);
+        void GetQueueDepths(std::vector<uint32_t>* out); // inbox depth per worker
     };
 
 } // namespace Control
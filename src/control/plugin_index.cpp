@@ -0,0 +1,241 @@
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mirabel/log.h"
+
+#include "control/plugin_index.hpp"
+
+namespace Control {
+
+    // "MBLPIDX1\t<tag>" once, then per plugin "P\t<file>\t<mtime_ns>\t<size>" followed by its "R\t<kind>\t<game>\t<variant>\t<name>\t<major>\t<minor>\t<patch>" lines
+    // and for frontends the "C\t<frontend>\t<game>\t<variant>\t<impl>\t<major>.<minor>.<patch>\t<impl file mtime_ns>:<size>\t<0|1>" lines of the games they were checked against
+    // the impl file stamp is "-" for impls linked into the binary, older "C" lines without the impl stamp are skipped
+    static const char* INDEX_MAGIC = "MBLPIDX1";
+    static const size_t INDEX_MAX_FIELDS = 8;
+
+    static size_t split_fields(char* line, char** fields)
+    {
+        size_t cnt = 0;
+        char* field = line;
+        while (cnt < INDEX_MAX_FIELDS) {
+            fields[cnt++] = field;
+            char* sep = strchr(field, '\t');
+            if (sep == NULL) {
+                break;
+            }
+            *sep = '\0';
+            field = sep + 1;
+        }
+        return cnt;
+    }
+
+    static bool storable(const std::string& str)
+    {
+        return str.find_first_of("\t\n") == std::string::npos;
+    }
+
+    std::string PluginIndex::compat_key(const char* frontend_name, const char* game_name, const char* variant_name, const char* impl_name, const std::string& impl_stamp)
+    {
+        // no stored name contains a tab, so the key splits back up the same way
+        return std::string(frontend_name) + "\t" + game_name + "\t" + variant_name + "\t" + impl_name + "\t" + impl_stamp;
+    }
+
+    bool PluginIndex::impl_stamp(const char* impl_filename, semver impl_version, std::string* stamp) const
+    {
+        char buf[96];
+        if (impl_filename == NULL) {
+            snprintf(buf, sizeof(buf), "%u.%u.%u\t-", impl_version.major, impl_version.minor, impl_version.patch);
+        } else {
+            std::unordered_map<std::string, entry>::const_iterator it = entries.find(impl_filename);
+            if (it == entries.end()) {
+                return false;
+            }
+            snprintf(buf, sizeof(buf), "%u.%u.%u\t%" PRId64 ":%" PRId64, impl_version.major, impl_version.minor, impl_version.patch, it->second.mtime_ns, it->second.size);
+        }
+        *stamp = buf;
+        return true;
+    }
+
+    PluginIndex::PluginIndex():
+        dirty(false)
+    {}
+
+    PluginIndex::~PluginIndex()
+    {}
+
+    void PluginIndex::load(const char* path, const char* tag)
+    {
+        this->path = path;
+        this->tag = tag;
+        entries.clear();
+        dirty = false;
+        FILE* f = fopen(path, "rb");
+        if (f == NULL) {
+            return;
+        }
+        char* line = NULL;
+        size_t line_cap = 0;
+        ssize_t line_len;
+        char* fields[INDEX_MAX_FIELDS];
+        bool valid = false;
+        entry* cur = NULL;
+        while ((line_len = getline(&line, &line_cap, f)) > 0) {
+            if (line[line_len - 1] == '\n') {
+                line[line_len - 1] = '\0';
+            }
+            size_t field_cnt = split_fields(line, fields);
+            if (!valid) {
+                // first line, anything else and the whole index is ignored
+                valid = (field_cnt == 2 && strcmp(fields[0], INDEX_MAGIC) == 0 && strcmp(fields[1], tag) == 0);
+                if (!valid) {
+                    break;
+                }
+            } else if (field_cnt == 4 && strcmp(fields[0], "P") == 0) {
+                cur = &entries[fields[1]];
+                cur->mtime_ns = strtoll(fields[2], NULL, 10);
+                cur->size = strtoll(fields[3], NULL, 10);
+                cur->records.clear();
+                cur->compat.clear();
+            } else if (field_cnt == 8 && strcmp(fields[0], "C") == 0 && cur != NULL) {
+                cur->compat[compat_key(fields[1], fields[2], fields[3], fields[4], std::string(fields[5]) + "\t" + fields[6])] = (strcmp(fields[7], "1") == 0);
+            } else if (field_cnt == 8 && strcmp(fields[0], "R") == 0 && cur != NULL) {
+                unsigned long kind = strtoul(fields[1], NULL, 10);
+                if (kind >= PLUGIN_RECORD_KIND_COUNT) {
+                    continue;
+                }
+                plugin_record rec;
+                rec.kind = (PLUGIN_RECORD_KIND)kind;
+                rec.game_name = fields[2];
+                rec.variant_name = fields[3];
+                rec.name = fields[4];
+                rec.version = semver{
+                    (uint32_t)strtoul(fields[5], NULL, 10),
+                    (uint32_t)strtoul(fields[6], NULL, 10),
+                    (uint32_t)strtoul(fields[7], NULL, 10),
+                };
+                cur->records.push_back(rec);
+            }
+        }
+        free(line);
+        fclose(f);
+        if (!valid) {
+            entries.clear();
+        }
+    }
+
+    bool PluginIndex::save()
+    {
+        if (!dirty || path.size() == 0) {
+            return true;
+        }
+        // unique per writer, engine host processes run their own plugin manager on the same index
+        std::string tmp_path = path + ".XXXXXX";
+        int fd = mkstemp(&tmp_path[0]);
+        FILE* f = NULL;
+        if (fd >= 0) {
+            fchmod(fd, 0644);
+            f = fdopen(fd, "wb");
+            if (f == NULL) {
+                close(fd);
+                remove(tmp_path.c_str());
+            }
+        }
+        if (f == NULL) {
+            mirabel_log("#W plugin index: failed to write\n", NULL);
+            return false;
+        }
+        fprintf(f, "%s\t%s\n", INDEX_MAGIC, tag.c_str());
+        for (std::unordered_map<std::string, entry>::iterator it = entries.begin(); it != entries.end(); it++) {
+            fprintf(f, "P\t%s\t%" PRId64 "\t%" PRId64 "\n", it->first.c_str(), it->second.mtime_ns, it->second.size);
+            for (size_t i = 0; i < it->second.records.size(); i++) {
+                const plugin_record& rec = it->second.records[i];
+                fprintf(f, "R\t%u\t%s\t%s\t%s\t%u\t%u\t%u\n", (unsigned)rec.kind, rec.game_name.c_str(), rec.variant_name.c_str(), rec.name.c_str(), rec.version.major, rec.version.minor, rec.version.patch);
+            }
+            for (std::unordered_map<std::string, bool>::iterator ci = it->second.compat.begin(); ci != it->second.compat.end(); ci++) {
+                fprintf(f, "C\t%s\t%d\n", ci->first.c_str(), ci->second ? 1 : 0);
+            }
+        }
+        bool ok = (ferror(f) == 0);
+        ok = (fclose(f) == 0) && ok;
+        if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+            remove(tmp_path.c_str());
+            mirabel_log("#W plugin index: failed to write\n", NULL);
+            return false;
+        }
+        dirty = false;
+        return true;
+    }
+
+    const std::vector<plugin_record>* PluginIndex::find(const std::string& filename, int64_t mtime_ns, int64_t size) const
+    {
+        std::unordered_map<std::string, entry>::const_iterator it = entries.find(filename);
+        if (it == entries.end() || it->second.mtime_ns != mtime_ns || it->second.size != size) {
+            return NULL;
+        }
+        return &it->second.records;
+    }
+
+    void PluginIndex::set(const std::string& filename, int64_t mtime_ns, int64_t size, const std::vector<plugin_record>& records)
+    {
+        // names the line format can not hold leave the plugin unindexed, it is then just opened on every start
+        bool can_store = storable(filename);
+        for (size_t i = 0; i < records.size() && can_store; i++) {
+            can_store = storable(records[i].game_name) && storable(records[i].variant_name) && storable(records[i].name);
+        }
+        if (!can_store) {
+            erase(filename);
+            return;
+        }
+        entry& e = entries[filename];
+        if (e.mtime_ns != mtime_ns || e.size != size) {
+            e.compat.clear();
+        }
+        e.mtime_ns = mtime_ns;
+        e.size = size;
+        e.records = records;
+        dirty = true;
+    }
+
+    void PluginIndex::erase(const std::string& filename)
+    {
+        if (entries.erase(filename) > 0) {
+            dirty = true;
+        }
+    }
+
+    bool PluginIndex::find_compat(const std::string& filename, const char* frontend_name, const char* game_name, const char* variant_name, const char* impl_name, const char* impl_filename, semver impl_version, bool* compatible) const
+    {
+        std::unordered_map<std::string, entry>::const_iterator it = entries.find(filename);
+        std::string stamp;
+        if (it == entries.end() || !impl_stamp(impl_filename, impl_version, &stamp)) {
+            return false;
+        }
+        std::unordered_map<std::string, bool>::const_iterator ci = it->second.compat.find(compat_key(frontend_name, game_name, variant_name, impl_name, stamp));
+        if (ci == it->second.compat.end()) {
+            return false;
+        }
+        *compatible = ci->second;
+        return true;
+    }
+
+    void PluginIndex::set_compat(const std::string& filename, const char* frontend_name, const char* game_name, const char* variant_name, const char* impl_name, const char* impl_filename, semver impl_version, bool compatible)
+    {
+        std::unordered_map<std::string, entry>::iterator it = entries.find(filename);
+        std::string stamp;
+        if (it == entries.end() || !storable(game_name) || !storable(variant_name) || !storable(impl_name) || !impl_stamp(impl_filename, impl_version, &stamp)) {
+            return;
+        }
+        it->second.compat[compat_key(frontend_name, game_name, variant_name, impl_name, stamp)] = compatible;
+        dirty = true;
+    }
+
+} // namespace Control
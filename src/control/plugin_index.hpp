@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rosalia/semver.h"
+
+namespace Control {
+
+    enum PLUGIN_RECORD_KIND {
+        PLUGIN_RECORD_KIND_GAME_METHODS,
+        PLUGIN_RECORD_KIND_GAME_WRAP,
+        PLUGIN_RECORD_KIND_FRONTEND,
+        PLUGIN_RECORD_KIND_ENGINE_METHODS,
+        PLUGIN_RECORD_KIND_ENGINE_WRAP,
+        PLUGIN_RECORD_KIND_COUNT,
+    };
+
+    // one catalogue entry provided by a plugin, enough to list it without opening the plugin
+    struct plugin_record {
+        PLUGIN_RECORD_KIND kind;
+        std::string game_name; // games only
+        std::string variant_name; // games only
+        std::string name; // impl, frontend or engine name
+        semver version;
+    };
+
+    // on disk index of what the plugins provide, keyed by file name, mtime and size
+    // the tag names the apis of the binary, an index written for other apis is ignored as a whole
+    class PluginIndex {
+      private:
+
+        struct entry {
+            int64_t mtime_ns;
+            int64_t size;
+            std::vector<plugin_record> records;
+            // is_game_compatible verdicts of the frontends in this file, by compat_key, dropped when the file changes
+            std::unordered_map<std::string, bool> compat;
+        };
+
+        static std::string compat_key(const char* frontend_name, const char* game_name, const char* variant_name, const char* impl_name, const std::string& impl_stamp);
+        // impl version and the mtime and size of the file providing it, false if that file is not indexed
+        bool impl_stamp(const char* impl_filename, semver impl_version, std::string* stamp) const;
+
+        std::string path;
+        std::string tag;
+        std::unordered_map<std::string, entry> entries;
+        bool dirty;
+
+      public:
+
+        PluginIndex();
+        ~PluginIndex();
+
+        // a missing, unreadable or foreign index just starts out empty
+        void load(const char* path, const char* tag);
+        // rewrites the file if anything changed, the old one is replaced atomically so concurrent readers never see half an index
+        bool save();
+
+        // NULL if the plugin is not indexed or its file changed since
+        const std::vector<plugin_record>* find(const std::string& filename, int64_t mtime_ns, int64_t size) const;
+        void set(const std::string& filename, int64_t mtime_ns, int64_t size, const std::vector<plugin_record>& records);
+        void erase(const std::string& filename);
+
+        // false if the frontend was never checked against this build of the game impl, or its file is not indexed
+        // impl_filename is the plugin providing the impl, NULL if linked into the binary
+        bool find_compat(const std::string& filename, const char* frontend_name, const char* game_name, const char* variant_name, const char* impl_name, const char* impl_filename, semver impl_version, bool* compatible) const;
+        // only kept for indexed files, until the frontend file changes, a changed game file just never matches again
+        void set_compat(const std::string& filename, const char* frontend_name, const char* game_name, const char* variant_name, const char* impl_name, const char* impl_filename, semver impl_version, bool compatible);
+    };
+
+} // namespace Control
@@ -1,16 +1,37 @@
 #include <algorithm>
+#include <cassert>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <dirent.h>
 #include <dlfcn.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
+#include <sys/inotify.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
 
+#ifndef SERVER
 #include "imgui.h"
+#endif
 #include "surena/engine_plugin.h"
 #include "surena/engine.h"
 #include "surena/game_plugin.h"
 #include "surena/game.h"
+#ifdef SERVER
+#include "surena/games/chess.h"
+#include "surena/games/havannah.h"
+#include "surena/games/tictactoe.h"
+#include "surena/games/tictactoe_ultimate.h"
+#include "surena/games/twixt_pp.h"
+#endif
 
 #include "mirabel/engine_wrap_plugin.h"
 #include "mirabel/engine_wrap.h"
@@ -19,23 +40,52 @@
 #include "mirabel/game_wrap_plugin.h"
 #include "mirabel/game_wrap.h"
 #include "mirabel/log.h"
+#include "control/thread_runtime.hpp"
 #include "engines/engine_catalogue.hpp"
+#ifndef SERVER
 #include "frontends/frontend_catalogue.hpp"
 #include "games/game_catalogue.hpp"
+#endif
 
 #include "control/plugins.hpp"
 
 namespace Control {
 
     static const size_t OPTS_WRAP_STR_SIZE = 512;
+    // a changed plugin file has to be quiet for this long before it is reloaded, build systems write in several steps
+    static const uint32_t RELOAD_SETTLE_MS = 500;
+
+    plugin_image::~plugin_image()
+    {
+        for (size_t i = 0; i < cleanups.size(); i++) {
+            cleanups[i]();
+        }
+        if (dll_handle != NULL) {
+            dlclose(dll_handle);
+        }
+        // may run at exit, after the logs are gone
+        printf("[INFO] plugin closed: %s\n", filename.c_str());
+    }
 
     BaseGameVariantImpl::BaseGameVariantImpl(const game_methods* methods):
+        id(0),
+        variant_id(0),
+        live(true),
+        source(NULL),
+        name(methods != NULL ? methods->impl_name : NULL),
+        version(methods != NULL ? methods->version : semver{0, 0, 0}),
         wrapped(false)
     {
         u.methods = methods;
     }
 
     BaseGameVariantImpl::BaseGameVariantImpl(const game_wrap* wrap):
+        id(0),
+        variant_id(0),
+        live(true),
+        source(NULL),
+        name(wrap != NULL ? wrap->backend->impl_name : NULL),
+        version(wrap != NULL ? wrap->backend->version : semver{0, 0, 0}),
         wrapped(true)
     {
         u.wrap = wrap;
@@ -60,14 +110,22 @@ namespace Control {
         return new_game;
     }
 
+    bool BaseGameVariantImpl::is_open() const
+    {
+        return (wrapped ? u.wrap != NULL : u.methods != NULL);
+    }
+
     const game_methods* BaseGameVariantImpl::get_methods() const
     {
+        if (!is_open()) {
+            return NULL;
+        }
         return (wrapped ? u.wrap->backend : u.methods);
     }
 
     const char* BaseGameVariantImpl::get_name() const
     {
-        return (wrapped ? u.wrap->backend->impl_name : u.methods->impl_name);
+        return name;
     }
 
     void BaseGameVariantImpl::create_opts(void** opts) const
@@ -82,6 +140,7 @@ namespace Control {
 
     void BaseGameVariantImpl::display_opts(void* opts) const
     {
+#ifndef SERVER
         if (wrapped && u.wrap->features.options) {
             u.wrap->opts_display(opts);
         } else {
@@ -91,6 +150,7 @@ namespace Control {
                 ImGui::TextDisabled("<no options>");
             }
         }
+#endif
     }
 
     void BaseGameVariantImpl::destroy_opts(void* opts) const
@@ -113,12 +173,14 @@ namespace Control {
 
     void BaseGameVariantImpl::display_runtime(game* rgame, void* opts) const
     {
+#ifndef SERVER
         if (wrapped && u.wrap->features.runtime) {
             u.wrap->runtime_display(rgame, opts);
         } else {
             //TODO general purpose runtime state
             ImGui::TextDisabled("<no runtime>");
         }
+#endif
     }
 
     void BaseGameVariantImpl::destroy_runtime(void* opts) const
@@ -130,36 +192,41 @@ namespace Control {
         }
     }
 
-    bool operator<(const BaseGameVariantImpl& lhs, const BaseGameVariantImpl& rhs)
-    {
-        return strcmp(lhs.get_name(), rhs.get_name()) < 0;
-    }
-
     BaseGameVariant::BaseGameVariant(const char* name):
+        id(0),
+        game_id(0),
+        live(true),
         name(name)
     {}
 
     BaseGameVariant::~BaseGameVariant()
     {}
 
-    bool operator<(const BaseGameVariant& lhs, const BaseGameVariant& rhs)
+    const char* BaseGameVariant::get_name() const
     {
-        return strcmp(lhs.name.c_str(), rhs.name.c_str()) < 0;
+        return name;
     }
 
     BaseGame::BaseGame(const char* name):
+        id(0),
+        live(true),
         name(name)
     {}
 
     BaseGame::~BaseGame()
     {}
 
-    bool operator<(const BaseGame& lhs, const BaseGame& rhs)
+    const char* BaseGame::get_name() const
     {
-        return strcmp(lhs.name.c_str(), rhs.name.c_str()) < 0;
+        return name;
     }
 
     FrontendImpl::FrontendImpl(const frontend_methods* methods):
+        id(0),
+        live(true),
+        source(NULL),
+        name(methods != NULL ? methods->frontend_name : NULL),
+        version(methods != NULL ? methods->version : semver{0, 0, 0}),
         methods(methods)
     {}
 
@@ -178,9 +245,14 @@ namespace Control {
         return new_fe;
     }
 
+    bool FrontendImpl::is_open() const
+    {
+        return methods != NULL;
+    }
+
     const char* FrontendImpl::get_name() const
     {
-        return methods->frontend_name;
+        return name;
     }
 
     void FrontendImpl::create_opts(void** opts) const
@@ -192,11 +264,13 @@ namespace Control {
 
     void FrontendImpl::display_opts(void* opts) const
     {
+#ifndef SERVER
         if (methods->features.options) {
             methods->opts_display(opts);
         } else {
             ImGui::TextDisabled("<no options>");
         }
+#endif
     }
 
     void FrontendImpl::destroy_opts(void* opts) const
@@ -206,18 +280,23 @@ namespace Control {
         }
     }
 
-    bool operator<(const FrontendImpl& lhs, const FrontendImpl& rhs)
-    {
-        return strcmp(lhs.methods->frontend_name, rhs.methods->frontend_name) < 0;
-    }
-
     EngineImpl::EngineImpl(const engine_methods* methods):
+        id(0),
+        live(true),
+        source(NULL),
+        name(methods != NULL ? methods->engine_name : NULL),
+        version(methods != NULL ? methods->version : semver{0, 0, 0}),
         wrapped(false)
     {
         u.methods = methods;
     }
 
     EngineImpl::EngineImpl(const engine_wrap* wrap):
+        id(0),
+        live(true),
+        source(NULL),
+        name(wrap != NULL ? wrap->backend->engine_name : NULL),
+        version(wrap != NULL ? wrap->backend->version : semver{0, 0, 0}),
         wrapped(true)
     {
         u.wrap = wrap;
@@ -226,14 +305,22 @@ namespace Control {
     EngineImpl::~EngineImpl()
     {}
 
+    bool EngineImpl::is_open() const
+    {
+        return (wrapped ? u.wrap != NULL : u.methods != NULL);
+    }
+
     const engine_methods* EngineImpl::get_methods() const
     {
+        if (!is_open()) {
+            return NULL;
+        }
         return (wrapped ? u.wrap->backend : u.methods);
     }
 
     const char* EngineImpl::get_name() const
     {
-        return (wrapped ? u.wrap->backend->engine_name : u.methods->engine_name);
+        return name;
     }
 
     void EngineImpl::create_opts(void** opts) const
@@ -248,6 +335,7 @@ namespace Control {
 
     void EngineImpl::display_opts(void* opts) const
     {
+#ifndef SERVER
         if (wrapped) {
             u.wrap->opts_display(opts);
         } else {
@@ -257,6 +345,7 @@ namespace Control {
                 ImGui::TextDisabled("<no options>");
             }
         }
+#endif
     }
 
     void EngineImpl::destroy_opts(void* opts) const
@@ -268,18 +357,101 @@ namespace Control {
         }
     }
 
-    bool operator<(const EngineImpl& lhs, const EngineImpl& rhs)
+    // catalogues are small and only change on plugin (un)load, sorted vectors keep the per frame ui iteration contiguous
+    template <typename T>
+    static void insert_by_name(std::vector<uint32_t>& order, const std::vector<T>& entries, uint32_t id)
+    {
+        std::vector<uint32_t>::iterator pos = order.begin();
+        while (pos != order.end() && strcmp(entries[*pos].get_name(), entries[id].get_name()) < 0) {
+            pos++;
+        }
+        order.insert(pos, id);
+    }
+
+    static void erase_id(std::vector<uint32_t>& order, uint32_t id)
+    {
+        order.erase(std::remove(order.begin(), order.end(), id), order.end());
+    }
+
+    static bool from_source(const char* entry_source, const char* source)
+    {
+        return entry_source != NULL && strcmp(entry_source, source) == 0;
+    }
+
+    static bool stat_plugin(const std::string& filename, int64_t* mtime_ns, int64_t* size)
+    {
+        std::string path = "../plugins/" + filename;
+        struct stat file_stat;
+        if (stat(path.c_str(), &file_stat) != 0) {
+            return false;
+        }
+        *mtime_ns = (int64_t)file_stat.st_mtim.tv_sec * 1000000000 + file_stat.st_mtim.tv_nsec;
+        *size = file_stat.st_size;
+        return true;
+    }
+
+    static plugin_record make_record(PLUGIN_RECORD_KIND kind, const char* game_name, const char* variant_name, const char* name, semver version)
     {
-        return strcmp(lhs.get_name(), rhs.get_name()) < 0;
+        plugin_record rec;
+        rec.kind = kind;
+        rec.game_name = game_name != NULL ? game_name : "";
+        rec.variant_name = variant_name != NULL ? variant_name : "";
+        rec.name = name;
+        rec.version = version;
+        return rec;
+    }
+
+    static std::string catalogue_key(const char* base_name, const char* variant_name, const char* impl_name)
+    {
+        std::string key = base_name;
+        if (variant_name != NULL) {
+            key += '.';
+            key += variant_name;
+        }
+        if (impl_name != NULL) {
+            key += '.';
+            key += impl_name;
+        }
+        return key;
     }
 
     PluginManager::PluginManager(bool defaults, bool persist_plugins):
-        persist_plugins(persist_plugins)
+        persist_plugins(persist_plugins),
+        catalogue_generation(0),
+        watch_fd(-1),
+        shadow_cnt(0)
     {
-        if (defaults) {
+        // the invalid/none entries
+        games.emplace_back("");
+        variants.emplace_back("");
+        impls.emplace_back((const game_methods*)NULL);
+        frontends.emplace_back((const frontend_methods*)NULL);
+        engines.emplace_back((const engine_methods*)NULL);
+        games[0].live = false;
+        variants[0].live = false;
+        impls[0].live = false;
+        frontends[0].live = false;
+        engines[0].live = false;
+
+        // server and client catalogue different parts of the same plugins, so they keep separate indices
+        char index_tag[128];
+        sprintf(index_tag, "%lu.%lu.%lu.%lu.%lu", SURENA_GAME_API_VERSION, MIRABEL_GAME_WRAP_API_VERSION, MIRABEL_FRONTEND_API_VERSION, SURENA_ENGINE_API_VERSION, MIRABEL_ENGINE_WRAP_API_VERSION);
+#ifdef SERVER
+        index.load("../plugins/.index_server", index_tag);
+#else
+        index.load("../plugins/.index_client", index_tag);
+#endif
 
-            //TODO server doesnt load default wrappers, instead only loads default methods, what kind of switch for that?
+        if (defaults) {
 
+#ifdef SERVER
+            // server has no gui, so it only uses the plain methods instead of the wrappers
+            add_game_methods(&chess_gbe);
+            add_game_methods(&havannah_gbe);
+            add_game_methods(&tictactoe_ultimate_gbe);
+            add_game_methods(&tictactoe_gbe);
+            add_game_methods(&twixt_pp_gbe);
+#else
             add_game_wrap(&chess_gw);
             add_game_wrap(&havannah_gw);
             add_game_wrap(&tictactoe_ultimate_gw);
@@ -293,6 +465,7 @@ namespace Control {
             add_frontend(&tictactoe_ultimate_fem);
             add_frontend(&tictactoe_fem);
             add_frontend(&twixt_pp_fem);
+#endif
 
             add_engine_methods(&randomengine_ebe);
             add_engine_methods(&uci_wrap_ebe);
@@ -308,6 +481,10 @@ namespace Control {
         for (int i = 0; i < plugins.size(); i++) {
             unload_plugin(i);
         }
+        if (watch_fd >= 0) {
+            close(watch_fd);
+            rmdir(shadow_dir.c_str()); // the copies are unlinked right after opening, so it is empty
+        }
     }
 
     // https://man7.org/linux/man-pages/man0/dirent.h.0p.html
@@ -315,6 +492,7 @@ namespace Control {
     // https://man7.org/linux/man-pages/man7/inode.7.html
     void PluginManager::detect_plugins()
     {
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
         for (int i = plugins.size() - 1; i >= 0; i--) {
             if (plugins[i].loaded == false) {
                 plugins.erase(plugins.begin() + i);
@@ -343,6 +521,7 @@ namespace Control {
                         plugins.push_back(plugin_file{
                             .filename = dp->d_name,
                             .loaded = false,
+                            .load_ms = 0,
                         });
                     }
                 }
@@ -357,22 +536,84 @@ namespace Control {
         closedir(dir);
     }
 
-    void PluginManager::load_plugin(int idx)
+    static bool copy_file(const char* from_path, const char* to_path)
     {
-        if (idx < 0 || idx > plugins.size()) {
-            return;
+        FILE* from = fopen(from_path, "rb");
+        if (from == NULL) {
+            return false;
         }
-        plugin_file& the_plugin = plugins[idx];
+        FILE* to = fopen(to_path, "wb");
+        if (to == NULL) {
+            fclose(from);
+            return false;
+        }
+        bool ok = true;
+        char buf[65536];
+        size_t len;
+        while ((len = fread(buf, 1, sizeof(buf), from)) > 0) {
+            if (fwrite(buf, 1, len, to) != len) {
+                ok = false;
+                break;
+            }
+        }
+        ok = ok && !ferror(from);
+        fclose(from);
+        ok = (fclose(to) == 0) && ok;
+        if (!ok) {
+            unlink(to_path);
+        }
+        return ok;
+    }
+
+    bool PluginManager::open_plugin(plugin_file& the_plugin)
+    {
+        return map_plugin(the_plugin) && init_plugin(the_plugin);
+    }
+
+    bool PluginManager::map_plugin(plugin_file& the_plugin)
+    {
+        std::chrono::steady_clock::time_point open_start = std::chrono::steady_clock::now();
 
         char pluginpath[512]; //TODO will overflow
         sprintf(pluginpath, "../plugins/%s", the_plugin.filename.c_str());
+        // before opening, a file replaced meanwhile just gets indexed with its old stats and is opened again next time
+        if (!stat_plugin(the_plugin.filename, &the_plugin.mtime_ns, &the_plugin.size)) {
+            printf("[ERROR] failed to find plugin %s for loading\n", the_plugin.filename.c_str());
+            return false;
+        }
 
-        void* dll_handle = dlopen(pluginpath, RTLD_LAZY);
+        std::string shadow_path;
+        if (shadow_dir.size() > 0) {
+            // a new name for every version, dlopen hands back the already open library for a known path
+            shadow_path = shadow_dir + "/" + std::to_string(shadow_cnt.fetch_add(1)) + "_" + the_plugin.filename;
+            if (!copy_file(pluginpath, shadow_path.c_str())) {
+                printf("[ERROR] failed to copy plugin %s for loading\n", the_plugin.filename.c_str());
+                return false;
+            }
+        }
+        void* dll_handle = dlopen(shadow_path.size() > 0 ? shadow_path.c_str() : pluginpath, RTLD_LAZY);
+        if (shadow_path.size() > 0) {
+            unlink(shadow_path.c_str()); // stays mapped, nothing left to clean up later
+        }
         if (dll_handle == NULL) {
             const char* err = dlerror();
             printf("[ERROR] failed to load plugin: %s\n", err ? err : "<unknown error>");
-            return;
+            return false;
         }
+        the_plugin.mapped = std::make_shared<plugin_image>();
+        the_plugin.mapped->filename = the_plugin.filename;
+        the_plugin.mapped->dll_handle = dll_handle;
+        the_plugin.load_ms = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - open_start).count() / 1000.0f;
+        return true;
+    }
+
+    bool PluginManager::init_plugin(plugin_file& the_plugin)
+    {
+        std::chrono::steady_clock::time_point init_start = std::chrono::steady_clock::now();
+        // from here on failing closes the plugin again, after cleaning up the parts that were already initialized
+        plugin_ref image = the_plugin.mapped;
+        the_plugin.mapped.reset();
+        void* dll_handle = image->dll_handle;
 
         // clear any remaining provided methods
         // partial abort cases where some provided methods might already be filled are cared for because we just filled the vectors, sets are untouched
@@ -397,19 +638,20 @@ namespace Control {
             void (*init)() = (void (*)())dlsym(dll_handle, "plugin_init_game");
             if (init == NULL) {
                 mirabel_log("#W plugin surena game: \"plugin_init_game\" symbol not found\n", NULL);
-                return;
+                return false;
             }
             init();
             plugin_get_game_methods_t get_methods = (plugin_get_game_methods_t)dlsym(dll_handle, "plugin_get_game_methods");
             if (get_methods == NULL) {
                 mirabel_log("#W plugin surena game: \"plugin_get_game_methods\" symbol not found\n", NULL);
-                return;
+                return false;
             }
             void (*gm_cleanup)() = (void (*)())dlsym(dll_handle, "plugin_cleanup_game");
             if (gm_cleanup == NULL) {
                 mirabel_log("#W plugin surena game: \"plugin_cleanup_game\" symbol not found\n", NULL);
-                return;
+                return false;
             }
+            image->cleanups.push_back(gm_cleanup);
             uint32_t method_cnt;
             get_methods(&method_cnt, NULL);
             if (method_cnt == 0) {
@@ -418,7 +660,7 @@ namespace Control {
             the_plugin.provided_game_methods.resize(method_cnt, NULL);
             get_methods(&method_cnt, &the_plugin.provided_game_methods.front());
             if (method_cnt == 0) {
-                return;
+                return false;
             }
         } while (0);
 
@@ -437,19 +679,20 @@ namespace Control {
             void (*init)() = (void (*)())dlsym(dll_handle, "plugin_init_game_wrap");
             if (init == NULL) {
                 mirabel_log("#W plugin mirabel game wrap: \"plugin_init_game_wrap\" symbol not found\n", NULL);
-                return;
+                return false;
             }
             init();
             plugin_get_game_wrap_methods_t get_methods = (plugin_get_game_wrap_methods_t)dlsym(dll_handle, "plugin_get_game_wrap_methods");
             if (get_methods == NULL) {
                 mirabel_log("#W plugin mirabel game wrap: \"plugin_get_game_wrap_methods\" symbol not found\n", NULL);
-                return;
+                return false;
             }
             void (*gw_cleanup)() = (void (*)())dlsym(dll_handle, "plugin_cleanup_game_wrap");
             if (gw_cleanup == NULL) {
                 mirabel_log("#W plugin mirabel game wrap: \"plugin_cleanup_game_wrap\" symbol not found\n", NULL);
-                return;
+                return false;
             }
+            image->cleanups.push_back(gw_cleanup);
             uint32_t method_cnt;
             get_methods(&method_cnt, NULL);
             if (method_cnt == 0) {
@@ -458,11 +701,12 @@ namespace Control {
             the_plugin.provided_game_wraps.resize(method_cnt, NULL);
             get_methods(&method_cnt, &the_plugin.provided_game_wraps.front());
             if (method_cnt == 0) {
-                return;
+                return false;
             }
         } while (0);
 
-        // load frontend_methods
+        // load frontend_methods, server never displays anything so it skips them
+#ifndef SERVER
         plugin_get_frontend_capi_version_t fe_version = (plugin_get_frontend_capi_version_t)dlsym(dll_handle, "plugin_get_frontend_capi_version");
         do {
             if (fe_version == NULL) {
@@ -477,19 +721,20 @@ namespace Control {
             void (*init)() = (void (*)())dlsym(dll_handle, "plugin_init_frontend");
             if (init == NULL) {
                 mirabel_log("#W plugin mirabel frontend: \"plugin_init_frontend\" symbol not found\n", NULL);
-                return;
+                return false;
             }
             init();
             plugin_get_frontend_methods_t get_methods = (plugin_get_frontend_methods_t)dlsym(dll_handle, "plugin_get_frontend_methods");
             if (get_methods == NULL) {
                 mirabel_log("#W plugin mirabel frontend: \"plugin_get_frontend_methods\" symbol not found\n", NULL);
-                return;
+                return false;
             }
             void (*fe_cleanup)() = (void (*)())dlsym(dll_handle, "plugin_cleanup_frontend");
             if (fe_cleanup == NULL) {
                 mirabel_log("#W plugin mirabel frontend: \"plugin_cleanup_frontend\" symbol not found\n", NULL);
-                return;
+                return false;
             }
+            image->cleanups.push_back(fe_cleanup);
             uint32_t method_cnt;
             get_methods(&method_cnt, NULL);
             if (method_cnt == 0) {
@@ -498,9 +743,10 @@ namespace Control {
             the_plugin.provided_frontends.resize(method_cnt, NULL);
             get_methods(&method_cnt, &the_plugin.provided_frontends.front());
             if (method_cnt == 0) {
-                return;
+                return false;
             }
         } while (0);
+#endif
 
         // load engine_methods
         plugin_get_engine_capi_version_t em_version = (plugin_get_engine_capi_version_t)dlsym(dll_handle, "plugin_get_engine_capi_version");
@@ -517,19 +763,20 @@ namespace Control {
             void (*init)() = (void (*)())dlsym(dll_handle, "plugin_init_engine");
             if (init == NULL) {
                 mirabel_log("#W plugin surena engine: \"plugin_init_engine\" symbol not found\n", NULL);
-                return;
+                return false;
             }
             init();
             plugin_get_engine_methods_t get_methods = (plugin_get_engine_methods_t)dlsym(dll_handle, "plugin_get_engine_methods");
             if (get_methods == NULL) {
                 mirabel_log("#W plugin surena engine: \"plugin_get_engine_methods\" symbol not found\n", NULL);
-                return;
+                return false;
             }
             void (*em_cleanup)() = (void (*)())dlsym(dll_handle, "plugin_cleanup_engine");
             if (em_cleanup == NULL) {
                 mirabel_log("#W plugin surena engine: \"plugin_cleanup_engine\" symbol not found\n", NULL);
-                return;
+                return false;
             }
+            image->cleanups.push_back(em_cleanup);
             uint32_t method_cnt;
             get_methods(&method_cnt, NULL);
             if (method_cnt == 0) {
@@ -538,7 +785,7 @@ namespace Control {
             the_plugin.provided_engine_methods.resize(method_cnt, NULL);
             get_methods(&method_cnt, &the_plugin.provided_engine_methods.front());
             if (method_cnt == 0) {
-                return;
+                return false;
             }
         } while (0);
 
@@ -557,19 +804,20 @@ namespace Control {
             void (*init)() = (void (*)())dlsym(dll_handle, "plugin_init_engine_wrap");
             if (init == NULL) {
                 mirabel_log("#W plugin mirabel engine wrap: \"plugin_init_engine_wrap\" symbol not found\n", NULL);
-                return;
+                return false;
             }
             init();
             plugin_get_engine_wrap_methods_t get_methods = (plugin_get_engine_wrap_methods_t)dlsym(dll_handle, "plugin_get_engine_wrap_methods");
             if (get_methods == NULL) {
                 mirabel_log("#W plugin mirabel engine wrap: \"plugin_get_engine_wrap_methods\" symbol not found\n", NULL);
-                return;
+                return false;
             }
             void (*ew_cleanup)() = (void (*)())dlsym(dll_handle, "plugin_cleanup_engine_wrap");
             if (ew_cleanup == NULL) {
                 mirabel_log("#W plugin mirabel engine wrap: \"plugin_cleanup_engine_wrap\" symbol not found\n", NULL);
-                return;
+                return false;
             }
+            image->cleanups.push_back(ew_cleanup);
             uint32_t method_cnt;
             get_methods(&method_cnt, NULL);
             if (method_cnt == 0) {
@@ -578,213 +826,774 @@ namespace Control {
             the_plugin.provided_engine_wraps.resize(method_cnt, NULL);
             get_methods(&method_cnt, &the_plugin.provided_engine_wraps.front());
             if (method_cnt == 0) {
-                return;
+                return false;
             }
         } while (0);
 
-        the_plugin.dll_handle = dll_handle;
+        the_plugin.records.clear();
+        for (const game_methods* el : the_plugin.provided_game_methods) {
+            the_plugin.records.push_back(make_record(PLUGIN_RECORD_KIND_GAME_METHODS, el->game_name, el->variant_name, el->impl_name, el->version));
+        }
+        for (const game_wrap* el : the_plugin.provided_game_wraps) {
+            the_plugin.records.push_back(make_record(PLUGIN_RECORD_KIND_GAME_WRAP, el->backend->game_name, el->backend->variant_name, el->backend->impl_name, el->backend->version));
+        }
+        for (const frontend_methods* el : the_plugin.provided_frontends) {
+            the_plugin.records.push_back(make_record(PLUGIN_RECORD_KIND_FRONTEND, NULL, NULL, el->frontend_name, el->version));
+        }
+        for (const engine_methods* el : the_plugin.provided_engine_methods) {
+            the_plugin.records.push_back(make_record(PLUGIN_RECORD_KIND_ENGINE_METHODS, NULL, NULL, el->engine_name, el->version));
+        }
+        for (const engine_wrap* el : the_plugin.provided_engine_wraps) {
+            the_plugin.records.push_back(make_record(PLUGIN_RECORD_KIND_ENGINE_WRAP, NULL, NULL, el->backend->engine_name, el->backend->version));
+        }
 
-        // insert provided methods in to the catalogues
-        // if the name exists already then skip it and remove it from the provided list so it doesnt get removed on unloading later on
-        for (int i = the_plugin.provided_game_methods.size() - 1; i >= 0; i--) {
-            if (add_game_methods(the_plugin.provided_game_methods[i]) == false) {
-                the_plugin.provided_game_methods.erase(the_plugin.provided_game_methods.begin() + i);
-            }
+        the_plugin.image = image;
+        the_plugin.load_ms += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - init_start).count() / 1000.0f;
+        return true;
+    }
+
+    void PluginManager::catalogue_plugin(plugin_file& the_plugin)
+    {
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        // insert provided methods in to the catalogues, if the name exists already it is skipped
+        // entries remember their source, so unloading never removes the entry another plugin provided under the same name
+        for (const game_methods* el : the_plugin.provided_game_methods) {
+            add_game_methods(el, the_plugin.image);
         }
-        for (int i = the_plugin.provided_game_wraps.size() - 1; i >= 0; i--) {
-            if (add_game_wrap(the_plugin.provided_game_wraps[i]) == false) {
-                the_plugin.provided_game_wraps.erase(the_plugin.provided_game_wraps.begin() + i);
-            }
+        for (const game_wrap* el : the_plugin.provided_game_wraps) {
+            add_game_wrap(el, the_plugin.image);
         }
-        for (int i = the_plugin.provided_frontends.size() - 1; i >= 0; i--) {
-            if (add_frontend(the_plugin.provided_frontends[i]) == false) {
-                the_plugin.provided_frontends.erase(the_plugin.provided_frontends.begin() + i);
-            }
+        for (const frontend_methods* el : the_plugin.provided_frontends) {
+            add_frontend(el, the_plugin.image);
         }
-        for (int i = the_plugin.provided_engine_methods.size() - 1; i >= 0; i--) {
-            if (add_engine_methods(the_plugin.provided_engine_methods[i]) == false) {
-                the_plugin.provided_engine_methods.erase(the_plugin.provided_engine_methods.begin() + i);
-            }
+        for (const engine_methods* el : the_plugin.provided_engine_methods) {
+            add_engine_methods(el, the_plugin.image);
         }
-        for (int i = the_plugin.provided_engine_wraps.size() - 1; i >= 0; i--) {
-            if (add_engine_wrap(the_plugin.provided_engine_wraps[i]) == false) {
-                the_plugin.provided_engine_wraps.erase(the_plugin.provided_engine_wraps.begin() + i);
-            }
+        for (const engine_wrap* el : the_plugin.provided_engine_wraps) {
+            add_engine_wrap(el, the_plugin.image);
         }
+        index.set(the_plugin.filename, the_plugin.mtime_ns, the_plugin.size, the_plugin.records);
 
         the_plugin.loaded = true;
     }
 
-    void PluginManager::unload_plugin(int idx)
+    bool PluginManager::catalogue_indexed(plugin_file& the_plugin)
     {
-        if (idx < 0 || idx > plugins.size()) {
+        int64_t mtime_ns;
+        int64_t size;
+        if (!stat_plugin(the_plugin.filename, &mtime_ns, &size)) {
+            return false;
+        }
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        const std::vector<plugin_record>* records = index.find(the_plugin.filename, mtime_ns, size);
+        if (records == NULL) {
+            return false;
+        }
+        the_plugin.mtime_ns = mtime_ns;
+        the_plugin.size = size;
+        the_plugin.load_ms = 0;
+        the_plugin.records = *records;
+        // same as a normal load, just without methods, the first one resolved opens the plugin for all of them
+        const char* source = the_plugin.filename.c_str();
+        for (const plugin_record& rec : the_plugin.records) {
+            switch (rec.kind) {
+                case PLUGIN_RECORD_KIND_GAME_METHODS:
+                case PLUGIN_RECORD_KIND_GAME_WRAP: {
+                    BaseGameVariantImpl impl((const game_methods*)NULL);
+                    impl.wrapped = (rec.kind == PLUGIN_RECORD_KIND_GAME_WRAP);
+                    impl.source = source;
+                    impl.name = rec.name.c_str();
+                    impl.version = rec.version;
+                    add_game_impl(rec.game_name.c_str(), rec.variant_name.c_str(), impl);
+                } break;
+                case PLUGIN_RECORD_KIND_FRONTEND: {
+                    FrontendImpl impl((const frontend_methods*)NULL);
+                    impl.source = source;
+                    impl.name = rec.name.c_str();
+                    impl.version = rec.version;
+                    add_frontend_impl(impl);
+                } break;
+                case PLUGIN_RECORD_KIND_ENGINE_METHODS:
+                case PLUGIN_RECORD_KIND_ENGINE_WRAP: {
+                    EngineImpl impl((const engine_methods*)NULL);
+                    impl.wrapped = (rec.kind == PLUGIN_RECORD_KIND_ENGINE_WRAP);
+                    impl.source = source;
+                    impl.name = rec.name.c_str();
+                    impl.version = rec.version;
+                    add_engine(impl);
+                } break;
+                default: {
+                    assert(0);
+                } break;
+            }
+        }
+        the_plugin.loaded = true;
+        return true;
+    }
+
+    void PluginManager::uncatalogue_records(const char* source, const std::vector<plugin_record>& records, bool unopened_only)
+    {
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        for (const plugin_record& rec : records) {
+            switch (rec.kind) {
+                case PLUGIN_RECORD_KIND_GAME_METHODS:
+                case PLUGIN_RECORD_KIND_GAME_WRAP: {
+                    std::unordered_map<std::string, uint32_t>::iterator it = impl_index.find(catalogue_key(rec.game_name.c_str(), rec.variant_name.c_str(), rec.name.c_str()));
+                    if (it != impl_index.end() && from_source(impls[it->second].source, source) && !(unopened_only && impls[it->second].is_open())) {
+                        remove_game_impl(rec.game_name.c_str(), rec.variant_name.c_str(), impls[it->second]);
+                    }
+                } break;
+                case PLUGIN_RECORD_KIND_FRONTEND: {
+                    std::unordered_map<std::string, uint32_t>::iterator it = frontend_index.find(rec.name);
+                    if (it != frontend_index.end() && from_source(frontends[it->second].source, source) && !(unopened_only && frontends[it->second].is_open())) {
+                        remove_frontend_impl(rec.name.c_str());
+                    }
+                } break;
+                case PLUGIN_RECORD_KIND_ENGINE_METHODS:
+                case PLUGIN_RECORD_KIND_ENGINE_WRAP: {
+                    std::unordered_map<std::string, uint32_t>::iterator it = engine_index.find(rec.name);
+                    if (it != engine_index.end() && from_source(engines[it->second].source, source) && !(unopened_only && engines[it->second].is_open())) {
+                        remove_engine(rec.name.c_str());
+                    }
+                } break;
+                default: {
+                    assert(0);
+                } break;
+            }
+        }
+    }
+
+    void PluginManager::open_indexed(const char* source)
+    {
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        int idx = -1;
+        for (int i = 0; i < plugins.size(); i++) {
+            if (plugins[i].loaded && !plugins[i].image && plugins[i].filename == source) {
+                idx = i;
+                break;
+            }
+        }
+        if (idx < 0) {
             return;
         }
         plugin_file& the_plugin = plugins[idx];
-
+        char log_str[512];
+        std::vector<plugin_record> indexed = the_plugin.records;
+        if (!open_plugin(the_plugin)) {
+            // its entries can never be resolved, next time it is opened right away and fails in plain sight
+            snprintf(log_str, sizeof(log_str), "#W plugin failed to open on first use, dropping its entries: %s\n", the_plugin.filename.c_str());
+            mirabel_log(log_str, NULL);
+            index.erase(the_plugin.filename);
+            index.save();
+            unload_plugin(idx);
+            return;
+        }
+        // the indexed entries get their methods in place so their ids stay valid, whatever the index did not know about is added like on a normal load
         for (const game_methods* el : the_plugin.provided_game_methods) {
-            remove_game_methods(el);
+            std::unordered_map<std::string, uint32_t>::iterator it = impl_index.find(catalogue_key(el->game_name, el->variant_name, el->impl_name));
+            if (it == impl_index.end()) {
+                add_game_methods(el, the_plugin.image);
+            } else if (from_source(impls[it->second].source, source) && !impls[it->second].is_open()) {
+                impls[it->second].plugin = the_plugin.image;
+                impls[it->second].version = el->version;
+                impls[it->second].wrapped = false;
+                impls[it->second].u.methods = el;
+            }
         }
         for (const game_wrap* el : the_plugin.provided_game_wraps) {
-            remove_game_wrap(el);
+            std::unordered_map<std::string, uint32_t>::iterator it = impl_index.find(catalogue_key(el->backend->game_name, el->backend->variant_name, el->backend->impl_name));
+            if (it == impl_index.end()) {
+                add_game_wrap(el, the_plugin.image);
+            } else if (from_source(impls[it->second].source, source) && !impls[it->second].is_open()) {
+                impls[it->second].plugin = the_plugin.image;
+                impls[it->second].version = el->backend->version;
+                impls[it->second].wrapped = true;
+                impls[it->second].u.wrap = el;
+            }
         }
         for (const frontend_methods* el : the_plugin.provided_frontends) {
-            remove_frontend(el);
+            std::unordered_map<std::string, uint32_t>::iterator it = frontend_index.find(el->frontend_name);
+            if (it == frontend_index.end()) {
+                add_frontend(el, the_plugin.image);
+            } else if (from_source(frontends[it->second].source, source) && !frontends[it->second].is_open()) {
+                frontends[it->second].plugin = the_plugin.image;
+                frontends[it->second].version = el->version;
+                frontends[it->second].methods = el;
+            }
         }
         for (const engine_methods* el : the_plugin.provided_engine_methods) {
-            remove_engine_methods(el);
+            std::unordered_map<std::string, uint32_t>::iterator it = engine_index.find(el->engine_name);
+            if (it == engine_index.end()) {
+                add_engine_methods(el, the_plugin.image);
+            } else if (from_source(engines[it->second].source, source) && !engines[it->second].is_open()) {
+                engines[it->second].plugin = the_plugin.image;
+                engines[it->second].version = el->version;
+                engines[it->second].wrapped = false;
+                engines[it->second].u.methods = el;
+            }
         }
         for (const engine_wrap* el : the_plugin.provided_engine_wraps) {
-            remove_engine_wrap(el);
+            std::unordered_map<std::string, uint32_t>::iterator it = engine_index.find(el->backend->engine_name);
+            if (it == engine_index.end()) {
+                add_engine_wrap(el, the_plugin.image);
+            } else if (from_source(engines[it->second].source, source) && !engines[it->second].is_open()) {
+                engines[it->second].plugin = the_plugin.image;
+                engines[it->second].version = el->backend->version;
+                engines[it->second].wrapped = true;
+                engines[it->second].u.wrap = el;
+            }
+        }
+        // and what the index listed but the plugin no longer provides is gone
+        uncatalogue_records(source, indexed, true);
+        catalogue_generation++;
+        index.set(the_plugin.filename, the_plugin.mtime_ns, the_plugin.size, the_plugin.records);
+        index.save();
+        snprintf(log_str, sizeof(log_str), "#I plugin opened on first use in %.1fms: %s\n", the_plugin.load_ms, the_plugin.filename.c_str());
+        mirabel_log(log_str, NULL);
+    }
+
+    void PluginManager::load_plugin(int idx)
+    {
+        if (idx < 0 || idx > plugins.size()) {
+            return;
+        }
+        if (catalogue_indexed(plugins[idx])) {
+            return;
+        }
+        if (open_plugin(plugins[idx])) {
+            std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+            catalogue_plugin(plugins[idx]);
+            index.save();
+        }
+    }
+
+    void PluginManager::load_all_plugins()
+    {
+        // unchanged plugins are catalogued from the index right away, only new and changed ones need opening
+        std::vector<int> pending;
+        for (int i = 0; i < plugins.size(); i++) {
+            if (!plugins[i].loaded && !catalogue_indexed(plugins[i])) {
+                pending.push_back(i);
+            }
+        }
+        if (pending.size() == 0) {
+            return;
+        }
+        // dlopen dominates and the plugins are independent of each other, so only that happens concurrently
+        // the init hooks may touch plugin globals or thread locals, they run afterwards on this thread in plugin order
+        // as do the catalogue inserts, so which one of two duplicate methods wins stays the same
+        uint32_t worker_count = std::thread::hardware_concurrency();
+        if (worker_count == 0) {
+            worker_count = 1;
+        }
+        if (worker_count > pending.size()) {
+            worker_count = pending.size();
+        }
+        std::vector<char> opened(pending.size(), false); // not vector<bool>, the workers write neighbouring elements concurrently
+        std::atomic<uint32_t> next_pending(0);
+        std::vector<std::thread> workers;
+        for (uint32_t w = 0; w < worker_count; w++) {
+            workers.push_back(thread_runtime.spawn("plugload" + std::to_string(w), [this, &pending, &opened, &next_pending]() {
+                uint32_t pi = next_pending.fetch_add(1);
+                while (pi < pending.size()) {
+                    opened[pi] = map_plugin(plugins[pending[pi]]);
+                    pi = next_pending.fetch_add(1);
+                }
+            }));
+        }
+        for (uint32_t w = 0; w < worker_count; w++) {
+            workers[w].join();
+        }
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        for (size_t pi = 0; pi < pending.size(); pi++) {
+            if (opened[pi] && init_plugin(plugins[pending[pi]])) {
+                catalogue_plugin(plugins[pending[pi]]);
+            }
+        }
+        index.save();
+    }
+
+    void PluginManager::unload_plugin(int idx)
+    {
+        if (idx < 0 || idx > plugins.size()) {
+            return;
         }
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        plugin_file& the_plugin = plugins[idx];
+
+        uncatalogue_records(the_plugin.filename.c_str(), the_plugin.records, false);
+        the_plugin.records.clear();
         the_plugin.provided_game_methods.clear();
         the_plugin.provided_game_wraps.clear();
         the_plugin.provided_frontends.clear();
         the_plugin.provided_engine_methods.clear();
         the_plugin.provided_engine_wraps.clear();
 
-        void* dll_handle = the_plugin.dll_handle;
+        // plugin cleanup and dlclose happen once the last copy of its entries is gone
+        the_plugin.image.reset();
+
+        the_plugin.loaded = false;
+    }
 
-        void (*gm_cleanup)() = (void (*)())dlsym(dll_handle, "plugin_cleanup_game");
-        if (gm_cleanup != NULL) {
-            gm_cleanup();
+    bool PluginManager::reload_plugin(int idx)
+    {
+        if (idx < 0 || idx >= plugins.size() || !plugins[idx].loaded) {
+            return false;
         }
-        void (*gw_cleanup)() = (void (*)())dlsym(dll_handle, "plugin_cleanup_game_wrap");
-        if (gw_cleanup != NULL) {
-            gw_cleanup();
+        char log_str[512];
+        if (shadow_dir.size() == 0) {
+            // without copies dlopen would just hand back the old version that is still open
+            snprintf(log_str, sizeof(log_str), "#W plugin reload needs a plugin watch: %s\n", plugins[idx].filename.c_str());
+            mirabel_log(log_str, NULL);
+            return false;
         }
-        void (*fe_cleanup)() = (void (*)())dlsym(dll_handle, "plugin_cleanup_frontend");
-        if (fe_cleanup != NULL) {
-            fe_cleanup();
+        plugin_file fresh = plugin_file{
+            .filename = plugins[idx].filename,
+            .loaded = false,
+            .load_ms = 0,
+        };
+        if (!open_plugin(fresh)) {
+            // the old version keeps running, the next change to the file gets another try
+            snprintf(log_str, sizeof(log_str), "#W plugin reload failed, keeping the old version: %s\n", fresh.filename.c_str());
+            mirabel_log(log_str, NULL);
+            return false;
         }
-        void (*em_cleanup)() = (void (*)())dlsym(dll_handle, "plugin_cleanup_engine");
-        if (em_cleanup != NULL) {
-            em_cleanup();
+        // acquiring an impl in between would find neither version
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        unload_plugin(idx);
+        plugins[idx] = fresh;
+        catalogue_plugin(plugins[idx]);
+        index.save();
+        snprintf(log_str, sizeof(log_str), "#I plugin reloaded in %.1fms: %s\n", fresh.load_ms, fresh.filename.c_str());
+        mirabel_log(log_str, NULL);
+        return true;
+    }
+
+    // https://man7.org/linux/man-pages/man7/inotify.7.html
+    bool PluginManager::watch_plugins()
+    {
+        if (watch_fd >= 0) {
+            return true;
         }
-        void (*ew_cleanup)() = (void (*)())dlsym(dll_handle, "plugin_cleanup_engine_wrap");
-        if (ew_cleanup != NULL) {
-            ew_cleanup();
+        // next to the plugins, a tmpfs /tmp is often mounted noexec
+        char shadow_template[] = "../plugins/.shadow_XXXXXX";
+        if (mkdtemp(shadow_template) == NULL) {
+            mirabel_log("#W plugin watch: failed to create the shadow directory\n", NULL);
+            return false;
         }
+        watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watch_fd < 0) {
+            mirabel_log("#W plugin watch: inotify unavailable\n", NULL);
+            rmdir(shadow_template);
+            return false;
+        }
+        // written in place or moved over, either way the file is complete once one of these arrives
+        if (inotify_add_watch(watch_fd, "../plugins/", IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            mirabel_log("#W plugin watch: failed to watch the plugins directory\n", NULL);
+            close(watch_fd);
+            watch_fd = -1;
+            rmdir(shadow_template);
+            return false;
+        }
+        shadow_dir = shadow_template;
+        return true;
+    }
 
-        dlclose(dll_handle);
-
-        the_plugin.loaded = false;
+    void PluginManager::poll_plugins()
+    {
+        if (watch_fd < 0) {
+            return;
+        }
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t len;
+        while ((len = read(watch_fd, buf, sizeof(buf))) > 0) {
+            const struct inotify_event* ev;
+            for (char* ev_ptr = buf; ev_ptr < buf + len; ev_ptr += sizeof(struct inotify_event) + ev->len) {
+                ev = (const struct inotify_event*)ev_ptr;
+                if (ev->len > 0) {
+                    changed_files[ev->name] = now;
+                }
+            }
+        }
+        std::unordered_map<std::string, std::chrono::steady_clock::time_point>::iterator it = changed_files.begin();
+        while (it != changed_files.end()) {
+            if (now - it->second < std::chrono::milliseconds(RELOAD_SETTLE_MS)) {
+                it++;
+                continue;
+            }
+            // plugins that were never loaded are left alone, same for new files, they are picked up by detecting plugins
+            for (int i = 0; i < plugins.size(); i++) {
+                if (plugins[i].loaded && plugins[i].filename == it->first) {
+                    reload_plugin(i);
+                    break;
+                }
+            }
+            it = changed_files.erase(it);
+        }
     }
 
     bool PluginManager::get_game_impl_idx(const char* base_name, const char* variant_name, const char* impl_name, uint32_t* base_idx, uint32_t* variant_idx, uint32_t* impl_idx)
     {
-        std::set<BaseGame>::iterator itrG = game_catalogue.find(base_name);
-        if (itrG == game_catalogue.end()) {
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        std::unordered_map<std::string, uint32_t>::iterator it = impl_index.find(catalogue_key(base_name, variant_name, impl_name));
+        if (it == impl_index.end()) {
             return false;
         }
-        std::set<BaseGameVariant>::iterator itrV = itrG->variants.find(variant_name);
-        if (itrV == itrG->variants.end()) {
+        const BaseGameVariantImpl& impl = impls[it->second];
+        if (base_idx) {
+            *base_idx = variants[impl.variant_id].game_id;
+        }
+        if (variant_idx) {
+            *variant_idx = impl.variant_id;
+        }
+        if (impl_idx) {
+            *impl_idx = impl.id;
+        }
+        return true;
+    }
+
+    bool PluginManager::acquire_game_impl(const char* base_name, const char* variant_name, const char* impl_name, BaseGameVariantImpl* impl)
+    {
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        std::unordered_map<std::string, uint32_t>::iterator it = impl_index.find(catalogue_key(base_name, variant_name, impl_name));
+        if (it == impl_index.end()) {
             return false;
         }
-        for (BaseGameVariantImpl itrI : itrV->impls) {
-            if (strcmp(itrI.get_name(), impl_name) == 0) {
-                if (base_idx) {
-                    *base_idx = itrG->map_idx;
-                }
-                if (variant_idx) {
-                    *variant_idx = itrV->map_idx;
-                }
-                if (impl_idx) {
-                    *impl_idx = itrI.map_idx;
-                }
-                return true;
-            }
+        uint32_t id = it->second;
+        if (!resolve_impl(id)) {
+            return false;
         }
-        return false;
+        *impl = impls[id];
+        return true;
     }
 
-    bool PluginManager::add_game_impl(const char* game_name, const char* variant_name, BaseGameVariantImpl impl)
+    bool PluginManager::resolve_impl(uint32_t id)
     {
-        // insert and record add pairs for game,variant,impl
-        std::pair<std::set<BaseGame>::iterator, bool> ap_g = game_catalogue.emplace(game_name);
-        std::pair<std::set<BaseGameVariant>::iterator, bool> ap_v = ap_g.first->variants.emplace(variant_name);
-        std::pair<std::set<BaseGameVariantImpl>::iterator, bool> ap_i = ap_v.first->impls.insert(impl);
-        if (ap_i.second) {
-            //BUG ? can it ever be that a base game and or variant are created, but we do not insert the final impl?
-            if (ap_g.second) {
-                ap_g.first->map_idx = lookup_idx;
-                game_lookup[lookup_idx++] = ap_g.first;
-            }
-            if (ap_v.second) {
-                ap_v.first->map_idx = lookup_idx;
-                variant_lookup[lookup_idx++] = ap_v.first;
-            }
-            ap_i.first->map_idx = lookup_idx;
-            impl_lookup[lookup_idx++] = ap_i.first;
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        if (has_impl(id) && !impls[id].is_open()) {
+            open_indexed(impls[id].source);
         }
-        return ap_i.second;
+        return has_impl(id) && impls[id].is_open();
     }
 
-    bool PluginManager::add_game_methods(const game_methods* methods)
+    bool PluginManager::resolve_frontend(uint32_t id)
     {
-        return add_game_impl(methods->game_name, methods->variant_name, BaseGameVariantImpl(methods));
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        if (has_frontend(id) && !frontends[id].is_open()) {
+            open_indexed(frontends[id].source);
+        }
+        return has_frontend(id) && frontends[id].is_open();
     }
 
-    bool PluginManager::add_game_wrap(const game_wrap* wrap)
+    bool PluginManager::resolve_engine(uint32_t id)
     {
-        return add_game_impl(wrap->backend->game_name, wrap->backend->variant_name, BaseGameVariantImpl(wrap));
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        if (has_engine(id) && !engines[id].is_open()) {
+            open_indexed(engines[id].source);
+        }
+        return has_engine(id) && engines[id].is_open();
     }
 
-    bool PluginManager::add_frontend(const frontend_methods* methods)
+    bool PluginManager::is_frontend_compatible(uint32_t frontend_id, uint32_t impl_id)
     {
-        std::pair<std::set<FrontendImpl>::iterator, bool> it = frontend_catalogue.emplace(methods);
-        if (it.second) {
-            it.first->map_idx = lookup_idx;
-            frontend_lookup[lookup_idx++] = it.first;
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        if (!has_frontend(frontend_id) || !has_impl(impl_id)) {
+            return false;
+        }
+        // all interned, these stay valid while resolving changes the catalogues
+        const char* fe_source = frontends[frontend_id].source;
+        const char* fe_name = frontends[frontend_id].name;
+        const char* impl_name = impls[impl_id].name;
+        const char* variant_name = variants[impls[impl_id].variant_id].name;
+        const char* game_name = games[variants[impls[impl_id].variant_id].game_id].name;
+        // a rebuilt game plugin may have changed what the frontend checks, so the verdict is per build of the impl
+        const char* impl_source = impls[impl_id].source;
+        semver impl_version = impls[impl_id].version;
+        bool compatible;
+        if (fe_source != NULL && index.find_compat(fe_source, fe_name, game_name, variant_name, impl_name, impl_source, impl_version, &compatible)) {
+            return compatible;
+        }
+        if (!resolve_impl(impl_id) || !resolve_frontend(frontend_id)) {
+            return false;
         }
-        return it.second;
+        compatible = (frontends[frontend_id].methods->is_game_compatible(impls[impl_id].get_methods()) == ERR_OK);
+        // opening may have picked up a newer build than the index knew
+        impl_version = impls[impl_id].version;
+        if (fe_source != NULL) {
+            index.set_compat(fe_source, fe_name, game_name, variant_name, impl_name, impl_source, impl_version, compatible);
+            index.save();
+        }
+        return compatible;
+    }
+
+    PluginManager::CatalogueView::CatalogueView(const PluginManager* mgr):
+        mgr(mgr),
+        lock(mgr->catalogue_m)
+    {}
+
+    uint64_t PluginManager::CatalogueView::generation() const
+    {
+        return mgr->catalogue_generation.load(std::memory_order_relaxed);
+    }
+
+    const std::vector<uint32_t>& PluginManager::CatalogueView::list_games() const
+    {
+        return mgr->game_order;
+    }
+
+    const std::vector<uint32_t>& PluginManager::CatalogueView::list_frontends() const
+    {
+        return mgr->frontend_order;
+    }
+
+    const std::vector<uint32_t>& PluginManager::CatalogueView::list_engines() const
+    {
+        return mgr->engine_order;
+    }
+
+    bool PluginManager::CatalogueView::has_game(uint32_t id) const
+    {
+        return id < mgr->games.size() && mgr->games[id].live;
+    }
+
+    bool PluginManager::CatalogueView::has_variant(uint32_t id) const
+    {
+        return id < mgr->variants.size() && mgr->variants[id].live;
+    }
+
+    bool PluginManager::CatalogueView::has_impl(uint32_t id) const
+    {
+        return id < mgr->impls.size() && mgr->impls[id].live;
+    }
+
+    bool PluginManager::CatalogueView::has_frontend(uint32_t id) const
+    {
+        return id < mgr->frontends.size() && mgr->frontends[id].live;
+    }
+
+    bool PluginManager::CatalogueView::has_engine(uint32_t id) const
+    {
+        return id < mgr->engines.size() && mgr->engines[id].live;
     }
 
-    bool PluginManager::add_engine_methods(const engine_methods* methods)
+    const BaseGame& PluginManager::CatalogueView::get_game(uint32_t id) const
     {
-        std::pair<std::set<EngineImpl>::iterator, bool> it = engine_catalogue.emplace(methods);
-        if (it.second) {
-            it.first->map_idx = lookup_idx;
-            engine_lookup[lookup_idx++] = it.first;
+        return mgr->games[id < mgr->games.size() ? id : 0];
+    }
+
+    const BaseGameVariant& PluginManager::CatalogueView::get_variant(uint32_t id) const
+    {
+        return mgr->variants[id < mgr->variants.size() ? id : 0];
+    }
+
+    const BaseGameVariantImpl& PluginManager::CatalogueView::get_impl(uint32_t id) const
+    {
+        return mgr->impls[id < mgr->impls.size() ? id : 0];
+    }
+
+    const FrontendImpl& PluginManager::CatalogueView::get_frontend(uint32_t id) const
+    {
+        return mgr->frontends[id < mgr->frontends.size() ? id : 0];
+    }
+
+    const EngineImpl& PluginManager::CatalogueView::get_engine(uint32_t id) const
+    {
+        return mgr->engines[id < mgr->engines.size() ? id : 0];
+    }
+
+    PluginManager::CatalogueView PluginManager::view() const
+    {
+        return CatalogueView(this);
+    }
+
+    bool PluginManager::has_game(uint32_t id) const
+    {
+        return view().has_game(id);
+    }
+
+    bool PluginManager::has_variant(uint32_t id) const
+    {
+        return view().has_variant(id);
+    }
+
+    bool PluginManager::has_impl(uint32_t id) const
+    {
+        return view().has_impl(id);
+    }
+
+    bool PluginManager::has_frontend(uint32_t id) const
+    {
+        return view().has_frontend(id);
+    }
+
+    bool PluginManager::has_engine(uint32_t id) const
+    {
+        return view().has_engine(id);
+    }
+
+    uint64_t PluginManager::generation() const
+    {
+        return catalogue_generation.load(std::memory_order_relaxed);
+    }
+
+    const char* PluginManager::intern(const char* name)
+    {
+        return interned_names.emplace(name).first->c_str();
+    }
+
+    bool PluginManager::add_game_impl(const char* game_name, const char* variant_name, BaseGameVariantImpl impl)
+    {
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        impl.name = intern(impl.name);
+        if (impl.source != NULL) {
+            impl.source = intern(impl.source);
         }
-        return it.second;
+        std::string impl_key = catalogue_key(game_name, variant_name, impl.get_name());
+        if (impl_index.find(impl_key) != impl_index.end()) {
+            return false;
+        }
+        // base game and variant are created implicitly with their first impl
+        uint32_t game_id;
+        std::unordered_map<std::string, uint32_t>::iterator it_g = game_index.find(game_name);
+        if (it_g == game_index.end()) {
+            game_id = games.size();
+            games.emplace_back(intern(game_name));
+            games.back().id = game_id;
+            game_index[game_name] = game_id;
+            insert_by_name(game_order, games, game_id);
+        } else {
+            game_id = it_g->second;
+        }
+        uint32_t variant_id;
+        std::string variant_key = catalogue_key(game_name, variant_name, NULL);
+        std::unordered_map<std::string, uint32_t>::iterator it_v = variant_index.find(variant_key);
+        if (it_v == variant_index.end()) {
+            variant_id = variants.size();
+            variants.emplace_back(intern(variant_name));
+            variants.back().id = variant_id;
+            variants.back().game_id = game_id;
+            variant_index[variant_key] = variant_id;
+            insert_by_name(games[game_id].variants, variants, variant_id);
+        } else {
+            variant_id = it_v->second;
+        }
+        impl.id = impls.size();
+        impl.variant_id = variant_id;
+        impl.live = true;
+        impls.push_back(impl);
+        impl_index[impl_key] = impl.id;
+        insert_by_name(variants[variant_id].impls, impls, impl.id);
+        catalogue_generation++;
+        return true;
+    }
+
+    bool PluginManager::add_game_methods(const game_methods* methods, plugin_ref plugin)
+    {
+        BaseGameVariantImpl impl(methods);
+        impl.plugin = plugin;
+        impl.source = plugin ? plugin->filename.c_str() : NULL;
+        return add_game_impl(methods->game_name, methods->variant_name, impl);
+    }
+
+    bool PluginManager::add_game_wrap(const game_wrap* wrap, plugin_ref plugin)
+    {
+        BaseGameVariantImpl impl(wrap);
+        impl.plugin = plugin;
+        impl.source = plugin ? plugin->filename.c_str() : NULL;
+        return add_game_impl(wrap->backend->game_name, wrap->backend->variant_name, impl);
+    }
+
+    bool PluginManager::add_frontend_impl(FrontendImpl impl)
+    {
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        if (frontend_index.find(impl.get_name()) != frontend_index.end()) {
+            return false;
+        }
+        impl.name = intern(impl.name);
+        if (impl.source != NULL) {
+            impl.source = intern(impl.source);
+        }
+        impl.id = frontends.size();
+        impl.live = true;
+        frontends.push_back(impl);
+        frontend_index[impl.get_name()] = impl.id;
+        insert_by_name(frontend_order, frontends, impl.id);
+        catalogue_generation++;
+        return true;
+    }
+
+    bool PluginManager::add_frontend(const frontend_methods* methods, plugin_ref plugin)
+    {
+        FrontendImpl impl(methods);
+        impl.plugin = plugin;
+        impl.source = plugin ? plugin->filename.c_str() : NULL;
+        return add_frontend_impl(impl);
     }
 
-    bool PluginManager::add_engine_wrap(const engine_wrap* wrap)
+    bool PluginManager::add_engine(EngineImpl impl)
     {
-        std::pair<std::set<EngineImpl>::iterator, bool> it = engine_catalogue.emplace(wrap);
-        if (it.second) {
-            it.first->map_idx = lookup_idx;
-            engine_lookup[lookup_idx++] = it.first;
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        if (engine_index.find(impl.get_name()) != engine_index.end()) {
+            return false;
+        }
+        impl.name = intern(impl.name);
+        if (impl.source != NULL) {
+            impl.source = intern(impl.source);
         }
-        return it.second;
+        impl.id = engines.size();
+        impl.live = true;
+        engines.push_back(impl);
+        engine_index[impl.get_name()] = impl.id;
+        insert_by_name(engine_order, engines, impl.id);
+        catalogue_generation++;
+        return true;
+    }
+
+    bool PluginManager::add_engine_methods(const engine_methods* methods, plugin_ref plugin)
+    {
+        EngineImpl impl(methods);
+        impl.plugin = plugin;
+        impl.source = plugin ? plugin->filename.c_str() : NULL;
+        return add_engine(impl);
+    }
+
+    bool PluginManager::add_engine_wrap(const engine_wrap* wrap, plugin_ref plugin)
+    {
+        EngineImpl impl(wrap);
+        impl.plugin = plugin;
+        impl.source = plugin ? plugin->filename.c_str() : NULL;
+        return add_engine(impl);
     }
 
     void PluginManager::remove_game_impl(const char* game_name, const char* variant_name, BaseGameVariantImpl impl)
     {
-        std::set<BaseGame>::iterator itrG = game_catalogue.find(game_name);
-        if (itrG == game_catalogue.end()) {
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        std::unordered_map<std::string, uint32_t>::iterator it = impl_index.find(catalogue_key(game_name, variant_name, impl.get_name()));
+        if (it == impl_index.end()) {
             return;
         }
-        std::set<BaseGameVariant>::iterator itrV = itrG->variants.find(variant_name);
-        if (itrV == itrG->variants.end()) {
+        // kill the impl, chain up to the base game, remove implicit basegame/variant if empty
+        BaseGameVariantImpl& dead_impl = impls[it->second];
+        impl_index.erase(it);
+        dead_impl.live = false;
+        dead_impl.plugin.reset();
+        catalogue_generation++;
+        BaseGameVariant& the_variant = variants[dead_impl.variant_id];
+        erase_id(the_variant.impls, dead_impl.id);
+        if (the_variant.impls.size() > 0) {
             return;
         }
-        std::set<BaseGameVariantImpl>::iterator itrI = itrV->impls.find(impl);
-        if (itrI == itrV->impls.end()) {
+        the_variant.live = false;
+        variant_index.erase(catalogue_key(game_name, variant_name, NULL));
+        BaseGame& the_game = games[the_variant.game_id];
+        erase_id(the_game.variants, the_variant.id);
+        if (the_game.variants.size() > 0) {
             return;
         }
-        // erase from lookup then from parent container, chain up to base game, remove implicit basegame/variant if empty
-        impl_lookup.erase(itrI->map_idx);
-        itrV->impls.erase(impl);
-        if (itrV->impls.size() == 0) {
-            variant_lookup.erase(itrV->map_idx);
-            itrG->variants.erase(itrV);
-        }
-        if (itrG->variants.size() == 0) {
-            game_lookup.erase(itrG->map_idx);
-            game_catalogue.erase(itrG);
-        }
+        the_game.live = false;
+        game_index.erase(game_name);
+        erase_id(game_order, the_game.id);
     }
 
     void PluginManager::remove_game_methods(const game_methods* methods)
@@ -797,31 +1606,45 @@ namespace Control {
         remove_game_impl(wrap->backend->game_name, wrap->backend->variant_name, BaseGameVariantImpl(wrap));
     }
 
+    void PluginManager::remove_frontend_impl(const char* name)
+    {
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        std::unordered_map<std::string, uint32_t>::iterator it = frontend_index.find(name);
+        if (it != frontend_index.end()) {
+            frontends[it->second].live = false;
+            frontends[it->second].plugin.reset();
+            erase_id(frontend_order, it->second);
+            frontend_index.erase(it);
+            catalogue_generation++;
+        }
+    }
+
     void PluginManager::remove_frontend(const frontend_methods* methods)
     {
-        std::set<FrontendImpl>::iterator it = frontend_catalogue.find(methods);
-        if (it != frontend_catalogue.end()) {
-            frontend_lookup.erase(it->map_idx);
-            frontend_catalogue.erase(it);
+        remove_frontend_impl(methods->frontend_name);
+    }
+
+    void PluginManager::remove_engine(const char* name)
+    {
+        std::lock_guard<std::recursive_mutex> lock(catalogue_m);
+        std::unordered_map<std::string, uint32_t>::iterator it = engine_index.find(name);
+        if (it != engine_index.end()) {
+            engines[it->second].live = false;
+            engines[it->second].plugin.reset();
+            erase_id(engine_order, it->second);
+            engine_index.erase(it);
+            catalogue_generation++;
         }
     }
 
     void PluginManager::remove_engine_methods(const engine_methods* methods)
     {
-        std::set<EngineImpl>::iterator it = engine_catalogue.find(methods);
-        if (it != engine_catalogue.end()) {
-            engine_lookup.erase(it->map_idx);
-            engine_catalogue.erase(it);
-        }
+        remove_engine(methods->engine_name);
     }
 
     void PluginManager::remove_engine_wrap(const engine_wrap* wrap)
     {
-        std::set<EngineImpl>::iterator it = engine_catalogue.find(wrap);
-        if (it != engine_catalogue.end()) {
-            engine_lookup.erase(it->map_idx);
-            engine_catalogue.erase(it);
-        }
+        remove_engine(wrap->backend->engine_name);
     }
 
 } // namespace Control
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
-#include <set>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "surena/engine.h"
@@ -12,18 +16,39 @@
 #include "mirabel/engine_wrap.h"
 #include "mirabel/frontend.h"
 #include "mirabel/game_wrap.h"
+#include "control/plugin_index.hpp"
 
 namespace Control {
 
-    //TODO block unloading of plugins while any of the provided methods are in use
-    // e.g. mark plugin as in use? or just the methods in the catalogue?
+    // a dlopened plugin, the plugin is cleaned up and closed once the last reference to it is gone
+    struct plugin_image {
+        std::string filename;
+        void* dll_handle;
+        std::vector<void (*)()> cleanups; // of the plugin parts that were initialized, in init order
+
+        ~plugin_image();
+    };
+
+    // every catalogue entry provided by a plugin holds one of these, so a copy of an entry is a handle that keeps its methods loaded
+    // whatever keeps methods around (running games, frontends, engines, options) holds such a copy, unloading only drops the catalogue's reference
+    typedef std::shared_ptr<plugin_image> plugin_ref;
+
+    // catalogue entries live in flat vectors owned by the plugin manager, an entry is referred to by its id, the index into its vector
+    // dead entries stay behind so their ids are never reused, their methods may already be unloaded, so only the ids and names of dead entries are safe to use
+    // entries catalogued from the plugin index have no methods until their plugin is opened by resolving them, name and version are always there
 
     class BaseGameVariantImpl {
 
       public:
 
-        mutable uint32_t map_idx; //TODO maybe put this in the constructor instead of a mutable member
+        uint32_t id;
+        uint32_t variant_id;
+        bool live;
+        plugin_ref plugin; // empty for methods linked into the binary
+        const char* source; // interned plugin filename, NULL for methods linked into the binary
 
+        const char* name; // interned once catalogued
+        semver version;
         bool wrapped;
 
         union {
@@ -37,6 +62,8 @@ namespace Control {
 
         game* new_game(game_init init_info) const;
 
+        bool is_open() const;
+        // NULL while not open
         const game_methods* get_methods() const;
         const char* get_name() const;
 
@@ -49,68 +76,78 @@ namespace Control {
         void create_runtime(game* rgame, void** opts) const;
         void display_runtime(game* rgame, void* opts) const;
         void destroy_runtime(void* opts) const;
-
-        friend bool operator<(const BaseGameVariantImpl& lhs, const BaseGameVariantImpl& rhs);
     };
 
     class BaseGameVariant {
 
       public:
 
-        mutable uint32_t map_idx; //TODO maybe put this in the constructor instead of a mutable member
+        uint32_t id;
+        uint32_t game_id;
+        bool live;
 
-        std::string name;
-        mutable std::set<BaseGameVariantImpl> impls;
+        const char* name; // interned
+        std::vector<uint32_t> impls; // live impl ids, sorted by name
 
         BaseGameVariant(const char* name);
         ~BaseGameVariant();
 
-        friend bool operator<(const BaseGameVariant& lhs, const BaseGameVariant& rhs);
+        const char* get_name() const;
     };
 
     class BaseGame {
 
       public:
 
-        mutable uint32_t map_idx; //TODO maybe put this in the constructor instead of a mutable member
+        uint32_t id;
+        bool live;
 
-        std::string name;
-        mutable std::set<BaseGameVariant> variants;
+        const char* name; // interned
+        std::vector<uint32_t> variants; // live variant ids, sorted by name
 
         BaseGame(const char* name);
         ~BaseGame();
 
-        friend bool operator<(const BaseGame& lhs, const BaseGame& rhs);
+        const char* get_name() const;
     };
 
     class FrontendImpl {
 
       public:
 
-        mutable uint32_t map_idx; //TODO maybe put this in the constructor instead of a mutable member
+        uint32_t id;
+        bool live;
+        plugin_ref plugin; // empty for methods linked into the binary
+        const char* source; // interned plugin filename, NULL for methods linked into the binary
 
-        const frontend_methods* methods;
+        const char* name; // interned once catalogued
+        semver version;
+        const frontend_methods* methods; // NULL while not open
 
         FrontendImpl(const frontend_methods* methods);
         ~FrontendImpl();
 
         frontend* new_frontend(frontend_display_data* dd, void* load_opts) const;
 
+        bool is_open() const;
         const char* get_name() const;
 
         void create_opts(void** opts) const;
         void display_opts(void* opts) const;
         void destroy_opts(void* opts) const;
-
-        friend bool operator<(const FrontendImpl& lhs, const FrontendImpl& rhs);
     };
 
     class EngineImpl {
 
       public:
 
-        mutable uint32_t map_idx; //TODO maybe put this in the constructor instead of a mutable member
+        uint32_t id;
+        bool live;
+        plugin_ref plugin; // empty for methods linked into the binary
+        const char* source; // interned plugin filename, NULL for methods linked into the binary
 
+        const char* name; // interned once catalogued
+        semver version;
         bool wrapped;
 
         union {
@@ -122,6 +159,8 @@ namespace Control {
         EngineImpl(const engine_wrap* wrap);
         ~EngineImpl();
 
+        bool is_open() const;
+        // NULL while not open
         const engine_methods* get_methods() const;
         const char* get_name() const;
 
@@ -129,8 +168,6 @@ namespace Control {
         void create_opts(void** opts) const;
         void display_opts(void* opts) const;
         void destroy_opts(void* opts) const;
-
-        friend bool operator<(const EngineImpl& lhs, const EngineImpl& rhs);
     };
 
     //TODO the plugin manager now also functions as the catalogue manager, but there is no real use in separating them right now
@@ -142,28 +179,65 @@ namespace Control {
 
         bool persist_plugins;
 
-      public:
-
-        // the server plugins dont contain gui code they just load engine_methods and game_methods, keep both lists and offer two search methods
-        std::set<BaseGame> game_catalogue;
-        std::set<FrontendImpl> frontend_catalogue;
-        std::set<EngineImpl> engine_catalogue;
+        // the set never shrinks, so the pointers handed out stay valid for the life of the manager
+        std::unordered_set<std::string> interned_names;
+
+        // slot 0 of every vector is the invalid/none entry
+        std::vector<BaseGame> games;
+        std::vector<BaseGameVariant> variants;
+        std::vector<BaseGameVariantImpl> impls;
+        std::vector<FrontendImpl> frontends;
+        std::vector<EngineImpl> engines;
+
+        // live ids sorted by name, for the ui
+        std::vector<uint32_t> game_order;
+        std::vector<uint32_t> frontend_order;
+        std::vector<uint32_t> engine_order;
+
+        // live ids by "base", "base.variant" and "base.variant.impl", frontends and engines by their name
+        std::unordered_map<std::string, uint32_t> game_index;
+        std::unordered_map<std::string, uint32_t> variant_index;
+        std::unordered_map<std::string, uint32_t> impl_index;
+        std::unordered_map<std::string, uint32_t> frontend_index;
+        std::unordered_map<std::string, uint32_t> engine_index;
+
+        // catalogue changes, lookups and the getters are serialized by this
+        // recursive so a reload can swap a plugin without the catalogue ever missing its methods in between
+        mutable std::recursive_mutex catalogue_m;
+        // bumped under catalogue_m by every change to the entries or the orders
+        std::atomic<uint64_t> catalogue_generation;
+
+        // plugins directory inotify watch, -1 if not watching
+        int watch_fd;
+        // while watching, plugins are opened from copies in here, rebuilding a plugin never touches a mapped file and every version gets its own handle
+        std::string shadow_dir;
+        std::atomic<uint32_t> shadow_cnt;
+        // changed plugin files by the time of their last change, reloaded once they settled
+        std::unordered_map<std::string, std::chrono::steady_clock::time_point> changed_files;
+
+        // what the plugins provided when they were last opened, unchanged plugins are catalogued from here without opening them
+        PluginIndex index;
+
+        const char* intern(const char* name);
+        bool add_frontend_impl(FrontendImpl impl);
+        void remove_frontend_impl(const char* name);
+        bool add_engine(EngineImpl impl);
+        void remove_engine(const char* name);
 
-        // metagui display comboboxes use this for random access to the set objects
-        uint32_t lookup_idx = 1; // start at 1, 0 is invalid/none
-        //TODO why need iterators here?
-        std::unordered_map<uint32_t, std::set<BaseGame>::iterator> game_lookup;
-        std::unordered_map<uint32_t, std::set<BaseGameVariant>::iterator> variant_lookup;
-        std::unordered_map<uint32_t, std::set<BaseGameVariantImpl>::iterator> impl_lookup;
-        std::unordered_map<uint32_t, std::set<FrontendImpl>::iterator> frontend_lookup;
-        std::unordered_map<uint32_t, std::set<EngineImpl>::iterator> engine_lookup;
+      public:
 
         struct plugin_file {
             std::string filename;
-            bool loaded;
-            void* dll_handle;
-
-            // need to store these here to easily remove them from the catalogues
+            bool loaded; // catalogued, not necessarily open
+            float load_ms; // dlopen, init and method extraction of the last open
+            int64_t mtime_ns; // of the file the records describe
+            int64_t size;
+            plugin_ref image; // only the catalogue's reference, copies of the provided entries may keep an unloaded image open, empty while not open
+            plugin_ref mapped; // dlopened but not initialized yet, between map_plugin and init_plugin
+
+            // everything the plugin provides, from the index or from opening it, unloading removes the entries catalogued from this plugin by these
+            std::vector<plugin_record> records;
+            // filled by opening the plugin
             std::vector<const game_methods*> provided_game_methods;
             std::vector<const game_wrap*> provided_game_wraps;
             std::vector<const frontend_methods*> provided_frontends;
@@ -173,23 +247,109 @@ namespace Control {
 
         std::vector<plugin_file> plugins;
 
+      private:
+
+        // only fills the plugin file, never touches the catalogues
+        bool open_plugin(plugin_file& the_plugin); // map and init
+        bool map_plugin(plugin_file& the_plugin); // just the dlopen, threadsafe for distinct plugins
+        bool init_plugin(plugin_file& the_plugin); // init hooks and method extraction, always on the loading thread
+        void catalogue_plugin(plugin_file& the_plugin);
+        // catalogues the plugin from its index records without opening it, false if the index does not know the current file
+        bool catalogue_indexed(plugin_file& the_plugin);
+        void uncatalogue_records(const char* source, const std::vector<plugin_record>& records, bool unopened_only);
+        // opens an indexed plugin on first use and fills in its entries, drops them if it fails to open
+        void open_indexed(const char* source);
+
+      public:
+
         PluginManager(bool defaults, bool persist_plugins);
         ~PluginManager();
 
         void detect_plugins();
+        // plugins that are unchanged since they were last indexed are only catalogued, they are opened once one of their entries is resolved
         void load_plugin(int idx);
+        // all detected plugins that are not loaded yet, the ones not in the index are opened concurrently and then added to the catalogues in one pass
+        void load_all_plugins();
         void unload_plugin(int idx);
+        // opens the current file of a loaded plugin and swaps it into the catalogues, the old version stays open for as long as anything still uses it
+        // only while watching, every version needs its own shadow copy
+        bool reload_plugin(int idx);
 
+        // start watching the plugins directory, call before loading any plugins so they are all opened from shadow copies
+        bool watch_plugins();
+        // reloads loaded plugins whose files changed and settled since the last call, cheap enough to call every few hundred ms
+        void poll_plugins();
+
+        // one hash lookup, any of the out ids may be NULL
         bool get_game_impl_idx(const char* base_name, const char* variant_name, const char* impl_name, uint32_t* base_idx, uint32_t* variant_idx, uint32_t* impl_idx);
         //TODO get compatible for frontends and engines?
+        // copies the live impl after resolving it, the copy keeps its plugin open, safe to call from any thread
+        bool acquire_game_impl(const char* base_name, const char* variant_name, const char* impl_name, BaseGameVariantImpl* impl);
+
+        // opens the plugin of the entry if it is not open yet, false if the entry is gone or its plugin failed to open
+        // resolving may add and remove entries, so it invalidates views and references like any other catalogue change
+        bool resolve_impl(uint32_t id);
+        bool resolve_frontend(uint32_t id);
+        bool resolve_engine(uint32_t id);
+
+        // is_game_compatible of the frontend for games of the impl, verdicts are kept in the index
+        // so only a frontend never checked against the game is opened, and the game with it
+        bool is_frontend_compatible(uint32_t frontend_id, uint32_t impl_id);
+
+        // holds catalogue_m for as long as it lives, so other threads can not change the catalogue under it
+        // everything it hands out points into the catalogue, no copies, e.g. for one ui frame
+        // resolving through the manager on the same thread still may change the catalogue, compare generations after it
+        class CatalogueView {
+          private:
+
+            const PluginManager* mgr;
+            std::unique_lock<std::recursive_mutex> lock;
+
+          public:
+
+            explicit CatalogueView(const PluginManager* mgr);
+
+            uint64_t generation() const; // the catalogue generation, references from before a change are invalid
+
+            // live ids sorted by name
+            const std::vector<uint32_t>& list_games() const;
+            const std::vector<uint32_t>& list_frontends() const;
+            const std::vector<uint32_t>& list_engines() const;
+
+            // false for 0, dead and unknown ids
+            bool has_game(uint32_t id) const;
+            bool has_variant(uint32_t id) const;
+            bool has_impl(uint32_t id) const;
+            bool has_frontend(uint32_t id) const;
+            bool has_engine(uint32_t id) const;
+
+            // ids stay valid forever, unknown ids get the none entry, impl copies keep their plugin open
+            const BaseGame& get_game(uint32_t id) const;
+            const BaseGameVariant& get_variant(uint32_t id) const;
+            const BaseGameVariantImpl& get_impl(uint32_t id) const;
+            const FrontendImpl& get_frontend(uint32_t id) const;
+            const EngineImpl& get_engine(uint32_t id) const;
+        };
+
+        CatalogueView view() const;
+
+        // false for 0, dead and unknown ids, for single checks without a view
+        bool has_game(uint32_t id) const;
+        bool has_variant(uint32_t id) const;
+        bool has_impl(uint32_t id) const;
+        bool has_frontend(uint32_t id) const;
+        bool has_engine(uint32_t id) const;
+
+        // bumped on every catalogue change, ui state derived from the catalogue only needs refreshing when this moved
+        uint64_t generation() const;
 
         // return true if the impl was added, false if dupe
         bool add_game_impl(const char* game_name, const char* variant_name, BaseGameVariantImpl impl);
-        bool add_game_methods(const game_methods* methods);
-        bool add_game_wrap(const game_wrap* wrap);
-        bool add_frontend(const frontend_methods* methods);
-        bool add_engine_methods(const engine_methods* methods);
-        bool add_engine_wrap(const engine_wrap* wrap);
+        bool add_game_methods(const game_methods* methods, plugin_ref plugin = plugin_ref());
+        bool add_game_wrap(const game_wrap* wrap, plugin_ref plugin = plugin_ref());
+        bool add_frontend(const frontend_methods* methods, plugin_ref plugin = plugin_ref());
+        bool add_engine_methods(const engine_methods* methods, plugin_ref plugin = plugin_ref());
+        bool add_engine_wrap(const engine_wrap* wrap, plugin_ref plugin = plugin_ref());
 
         // does nothing if nonexistant
         void remove_game_impl(const char* game_name, const char* variant_name, BaseGameVariantImpl impl);
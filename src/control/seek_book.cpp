@@ -0,0 +1,216 @@
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "mirabel/event_queue.h"
+#include "mirabel/event.h"
+
+#include "control/seek_book.hpp"
+
+namespace Control {
+
+    SeekBook::SeekBook()
+    {}
+
+    SeekBook::~SeekBook()
+    {
+        invalidate();
+    }
+
+    std::string SeekBook::make_key(const event_seek& req)
+    {
+        // strings can't contain \n in any sensible game name, so it separates the fields unambiguously enough
+        std::string key;
+        key += req.base_name ? req.base_name : "";
+        key += '\n';
+        key += req.variant_name ? req.variant_name : "";
+        key += '\n';
+        key += req.impl_name ? req.impl_name : "";
+        key += '\n';
+        key += req.options ? req.options : "";
+        key += '\n';
+        key += std::to_string(req.initial_ms) + "+" + std::to_string(req.increment_ms) + "/" + std::to_string(req.delay_ms);
+        return key;
+    }
+
+    bool SeekBook::Add(uint32_t client_id, const event_seek& req, seek* match)
+    {
+        if (req.base_name == NULL || req.variant_name == NULL || req.impl_name == NULL) {
+            printf("[WARN] client %u sent seek without game\n", client_id);
+            return false;
+        }
+        std::string key = make_key(req);
+        std::unordered_map<std::string, std::map<uint64_t, uint32_t>>::iterator bucket = buckets.find(key);
+        if (bucket != buckets.end()) {
+            // a client never has two equal seeks, so the oldest one in the bucket is always someone else's
+            std::unordered_map<uint32_t, seek>::iterator best = seeks.find(bucket->second.begin()->second);
+            if (best->second.owner_client_id == client_id) {
+                printf("[WARN] client %u already has an equal seek open\n", client_id);
+                return false;
+            }
+            *match = best->second;
+            erase(best);
+            return true;
+        }
+        std::vector<uint32_t>& own_seeks = client_seeks[client_id];
+        if (own_seeks.size() >= MAX_SEEKS_PER_CLIENT) {
+            printf("[WARN] client %u is at its seek limit\n", client_id);
+            return false;
+        }
+        seek s;
+        s.seek_id = next_seek_id++;
+        s.owner_client_id = client_id;
+        s.seq = next_seq++;
+        s.key = key;
+        s.base_name = req.base_name;
+        s.variant_name = req.variant_name;
+        s.impl_name = req.impl_name;
+        s.options = (req.options ? req.options : "");
+        s.initial_ms = req.initial_ms;
+        s.increment_ms = req.increment_ms;
+        s.delay_ms = req.delay_ms;
+        buckets[key][s.seq] = s.seek_id;
+        own_seeks.push_back(s.seek_id);
+        seeks[s.seek_id] = s;
+        invalidate();
+        event_any es;
+        event_create_seek(&es, EVENT_TYPE_LOBBY_SEEK_ADD, s.seek_id, client_id, req.base_name, req.variant_name, req.impl_name, req.options, req.initial_ms, req.increment_ms, req.delay_ms);
+        broadcast(&es, client_id);
+        event_destroy(&es);
+        return false;
+    }
+
+    void SeekBook::Cancel(uint32_t client_id, uint32_t seek_id)
+    {
+        std::unordered_map<uint32_t, seek>::iterator si = seeks.find(seek_id);
+        if (si == seeks.end()) {
+            return; // matched or cancelled already
+        }
+        if (si->second.owner_client_id != client_id) {
+            printf("[WARN] client %u tried to cancel seek %u of client %u\n", client_id, seek_id, si->second.owner_client_id);
+            return;
+        }
+        erase(si);
+    }
+
+    void SeekBook::Subscribe(uint32_t client_id)
+    {
+        if (!subscribers.insert(client_id).second) {
+            return;
+        }
+        if (seeks.size() == 0) {
+            return;
+        }
+        if (book_buf == NULL) {
+            // oldest first per bucket is not needed by clients, any order will do
+            std::vector<uint8_t> buf;
+            for (std::pair<const uint32_t, seek>& si : seeks) {
+                seek& s = si.second;
+                event_any es;
+                event_create_seek(&es, EVENT_TYPE_LOBBY_SEEK_ADD, s.seek_id, s.owner_client_id, s.base_name.c_str(), s.variant_name.c_str(), s.impl_name.c_str(), s.options.size() > 0 ? s.options.c_str() : NULL, s.initial_ms, s.increment_ms, s.delay_ms);
+                es.base.client_id = EVENT_CLIENT_SERVER;
+                event_serialized* sbuf = event_serialized_create(&es);
+                buf.insert(buf.end(), (uint8_t*)sbuf->data, (uint8_t*)sbuf->data + sbuf->size);
+                event_serialized_unref(sbuf);
+                event_destroy(&es);
+            }
+            book_buf = event_serialized_create_raw(buf.data(), buf.size());
+        }
+        event_any es;
+        event_create_send_serialized(&es, client_id, book_buf);
+        event_queue_push(send_queue, &es);
+    }
+
+    void SeekBook::Unsubscribe(uint32_t client_id)
+    {
+        subscribers.erase(client_id);
+    }
+
+    void SeekBook::CancelAll(uint32_t client_id)
+    {
+        std::unordered_map<uint32_t, std::vector<uint32_t>>::iterator cs = client_seeks.find(client_id);
+        if (cs == client_seeks.end()) {
+            return;
+        }
+        std::vector<uint32_t> own_seeks = cs->second; // erase modifies the original
+        for (uint32_t seek_id : own_seeks) {
+            erase(seeks.find(seek_id));
+        }
+    }
+
+    void SeekBook::RemoveClient(uint32_t client_id)
+    {
+        subscribers.erase(client_id);
+        CancelAll(client_id);
+    }
+
+    uint32_t SeekBook::size()
+    {
+        return seeks.size();
+    }
+
+    void SeekBook::erase(std::unordered_map<uint32_t, seek>::iterator si)
+    {
+        seek& s = si->second;
+        std::unordered_map<std::string, std::map<uint64_t, uint32_t>>::iterator bucket = buckets.find(s.key);
+        bucket->second.erase(s.seq);
+        if (bucket->second.size() == 0) {
+            buckets.erase(bucket);
+        }
+        std::unordered_map<uint32_t, std::vector<uint32_t>>::iterator cs = client_seeks.find(s.owner_client_id);
+        std::vector<uint32_t>& own_seeks = cs->second;
+        for (size_t i = 0; i < own_seeks.size(); i++) {
+            if (own_seeks[i] == s.seek_id) {
+                own_seeks[i] = own_seeks.back();
+                own_seeks.pop_back();
+                break;
+            }
+        }
+        if (own_seeks.size() == 0) {
+            client_seeks.erase(cs);
+        }
+        event_any es;
+        event_create_seek(&es, EVENT_TYPE_LOBBY_SEEK_REMOVE, s.seek_id, s.owner_client_id, NULL, NULL, NULL, NULL, 0, 0, 0);
+        uint32_t owner_client_id = s.owner_client_id;
+        seeks.erase(si);
+        invalidate();
+        broadcast(&es, owner_client_id);
+        event_destroy(&es);
+    }
+
+    void SeekBook::broadcast(event_any* e, uint32_t owner_client_id)
+    {
+        // the owner copy goes out as a plain event, so it arrives with the owners own client id, that is how clients recognize their seeks
+        event_any es;
+        event_copy(&es, e);
+        es.base.client_id = owner_client_id;
+        event_queue_push(send_queue, &es);
+        if (subscribers.size() == 0) {
+            return;
+        }
+        // serialized once, shared by all other subscribers
+        e->base.client_id = EVENT_CLIENT_SERVER;
+        event_serialized* buf = event_serialized_create(e);
+        for (uint32_t client_id : subscribers) {
+            if (client_id == owner_client_id) {
+                continue;
+            }
+            event_create_send_serialized(&es, client_id, buf);
+            event_queue_push(send_queue, &es);
+        }
+        event_serialized_unref(buf);
+    }
+
+    void SeekBook::invalidate()
+    {
+        if (book_buf) {
+            event_serialized_unref(book_buf);
+            book_buf = NULL;
+        }
+    }
+
+} // namespace Control
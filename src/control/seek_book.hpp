@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdbool>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "mirabel/event_queue.h"
+#include "mirabel/event.h"
+
+namespace Control {
+
+    // open seeks, grouped into buckets of identical game and time control, each bucket ordered oldest first
+    // insert and cancel are O(log n) in the bucket, the best match for a new seek is the head of its bucket, found by one hash lookup
+    // all methods are expected to be called from the server main thread only
+    class SeekBook {
+      public:
+
+        static const uint32_t MAX_SEEKS_PER_CLIENT = 8;
+
+        struct seek {
+            uint32_t seek_id;
+            uint32_t owner_client_id;
+            uint64_t seq; // position in the bucket, smaller is older
+            std::string key; // bucket key
+            std::string base_name;
+            std::string variant_name;
+            std::string impl_name;
+            std::string options;
+            uint32_t initial_ms;
+            uint32_t increment_ms;
+            uint32_t delay_ms;
+        };
+
+      private:
+
+        uint32_t next_seek_id = 1;
+        uint64_t next_seq = 1;
+        std::unordered_map<uint32_t, seek> seeks; // seek_id -> seek
+        std::unordered_map<std::string, std::map<uint64_t, uint32_t>> buckets; // key -> seq -> seek_id
+        std::unordered_map<uint32_t, std::vector<uint32_t>> client_seeks; // client_id -> its open seek ids, at most MAX_SEEKS_PER_CLIENT
+        std::unordered_set<uint32_t> subscribers;
+        event_serialized* book_buf = NULL; // all seeks as adds for new subscribers, rebuilt lazily after changes
+
+        static std::string make_key(const event_seek& req);
+        void erase(std::unordered_map<uint32_t, seek>::iterator si); // remove and announce the removal
+        void broadcast(event_any* e, uint32_t owner_client_id); // to all subscribers, the owner always gets it, addressed to itself
+        void invalidate();
+
+      public:
+
+        event_queue* send_queue = NULL;
+
+        SeekBook();
+        ~SeekBook();
+
+        // returns true if the seek of client_id matched an open one of another client, that one is taken out of the book and copied to match
+        // otherwise the seek is added (unless the client is at its limit or already has an equal seek) and false is returned
+        bool Add(uint32_t client_id, const event_seek& req, seek* match);
+        void Cancel(uint32_t client_id, uint32_t seek_id);
+        void Subscribe(uint32_t client_id);
+        void Unsubscribe(uint32_t client_id);
+        void CancelAll(uint32_t client_id); // cancels all its seeks, e.g. once it got a match
+        void RemoveClient(uint32_t client_id); // cancels all its seeks and its subscription
+
+        uint32_t size();
+    };
+
+} // namespace Control
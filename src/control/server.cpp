@@ -1,17 +1,20 @@
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <string>
 
 #include <SDL2/SDL.h>
 #include "SDL_net.h"
-#include "rosalia/rand.h"
 #include "rosalia/semver.h"
 #include "surena/game.h"
 
 #include "mirabel/event.h"
+#include "control/admin_socket.hpp"
 #include "control/auth_manager.hpp"
 #include "control/lobby_manager.hpp"
 #include "control/plugins.hpp"
+#include "control/seek_book.hpp"
 #include "control/user_manager.hpp"
 #include "network/network_server.hpp"
 
@@ -22,7 +25,11 @@ namespace Control {
     const semver server_version = semver{0, 1, 1};
 
     Server::Server():
-        plugin_mgr(true, false)
+        plugin_mgr(true, false),
+        lobby_mgr(&plugin_mgr, &t_tc),
+        auth_mgr(&user_mgr, &inbox),
+        admin(this),
+        restart_requested(false)
     {
         event_queue_create(&inbox);
 
@@ -44,6 +51,7 @@ namespace Control {
         }
 
         Network::NetworkServer* net_server = new Network::NetworkServer();
+        net_server->metrics = &metrics;
         if (!net_server->open(NULL, 61801)) {
             fprintf(stderr, "[FATAL] networkserver failed to open\n");
             exit(1);
@@ -56,14 +64,80 @@ namespace Control {
 
         printf("[INFO] networkserver constructed\n");
 
-        // detect plugins in plugin_mgr and load all
+        // detect plugins in plugin_mgr and load all, rebuilt plugins are swapped in while the server runs
+        plugin_mgr.watch_plugins();
         plugin_mgr.detect_plugins();
-        for (int i = 0; i < plugin_mgr.plugins.size(); i++) {
-            plugin_mgr.load_plugin(i);
-        }
+        plugin_mgr.load_all_plugins();
 
         lobby_mgr.send_queue = network_send_queue;
         auth_mgr.send_queue = network_send_queue;
+        seek_book.send_queue = network_send_queue;
+
+        uint32_t user_cnt = user_mgr.load();
+        printf("[INFO] loaded %u user accounts\n", user_cnt);
+        auth_mgr.start(0);
+
+        lobby_mgr.start(0);
+
+        if (!admin.open()) {
+            printf("[WARN] running without admin socket\n");
+        }
+    }
+
+    Server::Server(Network::NetworkLoopback* loopback):
+        plugin_mgr(true, false),
+        lobby_mgr(&plugin_mgr, &t_tc),
+        auth_mgr(&user_mgr, &inbox),
+        admin(this),
+        restart_requested(false)
+    {
+        event_queue_create(&inbox);
+
+        t_tc.start();
+        tc_info = t_tc.register_timeout_item(&inbox, "offlineserver", 3000, 1000);
+
+        t_loopback = loopback;
+        loopback->server_recv_queue = &inbox;
+        event_any es;
+        event_create_type(&es, EVENT_TYPE_NETWORK_ADAPTER_LOAD);
+        event_queue_push(&inbox, &es);
+
+        plugin_mgr.detect_plugins();
+        plugin_mgr.load_all_plugins();
+
+        // offline lobbies and accounts are not persisted, and one worker each is plenty for a single local user
+        user_mgr.users_path = "";
+        auth_mgr.start(1);
+        lobby_mgr.journal_dir = "";
+        lobby_mgr.hot_seat = true;
+        lobby_mgr.start(1);
+    }
+
+    Server::Server(event_queue* stub_send_queue, uint32_t lobby_workers):
+        plugin_mgr(true, false),
+        lobby_mgr(&plugin_mgr, &t_tc),
+        auth_mgr(&user_mgr, &inbox),
+        admin(this),
+        restart_requested(false)
+    {
+        event_queue_create(&inbox);
+
+        t_tc.start();
+        tc_info = t_tc.register_timeout_item(&inbox, "replayserver", 3000, 1000);
+
+        // there is no adapter, the load only hooks up the stub queue
+        network_send_queue = stub_send_queue;
+        event_any es;
+        event_create_type(&es, EVENT_TYPE_NETWORK_ADAPTER_LOAD);
+        event_queue_push(&inbox, &es);
+
+        plugin_mgr.detect_plugins();
+        plugin_mgr.load_all_plugins();
+
+        user_mgr.users_path = "";
+        auth_mgr.start(0);
+        lobby_mgr.journal_dir = "";
+        lobby_mgr.start(lobby_workers);
     }
 
     Server::~Server()
@@ -71,13 +145,19 @@ namespace Control {
         tc_info.pre_quit(2000);
 
         printf("[INFO] server shutting down\n");
-        delete lobby;
+        admin.close();
+        auth_mgr.stop();
+        lobby_mgr.stop();
+        if (restart_requested.load()) {
+            save_members();
+        }
         if (t_network) {
             t_network->close();
             delete t_network;
+            // only the network server initialized sdl, the offline one shares it with the client
+            SDLNet_Quit();
+            SDL_Quit();
         }
-        SDLNet_Quit();
-        SDL_Quit();
 
         t_tc.unregister_timeout_item(tc_info.id);
         event_any es;
@@ -94,104 +174,211 @@ namespace Control {
         bool quit = false;
         while (!quit) {
             event_queue_pop(&inbox, &e, UINT32_MAX);
+            if (trace.is_open()) {
+                trace.record(&e);
+            }
+            std::chrono::steady_clock::time_point handle_start = std::chrono::steady_clock::now();
             switch (e.base.type) {
                 case EVENT_TYPE_NULL: {
                     printf("[WARN] received impossible null event\n");
                 } break;
                 case EVENT_TYPE_EXIT: {
                     quit = true;
+                    if (restart_requested.load() && t_network != NULL && network_send_queue != NULL) {
+                        // goes out before the network server closes, it drains its send queue on close
+                        printf("[INFO] restarting, clients are told to reconnect\n");
+                        event_any es;
+                        event_create_type(&es, EVENT_TYPE_NETWORK_PROTOCOL_RECONNECT);
+                        event_queue_push(network_send_queue, &es);
+                    }
                     break;
                 } break;
                 case EVENT_TYPE_HEARTBEAT: {
                     tc_info.send_heartbeat();
+                    plugin_mgr.poll_plugins();
+                    if (rejoin_members.size() > 0 && std::chrono::steady_clock::now() > rejoin_deadline) {
+                        expire_rejoins();
+                    }
                 } break;
                 case EVENT_TYPE_NETWORK_ADAPTER_CLIENT_CONNECTED: {
-                    // we only have one lobby for now
-                    if (lobby) {
-                        lobby->AddUser(e.base.client_id);
-                    }
+                    //TODO put new clients into a lobby browser instead of the default lobby
+                    lobby_mgr.AddUser(e.base.client_id, lobby_mgr.default_lobby_id, false, 0);
                 } break;
                 case EVENT_TYPE_NETWORK_ADAPTER_CLIENT_DISCONNECTED: {
-                    // we only have one lobby for now
-                    if (lobby) {
-                        lobby->RemoveUser(e.base.client_id);
+                    lobby_mgr.RemoveUser(e.base.client_id);
+                    seek_book.RemoveClient(e.base.client_id);
+                    user_mgr.release_client(e.base.client_id);
+                    account_clients.erase(e.base.client_id);
+                } break;
+                case EVENT_TYPE_LOBBY_JOIN: {
+                    // clients can't pick their seat
+                    lobby_mgr.AddUser(e.base.client_id, e.base.lobby_id, e.lobby_join.spectate, 0);
+                } break;
+                case EVENT_TYPE_LOBBY_LEAVE: {
+                    lobby_mgr.RemoveUser(e.base.client_id);
+                } break;
+                case EVENT_TYPE_LOBBY_CLOSE: {
+                    // only the admin socket may close lobbies, clients always carry their id
+                    if (e.base.client_id != EVENT_CLIENT_NONE) {
+                        printf("[WARN] client %u tried to close lobby #%u\n", e.base.client_id, e.base.lobby_id);
+                        break;
                     }
+                    lobby_mgr.CloseLobby(e.base.lobby_id);
+                } break;
+                case EVENT_TYPE_LOBBY_SEEK_ADD: {
+                    if (lobby_mgr.InRunningMatch(e.base.client_id)) {
+                        printf("[WARN] client %u sent a seek while playing a match\n", e.base.client_id);
+                        break;
+                    }
+                    SeekBook::seek match;
+                    if (!seek_book.Add(e.base.client_id, e.seek, &match)) {
+                        break;
+                    }
+                    // both players are moved into a fresh lobby, the game load reaches them after their join sync
+                    // owner plays first, the lobby closes once both players and any spectators left
+                    uint32_t lobby_id = lobby_mgr.CreateLobby(2, false, true);
+                    if (lobby_id == EVENT_LOBBY_NONE) {
+                        break;
+                    }
+                    // their other seeks would pull them out of this match once matched, the book announces them as removed
+                    seek_book.CancelAll(match.owner_client_id);
+                    seek_book.CancelAll(e.base.client_id);
+                    lobby_mgr.AddUser(match.owner_client_id, lobby_id, false, 1);
+                    lobby_mgr.AddUser(e.base.client_id, lobby_id, false, 2);
+                    lobby_mgr.StartGame(lobby_id, match.base_name.c_str(), match.variant_name.c_str(), match.impl_name.c_str(), match.options.size() > 0 ? match.options.c_str() : NULL, match.initial_ms, match.increment_ms, match.delay_ms);
+                    printf("[INFO] seek %u of client %u matched by client %u in lobby #%u\n", match.seek_id, match.owner_client_id, e.base.client_id, lobby_id);
+                } break;
+                case EVENT_TYPE_LOBBY_SEEK_REMOVE: {
+                    seek_book.Cancel(e.base.client_id, e.seek.seek_id);
+                } break;
+                case EVENT_TYPE_LOBBY_SEEK_SUBSCRIBE: {
+                    seek_book.Subscribe(e.base.client_id);
+                } break;
+                case EVENT_TYPE_LOBBY_SEEK_UNSUBSCRIBE: {
+                    seek_book.Unsubscribe(e.base.client_id);
                 } break;
                 case EVENT_TYPE_GAME_LOAD:
                 case EVENT_TYPE_GAME_UNLOAD:
                 case EVENT_TYPE_GAME_STATE:
                 case EVENT_TYPE_GAME_MOVE:
+                case EVENT_TYPE_GAME_TIMECTL:
                 case EVENT_TYPE_LOBBY_CHAT_MSG:
                 case EVENT_TYPE_LOBBY_CHAT_DEL: {
-                    // we only have one lobby for now
-                    if (lobby) {
-                        lobby->HandleEvent(e);
-                    }
+                    // routed to the worker owning the lobby, which takes ownership of the event
+                    lobby_mgr.HandleEvent(&e);
                 } break;
                 case EVENT_TYPE_USER_AUTHINFO: {
-                    // client wants to have the authinfo, serve it
+                    // client wants to have the authinfo, serve it, guests and user logins are accepted
                     event_any es;
-                    event_create_auth(&es, EVENT_TYPE_USER_AUTHINFO, e.base.client_id, true, NULL, NULL);
+                    event_create_auth(&es, EVENT_TYPE_USER_AUTHINFO, e.base.client_id, true, "", NULL);
                     event_queue_push(network_send_queue, &es);
                     //TODO it should be *possible* for the server to respond to a authinfo event with a login confirmation
                 } break;
                 case EVENT_TYPE_USER_AUTHN: {
                     event_any es;
                     // client wants to auth with given credentials, send back authn or authfail
-                    //TODO save guest names and check for dupes
-                    if (!e.auth.is_guest) {
-                        event_create_auth_fail(&es, e.base.client_id, "user logins not accepted");
+                    const char* fail_reason = AuthManager::check_username(e.auth.username);
+                    if (fail_reason != NULL) {
+                        event_create_auth_fail(&es, e.base.client_id, fail_reason);
                         event_queue_push(network_send_queue, &es);
                         break;
                     }
-                    if (e.auth.username == NULL) {
-                        event_create_auth_fail(&es, e.base.client_id, "name NULL");
-                        event_queue_push(network_send_queue, &es);
+                    if (!e.auth.is_guest) {
+                        // password hashing happens on the auth workers, the result comes back as an internal auth event
+                        auth_mgr.Authenticate(&e);
                         break;
                     }
-                    // validate that username uses only allowed characters
-                    for (int i = 0; i < strlen(e.auth.username); i++) {
-                        if (!strchr("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_-", e.auth.username[i])) {
-                            event_create_auth_fail(&es, e.base.client_id, "name contains illegal characters");
+                    if (strlen(e.auth.username) == 0) {
+                        std::string guest_name = user_mgr.reserve_guest_name(e.base.client_id);
+                        if (guest_name.size() == 0) {
+                            event_create_auth_fail(&es, e.base.client_id, "no guest name available");
+                            event_queue_push(network_send_queue, &es);
+                            break;
+                        }
+                        free(e.auth.username);
+                        e.auth.username = strdup(guest_name.c_str());
+                    } else {
+                        if (user_mgr.get_user_by_name(e.auth.username) != USER_ID_NONE) {
+                            event_create_auth_fail(&es, e.base.client_id, "name belongs to a registered user");
+                            event_queue_push(network_send_queue, &es);
+                            break;
+                        }
+                        if (!user_mgr.reserve_name(e.auth.username, e.base.client_id)) {
+                            event_create_auth_fail(&es, e.base.client_id, "name already in use");
                             event_queue_push(network_send_queue, &es);
                             break;
                         }
                     }
-                    if (strlen(e.auth.username) > 0 && strlen(e.auth.username) < 3) {
-                        event_create_auth_fail(&es, e.base.client_id, "name < 3 characters");
+                    // guests never get a seat back after a restart, anyone could claim their name
+                    event_create_auth(&es, EVENT_TYPE_USER_AUTHN, e.base.client_id, true, e.auth.username, NULL);
+                    event_queue_push(network_send_queue, &es);
+                } break;
+                case EVENT_TYPE_USER_REGISTER: {
+                    const char* fail_reason = AuthManager::check_username(e.auth.username);
+                    if (fail_reason == NULL && (e.auth.is_guest || strlen(e.auth.username) == 0)) {
+                        fail_reason = "guests can not register";
+                    }
+                    if (fail_reason != NULL) {
+                        event_any es;
+                        event_create_auth_fail(&es, e.base.client_id, fail_reason);
                         event_queue_push(network_send_queue, &es);
                         break;
                     }
-                    if (strlen(e.auth.username) == 0) {
-                        free(e.auth.username);
-                        static uint32_t seed = 123;
-                        fast_prng rng;
-                        fprng_srand(&rng, seed++);
-                        const int assigned_length = 5;
-                        const int guestname_length = 6 + assigned_length;
-                        e.auth.username = (char*)malloc(guestname_length);
-                        char* str_p = e.auth.username;
-                        str_p += sprintf(str_p, "Guest");
-                        for (int i = 0; i < assigned_length; i++) {
-                            str_p += sprintf(str_p, "%d", fprng_rand(&rng) % 10);
-                        }
+                    // hashed on the auth workers like a login, the result is the same internal auth event
+                    auth_mgr.Authenticate(&e);
+                } break;
+                case EVENT_TYPE_USER_INTERNAL_AUTHN: {
+                    event_any es;
+                    if (!user_mgr.reserve_name(e.auth.username, e.base.client_id)) {
+                        event_create_auth_fail(&es, e.base.client_id, "user already logged in");
+                        event_queue_push(network_send_queue, &es);
+                        break;
                     }
-                    event_create_auth(&es, EVENT_TYPE_USER_AUTHN, e.base.client_id, true, e.auth.username, NULL);
+                    printf("[INFO] client %d logged in as %s\n", e.base.client_id, e.auth.username);
+                    event_create_auth(&es, EVENT_TYPE_USER_AUTHN, e.base.client_id, false, e.auth.username, NULL);
+                    event_queue_push(network_send_queue, &es);
+                    account_clients.insert(e.base.client_id);
+                    rejoin(e.base.client_id, e.auth.username);
+                } break;
+                case EVENT_TYPE_USER_INTERNAL_AUTHFAIL: {
+                    event_any es;
+                    event_create_auth_fail(&es, e.base.client_id, e.auth_fail.reason);
                     event_queue_push(network_send_queue, &es);
                 } break;
                 case EVENT_TYPE_USER_AUTHFAIL: {
                     // client wants to logout but keep the connection, we tell them we logged them out
+                    user_mgr.release_client(e.base.client_id);
+                    account_clients.erase(e.base.client_id);
                     event_any es;
                     event_create_auth_fail(&es, e.base.client_id, NULL);
                     event_queue_push(network_send_queue, &es);
                 } break;
                 case EVENT_TYPE_NETWORK_ADAPTER_LOAD: {
-                    if (t_network != NULL) {
-                        network_send_queue = &(t_network->send_queue);
-                        printf("[INFO] networkserver adapter loaded\n");
-                        //TODO creating the lobby here is very ugly
-                        lobby = new Lobby(&plugin_mgr, network_send_queue, 8);
-                        printf("[INFO] lobby created\n");
+                    if (t_network != NULL || t_loopback != NULL || network_send_queue != NULL) {
+                        if (t_network != NULL) {
+                            network_send_queue = &(t_network->send_queue);
+                            printf("[INFO] networkserver adapter loaded\n");
+                        } else if (t_loopback != NULL) {
+                            network_send_queue = &(t_loopback->server_send_queue);
+                            printf("[INFO] loopback adapter loaded\n");
+                        } else {
+                            printf("[INFO] stub adapter loaded\n");
+                        }
+                        lobby_mgr.send_queue = network_send_queue;
+                        auth_mgr.send_queue = network_send_queue;
+                        seek_book.send_queue = network_send_queue;
+                        uint32_t restored = lobby_mgr.RestoreLobbies();
+                        if (restored > 0) {
+                            printf("[INFO] restored %u lobbies from journals\n", restored);
+                        }
+                        load_members();
+                        if (rejoin_members.size() == 0) {
+                            lobby_mgr.CloseEmptyLobbies();
+                        }
+                        //TODO lobbies should be created by users, for now there is always one default lobby
+                        if (lobby_mgr.default_lobby_id == EVENT_LOBBY_NONE) {
+                            lobby_mgr.CreateLobby(LobbyManager::DEFAULT_LOBBY_MAX_USERS, true, false);
+                        }
                     }
                 } break;
                 case EVENT_TYPE_NETWORK_ADAPTER_SOCKET_CLOSED: {
@@ -205,8 +392,94 @@ namespace Control {
                 } break;
             }
             event_destroy(&e);
+            metrics.record_loop(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - handle_start).count());
         }
         printf("[INFO] server exiting main loop\n");
     }
 
+    std::string Server::members_path()
+    {
+        return lobby_mgr.journal_dir + "restart_members";
+    }
+
+    void Server::save_members()
+    {
+        if (lobby_mgr.journal_dir.size() == 0) {
+            return;
+        }
+        FILE* f = fopen(members_path().c_str(), "w");
+        if (f == NULL) {
+            printf("[WARN] could not save lobby members for the restart\n");
+            return;
+        }
+        uint32_t saved = 0;
+        for (const LobbyManager::lobby_member& m : lobby_mgr.stopped_members) {
+            // clients are matched by name after the restart, only password accounts can prove theirs
+            // guests and unnamed clients just land in the default lobby
+            std::string name = user_mgr.get_client_name(m.client_id);
+            if (name.size() == 0 || account_clients.count(m.client_id) == 0) {
+                continue;
+            }
+            fprintf(f, "%s %u %u %u\n", name.c_str(), m.lobby_id, m.spectate ? 1 : 0, m.seat);
+            saved++;
+        }
+        fclose(f);
+        printf("[INFO] saved %u lobby members for the restart\n", saved);
+    }
+
+    void Server::load_members()
+    {
+        if (lobby_mgr.journal_dir.size() == 0) {
+            return;
+        }
+        FILE* f = fopen(members_path().c_str(), "r");
+        if (f == NULL) {
+            return;
+        }
+        char name[256];
+        unsigned lobby_id;
+        unsigned spectate;
+        unsigned seat;
+        while (fscanf(f, "%255s %u %u %u", name, &lobby_id, &spectate, &seat) == 4) {
+            rejoin_members[name] = LobbyManager::lobby_member{EVENT_CLIENT_NONE, lobby_id, spectate != 0, (uint8_t)seat};
+        }
+        fclose(f);
+        // only good for the first start after the restart
+        remove(members_path().c_str());
+        rejoin_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(REJOIN_WINDOW_MS);
+        printf("[INFO] loaded %zu lobby members to rejoin\n", rejoin_members.size());
+    }
+
+    void Server::expire_rejoins()
+    {
+        printf("[INFO] rejoin window over, %zu lobby members did not come back\n", rejoin_members.size());
+        rejoin_members.clear();
+        lobby_mgr.CloseEmptyLobbies();
+    }
+
+    void Server::rejoin(uint32_t client_id, const char* username)
+    {
+        if (rejoin_members.size() == 0) {
+            return;
+        }
+        if (std::chrono::steady_clock::now() > rejoin_deadline) {
+            expire_rejoins();
+            return;
+        }
+        std::unordered_map<std::string, LobbyManager::lobby_member>::iterator it = rejoin_members.find(username);
+        if (it == rejoin_members.end()) {
+            return;
+        }
+        LobbyManager::lobby_member m = it->second;
+        rejoin_members.erase(it);
+        if (!lobby_mgr.HasLobby(m.lobby_id)) {
+            return;
+        }
+        // the client was put into the default lobby on connect, move it back to its old place
+        if (!lobby_mgr.AddUser(client_id, m.lobby_id, m.spectate, m.seat)) {
+            return;
+        }
+        printf("[INFO] client %u rejoined lobby #%u as %s after the restart\n", client_id, m.lobby_id, username);
+    }
+
 } // namespace Control
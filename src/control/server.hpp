@@ -1,16 +1,25 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "rosalia/semver.h"
 
+#include "control/admin_socket.hpp"
 #include "control/auth_manager.hpp"
+#include "control/event_trace.hpp"
 #include "mirabel/event_queue.h"
 #include "control/lobby_manager.hpp"
-#include "control/lobby.hpp"
 #include "control/plugins.hpp"
+#include "control/seek_book.hpp"
+#include "control/server_metrics.hpp"
 #include "control/timeout_crash.hpp"
 #include "control/user_manager.hpp"
+#include "network/network_loopback.hpp"
 #include "network/network_server.hpp"
 
 namespace Control {
@@ -25,21 +34,46 @@ namespace Control {
         TimeoutCrash::timeout_info tc_info;
 
         Network::NetworkServer* t_network = NULL;
+        Network::NetworkLoopback* t_loopback = NULL; // offline only, owned by whoever runs the offline server
         event_queue* network_send_queue = NULL;
 
         event_queue inbox;
 
-        Lobby* lobby = NULL;
-
         PluginManager plugin_mgr;
         LobbyManager lobby_mgr;
         UserManager user_mgr;
         AuthManager auth_mgr;
+        SeekBook seek_book;
+
+        server_metrics metrics; // filled by the network server and the lobbies
+        AdminSocket admin; // network server only
+        // set by the admin socket, on exit the clients are told to reconnect and main re-executes the binary, lobbies come back from their journals
+        std::atomic<bool> restart_requested;
+        EventTrace trace; // if open, every event the loop handles is recorded
+
+        static const uint64_t REJOIN_WINDOW_MS = 60000; // how long after a restart reconnecting users get their old lobby and seat back
+        // username -> where that user was before the restart, loaded from the journal dir on adapter load
+        std::unordered_map<std::string, LobbyManager::lobby_member> rejoin_members;
+        std::chrono::steady_clock::time_point rejoin_deadline;
+        std::unordered_set<uint32_t> account_clients; // clients logged in with a password, only these keep their seat over a restart
 
-        Server(); //TODO this should probably take the argument if offline, i.e. no db, auto create single lobby and give all perms
+        Server();
+        // offline server for a client in the same process, talks only through the loopback, no sdl_net and no journals
+        //TODO offline should also mean no db and all perms for the local user
+        Server(Network::NetworkLoopback* loopback);
+        // replay server, everything it sends goes to stub_send_queue, no sdl_net, no journals and no persisted accounts
+        Server(event_queue* stub_send_queue, uint32_t lobby_workers);
         ~Server();
 
         void loop();
+
+      private:
+
+        std::string members_path();
+        void save_members(); // after lobby_mgr.stop(), for the re-executed server
+        void load_members();
+        void rejoin(uint32_t client_id, const char* username); // moves a freshly authed client back to where it was before the restart
+        void expire_rejoins(); // match lobbies that nobody came back to are closed
     };
 
 } // namespace Control
@@ -0,0 +1,121 @@
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "meta_gui/meta_gui.hpp"
+
+// the server has no metagui, this provides the metagui logging api for it and writes everything to stdout
+// log lines use the same "#I "/"#W "/"#E " prefixes as the gui, they are translated to the servers printf style
+
+namespace MetaGui {
+
+    const uint32_t DEBUG_LOG = 0;
+    const uint32_t LOG_DEFAULT_BUFFER_SIZE = 8192;
+    const std::chrono::steady_clock::time_point LOG_START_TIME = std::chrono::steady_clock::now();
+
+    static std::mutex log_m;
+    static uint32_t next_log_id = DEBUG_LOG + 1;
+    static std::unordered_map<uint32_t, std::string> log_names = {{DEBUG_LOG, ""}};
+
+    static void server_log_write(uint32_t log_id, const char* str, const char* str_end)
+    {
+        if (str_end == NULL) {
+            str_end = str + strlen(str);
+        }
+        const char* level = "[----]";
+        if (str_end - str >= 3 && str[0] == '#' && str[2] == ' ') {
+            switch (str[1]) {
+                case 'I': {
+                    level = "[INFO]";
+                } break;
+                case 'W': {
+                    level = "[WARN]";
+                } break;
+                case 'E': {
+                    level = "[ERROR]";
+                } break;
+            }
+            str += 3;
+        }
+        std::lock_guard<std::mutex> lock(log_m);
+        std::unordered_map<uint32_t, std::string>::iterator name = log_names.find(log_id);
+        if (name == log_names.end()) {
+            return;
+        }
+        if (name->second.size() > 0) {
+            printf("%s %s: %.*s", level, name->second.c_str(), (int)(str_end - str), str);
+        } else {
+            printf("%s %.*s", level, (int)(str_end - str), str);
+        }
+        if (str_end > str && str_end[-1] != '\n') {
+            printf("\n");
+        }
+    }
+
+    void log(const char* str, const char* str_end)
+    {
+        server_log_write(DEBUG_LOG, str, str_end);
+    }
+
+    void logf(const char* fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        logfv(DEBUG_LOG, fmt, args);
+        va_end(args);
+    }
+
+    void log(uint32_t log_id, const char* str, const char* str_end)
+    {
+        server_log_write(log_id, str, str_end);
+    }
+
+    void logf(uint32_t log_id, const char* fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        logfv(log_id, fmt, args);
+        va_end(args);
+    }
+
+    void logfv(uint32_t log_id, const char* fmt, va_list args)
+    {
+        char buf[512];
+        int len = vsnprintf(buf, sizeof(buf), fmt, args);
+        if (len < 0) {
+            return;
+        }
+        server_log_write(log_id, buf, buf + (len < sizeof(buf) ? len : sizeof(buf) - 1));
+    }
+
+    uint32_t log_register(const char* name, std::size_t buffer_size)
+    {
+        log_m.lock();
+        uint32_t log_id = next_log_id++;
+        log_names[log_id] = name;
+        log_m.unlock();
+        return log_id;
+    }
+
+    void log_unregister(uint32_t log_id)
+    {
+        if (log_id == DEBUG_LOG) {
+            return;
+        }
+        log_m.lock();
+        log_names.erase(log_id);
+        log_m.unlock();
+    }
+
+    void log_clear(uint32_t log_id)
+    {
+        // nothing buffered, everything went out already
+    }
+
+} // namespace MetaGui
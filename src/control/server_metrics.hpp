@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "network/protocol.hpp"
+
+namespace Control {
+
+    // counters written from the hot paths, only ever relaxed atomic adds/stores, no locks
+    // readers (the admin socket) get a slightly torn but lock free view, which is fine for monitoring
+
+    struct lobby_stats {
+        uint32_t lobby_id;
+        std::atomic<uint32_t> users;
+        std::atomic<uint32_t> spectators;
+        std::atomic<uint64_t> moves;
+        std::atomic<uint64_t> journal_failures; // appends the journal refused, a restore would miss these
+        std::atomic<bool> game_over; // the last game ended or was unloaded, false until the first one is loaded
+        // time the lobby worker spent applying a move, from pop to done
+        std::atomic<uint64_t> move_latency_us_total;
+        std::atomic<uint64_t> move_latency_us_max;
+        std::atomic<uint64_t> move_latency_us_last;
+
+        lobby_stats(uint32_t lobby_id):
+            lobby_id(lobby_id),
+            users(0),
+            spectators(0),
+            moves(0),
+            journal_failures(0),
+            game_over(false),
+            move_latency_us_total(0),
+            move_latency_us_max(0),
+            move_latency_us_last(0)
+        {}
+
+        void record_move(uint64_t latency_us)
+        {
+            // only the owning lobby worker writes these, so the max needs no cas loop
+            moves.fetch_add(1, std::memory_order_relaxed);
+            move_latency_us_total.fetch_add(latency_us, std::memory_order_relaxed);
+            move_latency_us_last.store(latency_us, std::memory_order_relaxed);
+            if (latency_us > move_latency_us_max.load(std::memory_order_relaxed)) {
+                move_latency_us_max.store(latency_us, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    struct server_metrics {
+        std::atomic<uint64_t> events_in; // received from clients and handed to the server
+        std::atomic<uint64_t> events_out; // written to clients
+        std::atomic<uint64_t> tls_handshakes_started;
+        std::atomic<uint64_t> tls_handshakes_completed;
+        std::atomic<uint64_t> tls_handshakes_failed; // closed before the handshake finished
+        std::atomic<int32_t> clients_by_state[Network::PROTOCOL_CONNECTION_STATE_COUNT];
+        // time the server loop spent handling an event, from pop to done
+        std::atomic<uint64_t> loop_events;
+        std::atomic<uint64_t> loop_us_total;
+        std::atomic<uint64_t> loop_us_max;
+
+        server_metrics():
+            events_in(0),
+            events_out(0),
+            tls_handshakes_started(0),
+            tls_handshakes_completed(0),
+            tls_handshakes_failed(0),
+            loop_events(0),
+            loop_us_total(0),
+            loop_us_max(0)
+        {
+            for (int i = 0; i < Network::PROTOCOL_CONNECTION_STATE_COUNT; i++) {
+                clients_by_state[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        void count(std::atomic<uint64_t>& counter)
+        {
+            counter.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void record_loop(uint64_t us)
+        {
+            // only the server loop writes these
+            loop_events.fetch_add(1, std::memory_order_relaxed);
+            loop_us_total.fetch_add(us, std::memory_order_relaxed);
+            if (us > loop_us_max.load(std::memory_order_relaxed)) {
+                loop_us_max.store(us, std::memory_order_relaxed);
+            }
+        }
+
+        void state_enter(Network::PROTOCOL_CONNECTION_STATE state)
+        {
+            clients_by_state[state].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void state_leave(Network::PROTOCOL_CONNECTION_STATE state)
+        {
+            clients_by_state[state].fetch_sub(1, std::memory_order_relaxed);
+        }
+    };
+
+} // namespace Control
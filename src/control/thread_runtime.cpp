@@ -0,0 +1,181 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "meta_gui/meta_gui.hpp"
+
+#include "control/thread_runtime.hpp"
+
+namespace Control {
+
+    ThreadRuntime thread_runtime;
+
+    static uint64_t clock_ns(clockid_t clock)
+    {
+        timespec ts;
+        if (clock_gettime(clock, &ts) != 0) {
+            return 0;
+        }
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    ThreadRuntime::ThreadRuntime():
+        configured(false),
+        last_sample_ns(clock_ns(CLOCK_MONOTONIC)),
+        last_other_ns(0),
+        exited_cpu_ns(0)
+    {}
+
+    ThreadRuntime::~ThreadRuntime()
+    {
+        // only adopted threads are left by now
+        for (size_t i = 0; i < threads.size(); i++) {
+            delete threads[i];
+        }
+    }
+
+    void ThreadRuntime::parse_affinity(const char* spec)
+    {
+        // rules are "<prefix>=<core>" or "<prefix>=<first>-<last>", separated by commas
+        const char* rule = spec;
+        while (*rule != '\0') {
+            const char* rule_end = strchr(rule, ',');
+            if (rule_end == NULL) {
+                rule_end = rule + strlen(rule);
+            }
+            const char* eq = (const char*)memchr(rule, '=', rule_end - rule);
+            char* num_end;
+            unsigned long first = 0;
+            unsigned long last = 0;
+            bool valid = (eq != NULL && eq > rule);
+            if (valid) {
+                first = strtoul(eq + 1, &num_end, 10);
+                last = first;
+                valid = (num_end > eq + 1);
+                if (valid && *num_end == '-') {
+                    const char* last_start = num_end + 1;
+                    last = strtoul(last_start, &num_end, 10);
+                    valid = (num_end > last_start);
+                }
+                valid = valid && num_end == rule_end && first <= last && last < CPU_SETSIZE;
+            }
+            if (valid) {
+                affinity_rule ar;
+                ar.prefix = std::string(rule, eq - rule);
+                CPU_ZERO(&ar.cpus);
+                for (unsigned long c = first; c <= last; c++) {
+                    CPU_SET(c, &ar.cpus);
+                }
+                affinity.push_back(ar);
+            } else {
+                MetaGui::logf("#W ignoring invalid thread affinity rule: %.*s\n", (int)(rule_end - rule), rule);
+            }
+            rule = (*rule_end == ',') ? rule_end + 1 : rule_end;
+        }
+    }
+
+    ThreadRuntime::thread_entry* ThreadRuntime::enter(const std::string& name)
+    {
+        pthread_t self = pthread_self();
+        // linux limits names to 16 bytes including the terminator, anything longer is rejected, not truncated
+        pthread_setname_np(self, name.substr(0, 15).c_str());
+        thread_entry* entry = new thread_entry();
+        entry->name = name;
+        if (pthread_getcpuclockid(self, &entry->cpu_clock) != 0) {
+            // the per thread clock of the sampler, wrong but harmless, does not happen on linux
+            entry->cpu_clock = CLOCK_THREAD_CPUTIME_ID;
+        }
+        entry->last_cpu_ns = clock_ns(entry->cpu_clock);
+        m.lock();
+        if (!configured) {
+            // not in the constructor, the global runtime is constructed before the logs exist
+            configured = true;
+            const char* spec = getenv("MIRABEL_THREAD_AFFINITY");
+            if (spec != NULL) {
+                parse_affinity(spec);
+            }
+        }
+        for (size_t i = 0; i < affinity.size(); i++) {
+            if (name.compare(0, affinity[i].prefix.size(), affinity[i].prefix) == 0) {
+                if (pthread_setaffinity_np(self, sizeof(cpu_set_t), &affinity[i].cpus) != 0) {
+                    MetaGui::logf("#W failed to set affinity for thread %s\n", name.c_str());
+                }
+                break;
+            }
+        }
+        threads.push_back(entry);
+        m.unlock();
+        return entry;
+    }
+
+    void ThreadRuntime::leave(thread_entry* entry)
+    {
+        // still on the thread itself, so its clock is valid until the entry is gone from the list
+        uint64_t cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+        m.lock();
+        for (size_t i = 0; i < threads.size(); i++) {
+            if (threads[i] == entry) {
+                threads.erase(threads.begin() + i);
+                break;
+            }
+        }
+        exited_cpu_ns += cpu_ns;
+        m.unlock();
+        delete entry;
+    }
+
+    std::thread ThreadRuntime::spawn(const std::string& name, std::function<void()> fn)
+    {
+        return std::thread([this, name, fn]() {
+            thread_entry* entry = enter(name);
+            fn();
+            leave(entry);
+        });
+    }
+
+    void ThreadRuntime::adopt(const std::string& name)
+    {
+        enter(name);
+    }
+
+    void ThreadRuntime::sample(std::vector<thread_sample>* out)
+    {
+        out->clear();
+        uint64_t now_ns = clock_ns(CLOCK_MONOTONIC);
+        m.lock();
+        double elapsed_ns = (double)(now_ns - last_sample_ns);
+        uint64_t registered_ns = exited_cpu_ns;
+        for (size_t i = 0; i < threads.size(); i++) {
+            thread_entry* entry = threads[i];
+            uint64_t cpu_ns = clock_ns(entry->cpu_clock);
+            thread_sample ts;
+            ts.name = entry->name;
+            ts.cpu_ms = cpu_ns / 1000000;
+            ts.cpu_percent = elapsed_ns > 0 && cpu_ns >= entry->last_cpu_ns ? 100 * (cpu_ns - entry->last_cpu_ns) / elapsed_ns : 0;
+            out->push_back(ts);
+            entry->last_cpu_ns = cpu_ns;
+            registered_ns += cpu_ns;
+        }
+        // whatever the process used beyond the registered threads, i.e. library and plugin threads
+        uint64_t process_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+        uint64_t other_ns = process_ns > registered_ns ? process_ns - registered_ns : 0;
+        thread_sample ts;
+        ts.name = "other";
+        ts.cpu_ms = other_ns / 1000000;
+        ts.cpu_percent = elapsed_ns > 0 && other_ns >= last_other_ns ? 100 * (other_ns - last_other_ns) / elapsed_ns : 0;
+        out->push_back(ts);
+        last_other_ns = other_ns;
+        last_sample_ns = now_ns;
+        m.unlock();
+    }
+
+} // namespace Control
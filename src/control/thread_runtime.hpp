@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+namespace Control {
+
+    struct thread_sample {
+        std::string name;
+        uint64_t cpu_ms; // total since the thread started
+        float cpu_percent; // of one core, since the previous sample
+    };
+
+    // every thread of mirabel itself is started through here, so it shows up named in top/perf and can be pinned
+    // names are kept short, the kernel truncates them to 15 characters, workers append their index: "lobby3", "auth0", "netsend"
+    // affinity is read once from the environment, e.g. MIRABEL_THREAD_AFFINITY="lobby=2-5,netsend=1,netrecv=1"
+    //   rules match by name prefix, the first matching rule wins, threads without a rule are left to the scheduler
+    // threads created inside libraries (rosalia job_queue, engine plugins) are not registered, their cpu time is reported as "other"
+    class ThreadRuntime {
+      private:
+
+        struct thread_entry {
+            std::string name;
+            clockid_t cpu_clock;
+            uint64_t last_cpu_ns;
+        };
+
+        struct affinity_rule {
+            std::string prefix;
+            cpu_set_t cpus;
+        };
+
+        std::mutex m;
+        std::vector<thread_entry*> threads;
+        bool configured; // affinity rules are parsed by the first thread that enters
+        std::vector<affinity_rule> affinity;
+        uint64_t last_sample_ns;
+        uint64_t last_other_ns;
+        uint64_t exited_cpu_ns; // accumulated from unregistered threads, so it does not show up as "other"
+
+        void parse_affinity(const char* spec);
+        thread_entry* enter(const std::string& name);
+        void leave(thread_entry* entry);
+
+      public:
+
+        ThreadRuntime();
+        ~ThreadRuntime();
+
+        // start fn on a new thread that is named, pinned and accounted for the whole of its life
+        std::thread spawn(const std::string& name, std::function<void()> fn);
+
+        // name, pin and account the calling thread, for threads not created by spawn, e.g. the main thread
+        // stays registered until the process exits
+        void adopt(const std::string& name);
+
+        // cpu usage of all registered threads, in order of registration, plus one "other" entry for everything else in the process
+        // the percentages are relative to the previous call, so this should be sampled from one place at a steady rate
+        void sample(std::vector<thread_sample>* out);
+    };
+
+    extern ThreadRuntime thread_runtime;
+
+} // namespace Control
@@ -1,23 +1,49 @@
+#include <atomic>
 #include <chrono>
 #include <climits>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <string>
 #include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <ctime>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
 
 #include "meta_gui/meta_gui.hpp"
 
-#include "control/client.hpp"
 #include "mirabel/event_queue.h"
 #include "mirabel/event.h"
+#include "control/thread_runtime.hpp"
 
 #include "control/timeout_crash.hpp"
 
 namespace Control {
 
+    // filled by the stalled thread itself from within the signal handler, backtrace is async signal safe once it has been called before
+    static const int STALL_SIGNAL = SIGUSR2;
+    static const int STALL_FRAMES_MAX = 64;
+    static void* stall_frames[STALL_FRAMES_MAX];
+    static std::atomic<int> stall_frame_count(-1);
+
+    static void stall_signal_handler(int sig)
+    {
+        stall_frame_count.store(backtrace(stall_frames, STALL_FRAMES_MAX));
+    }
+
     void TimeoutCrash::timeout_info::send_heartbeat()
     {
+        if (!thread_bound) {
+            tc->bind_thread(id);
+            thread_bound = true;
+        }
         event_any es;
         event_create_heartbeat(&es, EVENT_TYPE_HEARTBEAT, id, 0);
         event_queue_push(q, &es);
@@ -33,14 +59,17 @@ namespace Control {
     TimeoutCrash::timeout_item::timeout_item():
         id(0),
         name(NULL),
+        thread_bound(false),
         q(NULL),
         quit(false)
     {}
 
-    TimeoutCrash::timeout_item::timeout_item(event_queue* target_queue, uint32_t new_id, const char* new_name, int new_initial_delay, int new_timeout_ms):
+    TimeoutCrash::timeout_item::timeout_item(event_queue* target_queue, uint32_t new_id, const char* new_name, uint64_t new_deadline_ms, int new_timeout_ms):
         id(new_id),
         timeout_ms(new_timeout_ms),
-        last_heartbeat_age(-new_initial_delay),
+        deadline_ms(new_deadline_ms),
+        heap_idx(0),
+        thread_bound(false),
         heartbeat_answered(false),
         q(target_queue),
         quit(false)
@@ -59,32 +88,70 @@ namespace Control {
         event_queue_destroy(&inbox);
     }
 
-    void TimeoutCrash::loop()
+    uint64_t TimeoutCrash::now_ms()
     {
-        bool quit = false;
-        while (!quit) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
 
-            // get the time to sleep until we need to check the earliest heartbeat again
-            m.lock();
-            int heartbeat_deadline = INT_MAX; // in ms as everything here is
-            std::unordered_map<uint32_t, timeout_item>::iterator map_iter = timeout_items.begin();
-            while (map_iter != timeout_items.end()) {
-                timeout_item& tii = map_iter->second;
-                int item_deadline = tii.timeout_ms - tii.last_heartbeat_age;
-                if (item_deadline < heartbeat_deadline) {
-                    heartbeat_deadline = item_deadline;
-                }
-                map_iter++;
+    void TimeoutCrash::heap_swap(uint32_t a, uint32_t b)
+    {
+        std::swap(deadline_heap[a], deadline_heap[b]);
+        timeout_items[deadline_heap[a]].heap_idx = a;
+        timeout_items[deadline_heap[b]].heap_idx = b;
+    }
+
+    void TimeoutCrash::heap_sift(uint32_t idx)
+    {
+        // up
+        while (idx > 0) {
+            uint32_t parent = (idx - 1) / 2;
+            if (timeout_items[deadline_heap[parent]].deadline_ms <= timeout_items[deadline_heap[idx]].deadline_ms) {
+                break;
             }
-            m.unlock();
+            heap_swap(parent, idx);
+            idx = parent;
+        }
+        // down
+        while (true) {
+            uint32_t smallest = idx;
+            uint32_t left = 2 * idx + 1;
+            uint32_t right = left + 1;
+            if (left < deadline_heap.size() && timeout_items[deadline_heap[left]].deadline_ms < timeout_items[deadline_heap[smallest]].deadline_ms) {
+                smallest = left;
+            }
+            if (right < deadline_heap.size() && timeout_items[deadline_heap[right]].deadline_ms < timeout_items[deadline_heap[smallest]].deadline_ms) {
+                smallest = right;
+            }
+            if (smallest == idx) {
+                break;
+            }
+            heap_swap(smallest, idx);
+            idx = smallest;
+        }
+    }
 
-            std::chrono::steady_clock::time_point sleep_start = std::chrono::steady_clock::now();
+    void TimeoutCrash::heap_remove(uint32_t idx)
+    {
+        uint32_t last = deadline_heap.size() - 1;
+        if (idx != last) {
+            heap_swap(idx, last);
+        }
+        deadline_heap.pop_back();
+        if (idx < deadline_heap.size()) {
+            heap_sift(idx);
+        }
+    }
+
+    void TimeoutCrash::loop()
+    {
+        bool quit = false;
+        int heartbeat_wait = INT_MAX; // in ms as everything here is, until the earliest deadline
+        while (!quit) {
             event_any e;
-            event_queue_pop(&inbox, &e, heartbeat_deadline);
-            std::chrono::steady_clock::time_point sleep_stop = std::chrono::steady_clock::now();
-            int real_sleep_time = std::chrono::duration_cast<std::chrono::milliseconds>(sleep_stop - sleep_start).count();
-            // upon wakeup, check for heartbeat responses
+            event_queue_pop(&inbox, &e, heartbeat_wait);
+            // upon wakeup, check for heartbeat responses, only expired deadlines are touched, so this is O(log n) per item due
             m.lock();
+            uint64_t now = now_ms();
             while (e.base.type != EVENT_TYPE_NULL) {
                 // process event e
                 switch (e.base.type) {
@@ -106,12 +173,14 @@ namespace Control {
                     } break;
                     case EVENT_TYPE_HEARTBEAT_PREQUIT: {
                         if (timeout_item_exists(e.heartbeat.id)) {
-                            if (!timeout_items[e.heartbeat.id].quit) {
+                            timeout_item& tii = timeout_items[e.heartbeat.id];
+                            if (!tii.quit) {
                                 // set item to timeout in e.heartbeat.time ms if it isnt unregistered until then
-                                timeout_items[e.heartbeat.id].heartbeat_answered = false;
-                                timeout_items[e.heartbeat.id].last_heartbeat_age = -real_sleep_time;
-                                timeout_items[e.heartbeat.id].timeout_ms = e.heartbeat.time;
-                                timeout_items[e.heartbeat.id].quit = true;
+                                tii.heartbeat_answered = false;
+                                tii.deadline_ms = now + e.heartbeat.time;
+                                tii.timeout_ms = e.heartbeat.time;
+                                tii.quit = true;
+                                heap_sift(tii.heap_idx);
                             } else {
                                 MetaGui::logf("#W timeout_crash: received prequit for prequit timeout item #%d\n", e.heartbeat.id);
                             }
@@ -121,14 +190,11 @@ namespace Control {
                         }
                     } break;
                     case EVENT_TYPE_HEARTBEAT_RESET: {
-                        if (timeout_item_exists(e.heartbeat.id)) {
-                            if (!timeout_items[e.heartbeat.id].quit) {
-                                timeout_items[e.heartbeat.id].last_heartbeat_age -= real_sleep_time;
-                            } else {
-                                MetaGui::logf("#W timeout_crash: received reset for prequit timeout item #%d\n", e.heartbeat.id);
-                            }
-                        } else {
+                        // deadlines are absolute, this only wakes us up to pick up the deadline of a new item
+                        if (!timeout_item_exists(e.heartbeat.id)) {
                             MetaGui::logf("#E timeout_crash: received reset for unknown timeout item #%d\n", e.heartbeat.id);
+                        } else if (timeout_items[e.heartbeat.id].quit) {
+                            MetaGui::logf("#W timeout_crash: received reset for prequit timeout item #%d\n", e.heartbeat.id);
                         }
                     } break;
                     default: {
@@ -137,38 +203,106 @@ namespace Control {
                 }
                 event_queue_pop(&inbox, &e, 0);
             }
-            // add slept time to all heartbeat ages (except new ones), might've woken up earlier than expected
-            map_iter = timeout_items.begin();
-            while (map_iter != timeout_items.end()) {
-                timeout_item& tii = map_iter->second;
-                tii.last_heartbeat_age += real_sleep_time;
-                if (tii.last_heartbeat_age >= tii.timeout_ms) {
-                    // heartbeat deadline
-                    if (tii.heartbeat_answered) {
-                        tii.last_heartbeat_age -= tii.timeout_ms;
-                        tii.heartbeat_answered = false;
-                        event_any es;
-                        event_create_heartbeat(&es, EVENT_TYPE_HEARTBEAT, tii.id, 0);
-                        event_queue_push(tii.q, &es);
+            // handle all items that are due, might've woken up earlier than expected, then nothing is
+            while (deadline_heap.size() > 0 && timeout_items[deadline_heap[0]].deadline_ms <= now) {
+                timeout_item& tii = timeout_items[deadline_heap[0]];
+                if (!tii.heartbeat_answered) {
+                    // if the item has not responded to our heartbeat in timeout ms, quit
+                    if (!tii.quit) {
+                        fprintf(stderr, "[FATAL] timeout item #%d failed to provide heartbeat: %s\n", tii.id, tii.name);
                     } else {
-                        // if the item has not responded to our heartbeat in timeout ms, quit
-                        if (!tii.quit) {
-                            fprintf(stderr, "[FATAL] timeout item #%d failed to provide heartbeat: %s\n", tii.id, tii.name);
-                        } else {
-                            fprintf(stderr, "[FATAL] timeout item #%d failed to unregister in time: %s\n", tii.id, tii.name);
-                        }
-                        exit(1);
+                        fprintf(stderr, "[FATAL] timeout item #%d failed to unregister in time: %s\n", tii.id, tii.name);
                     }
+                    write_crash_report(tii);
+                    exit(1);
+                }
+                // keep the period stable, unless we overslept by more than a whole period
+                tii.deadline_ms += tii.timeout_ms;
+                if (tii.deadline_ms <= now) {
+                    tii.deadline_ms = now + tii.timeout_ms;
                 }
-                map_iter++;
+                tii.heartbeat_answered = false;
+                heap_sift(0);
+                event_any es;
+                event_create_heartbeat(&es, EVENT_TYPE_HEARTBEAT, tii.id, 0);
+                event_queue_push(tii.q, &es);
+            }
+            // sleep until the nearest deadline, the heap top
+            if (deadline_heap.size() > 0) {
+                uint64_t wait = timeout_items[deadline_heap[0]].deadline_ms - now;
+                heartbeat_wait = (wait > INT_MAX ? INT_MAX : (int)wait);
+            } else {
+                heartbeat_wait = INT_MAX;
             }
             m.unlock();
         }
     }
 
+    void TimeoutCrash::write_crash_report(timeout_item& stalled)
+    {
+        // interrupt the stalled thread wherever it is stuck and let it record its own stack
+        int frame_cnt = -1;
+        if (stalled.thread_bound) {
+            stall_frame_count.store(-1);
+            if (pthread_kill(stalled.thread, STALL_SIGNAL) == 0) {
+                for (int i = 0; i < 100; i++) {
+                    frame_cnt = stall_frame_count.load();
+                    if (frame_cnt >= 0) {
+                        break;
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+            }
+        }
+
+        char path[256];
+        snprintf(path, sizeof(path), "%smirabel_crash_%lu_%d.txt", crash_report_dir.c_str(), (unsigned long)time(NULL), (int)getpid());
+        FILE* f = fopen(path, "w");
+        if (f == NULL) {
+            fprintf(stderr, "[ERROR] failed to create crash report %s, writing it to stderr\n", path);
+            f = stderr;
+        }
+        uint64_t now = now_ms();
+        fprintf(f, "mirabel crash report, unix time %lu\n", (unsigned long)time(NULL));
+        fprintf(f, "timeout item #%d %s %s, timeout %dms\n", stalled.id, stalled.name, stalled.quit ? "failed to unregister in time" : "failed to provide heartbeat", stalled.timeout_ms);
+
+        fprintf(f, "\nbacktrace of the stalled thread:\n");
+        if (frame_cnt >= 0) {
+            fflush(f);
+            backtrace_symbols_fd(stall_frames, frame_cnt, fileno(f));
+        } else {
+            fprintf(f, "  unavailable, %s\n", stalled.thread_bound ? "the thread did not handle the signal" : "the thread never answered a heartbeat");
+        }
+
+        fprintf(f, "\ntimeout items:\n");
+        for (std::pair<const uint32_t, timeout_item>& ti : timeout_items) {
+            timeout_item& tii = ti.second;
+            int64_t deadline_in = (int64_t)tii.deadline_ms - (int64_t)now;
+            fprintf(f, "#%d %s: queue depth %u, deadline in %ldms, heartbeat %s%s\n", tii.id, tii.name, event_queue_size(tii.q), (long)deadline_in, tii.heartbeat_answered ? "answered" : "pending", tii.quit ? ", prequit" : "");
+            event_queue_history_entry history[EVENT_QUEUE_HISTORY_SIZE];
+            uint32_t history_cnt = event_queue_history(tii.q, history);
+            for (uint32_t i = 0; i < history_cnt; i++) {
+                fprintf(f, "    %8lums ago: type %u, client %u, lobby %u\n", (unsigned long)(now - history[i].time_ms), history[i].type, history[i].client_id, history[i].lobby_id);
+            }
+        }
+        if (f != stderr) {
+            fclose(f);
+            fprintf(stderr, "[FATAL] crash report written to %s\n", path);
+        }
+    }
+
     void TimeoutCrash::start()
     {
-        runner = std::thread(&TimeoutCrash::loop, this);
+        // warm up backtrace outside of any signal handler, its first call may load libgcc and allocate
+        void* warmup_frame;
+        backtrace(&warmup_frame, 1);
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = stall_signal_handler;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        sigaction(STALL_SIGNAL, &sa, NULL);
+        runner = thread_runtime.spawn("watchdog", [this]() { loop(); });
     }
 
     void TimeoutCrash::join()
@@ -183,15 +317,19 @@ namespace Control {
         if (timeout_item_exists(name)) {
             MetaGui::logf("#W registering timeout item #%d with an already existing name: %s\n", item_id, name);
         }
-        timeout_items[item_id] = timeout_item(target_queue, item_id, name, initial_delay, timeout_ms);
+        timeout_items[item_id] = timeout_item(target_queue, item_id, name, now_ms() + initial_delay + timeout_ms, timeout_ms);
+        timeout_items[item_id].heap_idx = deadline_heap.size();
+        deadline_heap.push_back(item_id);
+        heap_sift(deadline_heap.size() - 1);
+        timeout_item_names[name]++;
         event_any es;
         event_create_heartbeat(&es, EVENT_TYPE_HEARTBEAT, item_id, 0);
         event_queue_push(timeout_items[item_id].q, &es);
         m.unlock();
-        // force wakeup the looping thread to re-calculate nearest deadline, also dont add sleep to the new one
+        // force wakeup the looping thread to re-calculate nearest deadline
         event_create_heartbeat(&es, EVENT_TYPE_HEARTBEAT_RESET, item_id, 0);
         event_queue_push(&inbox, &es);
-        return timeout_info{item_id, &inbox};
+        return timeout_info{item_id, &inbox, this, false};
     }
 
     void TimeoutCrash::unregister_timeout_item(uint32_t id)
@@ -202,12 +340,28 @@ namespace Control {
             m.unlock();
             return;
         }
+        timeout_item& tii = timeout_items[id];
+        heap_remove(tii.heap_idx);
+        std::unordered_map<std::string, uint32_t>::iterator name_iter = timeout_item_names.find(tii.name);
+        if (--name_iter->second == 0) {
+            timeout_item_names.erase(name_iter);
+        }
         // free name string and erase from map
-        free(timeout_items[id].name);
+        free(tii.name);
         timeout_items.erase(id);
         m.unlock();
     }
 
+    void TimeoutCrash::bind_thread(uint32_t id)
+    {
+        m.lock();
+        if (timeout_item_exists(id)) {
+            timeout_items[id].thread = pthread_self();
+            timeout_items[id].thread_bound = true;
+        }
+        m.unlock();
+    }
+
     bool TimeoutCrash::timeout_item_exists(uint32_t id)
     {
         return timeout_items.find(id) != timeout_items.end();
@@ -215,14 +369,7 @@ namespace Control {
 
     bool TimeoutCrash::timeout_item_exists(const char* name)
     {
-        std::unordered_map<uint32_t, timeout_item>::iterator map_iter = timeout_items.begin();
-        while (map_iter != timeout_items.end()) {
-            if (strcmp(map_iter->second.name, name) == 0) {
-                return true;
-            }
-            map_iter++;
-        }
-        return false;
+        return timeout_item_names.find(name) != timeout_item_names.end();
     }
 
 } // namespace Control
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <mutex>
+#include <pthread.h>
+#include <string>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "mirabel/event_queue.h"
 
@@ -15,6 +19,8 @@ namespace Control {
         struct timeout_info {
             uint32_t id;
             event_queue* q;
+            TimeoutCrash* tc;
+            bool thread_bound; // the first heartbeat tells the watchdog which thread to signal for a backtrace on a stall
             void send_heartbeat();
             void pre_quit(uint32_t timeout);
         };
@@ -26,17 +32,31 @@ namespace Control {
             int32_t id;
             char* name;
             int timeout_ms;
-            int last_heartbeat_age;
+            uint64_t deadline_ms; // absolute, steady clock, the heartbeat has to be answered by then
+            uint32_t heap_idx; // position in deadline_heap
+            pthread_t thread; // only valid once thread_bound
+            bool thread_bound;
             bool heartbeat_answered;
             bool quit;
             event_queue* q;
             timeout_item();
-            timeout_item(event_queue* target_queue, uint32_t new_id, const char* new_name, int new_initial_delay, int new_timeout_ms);
+            timeout_item(event_queue* target_queue, uint32_t new_id, const char* new_name, uint64_t new_deadline_ms, int new_timeout_ms);
         };
 
         uint32_t next_id = 1;
         std::unordered_map<uint32_t, timeout_item> timeout_items;
+        // ids of all items as a binary min-heap on their deadline, every item knows its heap_idx so updates and removals are O(log n)
+        std::vector<uint32_t> deadline_heap;
+        std::unordered_map<std::string, uint32_t> timeout_item_names; // name -> number of items registered with it
         std::mutex m;
+        std::string crash_report_dir = "./";
+
+        static uint64_t now_ms();
+        void heap_swap(uint32_t a, uint32_t b);
+        void heap_sift(uint32_t idx); // restore the heap after the deadline at idx changed
+        void heap_remove(uint32_t idx);
+        // backtrace of the stalled thread, depth and recent events of every queue, expects m to be held
+        void write_crash_report(timeout_item& stalled);
 
         TimeoutCrash();
         ~TimeoutCrash();
@@ -47,7 +67,9 @@ namespace Control {
 
         timeout_info register_timeout_item(event_queue* target_queue, const char* name, int initial_delay, int timeout_ms); // copies name into internals
         void unregister_timeout_item(uint32_t id); //TODO maybe move this into timeout_info.unregister() using EVENT_TYPE_HEARTBEAT_UNREGISTER
+        void bind_thread(uint32_t id); // the calling thread is the one answering the heartbeats of id
 
+        // expect m to be held
         bool timeout_item_exists(uint32_t id);
         bool timeout_item_exists(const char* name);
     };
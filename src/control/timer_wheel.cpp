@@ -0,0 +1,142 @@
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "control/timer_wheel.hpp"
+
+namespace Control {
+
+    TimerWheel::TimerWheel()
+    {
+        for (uint32_t l = 0; l < LEVEL_COUNT; l++) {
+            for (uint32_t s = 0; s < SLOT_COUNT; s++) {
+                slots[l][s] = NULL;
+            }
+        }
+    }
+
+    uint64_t TimerWheel::now()
+    {
+        return now_tick;
+    }
+
+    uint32_t TimerWheel::size()
+    {
+        return timer_count;
+    }
+
+    void TimerWheel::insert(timer* t)
+    {
+        // the level is picked by distance, the slot by the expiry bits of that level, so a timer always cascades down exactly when its block comes up
+        uint64_t delta = t->expires - now_tick;
+        uint32_t level = 0;
+        while (level < LEVEL_COUNT - 1 && delta >= ((uint64_t)1 << (SLOT_BITS * (level + 1)))) {
+            level++;
+        }
+        timer** head = &slots[level][(t->expires >> (SLOT_BITS * level)) & SLOT_MASK];
+        t->prev = NULL;
+        t->next = *head;
+        if (*head) {
+            (*head)->prev = t;
+        }
+        *head = t;
+    }
+
+    void TimerWheel::unlink(timer* t)
+    {
+        if (t->prev) {
+            t->prev->next = t->next;
+        } else {
+            // first in its slot, find the slot the same way insert did
+            for (uint32_t l = 0; l < LEVEL_COUNT; l++) {
+                timer** head = &slots[l][(t->expires >> (SLOT_BITS * l)) & SLOT_MASK];
+                if (*head == t) {
+                    *head = t->next;
+                    break;
+                }
+            }
+        }
+        if (t->next) {
+            t->next->prev = t->prev;
+        }
+        t->prev = NULL;
+        t->next = NULL;
+    }
+
+    void TimerWheel::cascade(uint32_t level)
+    {
+        timer** head = &slots[level][(now_tick >> (SLOT_BITS * level)) & SLOT_MASK];
+        timer* t = *head;
+        *head = NULL;
+        while (t) {
+            timer* next = t->next;
+            insert(t);
+            t = next;
+        }
+    }
+
+    void TimerWheel::schedule(timer* t, uint64_t expires_tick)
+    {
+        if (t->scheduled) {
+            cancel(t);
+        }
+        if (expires_tick <= now_tick) {
+            expires_tick = now_tick + 1;
+        }
+        if (expires_tick - now_tick > MAX_DELTA) {
+            expires_tick = now_tick + MAX_DELTA;
+        }
+        t->expires = expires_tick;
+        t->scheduled = true;
+        insert(t);
+        timer_count++;
+    }
+
+    void TimerWheel::cancel(timer* t)
+    {
+        if (!t->scheduled) {
+            return;
+        }
+        unlink(t);
+        t->scheduled = false;
+        timer_count--;
+    }
+
+    void TimerWheel::advance(uint64_t to_tick, std::vector<timer*>* fired)
+    {
+        if (timer_count == 0) {
+            // nothing can fire or cascade, idle wheels skip ahead for free
+            if (to_tick > now_tick) {
+                now_tick = to_tick;
+            }
+            return;
+        }
+        while (now_tick < to_tick) {
+            now_tick++;
+            // refill lower levels first, a cascaded timer may land in the slot processed right below
+            for (uint32_t l = 1; l < LEVEL_COUNT; l++) {
+                if ((now_tick & (((uint64_t)1 << (SLOT_BITS * l)) - 1)) != 0) {
+                    break;
+                }
+                cascade(l);
+            }
+            timer** head = &slots[0][now_tick & SLOT_MASK];
+            while (*head) {
+                timer* t = *head;
+                *head = t->next;
+                if (*head) {
+                    (*head)->prev = NULL;
+                }
+                t->prev = NULL;
+                t->next = NULL;
+                t->scheduled = false;
+                timer_count--;
+                fired->push_back(t);
+            }
+            if (timer_count == 0) {
+                now_tick = to_tick;
+            }
+        }
+    }
+
+} // namespace Control
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Control {
+
+    // hierarchical timer wheel, LEVEL_COUNT levels of SLOT_COUNT slots each, every level covers SLOT_COUNT times the range of the one below
+    // schedule and cancel are O(1), advancing by one tick only empties one slot, plus a cascade of one higher slot every SLOT_COUNT ticks
+    // not threadsafe, every lobby worker owns one for the lobbies pinned to it
+    class TimerWheel {
+      public:
+
+        static const uint32_t TICK_MS = 10;
+
+        // embedded into whatever owns the timer, must be cancelled before it goes away
+        struct timer {
+            timer* prev = NULL;
+            timer* next = NULL;
+            uint64_t expires = 0; // absolute tick
+            bool scheduled = false;
+            void* data = NULL; // owner, for whoever handles the fired timers
+        };
+
+      private:
+
+        static const uint32_t SLOT_BITS = 6;
+        static const uint32_t SLOT_COUNT = 1 << SLOT_BITS;
+        static const uint32_t SLOT_MASK = SLOT_COUNT - 1;
+        static const uint32_t LEVEL_COUNT = 4; // 2^24 ticks, ~46 hours at 10ms
+        static const uint64_t MAX_DELTA = ((uint64_t)1 << (SLOT_BITS * LEVEL_COUNT)) - 1;
+
+        uint64_t now_tick = 0; // last processed tick
+        uint32_t timer_count = 0;
+        timer* slots[LEVEL_COUNT][SLOT_COUNT];
+
+        void insert(timer* t);
+        void unlink(timer* t);
+        void cascade(uint32_t level);
+
+      public:
+
+        TimerWheel();
+
+        uint64_t now();
+        uint32_t size();
+
+        // expiry in the past or present fires on the next tick, too far in the future is clamped to the wheel range
+        void schedule(timer* t, uint64_t expires_tick);
+        void cancel(timer* t);
+
+        // process all ticks up to and including to_tick, expired timers are unscheduled and appended to fired in expiry order
+        void advance(uint64_t to_tick, std::vector<timer*>* fired);
+    };
+
+} // namespace Control
@@ -0,0 +1,164 @@
+#include <atomic>
+#include <chrono>
+#include <cstdbool>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "mirabel/event_queue.h"
+#include "mirabel/event.h"
+#include "control/auth_manager.hpp"
+#include "control/event_trace.hpp"
+#include "control/server_metrics.hpp"
+#include "control/server.hpp"
+#include "control/thread_runtime.hpp"
+
+#include "control/trace_replay.hpp"
+
+namespace Control {
+
+    // queued but unhandled events across the server and its lobby workers, beyond this the feed waits
+    // without it a fast replay would bury the heartbeats and trip the watchdog
+    static const uint32_t REPLAY_BACKLOG_LIMIT = 1024;
+    // idle stretches in realtime replays are cut short, the recorded traffic around them is what matters
+    static const uint64_t REPLAY_MAX_GAP_US = 5000000;
+
+    static bool replayable(const event_any* e)
+    {
+        switch (e->base.type) {
+            // local to the recording process, the replay server brings its own adapter and watchdog
+            case EVENT_TYPE_EXIT:
+            case EVENT_TYPE_HEARTBEAT:
+            case EVENT_TYPE_HEARTBEAT_PREQUIT:
+            case EVENT_TYPE_HEARTBEAT_RESET:
+            case EVENT_TYPE_NETWORK_ADAPTER_LOAD:
+            case EVENT_TYPE_NETWORK_ADAPTER_SOCKET_CLOSED: {
+                return false;
+            } break;
+            // the password is redacted, so the auth workers would only produce a different result
+            // the result they recorded follows as an internal auth event and is replayed in its place
+            case EVENT_TYPE_USER_AUTHN:
+            case EVENT_TYPE_USER_REGISTER: {
+                // whatever the server answers itself, bad names and guests, never reaches the workers
+                if (AuthManager::check_username(e->auth.username) != NULL || e->auth.is_guest) {
+                    return true;
+                }
+                return e->base.type == EVENT_TYPE_USER_AUTHN ? false : strlen(e->auth.username) == 0;
+            } break;
+            default: {
+                return true;
+            } break;
+        }
+    }
+
+    static uint32_t backlog(Server* server)
+    {
+        uint32_t depth = event_queue_size(&server->inbox);
+        std::vector<uint32_t> depths;
+        server->lobby_mgr.GetQueueDepths(&depths);
+        for (size_t i = 0; i < depths.size(); i++) {
+            depth += depths[i];
+        }
+        return depth;
+    }
+
+    int replay_trace(const char* path, bool realtime)
+    {
+        EventTrace trace;
+        if (!trace.open_read(path)) {
+            return EXIT_FAILURE;
+        }
+
+        event_queue sink;
+        event_queue_create(&sink);
+        std::atomic<uint64_t> events_out(0);
+        std::thread sink_runner = thread_runtime.spawn("replaysink", [&sink, &events_out]() {
+            event_any e;
+            while (true) {
+                event_queue_pop(&sink, &e, UINT32_MAX);
+                if (e.base.type == EVENT_TYPE_EXIT) {
+                    break;
+                }
+                events_out.fetch_add(1, std::memory_order_relaxed);
+                event_destroy(&e);
+            }
+        });
+
+        Server* server = new Server(&sink, 0);
+        std::thread server_runner = thread_runtime.spawn("server", [server]() { server->loop(); });
+
+        printf("[INFO] replaying %s %s\n", path, realtime ? "in real time" : "as fast as possible");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        uint64_t events_in = 0;
+        uint64_t skipped = 0;
+        uint64_t trace_start_us = 0;
+        uint64_t trace_prev_us = 0;
+        uint64_t schedule_us = 0; // trace time with the long gaps cut out
+        event_any e;
+        uint64_t time_us;
+        while (trace.read(&e, &time_us)) {
+            if (!replayable(&e)) {
+                event_destroy(&e);
+                skipped++;
+                continue;
+            }
+            if (events_in == 0) {
+                trace_start_us = time_us;
+                trace_prev_us = time_us;
+            }
+            if (realtime) {
+                // a restarted recording may step back in time, that just counts as no gap
+                uint64_t gap = time_us > trace_prev_us ? time_us - trace_prev_us : 0;
+                schedule_us += gap < REPLAY_MAX_GAP_US ? gap : REPLAY_MAX_GAP_US;
+                std::this_thread::sleep_until(start + std::chrono::microseconds(schedule_us));
+            } else if (events_in % 64 == 0) {
+                while (backlog(server) >= REPLAY_BACKLOG_LIMIT) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            }
+            trace_prev_us = time_us;
+            event_queue_push(&server->inbox, &e);
+            events_in++;
+        }
+
+        // everything fed, the lobby workers drain their inboxes before they stop
+        event_create_type(&e, EVENT_TYPE_EXIT);
+        event_queue_push(&server->inbox, &e);
+        server_runner.join();
+        std::vector<std::shared_ptr<lobby_stats>> lobbies;
+        server->lobby_mgr.GetLobbyStats(&lobbies);
+        server->lobby_mgr.stop();
+        server->auth_mgr.stop();
+        double elapsed_s = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000000.0;
+
+        server_metrics& m = server->metrics;
+        uint64_t loop_events = m.loop_events.load(std::memory_order_relaxed);
+        uint64_t moves = 0;
+        uint64_t move_us_total = 0;
+        uint64_t move_us_max = 0;
+        for (size_t i = 0; i < lobbies.size(); i++) {
+            moves += lobbies[i]->moves.load(std::memory_order_relaxed);
+            move_us_total += lobbies[i]->move_latency_us_total.load(std::memory_order_relaxed);
+            uint64_t lobby_max = lobbies[i]->move_latency_us_max.load(std::memory_order_relaxed);
+            if (lobby_max > move_us_max) {
+                move_us_max = lobby_max;
+            }
+        }
+        printf("[INFO] replayed %lu events (%lu skipped) spanning %.1fs of trace in %.3fs\n", (unsigned long)events_in, (unsigned long)skipped, (trace_prev_us - trace_start_us) / 1000000.0, elapsed_s);
+        printf("[INFO] throughput: %.0f events/s in, %lu events out\n", elapsed_s > 0 ? events_in / elapsed_s : 0, (unsigned long)events_out.load());
+        printf("[INFO] server loop: %lu events, avg %.1fus, max %luus\n", (unsigned long)loop_events, loop_events > 0 ? (double)m.loop_us_total.load(std::memory_order_relaxed) / loop_events : 0, (unsigned long)m.loop_us_max.load(std::memory_order_relaxed));
+        printf("[INFO] lobby moves: %lu in %zu lobbies, avg %.1fus, max %luus\n", (unsigned long)moves, lobbies.size(), moves > 0 ? (double)move_us_total / moves : 0, (unsigned long)move_us_max);
+
+        delete server;
+        event_create_type(&e, EVENT_TYPE_EXIT);
+        event_queue_push(&sink, &e);
+        sink_runner.join();
+        event_queue_destroy(&sink);
+        return EXIT_SUCCESS;
+    }
+
+} // namespace Control
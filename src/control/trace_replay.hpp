@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdbool>
+
+namespace Control {
+
+    // feeds a recorded event trace into a fresh replay server and reports throughput and latency, returns a process exit code
+    // realtime keeps the recorded spacing between events, otherwise they are fed as fast as the server keeps up
+    // replies are drained into a stub adapter and only counted, lobby ids match the recording if it was started with the server
+    int replay_trace(const char* path, bool realtime);
+
+} // namespace Control
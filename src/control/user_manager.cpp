@@ -1,24 +1,334 @@
+#include <cctype>
+#include <chrono>
 #include <cstddef>
 #include <cstdbool>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include "rosalia/rand.h"
+
+#include "mirabel/event.h"
 
 #include "control/user_manager.hpp"
 
 namespace Control {
 
+    static const uint64_t SCRYPT_MAX_MEM = (uint64_t)64 << 20; // must exceed 128 * N * r * p
+
     bool is_guest(uint64_t user_id)
     {
         return (user_id & USER_ID_MASK_GUEST);
     }
 
-    UserManager::UserManager()
+    static void write_hex(FILE* f, const uint8_t* data, size_t len)
+    {
+        for (size_t i = 0; i < len; i++) {
+            fprintf(f, "%02x", data[i]);
+        }
+    }
+
+    static bool read_hex(const char* str, uint8_t* data, size_t len)
+    {
+        if (strlen(str) != len * 2) {
+            return false;
+        }
+        for (size_t i = 0; i < len; i++) {
+            unsigned int byte;
+            if (sscanf(str + i * 2, "%2x", &byte) != 1) {
+                return false;
+            }
+            data[i] = byte;
+        }
+        return true;
+    }
+
+    static std::string name_key(const char* username)
+    {
+        std::string key(username);
+        for (size_t i = 0; i < key.size(); i++) {
+            key[i] = tolower((unsigned char)key[i]);
+        }
+        return key;
+    }
+
+    UserManager::UserManager():
+        next_guest_id(1)
     {
-        //TODO
+        fprng_srand(&guest_rng, std::chrono::steady_clock::now().time_since_epoch().count());
     }
 
     UserManager::~UserManager()
+    {}
+
+    bool UserManager::hash_password(const char* password, const user_account* account, uint8_t* hash_out)
+    {
+        return EVP_PBE_scrypt(password, strlen(password), account->salt, USER_SALT_LEN, (uint64_t)1 << account->kdf_log_n, account->kdf_r, account->kdf_p, SCRYPT_MAX_MEM, hash_out, USER_HASH_LEN) == 1;
+    }
+
+    bool UserManager::append_user(const std::string& username, const user_account* account)
+    {
+        if (users_path.size() == 0) {
+            return true;
+        }
+        // created owner only, it holds the password hashes
+        int fd = open(users_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        FILE* f = fd < 0 ? NULL : fdopen(fd, "a");
+        if (f == NULL) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            printf("[ERROR] failed to open users file %s\n", users_path.c_str());
+            return false;
+        }
+        // one account per line: id name log_n r p salt hash
+        fprintf(f, "%lu %s %u %u %u ", (unsigned long)account->user_id, username.c_str(), account->kdf_log_n, account->kdf_r, account->kdf_p);
+        write_hex(f, account->salt, USER_SALT_LEN);
+        fprintf(f, " ");
+        write_hex(f, account->hash, USER_HASH_LEN);
+        fprintf(f, "\n");
+        fclose(f);
+        return true;
+    }
+
+    uint32_t UserManager::load()
+    {
+        if (users_path.size() == 0) {
+            return 0;
+        }
+        FILE* f = fopen(users_path.c_str(), "r");
+        if (f == NULL) {
+            return 0; // no users yet
+        }
+        uint32_t loaded = 0;
+        unsigned long user_id;
+        char username[64];
+        unsigned int log_n;
+        unsigned int r;
+        unsigned int p;
+        char salt_str[USER_SALT_LEN * 2 + 1];
+        char hash_str[USER_HASH_LEN * 2 + 1];
+        std::lock_guard<std::mutex> lock(m);
+        while (fscanf(f, "%lu %63s %u %u %u %32s %64s", &user_id, username, &log_n, &r, &p, salt_str, hash_str) == 7) {
+            user_account account;
+            account.user_id = user_id;
+            account.kdf_log_n = log_n;
+            account.kdf_r = r;
+            account.kdf_p = p;
+            if (user_id == USER_ID_NONE || is_guest(user_id) || !read_hex(salt_str, account.salt, USER_SALT_LEN) || !read_hex(hash_str, account.hash, USER_HASH_LEN)) {
+                printf("[WARN] skipping malformed account in users file: %s\n", username);
+                continue;
+            }
+            if (!users.emplace(name_key(username), account).second) {
+                printf("[WARN] skipping account with duplicate name in users file: %s\n", username);
+                continue;
+            }
+            if (user_id >= next_user_id) {
+                next_user_id = user_id + 1;
+            }
+            loaded++;
+        }
+        fclose(f);
+        return loaded;
+    }
+
+    uint64_t UserManager::create_user(const char* username, const char* password, bool guest)
+    {
+        if (guest) {
+            // guests are never stored
+            std::lock_guard<std::mutex> lock(m);
+            if (next_guest_id == 0) {
+                return USER_ID_NONE;
+            }
+            return (next_guest_id++) | USER_ID_MASK_GUEST;
+        }
+        std::string key = name_key(username);
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if (users.find(key) != users.end()) {
+                return USER_ID_NONE;
+            }
+        }
+        user_account account;
+        account.kdf_log_n = KDF_LOG_N;
+        account.kdf_r = KDF_R;
+        account.kdf_p = KDF_P;
+        if (RAND_bytes(account.salt, USER_SALT_LEN) != 1 || !hash_password(password, &account, account.hash)) {
+            printf("[ERROR] failed to hash password for new user %s\n", username);
+            return USER_ID_NONE;
+        }
+        std::lock_guard<std::mutex> lock(m);
+        // someone else may have registered the name while we were hashing
+        if (users.find(key) != users.end()) {
+            return USER_ID_NONE;
+        }
+        account.user_id = next_user_id++;
+        users[key] = account;
+        append_user(username, &account);
+        return account.user_id;
+    }
+
+    uint64_t UserManager::get_user_by_name(const char* username)
+    {
+        std::string key = name_key(username);
+        std::lock_guard<std::mutex> lock(m);
+        std::unordered_map<std::string, user_account>::iterator it = users.find(key);
+        if (it == users.end()) {
+            return USER_ID_NONE;
+        }
+        return it->second.user_id;
+    }
+
+    uint64_t UserManager::authenticate_user(const char* username, const char* password, bool guest)
+    {
+        if (guest) {
+            return create_user(username, password, true);
+        }
+        std::string key = name_key(username);
+        user_account account;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            std::unordered_map<std::string, user_account>::iterator it = users.find(key);
+            if (it == users.end()) {
+                return USER_ID_NONE;
+            }
+            account = it->second; // copy out, so the kdf runs without the lock
+        }
+        uint8_t hash[USER_HASH_LEN];
+        if (!hash_password(password, &account, hash)) {
+            return USER_ID_NONE;
+        }
+        if (CRYPTO_memcmp(hash, account.hash, USER_HASH_LEN) != 0) {
+            return USER_ID_NONE;
+        }
+        return account.user_id;
+    }
+
+    UserManager::name_shard& UserManager::shard_by_name(const std::string& key)
+    {
+        return name_shards[std::hash<std::string>()(key) % NAME_SHARD_COUNT];
+    }
+
+    UserManager::name_shard& UserManager::shard_by_client(uint32_t client_id)
+    {
+        return name_shards[client_id % NAME_SHARD_COUNT];
+    }
+
+    bool UserManager::reserve_name(const char* username, uint32_t client_id)
+    {
+        std::string key = name_key(username);
+        {
+            name_shard& ns = shard_by_name(key);
+            std::lock_guard<std::mutex> lock(ns.m);
+            std::unordered_map<std::string, uint32_t>::iterator it = ns.name_clients.find(key);
+            if (it != ns.name_clients.end()) {
+                return it->second == client_id;
+            }
+            ns.name_clients[key] = client_id;
+        }
+        // only ever hold one shard lock at a time, the old name is released after the swap
+        std::string old_name;
+        {
+            name_shard& cs = shard_by_client(client_id);
+            std::lock_guard<std::mutex> lock(cs.m);
+            std::string& client_name = cs.client_names[client_id];
+            old_name.swap(client_name);
+            client_name = username;
+        }
+        if (old_name.size() > 0) {
+            std::string old_key = name_key(old_name.c_str());
+            name_shard& ns = shard_by_name(old_key);
+            std::lock_guard<std::mutex> lock(ns.m);
+            std::unordered_map<std::string, uint32_t>::iterator it = ns.name_clients.find(old_key);
+            if (it != ns.name_clients.end() && it->second == client_id) {
+                ns.name_clients.erase(it);
+            }
+        }
+        return true;
+    }
+
+    std::string UserManager::reserve_guest_name(uint32_t client_id)
+    {
+        // random numbers so guest names don't reveal how many joined, each digit count gets a few tries before the next one is used
+        const int tries_per_length = 8;
+        char name_buf[16];
+        for (int digits = 5; digits <= 9; digits++) {
+            uint64_t range = 1;
+            for (int i = 0; i < digits; i++) {
+                range *= 10;
+            }
+            for (int t = 0; t < tries_per_length; t++) {
+                uint64_t number;
+                {
+                    std::lock_guard<std::mutex> lock(m);
+                    number = fprng_rand(&guest_rng) % range;
+                }
+                sprintf(name_buf, "Guest%0*lu", digits, (unsigned long)number);
+                // an offline account keeps its name, the guest would show up as that user otherwise
+                if (get_user_by_name(name_buf) != USER_ID_NONE) {
+                    continue;
+                }
+                if (reserve_name(name_buf, client_id)) {
+                    return name_buf;
+                }
+            }
+        }
+        return "";
+    }
+
+    void UserManager::release_client(uint32_t client_id)
+    {
+        std::string name;
+        {
+            name_shard& cs = shard_by_client(client_id);
+            std::lock_guard<std::mutex> lock(cs.m);
+            std::unordered_map<uint32_t, std::string>::iterator it = cs.client_names.find(client_id);
+            if (it == cs.client_names.end()) {
+                return;
+            }
+            name.swap(it->second);
+            cs.client_names.erase(it);
+        }
+        std::string key = name_key(name.c_str());
+        name_shard& ns = shard_by_name(key);
+        std::lock_guard<std::mutex> lock(ns.m);
+        std::unordered_map<std::string, uint32_t>::iterator it = ns.name_clients.find(key);
+        if (it != ns.name_clients.end() && it->second == client_id) {
+            ns.name_clients.erase(it);
+        }
+    }
+
+    uint32_t UserManager::get_client_by_name(const char* username)
+    {
+        std::string key = name_key(username);
+        name_shard& ns = shard_by_name(key);
+        std::lock_guard<std::mutex> lock(ns.m);
+        std::unordered_map<std::string, uint32_t>::iterator it = ns.name_clients.find(key);
+        if (it == ns.name_clients.end()) {
+            return EVENT_CLIENT_NONE;
+        }
+        return it->second;
+    }
+
+    std::string UserManager::get_client_name(uint32_t client_id)
     {
-        //TODO
+        name_shard& cs = shard_by_client(client_id);
+        std::lock_guard<std::mutex> lock(cs.m);
+        std::unordered_map<uint32_t, std::string>::iterator it = cs.client_names.find(client_id);
+        if (it == cs.client_names.end()) {
+            return "";
+        }
+        return it->second;
     }
 
 } // namespace Control
@@ -3,6 +3,11 @@
 #include <cstddef>
 #include <cstdbool>
 #include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "rosalia/rand.h"
 
 namespace Control {
 
@@ -12,30 +17,83 @@ namespace Control {
 
     bool is_guest(uint64_t user_id);
 
+    // all methods are threadsafe, create_user and authenticate_user run the password kdf and are expensive, call them from the auth workers
     class UserManager {
       private:
 
+        static const size_t USER_SALT_LEN = 16;
+        static const size_t USER_HASH_LEN = 32;
+
+        // credentials are only ever stored as salted scrypt hashes, the cost parameters are kept per user so they can be raised later
+        struct user_account {
+            uint64_t user_id;
+            uint8_t kdf_log_n;
+            uint32_t kdf_r;
+            uint32_t kdf_p;
+            uint8_t salt[USER_SALT_LEN];
+            uint8_t hash[USER_HASH_LEN];
+        };
+
+        std::mutex m; // guards everything below, never held while hashing
         uint64_t next_guest_id; // if is 0 then disallow guests
+        uint64_t next_user_id = 1;
+        std::unordered_map<std::string, user_account> users; // by name_key, names differing only in case are the same account
+
+        // registry of the names currently online, sharded so reservations from different threads rarely contend
+        // names are keyed lowercased, so names only differing in case can't impersonate each other
+        static const uint32_t NAME_SHARD_COUNT = 16;
+
+        struct name_shard {
+            std::mutex m;
+            std::unordered_map<std::string, uint32_t> name_clients; // lowercased name -> client id, for names hashing into this shard
+            std::unordered_map<uint32_t, std::string> client_names; // client id -> name as given, for client ids hashing into this shard
+        };
+
+        name_shard name_shards[NAME_SHARD_COUNT];
+        fast_prng guest_rng; // guarded by m
+
+        static bool hash_password(const char* password, const user_account* account, uint8_t* hash_out);
+        bool append_user(const std::string& username, const user_account* account);
+        name_shard& shard_by_name(const std::string& key);
+        name_shard& shard_by_client(uint32_t client_id);
 
       public:
 
+        static const uint8_t KDF_LOG_N = 15; // 2^15 * 128 * r bytes, i.e. 32MiB per hash with r = 8
+        static const uint32_t KDF_R = 8;
+        static const uint32_t KDF_P = 1;
+
+        std::string users_path = "./users.db"; // accounts are appended here on creation, empty to keep them in memory only
+
         UserManager();
         ~UserManager();
-        //TODO func for auth isnt here, but use a separate auth manager which handles all auth events, and add a new event to signal the network manager that a certain user now possesses a certain user id, ??still need some way to get user id from client, and vice versa??
+        //TODO add a new event to signal the network manager that a certain user now possesses a certain user id, ??still need some way to get user id from client, and vice versa??
         //TODO ^^^ make sure users do not sign in twice at the same time!
         //TODO how to retrieve certain info about clients? cache somehow, or COPY everytime?!
-        //TODO create new user/guest / retrieve info
         //TODO manip user info?
 
+        // load all accounts from users_path, returns the number of accounts loaded
+        uint32_t load();
+
         //TODO need diff sig for guests alltogether?
         //TODO what really is the use of passworded guests?
         // returns USER_ID_NONE if the user already exists
         uint64_t create_user(const char* username, const char* password, bool guest);
 
-        uint64_t get_user_by_name(const char* username);
+        uint64_t get_user_by_name(const char* username); // case insensitive, like the online names
 
         // returns USER_ID_NONE if invalid
         uint64_t authenticate_user(const char* username, const char* password, bool guest);
+
+        // online names, all O(1)
+        // reserving replaces any name the client held before, returns false if another client holds the name
+        bool reserve_name(const char* username, uint32_t client_id);
+        // reserves a fresh GuestNNNNN name for the client, never one that belongs to an account
+        // grows the number if the space gets crowded, returns an empty string if none was found
+        std::string reserve_guest_name(uint32_t client_id);
+        void release_client(uint32_t client_id);
+        uint32_t get_client_by_name(const char* username); // EVENT_CLIENT_NONE if offline
+        std::string get_client_name(uint32_t client_id); // empty if the client has no name
     };
 
 } // namespace Control
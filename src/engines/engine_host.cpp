@@ -0,0 +1,843 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "surena/engine.h"
+#include "surena/game.h"
+
+#include "control/plugins.hpp"
+#include "control/thread_runtime.hpp"
+
+#include "engines/engine_host.hpp"
+
+namespace Engines {
+
+    // per direction, a power of two, large enough for a burst of searchinfos while the reader is descheduled
+    static const uint32_t RING_SIZE = 1 << 20;
+    // polls before the reader sleeps on the futex, an engine replying within this never costs a syscall on either side
+    static const uint32_t RING_SPIN_COUNT = 2000;
+    // the pumps wake up this often to notice a stop or a dead child
+    static const uint32_t HOST_POLL_MS = 100;
+    // time the child gets to exit after its engine exited or the host stopped, before it is killed
+    static const uint32_t HOST_REAP_MS = 1000;
+
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "ring atomics must be lock free to work across processes");
+
+    // lives in the shared memory, zeroed by ftruncate, which is a valid initial state for all the atomics
+    struct shm_ring {
+        alignas(64) std::atomic<uint64_t> head; // bytes written, only stored by the producer
+        alignas(64) std::atomic<uint64_t> tail; // bytes read, only stored by the consumer
+        alignas(64) std::atomic<uint32_t> seq; // futex word, bumped after every publish
+        std::atomic<uint32_t> waiting; // the consumer is about to sleep on seq
+        std::atomic<uint32_t> closed; // set by whichever side leaves first, wakes the other
+        alignas(64) uint8_t data[RING_SIZE];
+    };
+
+    struct shm_rings {
+        shm_ring to_child;
+        shm_ring to_host;
+    };
+
+    // not FUTEX_PRIVATE_FLAG, the word is shared with the other process
+    static void futex_wait(std::atomic<uint32_t>* word, uint32_t val, uint32_t timeout_ms)
+    {
+        struct timespec ts;
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+        syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, val, timeout_ms == UINT32_MAX ? NULL : &ts, NULL, 0);
+    }
+
+    static void futex_wake(std::atomic<uint32_t>* word)
+    {
+        syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+
+    static void ring_copy_in(shm_ring* r, uint64_t pos, const void* src, uint32_t len)
+    {
+        uint32_t off = pos & (RING_SIZE - 1);
+        uint32_t first = len < RING_SIZE - off ? len : RING_SIZE - off;
+        memcpy(r->data + off, src, first);
+        memcpy(r->data, (const uint8_t*)src + first, len - first);
+    }
+
+    static void ring_copy_out(shm_ring* r, uint64_t pos, void* dst, uint32_t len)
+    {
+        uint32_t off = pos & (RING_SIZE - 1);
+        uint32_t first = len < RING_SIZE - off ? len : RING_SIZE - off;
+        memcpy(dst, r->data + off, first);
+        memcpy((uint8_t*)dst + first, r->data, len - first);
+    }
+
+    static void ring_close(shm_ring* r)
+    {
+        r->closed.store(1, std::memory_order_seq_cst);
+        r->seq.fetch_add(1, std::memory_order_seq_cst);
+        futex_wake(&r->seq);
+    }
+
+    // false if the message can never fit or the other side is gone
+    static bool ring_push(shm_ring* r, const std::vector<uint8_t>& msg)
+    {
+        uint32_t len = msg.size();
+        uint64_t need = sizeof(len) + len;
+        if (need > RING_SIZE) {
+            return false;
+        }
+        uint64_t head = r->head.load(std::memory_order_relaxed);
+        // the consumer only ever waits on its own queues, so a full ring drains on its own unless the other side is gone
+        while (true) {
+            uint64_t used = head - r->tail.load(std::memory_order_acquire);
+            if (used > RING_SIZE) {
+                // the other side claims to have read more than was written, it can't be trusted anymore
+                ring_close(r);
+                return false;
+            }
+            if (used + need <= RING_SIZE) {
+                break;
+            }
+            if (r->closed.load(std::memory_order_acquire)) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        ring_copy_in(r, head, &len, sizeof(len));
+        ring_copy_in(r, head + sizeof(len), msg.data(), len);
+        // seq_cst on both sides, so either the consumer sees the new head or the producer sees it waiting
+        r->head.store(head + need, std::memory_order_seq_cst);
+        r->seq.fetch_add(1, std::memory_order_seq_cst);
+        if (r->waiting.load(std::memory_order_seq_cst)) {
+            futex_wake(&r->seq);
+        }
+        return true;
+    }
+
+    // false on timeout, or once the ring is closed and drained, UINT32_MAX waits for ever
+    static bool ring_pop(shm_ring* r, std::vector<uint8_t>& msg, uint32_t timeout_ms)
+    {
+        uint64_t tail = r->tail.load(std::memory_order_relaxed);
+        bool ready = false;
+        for (uint32_t i = 0; i < RING_SPIN_COUNT && !ready; i++) {
+            ready = (r->head.load(std::memory_order_acquire) != tail);
+        }
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms == UINT32_MAX ? 0 : timeout_ms);
+        while (!ready) {
+            uint32_t seq = r->seq.load(std::memory_order_seq_cst);
+            r->waiting.store(1, std::memory_order_seq_cst);
+            ready = (r->head.load(std::memory_order_seq_cst) != tail);
+            if (!ready && r->closed.load(std::memory_order_seq_cst)) {
+                r->waiting.store(0, std::memory_order_relaxed);
+                return false;
+            }
+            if (!ready) {
+                uint32_t wait_ms = UINT32_MAX;
+                if (timeout_ms != UINT32_MAX) {
+                    int64_t left_ms = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                    if (left_ms <= 0) {
+                        r->waiting.store(0, std::memory_order_relaxed);
+                        return false;
+                    }
+                    wait_ms = left_ms;
+                }
+                futex_wait(&r->seq, seq, wait_ms);
+                ready = (r->head.load(std::memory_order_acquire) != tail);
+            }
+            r->waiting.store(0, std::memory_order_relaxed);
+        }
+        // head and the length are written by the other process, read each once and check them before use
+        uint64_t avail = r->head.load(std::memory_order_acquire) - tail;
+        uint32_t len = 0;
+        if (avail >= sizeof(len) && avail <= RING_SIZE) {
+            ring_copy_out(r, tail, &len, sizeof(len));
+        }
+        if (avail < sizeof(len) || avail > RING_SIZE || len > RING_SIZE - sizeof(len) || len > avail - sizeof(len)) {
+            ring_close(r);
+            return false;
+        }
+        msg.resize(len);
+        ring_copy_out(r, tail + sizeof(len), msg.data(), len);
+        r->tail.store(tail + sizeof(len) + len, std::memory_order_release);
+        return true;
+    }
+
+    // eevents on the wire: type, engine id, then the payload of the type, both processes are the same binary so values are copied as they are
+    // pointers are flattened, strings as u32 length (UINT32_MAX for NULL) and bytes
+
+    static void put_bytes(std::vector<uint8_t>& buf, const void* src, size_t len)
+    {
+        buf.insert(buf.end(), (const uint8_t*)src, (const uint8_t*)src + len);
+    }
+
+    template <typename T>
+    static void put_val(std::vector<uint8_t>& buf, T val)
+    {
+        put_bytes(buf, &val, sizeof(T));
+    }
+
+    static void put_blob(std::vector<uint8_t>& buf, const void* src, uint32_t len)
+    {
+        put_val<uint32_t>(buf, src != NULL ? len : UINT32_MAX);
+        if (src != NULL) {
+            put_bytes(buf, src, len);
+        }
+    }
+
+    static void put_str(std::vector<uint8_t>& buf, const char* str)
+    {
+        put_blob(buf, str, str != NULL ? strlen(str) : 0);
+    }
+
+    struct wire_reader {
+        const uint8_t* pos;
+        const uint8_t* end;
+        bool ok;
+    };
+
+    template <typename T>
+    static T get_val(wire_reader& rd)
+    {
+        T val;
+        memset(&val, 0, sizeof(T));
+        if (rd.end - rd.pos < (ptrdiff_t)sizeof(T)) {
+            rd.ok = false;
+            return val;
+        }
+        memcpy(&val, rd.pos, sizeof(T));
+        rd.pos += sizeof(T);
+        return val;
+    }
+
+    // malloced and zero terminated, NULL if it was sent as NULL, len may be NULL
+    static char* get_blob(wire_reader& rd, uint32_t* len)
+    {
+        uint32_t blob_len = get_val<uint32_t>(rd);
+        if (!rd.ok || blob_len == UINT32_MAX) {
+            return NULL;
+        }
+        if (rd.end - rd.pos < (ptrdiff_t)blob_len) {
+            rd.ok = false;
+            return NULL;
+        }
+        char* blob = (char*)malloc(blob_len + 1);
+        memcpy(blob, rd.pos, blob_len);
+        blob[blob_len] = '\0';
+        rd.pos += blob_len;
+        if (len != NULL) {
+            *len = blob_len;
+        }
+        return blob;
+    }
+
+    static char* get_str(wire_reader& rd)
+    {
+        return get_blob(rd, NULL);
+    }
+
+    // combo variants are a sequence of zero terminated strings, ended by an empty one
+    static uint32_t var_size(const char* var)
+    {
+        const char* varp = var;
+        while (*varp != '\0') {
+            varp += strlen(varp) + 1;
+        }
+        return varp - var + 1;
+    }
+
+    static void encode_game_load(std::vector<uint8_t>& buf, game* the_game)
+    {
+        // the game only exists in this process, the child recreates it from its own catalogue
+        const game_methods* methods = the_game->methods;
+        put_str(buf, methods->game_name);
+        put_str(buf, methods->variant_name);
+        put_str(buf, methods->impl_name);
+        size_t size_fill;
+        char* opts = NULL;
+        if (methods->features.options) {
+            opts = (char*)malloc(the_game->sizer.options_str);
+            methods->export_options(the_game, &size_fill, opts);
+        }
+        char* state = (char*)malloc(the_game->sizer.state_str);
+        methods->export_state(the_game, &size_fill, state);
+        put_str(buf, opts);
+        put_str(buf, state);
+        free(opts);
+        free(state);
+    }
+
+    static void encode_eevent(std::vector<uint8_t>& buf, const engine_event& e)
+    {
+        buf.clear();
+        put_val<uint32_t>(buf, e.type);
+        put_val<uint32_t>(buf, e.engine_id);
+        switch (e.type) {
+            case EE_TYPE_LOG: {
+                put_val<error_code>(buf, e.log.ec);
+                put_str(buf, e.log.text);
+            } break;
+            case EE_TYPE_HEARTBEAT: {
+                put_val<uint32_t>(buf, e.heartbeat.id);
+            } break;
+            case EE_TYPE_GAME_LOAD: {
+                encode_game_load(buf, e.load.the_game);
+            } break;
+            case EE_TYPE_GAME_STATE: {
+                put_str(buf, e.state.state);
+            } break;
+            case EE_TYPE_GAME_MOVE: {
+                put_val<player_id>(buf, e.move.player);
+                put_val<move_code>(buf, e.move.code);
+            } break;
+            case EE_TYPE_GAME_SYNC: {
+                put_blob(buf, e.sync.data_start, (uint8_t*)e.sync.data_end - (uint8_t*)e.sync.data_start);
+            } break;
+            case EE_TYPE_GAME_DRAW: {
+                put_val<bool>(buf, e.draw.accept);
+            } break;
+            case EE_TYPE_ENGINE_ID: {
+                put_str(buf, e.id.name);
+                put_str(buf, e.id.author);
+            } break;
+            case EE_TYPE_ENGINE_OPTION: {
+                put_str(buf, e.option.name);
+                put_val<uint32_t>(buf, e.option.type);
+                switch (e.option.type) {
+                    case EE_OPTION_TYPE_CHECK: {
+                        put_val<bool>(buf, e.option.value.check);
+                    } break;
+                    case EE_OPTION_TYPE_SPIN:
+                    case EE_OPTION_TYPE_U64: {
+                        // spin and u64 share the storage
+                        put_val<uint64_t>(buf, e.option.value.u64);
+                        put_val<uint64_t>(buf, e.option.l.mm.min);
+                        put_val<uint64_t>(buf, e.option.l.mm.max);
+                    } break;
+                    case EE_OPTION_TYPE_COMBO: {
+                        put_str(buf, e.option.value.combo);
+                        put_blob(buf, e.option.l.v.var, e.option.l.v.var != NULL ? var_size(e.option.l.v.var) : 0);
+                    } break;
+                    case EE_OPTION_TYPE_STRING: {
+                        put_str(buf, e.option.value.str);
+                    } break;
+                    case EE_OPTION_TYPE_SPIND: {
+                        put_val<double>(buf, e.option.value.spind);
+                        put_val<double>(buf, e.option.l.mmd.min);
+                        put_val<double>(buf, e.option.l.mmd.max);
+                    } break;
+                    default: {
+                        // NONE removes the option, BUTTON has no value
+                    } break;
+                }
+            } break;
+            case EE_TYPE_ENGINE_START: {
+                //TODO time controls, the engine manager does not send any yet
+                put_val<player_id>(buf, e.start.player);
+                put_val<uint32_t>(buf, e.start.timeout);
+                put_val<bool>(buf, e.start.ponder);
+            } break;
+            case EE_TYPE_ENGINE_SEARCHINFO: {
+                put_val<ee_engine_searchinfo>(buf, e.searchinfo);
+            } break;
+            case EE_TYPE_ENGINE_STOP: {
+                put_val<bool>(buf, e.stop.all_score_infos);
+                put_val<bool>(buf, e.stop.all_move_scores);
+            } break;
+            case EE_TYPE_ENGINE_BESTMOVE: {
+                // towards the engine this is the empty poll, from it the actual moves
+                put_val<uint32_t>(buf, e.bestmove.count);
+                if (e.bestmove.count > 0) {
+                    put_bytes(buf, e.bestmove.player, sizeof(player_id) * e.bestmove.count);
+                    put_bytes(buf, e.bestmove.move, sizeof(move_code) * e.bestmove.count);
+                    put_bytes(buf, e.bestmove.confidence, sizeof(float) * e.bestmove.count);
+                }
+            } break;
+            default: {
+                //TODO scoreinfo, lineinfo and movescore only carry their type for now, the engine manager does not read them yet
+                // exit, game unload and resign have no payload
+            } break;
+        }
+    }
+
+    // game loads need the catalogue of the child to recreate the game, loaded_impl keeps its plugin open
+    static bool decode_eevent(const std::vector<uint8_t>& buf, engine_event* e, Control::PluginManager* plugin_mgr, Control::BaseGameVariantImpl* loaded_impl)
+    {
+        wire_reader rd = wire_reader{
+            .pos = buf.data(),
+            .end = buf.data() + buf.size(),
+            .ok = true,
+        };
+        EE_TYPE type = (EE_TYPE)get_val<uint32_t>(rd);
+        uint32_t engine_id = get_val<uint32_t>(rd);
+        if (!rd.ok) {
+            return false;
+        }
+        switch (type) {
+            case EE_TYPE_HEARTBEAT: {
+                uint32_t id = get_val<uint32_t>(rd);
+                eevent_create_heartbeat(e, engine_id, id);
+            } break;
+            case EE_TYPE_GAME_LOAD: {
+                char* base_name = get_str(rd);
+                char* variant_name = get_str(rd);
+                char* impl_name = get_str(rd);
+                char* opts = get_str(rd);
+                char* state = get_str(rd);
+                game* the_game = NULL;
+                if (rd.ok && plugin_mgr != NULL && base_name != NULL && variant_name != NULL && impl_name != NULL) {
+                    if (plugin_mgr->acquire_game_impl(base_name, variant_name, impl_name, loaded_impl)) {
+                        game_init init_info;
+                        init_info.source_type = GAME_INIT_SOURCE_TYPE_STANDARD;
+                        init_info.source.standard = {
+                            .opts = opts,
+                            .legacy = NULL,
+                            .state = state,
+                        };
+                        the_game = loaded_impl->new_game(init_info);
+                    } else {
+                        printf("[WARN] engine host: failed to find game: %s.%s.%s\n", base_name, variant_name, impl_name);
+                    }
+                }
+                if (the_game != NULL) {
+                    eevent_create_load(e, engine_id, the_game);
+                    the_game->methods->destroy(the_game);
+                    free(the_game);
+                }
+                free(base_name);
+                free(variant_name);
+                free(impl_name);
+                free(opts);
+                free(state);
+                if (the_game == NULL) {
+                    return false;
+                }
+            } break;
+            case EE_TYPE_GAME_STATE: {
+                char* state = get_str(rd);
+                eevent_create_state(e, engine_id, state);
+                free(state);
+            } break;
+            case EE_TYPE_GAME_MOVE: {
+                player_id player = get_val<player_id>(rd);
+                move_code code = get_val<move_code>(rd);
+                eevent_create_move(e, engine_id, player, code);
+            } break;
+            case EE_TYPE_GAME_SYNC: {
+                uint32_t len = 0;
+                char* data = get_blob(rd, &len);
+                eevent_create_sync(e, engine_id, data, data + len);
+                free(data);
+            } break;
+            case EE_TYPE_ENGINE_START: {
+                player_id player = get_val<player_id>(rd);
+                uint32_t timeout = get_val<uint32_t>(rd);
+                bool ponder = get_val<bool>(rd);
+                eevent_create_start(e, engine_id, player, timeout, ponder, 0, NULL);
+            } break;
+            case EE_TYPE_ENGINE_STOP: {
+                bool all_score_infos = get_val<bool>(rd);
+                bool all_move_scores = get_val<bool>(rd);
+                eevent_create_stop(e, engine_id, all_score_infos, all_move_scores);
+            } break;
+            default: {
+                // everything else is filled in directly, the event owns the malloced strings and arrays just like when the engine created it
+                eevent_create(e, engine_id, type);
+                switch (type) {
+                    case EE_TYPE_LOG: {
+                        e->log.ec = get_val<error_code>(rd);
+                        e->log.text = get_str(rd);
+                    } break;
+                    case EE_TYPE_GAME_DRAW: {
+                        e->draw.accept = get_val<bool>(rd);
+                    } break;
+                    case EE_TYPE_ENGINE_ID: {
+                        e->id.name = get_str(rd);
+                        e->id.author = get_str(rd);
+                    } break;
+                    case EE_TYPE_ENGINE_OPTION: {
+                        e->option.name = get_str(rd);
+                        e->option.type = (EE_OPTION_TYPE)get_val<uint32_t>(rd);
+                        switch (e->option.type) {
+                            case EE_OPTION_TYPE_CHECK: {
+                                e->option.value.check = get_val<bool>(rd);
+                            } break;
+                            case EE_OPTION_TYPE_SPIN:
+                            case EE_OPTION_TYPE_U64: {
+                                e->option.value.u64 = get_val<uint64_t>(rd);
+                                e->option.l.mm.min = get_val<uint64_t>(rd);
+                                e->option.l.mm.max = get_val<uint64_t>(rd);
+                            } break;
+                            case EE_OPTION_TYPE_COMBO: {
+                                e->option.value.combo = get_str(rd);
+                                e->option.l.v.var = get_blob(rd, NULL);
+                            } break;
+                            case EE_OPTION_TYPE_STRING: {
+                                e->option.value.str = get_str(rd);
+                            } break;
+                            case EE_OPTION_TYPE_SPIND: {
+                                e->option.value.spind = get_val<double>(rd);
+                                e->option.l.mmd.min = get_val<double>(rd);
+                                e->option.l.mmd.max = get_val<double>(rd);
+                            } break;
+                            default: {
+                                // pass
+                            } break;
+                        }
+                    } break;
+                    case EE_TYPE_ENGINE_SEARCHINFO: {
+                        e->searchinfo = get_val<ee_engine_searchinfo>(rd);
+                    } break;
+                    case EE_TYPE_ENGINE_BESTMOVE: {
+                        uint32_t count = get_val<uint32_t>(rd);
+                        if (!rd.ok || (size_t)(rd.end - rd.pos) < (sizeof(player_id) + sizeof(move_code) + sizeof(float)) * (size_t)count) {
+                            rd.ok = false;
+                            break;
+                        }
+                        e->bestmove.count = count;
+                        if (count == 0) {
+                            break;
+                        }
+                        e->bestmove.player = (player_id*)malloc(sizeof(player_id) * count);
+                        e->bestmove.move = (move_code*)malloc(sizeof(move_code) * count);
+                        e->bestmove.confidence = (float*)malloc(sizeof(float) * count);
+                        memcpy(e->bestmove.player, rd.pos, sizeof(player_id) * count);
+                        rd.pos += sizeof(player_id) * count;
+                        memcpy(e->bestmove.move, rd.pos, sizeof(move_code) * count);
+                        rd.pos += sizeof(move_code) * count;
+                        memcpy(e->bestmove.confidence, rd.pos, sizeof(float) * count);
+                        rd.pos += sizeof(float) * count;
+                    } break;
+                    default: {
+                        // no payload
+                    } break;
+                }
+            } break;
+        }
+        if (!rd.ok) {
+            eevent_destroy(e);
+            return false;
+        }
+        return true;
+    }
+
+    EngineHost::EngineHost():
+        engine_id(0),
+        outbox(NULL),
+        shm_fd(-1),
+        rings(NULL),
+        child(-1),
+        stopping(false)
+    {}
+
+    EngineHost::~EngineHost()
+    {
+        stopping.store(true);
+        if (rings != NULL) {
+            ring_close(&rings->to_child);
+            ring_close(&rings->to_host);
+        }
+        if (send_runner.joinable()) {
+            send_runner.join();
+        }
+        if (recv_runner.joinable()) {
+            recv_runner.join();
+        }
+        if (child > 0) {
+            // never got to the pumps
+            kill(child, SIGKILL);
+            waitpid(child, NULL, 0);
+        }
+        if (outbox != NULL) {
+            eevent_queue_destroy(&inbox);
+        }
+        if (rings != NULL) {
+            munmap(rings, sizeof(shm_rings));
+        }
+        if (shm_fd >= 0) {
+            close(shm_fd);
+        }
+    }
+
+    void EngineHost::destroy_async(EngineHost* host)
+    {
+        if (host == NULL) {
+            return;
+        }
+        // from here on nothing reaches the outbox, the rest can take until the child is reaped
+        host->stopping.store(true);
+        if (host->rings != NULL) {
+            ring_close(&host->rings->to_child);
+            ring_close(&host->rings->to_host);
+        }
+        Control::thread_runtime.spawn("ehreap" + std::to_string(host->engine_id), [host]() { delete host; }).detach();
+    }
+
+    bool EngineHost::start(const char* engine_name, uint32_t engine_id, eevent_queue* outbox, eevent_queue** eq, engine_host_limits limits)
+    {
+        // close on exec for every other child and a re-exec of the host, only the engine child clears it again
+        shm_fd = memfd_create("mirabel_engine_host", MFD_CLOEXEC);
+        if (shm_fd < 0) {
+            return false;
+        }
+        if (ftruncate(shm_fd, sizeof(shm_rings)) != 0) {
+            return false;
+        }
+        void* shm = mmap(NULL, sizeof(shm_rings), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+        if (shm == MAP_FAILED) {
+            return false;
+        }
+        rings = (shm_rings*)shm;
+
+        // everything the child needs is prepared up front, after fork only async signal safe calls until exec
+        char fd_str[16];
+        char id_str[16];
+        sprintf(fd_str, "%d", shm_fd);
+        sprintf(id_str, "%u", engine_id);
+        struct rlimit mem_limit;
+        mem_limit.rlim_cur = limits.memory_mb << 20;
+        mem_limit.rlim_max = limits.memory_mb << 20;
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        if (limits.cpu >= 0) {
+            CPU_SET(limits.cpu, &cpus);
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            // the engine goes down with the host, however the host goes down
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if (limits.memory_mb > 0) {
+                setrlimit(RLIMIT_AS, &mem_limit);
+            }
+            if (limits.cpu >= 0) {
+                sched_setaffinity(0, sizeof(cpus), &cpus);
+            }
+            // the child finds the rings under the same fd number
+            fcntl(shm_fd, F_SETFD, 0);
+            execl("/proc/self/exe", "mirabel", "engine-host", fd_str, engine_name, id_str, (char*)NULL);
+            _exit(127);
+        }
+        if (pid < 0) {
+            return false;
+        }
+        child = pid;
+        this->engine_id = engine_id;
+        this->outbox = outbox;
+        eevent_queue_create(&inbox);
+        *eq = &inbox;
+        send_runner = Control::thread_runtime.spawn("ehsend" + std::to_string(engine_id), [this]() { send_loop(); });
+        recv_runner = Control::thread_runtime.spawn("ehrecv" + std::to_string(engine_id), [this]() { recv_loop(); });
+        return true;
+    }
+
+    void EngineHost::send_loop()
+    {
+        // the manager may keep sending heartbeats after the exit until it got the exit back, so this runs until the host is destroyed
+        std::vector<uint8_t> buf;
+        engine_event e;
+        while (!stopping.load()) {
+            eevent_queue_pop(&inbox, &e, HOST_POLL_MS);
+            if (e.type == EE_TYPE_NULL) {
+                continue;
+            }
+            encode_eevent(buf, e);
+            eevent_destroy(&e);
+            // dropped if the child is gone, the recv loop reports that
+            ring_push(&rings->to_child, buf);
+        }
+    }
+
+    int EngineHost::reap()
+    {
+        int status = 0;
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(HOST_REAP_MS);
+        while (waitpid(child, &status, WNOHANG) == 0) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                kill(child, SIGKILL);
+                waitpid(child, &status, 0);
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        child = -1;
+        return status;
+    }
+
+    void EngineHost::recv_loop()
+    {
+        std::vector<uint8_t> buf;
+        engine_event e;
+        while (true) {
+            bool got = ring_pop(&rings->to_host, buf, HOST_POLL_MS);
+            if (got) {
+                if (!decode_eevent(buf, &e, NULL, NULL)) {
+                    continue;
+                }
+                if (stopping.load()) {
+                    // the manager let go of this host, its outbox may be gone already
+                    eevent_destroy(&e);
+                    continue;
+                }
+                bool exit = (e.type == EE_TYPE_EXIT);
+                eevent_queue_push(outbox, &e);
+                eevent_destroy(&e);
+                if (exit) {
+                    // the child destroyed its engine before sending this, it is on its way out
+                    ring_close(&rings->to_child);
+                    reap();
+                    return;
+                }
+                continue;
+            }
+            if (stopping.load()) {
+                // destroyed while the engine still runs, no exit is reported, nobody is listening anymore
+                reap();
+                return;
+            }
+            int status;
+            int wait_flags = WNOHANG;
+            if (rings->to_host.closed.load(std::memory_order_acquire)) {
+                // closed without an exit, or rejected as corrupt, nothing usable comes from it anymore
+                kill(child, SIGKILL);
+                wait_flags = 0;
+            }
+            if (waitpid(child, &status, wait_flags) != child) {
+                continue;
+            }
+            // died without exiting its engine, report it like an engine that exited with an error
+            child = -1;
+            ring_close(&rings->to_child);
+            char reason[128];
+            if (WIFSIGNALED(status)) {
+                sprintf(reason, "engine process killed by signal %d (%s)", WTERMSIG(status), strsignal(WTERMSIG(status)));
+            } else {
+                sprintf(reason, "engine process exited with code %d", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+            }
+            eevent_create(&e, engine_id, EE_TYPE_LOG);
+            e.log.ec = ERR_STATE_UNRECOVERABLE;
+            e.log.text = strdup(reason);
+            eevent_queue_push(outbox, &e);
+            eevent_destroy(&e);
+            eevent_create(&e, engine_id, EE_TYPE_EXIT);
+            eevent_queue_push(outbox, &e);
+            eevent_destroy(&e);
+            return;
+        }
+    }
+
+    int engine_host_main(int shm_fd, const char* engine_name, uint32_t engine_id)
+    {
+        Control::thread_runtime.adopt("enginehost");
+        void* shm = mmap(NULL, sizeof(shm_rings), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+        close(shm_fd);
+        if (shm == MAP_FAILED) {
+            printf("[ERROR] engine host: failed to map the rings\n");
+            return EXIT_FAILURE;
+        }
+        shm_rings* rings = (shm_rings*)shm;
+        std::vector<uint8_t> buf;
+        engine_event e;
+
+        // same plugins as the host, from the index this only opens the plugin that has the engine
+        Control::PluginManager plugin_mgr(true, false);
+        plugin_mgr.detect_plugins();
+        plugin_mgr.load_all_plugins();
+        uint32_t engine_idx = 0;
+        {
+            Control::PluginManager::CatalogueView catalogue = plugin_mgr.view();
+            for (uint32_t id : catalogue.list_engines()) {
+                if (strcmp(catalogue.get_engine(id).get_name(), engine_name) == 0) {
+                    engine_idx = id;
+                    break;
+                }
+            }
+        }
+        if (engine_idx == 0 || !plugin_mgr.resolve_engine(engine_idx)) {
+            char reason[512];
+            snprintf(reason, sizeof(reason), "engine process could not find engine: %s", engine_name);
+            eevent_create(&e, engine_id, EE_TYPE_LOG);
+            e.log.ec = ERR_INVALID_INPUT;
+            e.log.text = strdup(reason);
+            encode_eevent(buf, e);
+            eevent_destroy(&e);
+            ring_push(&rings->to_host, buf);
+            eevent_create(&e, engine_id, EE_TYPE_EXIT);
+            encode_eevent(buf, e);
+            eevent_destroy(&e);
+            ring_push(&rings->to_host, buf);
+            ring_close(&rings->to_host);
+            return EXIT_FAILURE;
+        }
+        Control::EngineImpl impl = plugin_mgr.view().get_engine(engine_idx);
+        engine the_engine = (engine){
+            .methods = impl.get_methods(),
+            .engine_id = engine_id,
+            .data1 = NULL,
+            .data2 = NULL,
+        };
+        eevent_queue engine_outbox;
+        eevent_queue_create(&engine_outbox);
+        eevent_queue* eq = NULL;
+        the_engine.methods->create(&the_engine, engine_id, &engine_outbox, &eq, NULL);
+
+        std::thread inbound_runner = Control::thread_runtime.spawn("ehinbound", [rings, eq, engine_id, &plugin_mgr]() {
+            Control::BaseGameVariantImpl loaded_impl((const game_methods*)NULL);
+            std::vector<uint8_t> in_buf;
+            engine_event ie;
+            while (ring_pop(&rings->to_child, in_buf, UINT32_MAX)) {
+                if (!decode_eevent(in_buf, &ie, &plugin_mgr, &loaded_impl)) {
+                    continue;
+                }
+                bool exit = (ie.type == EE_TYPE_EXIT);
+                eevent_queue_push(eq, &ie);
+                eevent_destroy(&ie);
+                if (exit) {
+                    return;
+                }
+            }
+            // closed without an exit, either the engine exited on its own or the host is gone, make sure the engine stops either way
+            eevent_create(&ie, engine_id, EE_TYPE_EXIT);
+            eevent_queue_push(eq, &ie);
+            eevent_destroy(&ie);
+        });
+
+        while (true) {
+            eevent_queue_pop(&engine_outbox, &e, UINT32_MAX);
+            if (e.type == EE_TYPE_NULL) {
+                continue;
+            }
+            bool exit = (e.type == EE_TYPE_EXIT);
+            if (exit) {
+                // the engine is done with its queues, destroy it before reporting, the host may kill this process right after
+                ring_close(&rings->to_child);
+                inbound_runner.join();
+                the_engine.methods->destroy(&the_engine);
+            }
+            encode_eevent(buf, e);
+            eevent_destroy(&e);
+            ring_push(&rings->to_host, buf);
+            if (exit) {
+                break;
+            }
+        }
+        ring_close(&rings->to_host);
+        eevent_queue_destroy(&engine_outbox);
+        munmap(rings, sizeof(shm_rings));
+        return EXIT_SUCCESS;
+    }
+
+} // namespace Engines
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include <sys/types.h>
+
+#include "surena/engine.h"
+
+namespace Engines {
+
+    struct engine_host_limits {
+        uint64_t memory_mb; // address space of the engine process, 0 for unlimited
+        int cpu; // pin the engine process to this cpu, -1 to leave it to the scheduler
+    };
+
+    struct shm_rings;
+
+    // runs a catalogue engine in a child process, the engine manager sees the same interface as for an in process engine:
+    // an inbox to push eevents into, and everything the engine sends arrives in the outbox
+    // the eevents travel through a pair of single producer single consumer rings in memory shared with the child
+    // if the child dies the outbox receives an error log and an exit, just like a regular engine exit
+    class EngineHost {
+      private:
+
+        uint32_t engine_id;
+        eevent_queue* outbox;
+        eevent_queue inbox;
+        int shm_fd;
+        shm_rings* rings;
+        pid_t child;
+        std::atomic<bool> stopping;
+        std::thread send_runner;
+        std::thread recv_runner;
+
+        void send_loop();
+        void recv_loop();
+        // waits a moment for the child to exit on its own before killing it, returns the wait status
+        int reap();
+
+      public:
+
+        EngineHost();
+        EngineHost(const EngineHost& other) = delete; // copy construct
+        EngineHost& operator=(const EngineHost& other) = delete; // copy assign
+        // kills the child if it is still running, blocks until the pumps stopped and the child is reaped
+        ~EngineHost();
+        // same as delete, but returns right away, the blocking part runs on a detached thread
+        static void destroy_async(EngineHost* host);
+
+        // forks and execs this binary as "engine-host", which then loads the catalogue and creates the named engine
+        // eq is only set if the child was started, engine errors after that arrive through the outbox
+        bool start(const char* engine_name, uint32_t engine_id, eevent_queue* outbox, eevent_queue** eq, engine_host_limits limits);
+    };
+
+    // main of the child process, serves one engine over the rings in the inherited shared memory fd, returns a process exit code
+    int engine_host_main(int shm_fd, const char* engine_name, uint32_t engine_id);
+
+} // namespace Engines
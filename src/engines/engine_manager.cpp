@@ -1,6 +1,8 @@
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <unordered_map>
 #include <vector>
 
 #include <SDL2/SDL.h>
@@ -21,6 +23,8 @@ namespace Engines {
         remove(false),
         catalogue_idx(0),
         load_options(NULL),
+        options_impl((const engine_methods*)NULL),
+        running_impl((const engine_methods*)NULL),
         name(_name),
         swap_names(false),
         ai_slot(_ai_slot),
@@ -31,6 +35,12 @@ namespace Engines {
             .data2 = NULL,
         }),
         eq(NULL),
+        out_of_process(false),
+        host_limits((engine_host_limits){
+            .memory_mb = 0,
+            .cpu = -1,
+        }),
+        host(NULL),
         stopping(false),
         heartbeat_next_id(0),
         heartbeat_last_response(0),
@@ -63,6 +73,10 @@ namespace Engines {
 
     EngineManager::engine_container::~engine_container()
     {
+        // kills the engine process if it still runs, without waiting for it here
+        EngineHost::destroy_async(host);
+        host = NULL;
+        destroy_load_options();
         free(name);
         name = NULL;
         free(name_swap);
@@ -90,6 +104,34 @@ namespace Engines {
         bestmove_strings.clear();
     }
 
+    void EngineManager::engine_container::merge_searchinfo(const ee_engine_searchinfo& update)
+    {
+        fold_searchinfo(searchinfo, update);
+    }
+
+    void EngineManager::engine_container::fold_searchinfo(ee_engine_searchinfo& into, const ee_engine_searchinfo& update)
+    {
+        into.flags |= update.flags;
+        if (update.flags & EE_SEARCHINFO_FLAG_TYPE_TIME) {
+            into.time = update.time;
+        }
+        if (update.flags & EE_SEARCHINFO_FLAG_TYPE_DEPTH) {
+            into.depth = update.depth;
+        }
+        if (update.flags & EE_SEARCHINFO_FLAG_TYPE_SELDEPTH) {
+            into.seldepth = update.seldepth;
+        }
+        if (update.flags & EE_SEARCHINFO_FLAG_TYPE_NODES) {
+            into.nodes = update.nodes;
+        }
+        if (update.flags & EE_SEARCHINFO_FLAG_TYPE_NPS) {
+            into.nps = update.nps;
+        }
+        if (update.flags & EE_SEARCHINFO_FLAG_TYPE_HASHFULL) {
+            into.hashfull = update.hashfull;
+        }
+    }
+
     void EngineManager::engine_container::start_search()
     {
         searchinfo.flags = 0; // for now reset flags at least before a new search
@@ -159,6 +201,22 @@ namespace Engines {
         option->type = EE_OPTION_TYPE_NONE;
     }
 
+    void EngineManager::engine_container::create_load_options(const Control::EngineImpl& impl)
+    {
+        destroy_load_options();
+        options_impl = impl;
+        options_impl.create_opts(&load_options);
+    }
+
+    void EngineManager::engine_container::destroy_load_options()
+    {
+        if (options_impl.get_methods() != NULL) {
+            options_impl.destroy_opts(load_options);
+        }
+        load_options = NULL;
+        options_impl = Control::EngineImpl((const engine_methods*)NULL);
+    }
+
     EngineManager::EngineManager(event_queue* _client_inbox):
         client_inbox(_client_inbox)
     {
@@ -169,16 +227,35 @@ namespace Engines {
     EngineManager::~EngineManager()
     {
         //TODO send exit to all engines, wait, destroy all containers
+        for (size_t i = update_batch_pos; i < update_batch.size(); i++) {
+            eevent_destroy(&update_batch[i]);
+        }
         eevent_queue_destroy(&engine_outbox);
         MetaGui::log_unregister(log);
     }
 
+    void EngineManager::hold_game_plugin(engine_container& tec)
+    {
+        // the clone runs on the methods of the game the client has loaded right now
+        const Control::plugin_ref& plugin = Control::main_client->the_game_impl.plugin;
+        if (!plugin) {
+            return;
+        }
+        for (const Control::plugin_ref& held : tec.game_plugins) {
+            if (held == plugin) {
+                return;
+            }
+        }
+        tec.game_plugins.push_back(plugin);
+    }
+
     void EngineManager::game_load(game* target_game)
     {
         engine_event e;
         for (int i = 0; i < engines.size(); i++) {
             if (engines[i]->eq) {
                 if (target_game != NULL) {
+                    hold_game_plugin(*engines[i]);
                     eevent_create_load(&e, engines[i]->e.engine_id, target_game);
                 } else {
                     eevent_create(&e, engines[i]->e.engine_id, EE_TYPE_GAME_UNLOAD);
@@ -225,19 +302,83 @@ namespace Engines {
         }
     }
 
+    void EngineManager::fill_update_batch()
+    {
+        update_batch.clear();
+        update_batch_pos = 0;
+        engine_event e;
+        while (update_batch.size() < UPDATE_BATCH_MAX) {
+            eevent_queue_pop(&engine_outbox, &e, 0);
+            if (e.type == EE_TYPE_NULL) {
+                break;
+            }
+            update_batch.push_back(e);
+        }
+        // a searching engine streams searchinfos, within a run of consecutive searchinfos from one engine only the last of them is handled
+        // the earlier ones are folded into it, so the merged state comes out the same as handling each of them
+        // any other event ends the run, a searchinfo must not move past e.g. a bestmove or stop of its engine
+        size_t run_searchinfo = SIZE_MAX;
+        for (size_t i = 0; i < update_batch.size(); i++) {
+            engine_event& cur = update_batch[i];
+            if (i > 0 && cur.engine_id != update_batch[i - 1].engine_id) {
+                run_searchinfo = SIZE_MAX;
+            }
+            if (cur.type != EE_TYPE_ENGINE_SEARCHINFO) {
+                run_searchinfo = SIZE_MAX;
+                continue;
+            }
+            if (run_searchinfo != SIZE_MAX) {
+                engine_event& prev = update_batch[run_searchinfo];
+                ee_engine_searchinfo folded = prev.searchinfo;
+                engine_container::fold_searchinfo(folded, cur.searchinfo);
+                cur.searchinfo = folded;
+                eevent_destroy(&prev);
+                prev.type = EE_TYPE_NULL;
+            }
+            run_searchinfo = i;
+        }
+    }
+
+    bool EngineManager::next_update_event(engine_event* e)
+    {
+        while (true) {
+            while (update_batch_pos < update_batch.size()) {
+                engine_event& be = update_batch[update_batch_pos++];
+                if (be.type != EE_TYPE_NULL) {
+                    *e = be;
+                    return true;
+                }
+            }
+            fill_update_batch();
+            if (update_batch.size() == 0) {
+                return false;
+            }
+        }
+    }
+
     void EngineManager::update()
     {
         engine_event e = (engine_event){
             .type = EE_TYPE_NULL};
+        std::chrono::steady_clock::time_point budget_end = std::chrono::steady_clock::now() + std::chrono::microseconds(UPDATE_BUDGET_US);
+        uint32_t handled = 0;
+        engine_container* tec_p = NULL; // a streaming engine sends long runs of events, those skip the lookup
         do {
             eevent_destroy(&e);
-            eevent_queue_pop(&engine_outbox, &e, 0);
-            if (e.type == EE_TYPE_NULL) {
+            // an engine flooding the outbox must not stall the frame, the remainder is handled next frame
+            if (++handled % UPDATE_BUDGET_CHECK_INTERVAL == 0 && std::chrono::steady_clock::now() > budget_end) {
+                e.type = EE_TYPE_NULL;
                 break;
             }
-            engine_container* tec_p = container_by_engine_id(e.engine_id);
+            if (!next_update_event(&e)) {
+                e.type = EE_TYPE_NULL;
+                break;
+            }
+            if (tec_p == NULL || tec_p->e.engine_id != e.engine_id) {
+                tec_p = container_by_engine_id(e.engine_id);
+            }
             if (tec_p == NULL) {
-                MetaGui::logf(log, "#W E%u container does not exists, eevent discarded\n");
+                MetaGui::logf(log, "#W E%u container does not exists, eevent discarded\n", e.engine_id);
                 continue;
             }
             engine_container& tec = *tec_p;
@@ -247,7 +388,15 @@ namespace Engines {
                 } break;
                 case EE_TYPE_EXIT: {
                     MetaGui::logf(log, "E%u exitted\n", e.engine_id);
-                    tec.e.methods->destroy(&tec.e);
+                    if (tec.host != NULL) {
+                        // the child destroyed its engine already, this just reaps it, off the gui thread
+                        EngineHost::destroy_async(tec.host);
+                        tec.host = NULL;
+                    } else {
+                        tec.e.methods->destroy(&tec.e);
+                    }
+                    tec.running_impl.plugin.reset();
+                    tec.game_plugins.clear();
                     tec.eq = NULL;
                     tec.stopping = false;
                     tec.heartbeat_next_id = 0;
@@ -407,25 +556,8 @@ namespace Engines {
                     tec.searching = true;
                 } break;
                 case EE_TYPE_ENGINE_SEARCHINFO: {
-                    tec.searchinfo.flags |= e.searchinfo.flags;
-                    if (e.searchinfo.flags & EE_SEARCHINFO_FLAG_TYPE_TIME) {
-                        tec.searchinfo.time = e.searchinfo.time;
-                    }
-                    if (e.searchinfo.flags & EE_SEARCHINFO_FLAG_TYPE_DEPTH) {
-                        tec.searchinfo.depth = e.searchinfo.depth;
-                    }
-                    if (e.searchinfo.flags & EE_SEARCHINFO_FLAG_TYPE_SELDEPTH) {
-                        tec.searchinfo.seldepth = e.searchinfo.seldepth;
-                    }
-                    if (e.searchinfo.flags & EE_SEARCHINFO_FLAG_TYPE_NODES) {
-                        tec.searchinfo.nodes = e.searchinfo.nodes;
-                    }
-                    if (e.searchinfo.flags & EE_SEARCHINFO_FLAG_TYPE_NPS) {
-                        tec.searchinfo.nps = e.searchinfo.nps;
-                    }
-                    if (e.searchinfo.flags & EE_SEARCHINFO_FLAG_TYPE_HASHFULL) {
-                        tec.searchinfo.hashfull = e.searchinfo.hashfull;
-                    }
+                    // the gui only shows the latest values, so a burst of searchinfos just overwrites them in place
+                    tec.merge_searchinfo(e.searchinfo);
                 } break;
                 case EE_TYPE_ENGINE_SCOREINFO: {
                     //TODO
@@ -488,6 +620,7 @@ namespace Engines {
                 tec.heartbeat_last_ticks = sdl_ticks;
             }
             if (tec.remove) {
+                engine_index.erase(tec.e.engine_id);
                 delete engines[i];
                 engines.erase(engines.begin() + i);
             } else {
@@ -498,12 +631,11 @@ namespace Engines {
 
     EngineManager::engine_container* EngineManager::container_by_engine_id(uint32_t engine_id)
     {
-        for (int i = 0; i < engines.size(); i++) {
-            if (engines[i]->e.engine_id == engine_id) {
-                return engines[i];
-            }
+        std::unordered_map<uint32_t, engine_container*>::iterator it = engine_index.find(engine_id);
+        if (it == engine_index.end()) {
+            return NULL;
         }
-        return NULL;
+        return it->second;
     }
 
     void EngineManager::add_container(player_id ai_slot)
@@ -515,6 +647,7 @@ namespace Engines {
             sprintf(name, "P%03hhu", ai_slot);
         }
         engines.push_back(new engine_container(name, ai_slot, next_engine_id++));
+        engine_index[engines.back()->e.engine_id] = engines.back();
     }
 
     void EngineManager::rename_container(uint32_t container_idx)
@@ -539,8 +672,24 @@ namespace Engines {
     {
         assert(container_idx < engines.size());
         engine_container& tec = *engines[container_idx];
-        tec.e.methods = Control::main_client->plugin_mgr.engine_lookup[tec.catalogue_idx]->get_methods();
-        {
+        // the engine keeps running on this version even if its plugin is reloaded meanwhile
+        if (!Control::main_client->plugin_mgr.resolve_engine(tec.catalogue_idx)) {
+            return;
+        }
+        tec.running_impl = Control::main_client->plugin_mgr.view().get_engine(tec.catalogue_idx);
+        tec.e.methods = tec.running_impl.get_methods();
+        if (tec.out_of_process) {
+            // the child opens the plugin on its own and only learns the engine name from here
+            tec.host = new EngineHost();
+            if (!tec.host->start(tec.running_impl.get_name(), tec.e.engine_id, &engine_outbox, &tec.eq, tec.host_limits)) {
+                MetaGui::logf(log, "#W E%u failed to start engine process\n", tec.e.engine_id);
+                delete tec.host;
+                tec.host = NULL;
+                tec.eq = NULL;
+                tec.running_impl.plugin.reset();
+                return;
+            }
+        } else {
             //TODO handle engine errors
             //tec.e.methods->create_with_opts_bin(&tec.e, tec.e.engine_id, &engine_outbox, &tec.eq, tec.load_options);
             // binary opts engines wrap needs to provide bin to str
@@ -554,6 +703,7 @@ namespace Engines {
         tec.heartbeat_last_ticks = SDL_GetTicks64();
         // send the engine the currently running game, if any
         if (Control::main_client->the_game != NULL) {
+            hold_game_plugin(tec);
             eevent_create_load(&e, tec.e.engine_id, Control::main_client->the_game);
             eevent_queue_push(tec.eq, &e);
             eevent_destroy(&e);
@@ -1,12 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <unordered_map>
 #include <vector>
 
 #include "surena/engine.h"
 #include "surena/game.h"
 
 #include "mirabel/event_queue.h"
+#include "control/plugins.hpp"
+#include "engines/engine_host.hpp"
 
 #include "surena/engine.h"
 
@@ -17,6 +20,12 @@ namespace Engines {
       public:
 
         static const size_t STR_BUF_MAX = 512;
+        // time per frame for handling engine events, whatever is left in the outbox waits for the next frame
+        static const uint32_t UPDATE_BUDGET_US = 2000;
+        // events handled between looking at the clock, a searchinfo is cheaper than reading the time
+        static const uint32_t UPDATE_BUDGET_CHECK_INTERVAL = 32;
+        // outbox events taken at once, superseded searchinfos within them are folded into the last one before handling
+        static const uint32_t UPDATE_BATCH_MAX = 256;
 
         uint32_t next_engine_id = 1;
 
@@ -25,12 +34,18 @@ namespace Engines {
             bool remove;
             uint32_t catalogue_idx;
             void* load_options;
+            Control::EngineImpl options_impl; // created load_options, they always go back to it, the copy keeps its plugin open
+            Control::EngineImpl running_impl; // e.methods belong to this, held until the engine exited
+            std::vector<Control::plugin_ref> game_plugins; // of every game clone sent to the engine, it may destroy them any time until it exited
             char* name; // tab name
             char* name_swap; // editing tab name
             bool swap_names;
             player_id ai_slot; // ai_slot != 0 to make the tab unclosable and mark with dot to show connection to an ai
             engine e; // contains the engine_id, which uniquely identifies this tab
             eevent_queue* eq; // also used to easily test if an engine exists here
+            bool out_of_process; // start the engine in its own process, set before starting
+            engine_host_limits host_limits;
+            EngineHost* host; // only while an out of process engine runs, then eq is its inbox
             bool stopping;
             uint32_t heartbeat_next_id;
             uint32_t heartbeat_last_response;
@@ -64,12 +79,18 @@ namespace Engines {
             engine_container& operator=(engine_container&& other) = delete; // move assign
             ~engine_container();
 
+            void merge_searchinfo(const ee_engine_searchinfo& update); // only takes the values flagged in update
+            static void fold_searchinfo(ee_engine_searchinfo& into, const ee_engine_searchinfo& update);
+
             void start_search();
             void search_poll_bestmove();
             void stop_search();
 
             void submit_option(ee_engine_option* option);
             void destroy_option(ee_engine_option* option);
+
+            void create_load_options(const Control::EngineImpl& impl);
+            void destroy_load_options();
         };
 
         //TODO figure out what can be private
@@ -78,8 +99,11 @@ namespace Engines {
         event_queue* client_inbox;
 
         eevent_queue engine_outbox; // this is where engines post their results
+        std::vector<engine_event> update_batch; // taken from the outbox, from update_batch_pos on not handled yet, kept over a frame that ran out of budget
+        size_t update_batch_pos = 0;
 
         std::vector<engine_container*> engines;
+        std::unordered_map<uint32_t, engine_container*> engine_index; // by engine_id, ids are never reused
 
         // methods
 
@@ -87,11 +111,14 @@ namespace Engines {
 
         ~EngineManager();
 
+        void hold_game_plugin(engine_container& tec); // keeps the plugin of the client's game open for the clones tec gets
         void game_load(game* target_game); // clones the game, unload is just game == NULL
         void game_state(const char* state);
         void game_move(player_id player, move_code code);
         void game_sync(void* data_start, void* data_end);
 
+        void fill_update_batch();
+        bool next_update_event(engine_event* e); // false once the outbox is empty
         void update();
 
         engine_container* container_by_engine_id(uint32_t engine_id);
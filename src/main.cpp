@@ -1,12 +1,43 @@
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
+#include <unistd.h>
+
 #include "rosalia/semver.h"
 
+#ifndef SERVER
 #include "control/client.hpp"
+#include "engines/engine_host.hpp"
+#endif
 #include "control/server.hpp"
+#include "control/thread_runtime.hpp"
+#include "control/trace_replay.hpp"
 #include "generated/git_commit_hash.h"
 
+static const char* trace_path = NULL;
+
+static int run_server(char** argv)
+{
+    Control::thread_runtime.adopt("server");
+    Control::Server* the_server = new Control::Server();
+    if (trace_path != NULL && the_server->trace.open_write(trace_path)) {
+        printf("[INFO] recording event trace to %s\n", trace_path);
+    }
+    the_server->loop();
+    bool restart = the_server->restart_requested.load();
+    delete the_server; // closes everything, so nothing leaks into the new process
+    if (restart) {
+        // same arguments, the new binary restores the lobbies from their journals and the clients reconnect on their own
+        printf("[INFO] re-executing %s\n", argv[0]);
+        execvp(argv[0], argv);
+        fprintf(stderr, "[FATAL] restart failed: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char** argv)
 {
     //TODO replace with proper, wait surena main for update
@@ -15,25 +46,44 @@ int main(int argc, char** argv)
         char* w_arg = argv[argc - (w_argc--)]; // working arg
         char* n_arg = (w_argc > 0) ? argv[argc - w_argc] : NULL; // next arg
         if (strcmp(w_arg, "version") == 0) {
+#ifndef SERVER
             printf("mirabel client version %u.%u.%u\n", Control::client_version.major, Control::client_version.minor, Control::client_version.patch);
+#endif
             printf("mirabel server version %u.%u.%u\n", Control::server_version.major, Control::server_version.minor, Control::server_version.patch);
             //TODO api versions?
             printf("git commit hash: %s%s\n", GIT_COMMIT_HASH == NULL ? "<no commit info available>" : GIT_COMMIT_HASH, GIT_COMMIT_DIRTY ? " (dirty)" : "");
             exit(EXIT_SUCCESS);
+        } else if (strcmp(w_arg, "trace") == 0 && n_arg != NULL) {
+            // record the events of the server started after this, e.g. "trace events.mbt server"
+            trace_path = n_arg;
+            w_argc--;
+        } else if (strcmp(w_arg, "replay") == 0 && n_arg != NULL) {
+            // "replay events.mbt [realtime]", benchmark a fresh server against a recorded trace
+            bool realtime = (w_argc > 1 && strcmp(argv[argc - w_argc + 1], "realtime") == 0);
+            Control::thread_runtime.adopt("replay");
+            exit(Control::replay_trace(n_arg, realtime));
+#ifndef SERVER
+        } else if (strcmp(w_arg, "engine-host") == 0 && w_argc >= 3) {
+            // "engine-host <fd> <engine name> <engine id>", started by an EngineHost, serves one engine over the shared memory rings
+            exit(Engines::engine_host_main(atoi(n_arg), argv[argc - w_argc + 1], strtoul(argv[argc - w_argc + 2], NULL, 10)));
+#endif
         } else if (strcmp(w_arg, "server") == 0) {
             //TODO use proper argparsing and offer some more sensible options, e.g. dont use watchdog, etc..
             // start server
-            Control::Server* the_server = new Control::Server();
-            the_server->loop();
-            delete the_server;
-            exit(EXIT_SUCCESS);
+            exit(run_server(argv));
         } else {
             printf("ignoring unknown argument: \"%s\"\n", w_arg);
         }
     }
+#ifdef SERVER
+    // dedicated server build, always runs the server
+    return run_server(argv);
+#else
     //TODO if launched in client mode, should still start the offline server, which is then paused if later connecting to another server
+    Control::thread_runtime.adopt("gui");
     Control::main_client = new Control::Client(); // instantiate the main client
     Control::main_client->loop(); // opengl + imgui has to run on the main thread
     delete Control::main_client; // destroy the client so everything cleans up nicely
     return 0;
+#endif
 }
@@ -2,7 +2,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <vector>
+#include <unordered_map>
 
 #include <SDL2/SDL.h>
 #include "imgui.h"
@@ -27,7 +27,12 @@ namespace MetaGui {
         char* text;
     };
 
-    std::vector<chat_msg> chat_log;
+    // ring of the last CHAT_LOG_SIZE messages, chat_log_end counts all messages ever added, so the oldest one is at chat_log_end - CHAT_LOG_SIZE
+    // chat_log_idx maps msg_id -> absolute position, messages without a (valid) id are not indexed
+    static const uint32_t CHAT_LOG_SIZE = 512;
+    chat_msg chat_log[CHAT_LOG_SIZE];
+    uint64_t chat_log_end = 0;
+    std::unordered_map<uint32_t, uint64_t> chat_log_idx;
     bool chat_autoscroll = true;
     bool window_has_focus = false;
     bool focus_chat_input = false;
@@ -76,30 +81,31 @@ namespace MetaGui {
         const float footer_height_to_reserve = ImGui::GetStyle().ItemSpacing.y + ImGui::GetFrameHeightWithSpacing();
         ImGui::BeginChild("ScrollingRegion", ImVec2(0, -footer_height_to_reserve), false, ImGuiWindowFlags_HorizontalScrollbar);
         // display chat history
-        for (int i = 0; i < chat_log.size(); i++) {
+        for (uint64_t pos = (chat_log_end > CHAT_LOG_SIZE ? chat_log_end - CHAT_LOG_SIZE : 0); pos < chat_log_end; pos++) {
+            chat_msg& msg = chat_log[pos % CHAT_LOG_SIZE];
             bool colored = false;
-            if (chat_log[i].client_id == EVENT_CLIENT_NONE || chat_log[i].msg_id == UINT32_MAX) {
+            if (msg.client_id == EVENT_CLIENT_NONE || msg.msg_id == UINT32_MAX) {
                 ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(180, 180, 180, 255)); // self/deleted messages are gray
                 colored = true;
-            } else if (chat_log[i].client_id == EVENT_CLIENT_SERVER) {
+            } else if (msg.client_id == EVENT_CLIENT_SERVER) {
                 ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(88, 255, 113, 255)); // server messages are green
                 colored = true;
             }
-            if (chat_log[i].client_id == EVENT_CLIENT_SERVER) {
-                ImGui::TextWrapped("[%09lu] %s", chat_log[i].timestamp, chat_log[i].text);
+            if (msg.client_id == EVENT_CLIENT_SERVER) {
+                ImGui::TextWrapped("[%09lu] %s", msg.timestamp, msg.text);
             } else {
-                ImGui::TextWrapped("[%09lu] %d: %s", chat_log[i].timestamp, chat_log[i].client_id, chat_log[i].text);
+                ImGui::TextWrapped("[%09lu] %d: %s", msg.timestamp, msg.client_id, msg.text);
             }
             //TODO should only offer popup if we are either msg owner or have mod perms in the lobby
-            sprintf(popup_str_id_buf, "%x", chat_log[i].msg_id); //HACK keep the id of the msg stable
-            if (chat_log[i].msg_id < UINT32_MAX && ImGui::BeginPopupContextItem(popup_str_id_buf)) {
+            sprintf(popup_str_id_buf, "%x", msg.msg_id); //HACK keep the id of the msg stable
+            if (msg.msg_id < UINT32_MAX && ImGui::BeginPopupContextItem(popup_str_id_buf)) {
                 if (ImGui::Selectable("Delete")) {
                     if (Control::main_client->network_send_queue) {
                         event_any es;
-                        event_create_chat_del(&es, chat_log[i].msg_id);
+                        event_create_chat_del(&es, msg.msg_id);
                         event_queue_push(Control::main_client->network_send_queue, &es);
                     } else {
-                        chat_msg_del(chat_log[i].msg_id);
+                        chat_msg_del(msg.msg_id);
                     }
                     ImGui::CloseCurrentPopup();
                 }
@@ -166,29 +172,43 @@ namespace MetaGui {
 
     void chat_msg_add(uint32_t msg_id, uint32_t client_id, uint64_t timestamp, const char* text)
     {
-        chat_msg new_msg{msg_id, client_id, timestamp, (char*)malloc(strlen(text) + 1)};
-        strcpy(new_msg.text, text);
-        chat_log.push_back(new_msg);
+        chat_msg& slot = chat_log[chat_log_end % CHAT_LOG_SIZE];
+        if (chat_log_end >= CHAT_LOG_SIZE) {
+            // evict the oldest, its id may have been reused by a newer message since (e.g. after a server restart)
+            std::unordered_map<uint32_t, uint64_t>::iterator old_idx = chat_log_idx.find(slot.msg_id);
+            if (old_idx != chat_log_idx.end() && old_idx->second == chat_log_end - CHAT_LOG_SIZE) {
+                chat_log_idx.erase(old_idx);
+            }
+            free(slot.text);
+        }
+        slot = chat_msg{msg_id, client_id, timestamp, (char*)malloc(strlen(text) + 1)};
+        strcpy(slot.text, text);
+        if (msg_id != UINT32_MAX) {
+            chat_log_idx[msg_id] = chat_log_end;
+        }
+        chat_log_end++;
     }
 
     void chat_msg_del(uint32_t msg_id)
     {
-        for (int i = 0; i < chat_log.size(); i++) {
-            if (chat_log[i].msg_id == msg_id) {
-                chat_log[i].text = (char*)realloc(chat_log[i].text, 18);
-                sprintf(chat_log[i].text, "<message deleted>");
-                chat_log[i].msg_id = UINT32_MAX;
-                return;
-            }
+        std::unordered_map<uint32_t, uint64_t>::iterator idx = chat_log_idx.find(msg_id);
+        if (idx == chat_log_idx.end()) {
+            return;
         }
+        chat_msg& msg = chat_log[idx->second % CHAT_LOG_SIZE];
+        chat_log_idx.erase(idx);
+        msg.text = (char*)realloc(msg.text, 18);
+        sprintf(msg.text, "<message deleted>");
+        msg.msg_id = UINT32_MAX;
     }
 
     void chat_clear()
     {
-        for (int i = 0; i < chat_log.size(); i++) {
-            free(chat_log[i].text);
+        for (uint64_t pos = (chat_log_end > CHAT_LOG_SIZE ? chat_log_end - CHAT_LOG_SIZE : 0); pos < chat_log_end; pos++) {
+            free(chat_log[pos % CHAT_LOG_SIZE].text);
         }
-        chat_log.clear();
+        chat_log_end = 0;
+        chat_log_idx.clear();
     }
 
     void chat_process_cmd(const char* msg)
@@ -55,6 +55,12 @@ namespace MetaGui {
                         delete net_client;
                     }
                 }
+                if (ImGui::Button("Play Offline", ImVec2(-1.0f, 0.0f))) {
+                    // local server in this process, connected without any sockets
+                    if (Control::main_client->start_offline_server()) {
+                        conn_info.adapter = RUNNING_STATE_ONGOING;
+                    }
+                }
             } break;
             case RUNNING_STATE_ONGOING: {
                 ImGui::BeginDisabled();
@@ -199,7 +205,7 @@ namespace MetaGui {
                     // accept connection
                     event_any es;
                     event_create_ssl_thumbprint(&es, EVENT_TYPE_NETWORK_ADAPTER_CONNECTION_ACCEPT);
-                    event_queue_push(&Control::main_client->t_network->send_queue, &es);
+                    event_queue_push(Control::main_client->adapter_send_queue(), &es);
                 }
                 ImGui::PopStyleColor(3);
             }
@@ -245,14 +251,24 @@ namespace MetaGui {
             }
             switch (conn_info.authentication) {
                 case RUNNING_STATE_NONE: {
-                    float btn_width = ImGui::CalcItemWidth();
+                    // login and register share the width of the inputs, guest gets the rest
+                    float btn_width = (ImGui::CalcItemWidth() - ImGui::GetStyle().ItemSpacing.x) / 2;
                     if (disable_login) {
                         ImGui::BeginDisabled();
                     }
                     if (ImGui::Button("Login", ImVec2(btn_width, 0.0f))) {
                         event_any es;
                         event_create_auth(&es, EVENT_TYPE_USER_AUTHN, EVENT_CLIENT_NONE, false, conn_info.username, conn_info.password);
-                        event_queue_push(&Control::main_client->t_network->send_queue, &es);
+                        event_queue_push(Control::main_client->adapter_send_queue(), &es);
+                        conn_info.authentication = RUNNING_STATE_ONGOING;
+                        free(conn_info.authfail_reason);
+                        conn_info.authfail_reason = NULL;
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::Button("Register", ImVec2(btn_width, 0.0f))) {
+                        event_any es;
+                        event_create_auth(&es, EVENT_TYPE_USER_REGISTER, EVENT_CLIENT_NONE, false, conn_info.username, conn_info.password);
+                        event_queue_push(Control::main_client->adapter_send_queue(), &es);
                         conn_info.authentication = RUNNING_STATE_ONGOING;
                         free(conn_info.authfail_reason);
                         conn_info.authfail_reason = NULL;
@@ -268,7 +284,7 @@ namespace MetaGui {
                     if (ImGui::Button("Guest", ImVec2(btn_width, 0.0f))) {
                         event_any es;
                         event_create_auth(&es, EVENT_TYPE_USER_AUTHN, EVENT_CLIENT_NONE, true, conn_info.username, conn_info.password);
-                        event_queue_push(&Control::main_client->t_network->send_queue, &es);
+                        event_queue_push(Control::main_client->adapter_send_queue(), &es);
                         conn_info.authentication = RUNNING_STATE_ONGOING;
                         free(conn_info.authfail_reason);
                         conn_info.authfail_reason = NULL;
@@ -286,7 +302,7 @@ namespace MetaGui {
                     if (ImGui::Button("Logout", ImVec2(-1.0f, 0.0f))) {
                         event_any es;
                         event_create_auth_fail(&es, EVENT_TYPE_USER_AUTHFAIL, NULL);
-                        event_queue_push(&Control::main_client->t_network->send_queue, &es);
+                        event_queue_push(Control::main_client->adapter_send_queue(), &es);
                     }
                 } break;
             }
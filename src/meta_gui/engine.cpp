@@ -48,13 +48,15 @@ namespace MetaGui {
                 if (((p_open && *p_open == true) || p_open == NULL) && ImGui::BeginTabItem(tec.name, p_open, item_flags)) {
                     // everything below here should be from an engine container indexed by the active engine tab, displayed inside the tab bar
 
+                    Control::PluginManager::CatalogueView catalogue = plugin_mgr.view();
                     const char* selected_name = "<NONE>";
                     if (tec.catalogue_idx > 0) {
-                        if (plugin_mgr.engine_lookup.find(tec.catalogue_idx) == plugin_mgr.engine_lookup.end()) {
-                            // catalogue idx has been invalidated
+                        if (!catalogue.has_engine(tec.catalogue_idx)) {
+                            // catalogue idx has been invalidated, the options still go back to the impl that made them
+                            tec.destroy_load_options();
                             tec.catalogue_idx = 0;
                         } else {
-                            selected_name = plugin_mgr.engine_lookup[tec.catalogue_idx]->get_name();
+                            selected_name = catalogue.get_engine(tec.catalogue_idx).get_name();
                         }
                     }
 
@@ -90,39 +92,29 @@ namespace MetaGui {
                         ImGui::EndDisabled();
                     }
 
-                    //BUG if a method is removed while its options were still on display there is a memory leak because no one can clean it up ==> NEED used refc in plugin impls
-                    bool disable_engine_selection = plugin_mgr.engine_catalogue.size() == 0;
+                    bool disable_engine_selection = catalogue.list_engines().size() == 0;
                     // catalogue idx should already be 0 if no engines exists in the catalogue
                     if (engine_running || disable_engine_selection) {
                         ImGui::BeginDisabled();
                     }
+                    uint32_t picked_engine_id = 0;
                     if (ImGui::BeginCombo("Engine", selected_name, disable_engine_selection ? ImGuiComboFlags_NoArrowButton : ImGuiComboFlags_None)) {
                         // offer idx 0 element, so selection can be reset, and the last engine can be unloaded from plugins
                         bool is_selected = (tec.catalogue_idx == 0);
                         if (ImGui::Selectable("<NONE>", is_selected)) {
                             // destruct old load data
-                            if (tec.catalogue_idx > 0) {
-                                plugin_mgr.engine_lookup[tec.catalogue_idx]->destroy_opts(tec.load_options);
-                                tec.load_options = NULL;
-                            }
+                            tec.destroy_load_options();
                             tec.catalogue_idx = 0;
                         }
                         // set the initial focus when opening the combo
                         if (is_selected) {
                             ImGui::SetItemDefaultFocus();
                         }
-                        for (Control::EngineImpl it : plugin_mgr.engine_catalogue) {
-                            is_selected = (tec.catalogue_idx == it.map_idx);
+                        for (uint32_t engine_id : catalogue.list_engines()) {
+                            const Control::EngineImpl& it = catalogue.get_engine(engine_id);
+                            is_selected = (tec.catalogue_idx == it.id);
                             if (ImGui::Selectable(it.get_name(), is_selected)) {
-                                // destruct old load data, construct new load data with new engine loader
-                                if (tec.catalogue_idx > 0) {
-                                    plugin_mgr.engine_lookup[tec.catalogue_idx]->destroy_opts(tec.load_options);
-                                    tec.load_options = NULL;
-                                }
-                                tec.catalogue_idx = it.map_idx;
-                                if (tec.catalogue_idx > 0) {
-                                    plugin_mgr.engine_lookup[tec.catalogue_idx]->create_opts(&tec.load_options);
-                                }
+                                picked_engine_id = it.id;
                             }
                             // set the initial focus when opening the combo
                             if (is_selected) {
@@ -131,6 +123,12 @@ namespace MetaGui {
                         }
                         ImGui::EndCombo();
                     }
+                    // resolving may open the plugin of the engine and change the list, so only after iterating it
+                    if (picked_engine_id > 0 && plugin_mgr.resolve_engine(picked_engine_id)) {
+                        // destruct old load data, construct new load data with new engine loader
+                        tec.catalogue_idx = picked_engine_id;
+                        tec.create_load_options(catalogue.get_engine(picked_engine_id));
+                    }
                     if (engine_running || disable_engine_selection) {
                         ImGui::EndDisabled();
                     }
@@ -143,7 +141,16 @@ namespace MetaGui {
                             ImGui::BeginDisabled();
                         }
 
-                        plugin_mgr.engine_lookup[tec.catalogue_idx]->display_opts(tec.load_options);
+                        tec.options_impl.display_opts(tec.load_options);
+
+                        ImGui::Checkbox("separate process", &tec.out_of_process);
+                        if (tec.out_of_process) {
+                            ImGui::InputScalar("memory limit (MB)", ImGuiDataType_U64, &tec.host_limits.memory_mb);
+                            ImGui::InputInt("pin to cpu", &tec.host_limits.cpu);
+                            if (tec.host_limits.cpu < -1) {
+                                tec.host_limits.cpu = -1;
+                            }
+                        }
 
                         if (engine_running) {
                             ImGui::EndDisabled();
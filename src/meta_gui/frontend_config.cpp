@@ -1,5 +1,5 @@
 #include <cstdint>
-#include <set>
+#include <vector>
 
 #include "imgui.h"
 
@@ -20,6 +20,25 @@ namespace MetaGui {
     uint32_t running_fem_idx = 0;
     void* frontend_load_options = NULL;
 
+    // the frontend that created frontend_load_options, same as for the game load options
+    static Control::FrontendImpl load_options_frontend((const frontend_methods*)NULL);
+
+    static void destroy_load_options()
+    {
+        if (load_options_frontend.methods != NULL) {
+            load_options_frontend.destroy_opts(frontend_load_options);
+        }
+        frontend_load_options = NULL;
+        load_options_frontend = Control::FrontendImpl((const frontend_methods*)NULL);
+    }
+
+    static void create_load_options(const Control::FrontendImpl& fe)
+    {
+        destroy_load_options();
+        load_options_frontend = fe;
+        load_options_frontend.create_opts(&frontend_load_options);
+    }
+
     void frontend_config_window(bool* p_open)
     {
         ImGui::SetNextWindowPos(ImVec2(300, 80), ImGuiCond_FirstUseEver);
@@ -33,17 +52,30 @@ namespace MetaGui {
         Control::PluginManager& plugin_mgr = Control::main_client->plugin_mgr;
 
         // collect all compatible frontends
-        //TODO cache this together with the game_impl_idx to which they belong, and update aswell if new thigns loaded
-        const game_methods* running_methods = NULL;
-        if (plugin_mgr.impl_lookup.find(game_impl_idx) != plugin_mgr.impl_lookup.end()) {
-            running_methods = plugin_mgr.impl_lookup[game_impl_idx]->get_methods();
-        }
+        // the verdicts come from the plugin index, only frontends never checked against this game get opened
+        // opening one changes the catalogue and invalidates the list, then start over, the verdicts so far are cached by then
         std::vector<uint32_t> compatible_fem{};
         bool selected_fem_compatible = false;
-        for (Control::FrontendImpl fe : plugin_mgr.frontend_catalogue) {
-            if (running_methods && fe.methods->is_game_compatible(running_methods) == ERR_OK) {
-                compatible_fem.emplace_back(fe.map_idx);
-                if (fe.map_idx == selected_fem_idx) {
+        bool collected = false;
+        while (!collected) {
+            Control::PluginManager::CatalogueView catalogue = plugin_mgr.view();
+            uint64_t generation = catalogue.generation();
+            const std::vector<uint32_t>& frontend_ids = catalogue.list_frontends();
+            compatible_fem.clear();
+            selected_fem_compatible = false;
+            collected = true;
+            for (size_t fei = 0; fei < frontend_ids.size(); fei++) {
+                uint32_t frontend_id = frontend_ids[fei];
+                bool compatible = plugin_mgr.is_frontend_compatible(frontend_id, game_impl_idx);
+                if (catalogue.generation() != generation) {
+                    collected = false;
+                    break;
+                }
+                if (!compatible) {
+                    continue;
+                }
+                compatible_fem.emplace_back(frontend_id);
+                if (frontend_id == selected_fem_idx) {
                     selected_fem_compatible = true;
                     fe_selection_idx = compatible_fem.size() - 1;
                 }
@@ -52,7 +84,7 @@ namespace MetaGui {
 
         // if a frontend is running, which is not the empty frontend, and not compatible, unload it
         if (running_fem_idx > 0 && !selected_fem_compatible && selected_fem_idx > 0) {
-            plugin_mgr.frontend_lookup[selected_fem_idx]->destroy_opts(frontend_load_options);
+            destroy_load_options();
             selected_fem_idx = 0;
             event_any es;
             event_create_type(&es, EVENT_TYPE_FRONTEND_UNLOAD);
@@ -62,9 +94,7 @@ namespace MetaGui {
         if (!selected_fem_compatible) {
             //TODO mabye select any one of the available ones?
             fe_selection_idx = UINT32_MAX;
-            if (selected_fem_idx > 0) {
-                plugin_mgr.frontend_lookup[selected_fem_idx]->destroy_opts(frontend_load_options);
-            }
+            destroy_load_options();
             selected_fem_idx = 0;
         }
 
@@ -76,9 +106,10 @@ namespace MetaGui {
             ImGui::BeginDisabled();
         }
         if (fronend_running) {
-            if (ImGui::Button("Restart")) {
+            if (ImGui::Button("Restart") && plugin_mgr.resolve_frontend(selected_fem_idx)) {
                 event_any es;
-                event_create_frontend_load(&es, plugin_mgr.frontend_lookup[selected_fem_idx]->new_frontend(&Control::main_client->dd, frontend_load_options));
+                Control::main_client->loading_frontend_impl = plugin_mgr.view().get_frontend(selected_fem_idx);
+                event_create_frontend_load(&es, Control::main_client->loading_frontend_impl.new_frontend(&Control::main_client->dd, frontend_load_options));
                 event_queue_push(&Control::main_client->inbox, &es);
             }
             ImGui::SameLine();
@@ -88,9 +119,10 @@ namespace MetaGui {
                 event_queue_push(&Control::main_client->inbox, &es);
             }
         } else {
-            if (ImGui::Button("Start", ImVec2(-1.0f, 0.0f))) {
+            if (ImGui::Button("Start", ImVec2(-1.0f, 0.0f)) && plugin_mgr.resolve_frontend(selected_fem_idx)) {
                 event_any es;
-                event_create_frontend_load(&es, plugin_mgr.frontend_lookup[selected_fem_idx]->new_frontend(&Control::main_client->dd, frontend_load_options));
+                Control::main_client->loading_frontend_impl = plugin_mgr.view().get_frontend(selected_fem_idx);
+                event_create_frontend_load(&es, Control::main_client->loading_frontend_impl.new_frontend(&Control::main_client->dd, frontend_load_options));
                 event_queue_push(&Control::main_client->inbox, &es);
             }
         }
@@ -101,9 +133,7 @@ namespace MetaGui {
         bool disable_frontend_selection = (compatible_fem.size() < 1);
         if (compatible_fem.size() == 0) {
             fe_selection_idx = UINT32_MAX;
-            if (selected_fem_idx > 0) {
-                plugin_mgr.frontend_lookup[selected_fem_idx]->destroy_opts(frontend_load_options);
-            }
+            destroy_load_options();
             selected_fem_idx = 0;
         }
         if (fronend_running || disable_frontend_selection) {
@@ -111,20 +141,19 @@ namespace MetaGui {
         }
         const char* selected_fem_name = "<empty>";
         if (selected_fem_idx > 0) {
-            if (plugin_mgr.frontend_lookup.find(selected_fem_idx) == plugin_mgr.frontend_lookup.end()) {
+            Control::PluginManager::CatalogueView catalogue = plugin_mgr.view();
+            if (!catalogue.has_frontend(selected_fem_idx)) {
                 // selected frontend invalid, select any compatible one and create opts
                 //TODO
             }
-            selected_fem_name = plugin_mgr.frontend_lookup[selected_fem_idx]->get_name();
+            selected_fem_name = catalogue.get_frontend(selected_fem_idx).get_name();
         }
         if (ImGui::BeginCombo("Frontend", selected_fem_name, disable_frontend_selection ? ImGuiComboFlags_NoArrowButton : ImGuiComboFlags_None)) {
             // offer idx 0 element, so selection can be reset
             bool is_selected = (fe_selection_idx == UINT32_MAX);
             if (ImGui::Selectable("<empty>", is_selected)) {
                 fe_selection_idx = UINT32_MAX;
-                if (selected_fem_idx > 0) {
-                    plugin_mgr.frontend_lookup[selected_fem_idx]->destroy_opts(frontend_load_options);
-                }
+                destroy_load_options();
                 selected_fem_idx = 0;
             }
             // set the initial focus when opening the combo
@@ -134,13 +163,15 @@ namespace MetaGui {
             for (int fei = 0; fei < compatible_fem.size(); fei++) {
                 uint32_t fe_map_idx = compatible_fem[fei];
                 bool is_selected = (fei == fe_selection_idx);
-                if (ImGui::Selectable(plugin_mgr.frontend_lookup[fe_map_idx]->get_name(), is_selected)) {
+                if (ImGui::Selectable(plugin_mgr.view().get_frontend(fe_map_idx).get_name(), is_selected)) {
                     fe_selection_idx = fei;
-                    if (selected_fem_idx > 0) {
-                        plugin_mgr.frontend_lookup[selected_fem_idx]->destroy_opts(frontend_load_options);
-                    }
                     selected_fem_idx = fe_map_idx;
-                    plugin_mgr.frontend_lookup[selected_fem_idx]->create_opts(&frontend_load_options);
+                    // a frontend known compatible from the index is only opened once it is picked
+                    if (plugin_mgr.resolve_frontend(selected_fem_idx)) {
+                        create_load_options(plugin_mgr.view().get_frontend(selected_fem_idx));
+                    } else {
+                        destroy_load_options();
+                    }
                 }
                 // set the initial focus when opening the combo
                 if (is_selected) {
@@ -158,7 +189,7 @@ namespace MetaGui {
                 ImGui::BeginDisabled();
             }
             if (frontend_load_options) {
-                plugin_mgr.frontend_lookup[selected_fem_idx]->display_opts(frontend_load_options);
+                load_options_frontend.display_opts(frontend_load_options);
             } else {
                 ImGui::TextDisabled("<no options>");
             }
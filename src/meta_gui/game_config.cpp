@@ -18,6 +18,25 @@ namespace MetaGui {
     void* game_load_options = NULL;
     void* game_runtime_options = NULL;
 
+    // the impl that created game_load_options, they always go back to it, the copy keeps its plugin open even if it is unloaded meanwhile
+    static Control::BaseGameVariantImpl load_options_impl((const game_methods*)NULL);
+
+    static void destroy_load_options()
+    {
+        if (load_options_impl.get_methods() != NULL) {
+            load_options_impl.destroy_opts(game_load_options);
+        }
+        game_load_options = NULL;
+        load_options_impl = Control::BaseGameVariantImpl((const game_methods*)NULL);
+    }
+
+    static void create_load_options(const Control::BaseGameVariantImpl& impl)
+    {
+        destroy_load_options();
+        load_options_impl = impl;
+        load_options_impl.create_opts(&game_load_options);
+    }
+
     void game_config_window(bool* p_open)
     {
         ImGui::SetNextWindowPos(ImVec2(50, 80), ImGuiCond_FirstUseEver);
@@ -29,32 +48,28 @@ namespace MetaGui {
         }
 
         Control::PluginManager& plugin_mgr = Control::main_client->plugin_mgr;
-
-        //BUG same problem as engines, what happens if impl gets unloaded while its runtime options have already been created, maybe do need a ref count
+        Control::PluginManager::CatalogueView catalogue = plugin_mgr.view();
 
         const char* selected_game_name = "<NONE>";
         const char* selected_variant_name = "<NONE>";
         const char* selected_impl_name = "<NONE>";
         // invalidate game base/variant/impl and set to default
         if (game_base_idx > 0) {
-            if (plugin_mgr.game_lookup.find(game_base_idx) == plugin_mgr.game_lookup.end()) {
+            if (!catalogue.has_game(game_base_idx)) {
                 // base game catalogue idx has been invalidated, reset all to NONE
                 game_base_idx = 0;
                 game_variant_idx = 0;
-                if (game_impl_idx > 0) {
-                    plugin_mgr.impl_lookup[game_impl_idx]->destroy_opts(game_load_options);
-                    game_load_options = NULL;
-                }
+                destroy_load_options();
                 game_impl_idx = 0;
             } else {
-                selected_game_name = plugin_mgr.game_lookup[game_base_idx]->name.c_str();
+                selected_game_name = catalogue.get_game(game_base_idx).name;
             }
         }
 
         bool game_running = (Control::main_client->the_game != NULL);
         // draw game start,stop,restart
         // locks all pre loading input elements if game is running, stop is only available if running
-        bool disable_startstop = (game_base_idx == 0);
+        bool disable_startstop = (game_base_idx == 0 || load_options_impl.get_methods() == NULL);
         if (disable_startstop) {
             ImGui::BeginDisabled();
         }
@@ -76,20 +91,20 @@ namespace MetaGui {
         }
         if (send_game_load) {
             // on start and reset, create game init info
-            std::set<Control::BaseGameVariantImpl>::iterator load_impl = plugin_mgr.impl_lookup[game_impl_idx];
+            const Control::BaseGameVariantImpl& load_impl = load_options_impl;
             game_init init_info;
-            const game_methods* load_methods = load_impl->get_methods();
+            const game_methods* load_methods = load_impl.get_methods();
             char* effective_opts_string = (char*)game_load_options; // use fallback string options as default
             if (load_methods->features.options == false) {
                 init_info = (game_init){.source_type = GAME_INIT_SOURCE_TYPE_DEFAULT};
             } else {
                 init_info.source_type = GAME_INIT_SOURCE_TYPE_STANDARD;
-                if (load_impl->wrapped && load_impl->u.wrap->features.options) {
+                if (load_impl.wrapped && load_impl.u.wrap->features.options) {
                     // for wrappers with options use wrapper opts_bin_to_str
                     size_t opts_str_len;
-                    load_impl->u.wrap->opts_bin_to_str(game_load_options, NULL, &opts_str_len);
+                    load_impl.u.wrap->opts_bin_to_str(game_load_options, NULL, &opts_str_len);
                     effective_opts_string = (char*)malloc(opts_str_len);
-                    load_impl->u.wrap->opts_bin_to_str(game_load_options, effective_opts_string, &opts_str_len);
+                    load_impl.u.wrap->opts_bin_to_str(game_load_options, effective_opts_string, &opts_str_len);
                 } else if (effective_opts_string != NULL && strlen(effective_opts_string) == 0) {
                     //HACK "" gets passed as NULL, do not do this, instead use a struct
                     //TODO make proper with struct and find solution for wrap that allows NULL opts
@@ -102,7 +117,7 @@ namespace MetaGui {
                 };
             }
             event_any es;
-            event_create_game_load(&es, plugin_mgr.game_lookup[game_base_idx]->name.c_str(), plugin_mgr.variant_lookup[game_variant_idx]->name.c_str(), plugin_mgr.impl_lookup[game_impl_idx]->get_name(), init_info);
+            event_create_game_load(&es, catalogue.get_game(game_base_idx).name, catalogue.get_variant(game_variant_idx).name, load_impl.get_name(), init_info);
             event_queue_push(&Control::main_client->inbox, &es);
             if (effective_opts_string != game_load_options) {
                 free(effective_opts_string);
@@ -112,7 +127,7 @@ namespace MetaGui {
             ImGui::EndDisabled();
         }
 
-        bool disable_game_selection = (plugin_mgr.game_catalogue.size() == 0);
+        bool disable_game_selection = (catalogue.list_games().size() == 0);
         if (game_running || disable_game_selection) {
             ImGui::BeginDisabled();
         }
@@ -123,25 +138,20 @@ namespace MetaGui {
             if (ImGui::Selectable("<NONE>", is_selected)) {
                 game_base_idx = 0;
                 game_variant_idx = 0;
-                if (game_impl_idx > 0) {
-                    plugin_mgr.impl_lookup[game_impl_idx]->destroy_opts(game_load_options);
-                    game_load_options = NULL;
-                }
+                destroy_load_options();
                 game_impl_idx = 0;
             }
             // set the initial focus when opening the combo
             if (is_selected) {
                 ImGui::SetItemDefaultFocus();
             }
-            for (Control::BaseGame it : plugin_mgr.game_catalogue) {
-                is_selected = (game_base_idx == it.map_idx);
-                if (ImGui::Selectable(it.name.c_str(), is_selected)) {
-                    game_base_idx = it.map_idx;
+            for (uint32_t game_id : catalogue.list_games()) {
+                const Control::BaseGame& it = catalogue.get_game(game_id);
+                is_selected = (game_base_idx == it.id);
+                if (ImGui::Selectable(it.name, is_selected)) {
+                    game_base_idx = it.id;
                     game_variant_idx = 0;
-                    if (game_impl_idx > 0) {
-                        plugin_mgr.impl_lookup[game_impl_idx]->destroy_opts(game_load_options);
-                        game_load_options = NULL;
-                    }
+                    destroy_load_options();
                     game_impl_idx = 0;
                 }
                 // set the initial focus when opening the combo
@@ -154,26 +164,24 @@ namespace MetaGui {
 
         if (game_base_idx > 0) {
             // game selected, make sure a variant is selected aswell
-            if (plugin_mgr.variant_lookup.find(game_variant_idx) == plugin_mgr.variant_lookup.end()) {
+            if (!catalogue.has_variant(game_variant_idx)) {
                 // variant invalidated, set to any valid one
-                game_variant_idx = plugin_mgr.game_lookup[game_base_idx]->variants.begin()->map_idx;
+                game_variant_idx = catalogue.get_game(game_base_idx).variants.front();
             }
-            selected_variant_name = plugin_mgr.variant_lookup[game_variant_idx]->name.c_str();
+            selected_variant_name = catalogue.get_variant(game_variant_idx).name;
         }
         // draw base game variant combo box, disabled if only one option or if variant idx 0
-        bool disable_variant_selection = (game_variant_idx == 0 || plugin_mgr.game_lookup[game_base_idx]->variants.size() == 1);
+        bool disable_variant_selection = (game_variant_idx == 0 || catalogue.get_game(game_base_idx).variants.size() == 1);
         if (disable_variant_selection) {
             ImGui::BeginDisabled();
         }
         if (ImGui::BeginCombo("Variant", selected_variant_name, disable_variant_selection ? ImGuiComboFlags_NoArrowButton : ImGuiComboFlags_None)) {
-            for (Control::BaseGameVariant it : plugin_mgr.game_lookup[game_base_idx]->variants) {
-                bool is_selected = (game_variant_idx == it.map_idx);
-                if (ImGui::Selectable(it.name.c_str(), is_selected)) {
-                    game_variant_idx = it.map_idx;
-                    if (game_impl_idx > 0) {
-                        plugin_mgr.impl_lookup[game_impl_idx]->destroy_opts(game_load_options);
-                        game_load_options = NULL;
-                    }
+            for (uint32_t variant_id : catalogue.get_game(game_base_idx).variants) {
+                const Control::BaseGameVariant& it = catalogue.get_variant(variant_id);
+                bool is_selected = (game_variant_idx == it.id);
+                if (ImGui::Selectable(it.name, is_selected)) {
+                    game_variant_idx = it.id;
+                    destroy_load_options();
                     game_impl_idx = 0;
                 }
                 // set the initial focus when opening the combo
@@ -189,28 +197,29 @@ namespace MetaGui {
 
         if (game_variant_idx > 0) {
             // variant selected, make sure an impl is selected aswell
-            if (plugin_mgr.impl_lookup.find(game_impl_idx) == plugin_mgr.impl_lookup.end()) {
+            if (!catalogue.has_impl(game_impl_idx)) {
                 // impl invalidated, set to any valid one
-                game_impl_idx = plugin_mgr.variant_lookup[game_variant_idx]->impls.begin()->map_idx;
-                plugin_mgr.impl_lookup[game_impl_idx]->create_opts(&game_load_options);
+                game_impl_idx = catalogue.get_variant(game_variant_idx).impls.front();
+            }
+            // the options need the methods, this is where an indexed plugin gets opened
+            // that changes the catalogue, so nothing below keeps references from above and everything is looked up again
+            if (load_options_impl.id != game_impl_idx && plugin_mgr.resolve_impl(game_impl_idx)) {
+                create_load_options(catalogue.get_impl(game_impl_idx));
             }
-            selected_impl_name = plugin_mgr.impl_lookup[game_impl_idx]->get_name();
+            selected_impl_name = catalogue.get_impl(game_impl_idx).get_name();
         }
         // draw impl selection combo box, disabled if only one option if impl idx 0
-        bool disable_impl_selection = (game_impl_idx == 0 || plugin_mgr.variant_lookup[game_variant_idx]->impls.size() == 1);
+        bool disable_impl_selection = (game_impl_idx == 0 || catalogue.get_variant(game_variant_idx).impls.size() == 1);
         if (disable_impl_selection) {
             ImGui::BeginDisabled();
         }
         if (ImGui::BeginCombo("Impl", selected_impl_name, disable_impl_selection ? ImGuiComboFlags_NoArrowButton : ImGuiComboFlags_None)) {
-            for (Control::BaseGameVariantImpl it : plugin_mgr.variant_lookup[game_variant_idx]->impls) {
-                bool is_selected = (game_impl_idx == it.map_idx);
+            for (uint32_t impl_id : catalogue.get_variant(game_variant_idx).impls) {
+                const Control::BaseGameVariantImpl& it = catalogue.get_impl(impl_id);
+                bool is_selected = (game_impl_idx == it.id);
                 if (ImGui::Selectable(it.get_name(), is_selected)) {
-                    if (game_impl_idx > 0) {
-                        plugin_mgr.impl_lookup[game_impl_idx]->destroy_opts(game_load_options);
-                        game_load_options = NULL;
-                    }
-                    game_impl_idx = it.map_idx;
-                    plugin_mgr.impl_lookup[game_impl_idx]->create_opts(&game_load_options);
+                    // options are created above on the next frame, resolving here would change the list while iterating it
+                    game_impl_idx = it.id;
                 }
                 // set the initial focus when opening the combo
                 if (is_selected) {
@@ -234,7 +243,7 @@ namespace MetaGui {
                 ImGui::BeginDisabled();
             }
             if (game_load_options) {
-                plugin_mgr.impl_lookup[game_impl_idx]->display_opts(game_load_options);
+                load_options_impl.display_opts(game_load_options);
             } else {
                 ImGui::TextDisabled("<no options>");
             }
@@ -249,7 +258,7 @@ namespace MetaGui {
         if (game_running) {
             if (ImGui::CollapsingHeader("State Editor", ImGuiTreeNodeFlags_DefaultOpen)) {
                 if (game_runtime_options) {
-                    plugin_mgr.impl_lookup[game_impl_idx]->display_runtime(Control::main_client->the_game, game_runtime_options);
+                    Control::main_client->the_game_impl.display_runtime(Control::main_client->the_game, game_runtime_options);
                 } else {
                     ImGui::TextDisabled("<no runtime>");
                 }
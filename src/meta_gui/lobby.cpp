@@ -1,6 +1,9 @@
 #include <cstdint>
+#include <cstdlib>
+#include <map>
 
 #include "imgui.h"
+#include "surena/game.h"
 
 #include "control/client.hpp"
 #include "mirabel/event_queue.h"
@@ -18,7 +21,74 @@ namespace MetaGui {
             ImGui::End();
             return;
         }
-        //TODO
+        //TODO lobby config
+        Control::Client* mc = Control::main_client;
+        if (mc->network_send_queue == NULL) {
+            ImGui::TextDisabled("not connected");
+            ImGui::End();
+            return;
+        }
+        if (!mc->seeks_subscribed) {
+            // seek list diffs only flow while this window is open
+            event_any es;
+            event_create_type(&es, EVENT_TYPE_LOBBY_SEEK_SUBSCRIBE);
+            event_queue_push(mc->network_send_queue, &es);
+            mc->seeks_subscribed = true;
+        }
+
+        // offer the currently loaded game, an equal seek by someone else is matched right away
+        static int initial_s = 300;
+        static int increment_s = 0;
+        static int delay_s = 0;
+        ImGui::InputInt("initial (s)", &initial_s);
+        ImGui::InputInt("increment (s)", &increment_s);
+        ImGui::InputInt("delay (s)", &delay_s);
+        initial_s = (initial_s < 0 ? 0 : initial_s);
+        increment_s = (increment_s < 0 ? 0 : increment_s);
+        delay_s = (delay_s < 0 ? 0 : delay_s);
+        game* tg = mc->the_game;
+        if (tg == NULL) {
+            ImGui::BeginDisabled();
+        }
+        if (ImGui::Button("Seek current game")) {
+            char* opts = NULL;
+            if (tg->methods->features.options) {
+                size_t size_fill;
+                opts = (char*)malloc(tg->sizer.options_str);
+                tg->methods->export_options(tg, &size_fill, opts);
+            }
+            event_any es;
+            event_create_seek(&es, EVENT_TYPE_LOBBY_SEEK_ADD, 0, 0, tg->methods->game_name, tg->methods->variant_name, tg->methods->impl_name, opts, initial_s * 1000, increment_s * 1000, delay_s * 1000);
+            event_queue_push(mc->network_send_queue, &es);
+            free(opts);
+        }
+        if (tg == NULL) {
+            ImGui::EndDisabled();
+        }
+
+        ImGui::Separator();
+        ImGui::Text("%zu open seeks", mc->seeks.size());
+        ImGui::BeginChild("seeks");
+        for (std::pair<const uint32_t, Control::Client::open_seek>& si : mc->seeks) {
+            Control::Client::open_seek& s = si.second;
+            ImGui::PushID(si.first);
+            if (s.own) {
+                if (ImGui::SmallButton("Cancel")) {
+                    event_any es;
+                    event_create_seek(&es, EVENT_TYPE_LOBBY_SEEK_REMOVE, si.first, 0, NULL, NULL, NULL, NULL, 0, 0, 0);
+                    event_queue_push(mc->network_send_queue, &es);
+                }
+            } else if (ImGui::SmallButton("Play")) {
+                // accepting is just seeking the exact same thing
+                event_any es;
+                event_create_seek(&es, EVENT_TYPE_LOBBY_SEEK_ADD, 0, 0, s.base_name.c_str(), s.variant_name.c_str(), s.impl_name.c_str(), s.options.size() > 0 ? s.options.c_str() : NULL, s.initial_ms, s.increment_ms, s.delay_ms);
+                event_queue_push(mc->network_send_queue, &es);
+            }
+            ImGui::SameLine();
+            ImGui::Text("%s.%s.%s %s %us+%us", s.base_name.c_str(), s.variant_name.c_str(), s.impl_name.c_str(), s.options.c_str(), s.initial_ms / 1000, s.increment_ms / 1000);
+            ImGui::PopID();
+        }
+        ImGui::EndChild();
         ImGui::End();
     }
 
@@ -1,5 +1,4 @@
 #include <cstdint>
-#include <set>
 #include <vector>
 
 #include "imgui.h"
@@ -36,12 +35,17 @@ namespace MetaGui {
                     plugin_mgr.detect_plugins();
                 }
                 ImGui::SameLine();
+                if (ImGui::Button("load all")) {
+                    plugin_mgr.load_all_plugins();
+                }
+                ImGui::SameLine();
                 ImGui::Text("%lu files detected", plugins_ref.size());
 
                 const ImGuiTableFlags table_flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg;
-                if (ImGui::BeginTable("plugins_table", 2, table_flags)) {
+                if (ImGui::BeginTable("plugins_table", 3, table_flags)) {
                     ImGui::TableSetupColumn("  ", ImGuiTableColumnFlags_WidthFixed);
                     ImGui::TableSetupColumn("Pluginpath");
+                    ImGui::TableSetupColumn("Load", ImGuiTableColumnFlags_WidthFixed);
                     ImGui::TableHeadersRow();
 
                     for (int i = 0; i < plugins_ref.size(); i++) {
@@ -57,10 +61,7 @@ namespace MetaGui {
                             }
                             ImGui::PopStyleColor(3);
                         } else {
-                            bool unload_disabled = (Control::main_client->the_game != NULL || Control::main_client->engine_mgr->engines.size() > 0 || Control::main_client->the_frontend != Control::main_client->empty_fe);
-                            if (unload_disabled) {
-                                ImGui::BeginDisabled();
-                            }
+                            // whatever still runs on the plugin holds its own reference, it is closed once they are all gone
                             ImGui::PushStyleColor(ImGuiCol_Button, (ImVec4)ImColor::HSV(0.0f, 0.6f, 0.6f));
                             ImGui::PushStyleColor(ImGuiCol_ButtonHovered, (ImVec4)ImColor::HSV(0.0f, 0.7f, 0.7f));
                             ImGui::PushStyleColor(ImGuiCol_ButtonActive, (ImVec4)ImColor::HSV(0.0f, 0.8f, 0.8f));
@@ -68,13 +69,23 @@ namespace MetaGui {
                                 plugin_mgr.unload_plugin(i);
                             }
                             ImGui::PopStyleColor(3);
-                            if (unload_disabled) {
-                                ImGui::EndDisabled();
+                            ImGui::SameLine();
+                            if (ImGui::Button("R")) {
+                                plugin_mgr.reload_plugin(i);
                             }
                         }
                         ImGui::TableSetColumnIndex(1);
                         ImGui::Text("%s", plugins_ref[i].filename.c_str());
                         //TODO setup right click for whole name line to see a detailed view of what a plugin provides
+                        ImGui::TableSetColumnIndex(2);
+                        if (plugins_ref[i].loaded && !plugins_ref[i].image) {
+                            // catalogued from the index, opened once something from it is used
+                            ImGui::TextDisabled("lazy");
+                        } else if (plugins_ref[i].loaded) {
+                            ImGui::Text("%.1fms", plugins_ref[i].load_ms);
+                        } else {
+                            ImGui::TextDisabled("-");
+                        }
                         ImGui::PopID();
                     }
 
@@ -96,6 +107,9 @@ namespace MetaGui {
 
                 const ImGuiTableFlags table_flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable;
 
+                // nothing below changes the catalogue, so one view holds for all tables
+                Control::PluginManager::CatalogueView catalogue = plugin_mgr.view();
+
                 if (ImGui::BeginTable("game_catalogue_table", 5, table_flags)) {
                     ImGui::TableSetupColumn("Game");
                     ImGui::TableSetupColumn("Variant");
@@ -103,18 +117,21 @@ namespace MetaGui {
                     ImGui::TableSetupColumn("Version", ImGuiTableColumnFlags_WidthFixed);
                     ImGui::TableSetupColumn("W", ImGuiTableColumnFlags_WidthFixed);
                     ImGui::TableHeadersRow();
-                    for (Control::BaseGame itrG : plugin_mgr.game_catalogue) {
-                        for (Control::BaseGameVariant itrV : itrG.variants) {
-                            for (Control::BaseGameVariantImpl itrI : itrV.impls) {
+                    for (uint32_t game_id : catalogue.list_games()) {
+                        const Control::BaseGame& itrG = catalogue.get_game(game_id);
+                        for (uint32_t variant_id : itrG.variants) {
+                            const Control::BaseGameVariant& itrV = catalogue.get_variant(variant_id);
+                            for (uint32_t impl_id : itrV.impls) {
+                                const Control::BaseGameVariantImpl& itrI = catalogue.get_impl(impl_id);
                                 ImGui::TableNextRow();
                                 ImGui::TableSetColumnIndex(0);
-                                ImGui::Text("%s", itrG.name.c_str());
+                                ImGui::Text("%s", itrG.name);
                                 ImGui::TableSetColumnIndex(1);
-                                ImGui::Text("%s", itrV.name.c_str());
+                                ImGui::Text("%s", itrV.name);
                                 ImGui::TableSetColumnIndex(2);
                                 ImGui::Text("%s", itrI.get_name());
                                 ImGui::TableSetColumnIndex(3);
-                                ImGui::Text("%u.%u.%u", itrI.get_methods()->version.major, itrI.get_methods()->version.minor, itrI.get_methods()->version.patch);
+                                ImGui::Text("%u.%u.%u", itrI.version.major, itrI.version.minor, itrI.version.patch);
                                 ImGui::TableSetColumnIndex(4);
                                 if (itrI.wrapped) {
                                     ImGui::Text("T");
@@ -131,12 +148,13 @@ namespace MetaGui {
                     ImGui::TableSetupColumn("Frontend");
                     ImGui::TableSetupColumn("Version", ImGuiTableColumnFlags_WidthFixed);
                     ImGui::TableHeadersRow();
-                    for (Control::FrontendImpl itrF : plugin_mgr.frontend_catalogue) {
+                    for (uint32_t frontend_id : catalogue.list_frontends()) {
+                        const Control::FrontendImpl& itrF = catalogue.get_frontend(frontend_id);
                         ImGui::TableNextRow();
                         ImGui::TableSetColumnIndex(0);
                         ImGui::Text("%s", itrF.get_name());
                         ImGui::TableSetColumnIndex(1);
-                        ImGui::Text("%u.%u.%u", itrF.methods->version.major, itrF.methods->version.minor, itrF.methods->version.patch);
+                        ImGui::Text("%u.%u.%u", itrF.version.major, itrF.version.minor, itrF.version.patch);
                     }
                     ImGui::EndTable();
                 }
@@ -146,12 +164,13 @@ namespace MetaGui {
                     ImGui::TableSetupColumn("Version", ImGuiTableColumnFlags_WidthFixed);
                     ImGui::TableSetupColumn("W", ImGuiTableColumnFlags_WidthFixed);
                     ImGui::TableHeadersRow();
-                    for (Control::EngineImpl itrE : plugin_mgr.engine_catalogue) {
+                    for (uint32_t engine_id : catalogue.list_engines()) {
+                        const Control::EngineImpl& itrE = catalogue.get_engine(engine_id);
                         ImGui::TableNextRow();
                         ImGui::TableSetColumnIndex(0);
                         ImGui::Text("%s", itrE.get_name());
                         ImGui::TableSetColumnIndex(1);
-                        ImGui::Text("%u.%u.%u", itrE.get_methods()->version.major, itrE.get_methods()->version.minor, itrE.get_methods()->version.patch);
+                        ImGui::Text("%u.%u.%u", itrE.version.major, itrE.version.minor, itrE.version.patch);
                         ImGui::TableSetColumnIndex(2);
                         if (itrE.wrapped) {
                             ImGui::Text("T");
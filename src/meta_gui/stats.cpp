@@ -1,8 +1,11 @@
 #include <cstdint>
+#include <vector>
 
 #include <SDL2/SDL.h>
 #include "imgui.h"
 
+#include "control/thread_runtime.hpp"
+
 #include "meta_gui/meta_gui.hpp"
 
 namespace MetaGui {
@@ -44,6 +47,17 @@ namespace MetaGui {
                 last_ticks = current_ticks;
             }
             ImGui::Text("FPS: %.1f", last_fps);
+            // the overlay is the only sampler in the client, so the percentages are over the last second
+            static std::vector<Control::thread_sample> threads;
+            static uint64_t last_threads_update_ticks = 0;
+            if (current_ticks - last_threads_update_ticks >= 1000) {
+                last_threads_update_ticks = current_ticks;
+                Control::thread_runtime.sample(&threads);
+            }
+            ImGui::Separator();
+            for (size_t i = 0; i < threads.size(); i++) {
+                ImGui::Text("%-10s %5.1f%% %8lums", threads[i].name.c_str(), threads[i].cpu_percent, (unsigned long)threads[i].cpu_ms);
+            }
             //TODO latency to server in ms goes here, if connected
             if (ImGui::BeginPopupContextWindow()) {
                 if (ImGui::MenuItem("Custom", NULL, corner == -1)) {
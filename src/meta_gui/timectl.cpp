@@ -1,6 +1,7 @@
 #include <cstdint>
 
 #include "imgui.h"
+#include "rosalia/timestamp.h"
 
 #include "control/client.hpp"
 #include "mirabel/event_queue.h"
@@ -12,7 +13,71 @@ namespace MetaGui {
 
     void timectl_window(bool* p_open)
     {
-        //TODO
+        ImGui::SetNextWindowSize(ImVec2(250, 300), ImGuiCond_FirstUseEver);
+        bool window_contents_visible = ImGui::Begin("Time Control", p_open);
+        if (!window_contents_visible) {
+            ImGui::End();
+            return;
+        }
+        Control::Client* mc = Control::main_client;
+
+        // config, in seconds, takes effect in the lobby once the server echoes it back
+        static int initial_s = 300;
+        static int increment_s = 0;
+        static int delay_s = 0;
+        ImGui::InputInt("initial (s)", &initial_s);
+        ImGui::InputInt("increment (s)", &increment_s);
+        ImGui::InputInt("delay (s)", &delay_s);
+        initial_s = (initial_s < 0 ? 0 : initial_s);
+        increment_s = (increment_s < 0 ? 0 : increment_s);
+        delay_s = (delay_s < 0 ? 0 : delay_s);
+        bool offline = (mc->network_send_queue == NULL);
+        if (offline) {
+            ImGui::BeginDisabled();
+        }
+        if (ImGui::Button("Apply")) {
+            event_any es;
+            event_create_game_timectl(&es, initial_s * 1000, increment_s * 1000, delay_s * 1000);
+            event_queue_push(mc->network_send_queue, &es);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Untimed")) {
+            event_any es;
+            event_create_game_timectl(&es, 0, 0, 0);
+            event_queue_push(mc->network_send_queue, &es);
+        }
+        if (offline) {
+            ImGui::EndDisabled();
+        }
+
+        ImGui::Separator();
+        if (mc->timectl_initial_ms == 0) {
+            ImGui::TextDisabled("untimed");
+            ImGui::End();
+            return;
+        }
+        ImGui::Text("%us + %us, %us delay", mc->timectl_initial_ms / 1000, mc->timectl_increment_ms / 1000, mc->timectl_delay_ms / 1000);
+        // the running clock counts down from the last server update, using the local monotonic time, the server decides when a flag falls
+        uint64_t now = timestamp_get_ms64();
+        for (size_t i = 0; i < mc->clocks.size(); i++) {
+            Control::Client::game_clock& gc = mc->clocks[i];
+            uint32_t remaining = gc.remaining_ms;
+            if (gc.running) {
+                uint64_t elapsed = now - gc.received_ms;
+                uint64_t charged = (elapsed > gc.delay_ms ? elapsed - gc.delay_ms : 0);
+                remaining = (charged >= remaining ? 0 : remaining - charged);
+            }
+            if (gc.flagged) {
+                ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(255, 88, 88, 255));
+            } else if (!gc.running) {
+                ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(180, 180, 180, 255));
+            }
+            ImGui::Text("%s player %zu: %u:%02u.%u%s", gc.running ? ">" : " ", i + 1, remaining / 60000, (remaining / 1000) % 60, (remaining / 100) % 10, gc.flagged ? " (flagged)" : "");
+            if (gc.flagged || !gc.running) {
+                ImGui::PopStyleColor();
+            }
+        }
+        ImGui::End();
     }
 
 } // namespace MetaGui
@@ -9,6 +9,7 @@
 
 #include "mirabel/event_queue.h"
 #include "mirabel/event.h"
+#include "control/thread_runtime.hpp"
 #include "meta_gui/meta_gui.hpp"
 #include "network/protocol.hpp"
 #include "network/util.hpp"
@@ -53,7 +54,7 @@ namespace Network {
         server_address = (char*)malloc(strlen(host_address) + 1);
         strcpy(server_address, host_address);
         server_port = host_port;
-        send_runner = std::thread(&NetworkClient::send_loop, this); // socket open, start send_runner
+        send_runner = Control::thread_runtime.spawn("netsend", [this]() { send_loop(); }); // socket open, start send_runner
         return true;
     }
 
@@ -116,7 +117,7 @@ namespace Network {
         event_any es;
         event_create_type(&es, EVENT_TYPE_NETWORK_ADAPTER_SOCKET_OPENED);
         event_queue_push(recv_queue, &es);
-        recv_runner = std::thread(&NetworkClient::recv_loop, this); // socket open, start recv_runner
+        recv_runner = Control::thread_runtime.spawn("netrecv", [this]() { recv_loop(); }); // socket open, start recv_runner
 
         size_t base_buffer_size = 16384;
         uint8_t* data_buffer_base = (uint8_t*)malloc(base_buffer_size); // recycled buffer for outgoing data
@@ -534,6 +535,11 @@ namespace Network {
                     case EVENT_TYPE_NETWORK_PROTOCOL_PONG: {
                         MetaGui::log(log_id, "#I < received pong\n");
                     } break;
+                    case EVENT_TYPE_NETWORK_PROTOCOL_RECONNECT: {
+                        // the client decides what to do once the connection actually drops
+                        MetaGui::log(log_id, "#I < server announced restart\n");
+                        event_queue_push(recv_queue, &recv_event);
+                    } break;
                     default: {
                         // general purpose events get pushed to the recv queue
                         MetaGui::logf(log_id, "< received event, type: %d\n", recv_event.base.type);
@@ -0,0 +1,193 @@
+#include <cstdint>
+#include <thread>
+
+#include "mirabel/event_queue.h"
+#include "mirabel/event.h"
+#include "control/thread_runtime.hpp"
+#include "control/timeout_crash.hpp"
+#include "meta_gui/meta_gui.hpp"
+#include "network/protocol.hpp"
+
+#include "network/network_loopback.hpp"
+
+namespace Network {
+
+    NetworkLoopback::NetworkLoopback(Control::TimeoutCrash* use_tc):
+        tc(use_tc),
+        recv_queue(NULL),
+        server_recv_queue(NULL)
+    {
+        event_queue_create(&send_queue);
+        event_queue_create(&server_send_queue);
+
+        log_id = MetaGui::log_register("NetworkLoopback");
+    }
+
+    NetworkLoopback::~NetworkLoopback()
+    {
+        // drop whatever was still sent after the runners quit
+        event_any e;
+        event_queue_pop(&send_queue, &e, 0);
+        while (e.base.type != EVENT_TYPE_NULL) {
+            event_destroy(&e);
+            event_queue_pop(&send_queue, &e, 0);
+        }
+        event_queue_pop(&server_send_queue, &e, 0);
+        while (e.base.type != EVENT_TYPE_NULL) {
+            event_destroy(&e);
+            event_queue_pop(&server_send_queue, &e, 0);
+        }
+
+        MetaGui::log_unregister(log_id);
+
+        event_queue_destroy(&server_send_queue);
+        event_queue_destroy(&send_queue);
+    }
+
+    bool NetworkLoopback::open()
+    {
+        if (recv_queue == NULL || server_recv_queue == NULL) {
+            return false;
+        }
+        if (tc) {
+            tc_info = tc->register_timeout_item(&send_queue, "networkloopback", 1000, 1000);
+        }
+        client_runner = Control::thread_runtime.spawn("loopclient", [this]() { client_loop(); });
+        server_runner = Control::thread_runtime.spawn("loopserver", [this]() { server_loop(); });
+
+        // there is no socket and no ssl, the connection is accepted right away on both sides
+        event_any es;
+        event_create_type(&es, EVENT_TYPE_NETWORK_ADAPTER_SOCKET_OPENED);
+        event_queue_push(recv_queue, &es);
+        event_create_ssl_thumbprint(&es, EVENT_TYPE_NETWORK_ADAPTER_CONNECTION_ACCEPT);
+        event_queue_push(recv_queue, &es);
+        event_create_type_client(&es, EVENT_TYPE_NETWORK_ADAPTER_CLIENT_CONNECTED, LOOPBACK_CLIENT_ID);
+        event_queue_push(server_recv_queue, &es);
+        MetaGui::logf(log_id, "#I loopback opened, client id %d\n", LOOPBACK_CLIENT_ID);
+        return true;
+    }
+
+    void NetworkLoopback::close()
+    {
+        if (!client_runner.joinable()) {
+            return; // never opened
+        }
+        event_any es;
+        event_create_type(&es, EVENT_TYPE_NETWORK_PROTOCOL_DISCONNECT); // notify server we're disconnecting
+        event_queue_push(&send_queue, &es);
+        event_create_type(&es, EVENT_TYPE_EXIT);
+        event_queue_push(&send_queue, &es);
+        event_create_type(&es, EVENT_TYPE_EXIT);
+        event_queue_push(&server_send_queue, &es);
+        client_runner.join();
+        server_runner.join();
+        if (tc) {
+            tc->unregister_timeout_item(tc_info.id);
+        }
+    }
+
+    void NetworkLoopback::client_loop()
+    {
+        bool quit = false;
+        while (!quit) {
+            event_any e;
+            event_queue_pop(&send_queue, &e, UINT32_MAX);
+            switch (e.base.type) {
+                case EVENT_TYPE_NULL: {
+                    MetaGui::log(log_id, "#W > received impossible null event\n");
+                } break;
+                case EVENT_TYPE_EXIT: {
+                    quit = true;
+                    break;
+                } break;
+                case EVENT_TYPE_HEARTBEAT: {
+                    tc_info.send_heartbeat();
+                } break;
+                case EVENT_TYPE_NETWORK_ADAPTER_CONNECTION_ACCEPT: {
+                    // nothing to verify, the connection was accepted on open
+                } break;
+                case EVENT_TYPE_NETWORK_PROTOCOL_DISCONNECT: {
+                    event_any es;
+                    event_create_type_client(&es, EVENT_TYPE_NETWORK_ADAPTER_CLIENT_DISCONNECTED, LOOPBACK_CLIENT_ID);
+                    event_queue_push(server_recv_queue, &es);
+                    MetaGui::log(log_id, "#I > connection closed\n");
+                } break;
+                case EVENT_TYPE_NETWORK_PROTOCOL_PING: {
+                    MetaGui::log(log_id, "#I < received pong\n");
+                } break;
+                default: {
+                    if (!client_event_allowed(e.base.type)) {
+                        MetaGui::logf(log_id, "#W > dropping internal event type %d\n", e.base.type);
+                        break;
+                    }
+                    // hand the event over as is, only the client id is set like the network server would
+                    e.base.client_id = LOOPBACK_CLIENT_ID;
+                    event_queue_push(server_recv_queue, &e);
+                } break;
+            }
+            event_destroy(&e);
+        }
+
+        if (tc) {
+            tc_info.pre_quit(1000);
+        }
+    }
+
+    void NetworkLoopback::server_loop()
+    {
+        bool quit = false;
+        while (!quit) {
+            event_any e;
+            event_queue_pop(&server_send_queue, &e, UINT32_MAX);
+            switch (e.base.type) {
+                case EVENT_TYPE_NULL: {
+                    MetaGui::log(log_id, "#W < received impossible null event\n");
+                } break;
+                case EVENT_TYPE_EXIT: {
+                    quit = true;
+                    break;
+                } break;
+                case EVENT_TYPE_NETWORK_PROTOCOL_DISCONNECT: {
+                    MetaGui::log(log_id, "#I < pre-close announced\n");
+                } break;
+                case EVENT_TYPE_NETWORK_PROTOCOL_CLIENT_ID_SET:
+                case EVENT_TYPE_NETWORK_PROTOCOL_PONG: {
+                    // protocol internals, nothing for the client
+                } break;
+                case EVENT_TYPE_NETWORK_INTERNAL_SEND_SERIALIZED: {
+                    if (e.base.client_id != LOOPBACK_CLIENT_ID) {
+                        MetaGui::logf(log_id, "#W < discarded serialized events for unknown client id %d\n", e.base.client_id);
+                        break;
+                    }
+                    // broadcasts were already serialized once for all network recipients (possibly batched), unpack them here
+                    uint8_t* data = (uint8_t*)e.send_serialized.buf->data;
+                    uint8_t* data_end = data + e.send_serialized.buf->size;
+                    while (data + sizeof(size_t) <= data_end) {
+                        size_t packet_size = event_read_size(data);
+                        if (packet_size < sizeof(size_t) || data + packet_size > data_end) {
+                            MetaGui::log(log_id, "#W < malformed serialized events\n");
+                            break;
+                        }
+                        event_any recv_event;
+                        event_deserialize(&recv_event, data, data + packet_size);
+                        data += packet_size;
+                        if (recv_event.base.type == EVENT_TYPE_NULL) {
+                            MetaGui::log(log_id, "#W < serialized event deserialization error\n");
+                            continue;
+                        }
+                        event_queue_push(recv_queue, &recv_event);
+                    }
+                } break;
+                default: {
+                    if (e.base.client_id != LOOPBACK_CLIENT_ID) {
+                        MetaGui::logf(log_id, "#W < discarded event type %d for unknown client id %d\n", e.base.type, e.base.client_id);
+                        break;
+                    }
+                    event_queue_push(recv_queue, &e);
+                } break;
+            }
+            event_destroy(&e);
+        }
+    }
+
+} // namespace Network
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <thread>
+
+#include "mirabel/event_queue.h"
+#include "control/timeout_crash.hpp"
+
+namespace Network {
+
+    // in process adapter connecting a client to a server living in the same process, e.g. for offline play
+    // events are handed over between the queues as they are, there is no serialization, ssl or socket involved
+    // both sides see exactly the same event semantics as with the network client and server
+    class NetworkLoopback {
+      private:
+
+        Control::TimeoutCrash* tc; // we don't own this
+        Control::TimeoutCrash::timeout_info tc_info;
+
+        uint32_t log_id;
+
+        std::thread client_runner;
+        std::thread server_runner;
+
+      public:
+
+        static const uint32_t LOOPBACK_CLIENT_ID = 1; // the only client, never EVENT_CLIENT_NONE so the client treats server events as remote
+
+        // client side, same as the network client
+        event_queue send_queue;
+        event_queue* recv_queue;
+
+        // server side, same as the network server
+        event_queue server_send_queue;
+        event_queue* server_recv_queue;
+
+        NetworkLoopback(Control::TimeoutCrash* use_tc);
+        ~NetworkLoopback();
+
+        // both recv queues have to be set before opening
+        bool open();
+        void close();
+
+        void client_loop(); // client -> server
+        void server_loop(); // server -> client
+    };
+
+} // namespace Network
@@ -1,7 +1,9 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 #include "SDL_net.h"
 #include <openssl/err.h>
@@ -9,6 +11,8 @@
 
 #include "mirabel/event_queue.h"
 #include "mirabel/event.h"
+#include "control/thread_runtime.hpp"
+#include "network/protocol.hpp"
 #include "network/util.hpp"
 
 #include "network/network_server.hpp"
@@ -66,9 +70,9 @@ namespace Network {
             return false;
         }
         SDLNet_TCP_AddSocket(server_socketset, server_socket); // cant fail, we only have one socket for our size 1 set
-        server_runner = std::thread(&NetworkServer::server_loop, this); // socket open, start server_runner
-        send_runner = std::thread(&NetworkServer::send_loop, this); // socket open, start send_runner
-        recv_runner = std::thread(&NetworkServer::recv_loop, this); // socket open, start recv_runner
+        server_runner = Control::thread_runtime.spawn("netaccept", [this]() { server_loop(); }); // socket open, start server_runner
+        send_runner = Control::thread_runtime.spawn("netsend", [this]() { send_loop(); }); // socket open, start send_runner
+        recv_runner = Control::thread_runtime.spawn("netrecv", [this]() { recv_loop(); }); // socket open, start recv_runner
         return true;
     }
 
@@ -81,6 +85,8 @@ namespace Network {
         event_any es;
         event_create_type(&es, EVENT_TYPE_EXIT); // stop send_runner
         event_queue_push(&send_queue, &es);
+        // drain, everything queued before the exit still goes out before the client sockets close
+        send_runner.join();
         // stop recv_runner
         for (uint32_t i = 0; i < client_connection_bucket_size; i++) {
             TCPsocket* client_socket = &(client_connections[i].socket);
@@ -91,10 +97,26 @@ namespace Network {
         }
         // everything closed, join dead runners
         server_runner.join();
-        send_runner.join();
         recv_runner.join();
     }
 
+    void NetworkServer::drop_client(uint32_t client_id)
+    {
+        // the send_runner hands it to the recv_runner for closing once the disconnect is out
+        event_any es;
+        event_create_type_client(&es, EVENT_TYPE_NETWORK_PROTOCOL_DISCONNECT, client_id);
+        event_queue_push(&send_queue, &es);
+    }
+
+    void NetworkServer::set_state(connection* conn, PROTOCOL_CONNECTION_STATE state)
+    {
+        if (metrics) {
+            metrics->state_leave(conn->state);
+            metrics->state_enter(state);
+        }
+        conn->state = state;
+    }
+
     void NetworkServer::server_loop()
     {
         uint32_t buffer_size = 16384;
@@ -150,6 +172,10 @@ namespace Network {
                     printf("[WARN] = packet sending failed\n");
                 }
                 connection_slot->state = PROTOCOL_CONNECTION_STATE_NONE;
+                if (metrics) {
+                    metrics->state_enter(PROTOCOL_CONNECTION_STATE_NONE);
+                    metrics->count(metrics->tls_handshakes_started);
+                }
                 connection_slot->socket = incoming_socket;
                 connection_slot->peer_addr = *SDLNet_TCP_GetPeerAddress(incoming_socket);
                 connection_slot->client_id = connection_id;
@@ -193,6 +219,30 @@ namespace Network {
                     break;
                 } break;
                 //TODO heartbeat
+                case EVENT_TYPE_NETWORK_PROTOCOL_RECONNECT: {
+                    // restart announcement goes to every accepted connection at once, serialized once
+                    uint32_t write_len = event_size(&e);
+                    uint8_t* data_buffer = (write_len > base_buffer_size ? (uint8_t*)malloc(write_len) : data_buffer_base);
+                    for (uint32_t i = 0; i < client_connection_bucket_size; i++) {
+                        connection* client = &(client_connections[i]);
+                        if (client->socket == NULL || client->state != PROTOCOL_CONNECTION_STATE_ACCEPTED) {
+                            continue;
+                        }
+                        e.base.client_id = client->client_id;
+                        event_serialize(&e, data_buffer);
+                        if (SSL_write(client->ssl_session, data_buffer, write_len) != write_len) {
+                            printf("[WARN] > ssl write failed\n");
+                            continue;
+                        }
+                        if (metrics) {
+                            metrics->count(metrics->events_out);
+                        }
+                        send_pending(client, data_buffer_base, base_buffer_size);
+                    }
+                    if (data_buffer != data_buffer_base) {
+                        free(data_buffer);
+                    }
+                } break;
                 default: {
                     // find target client connection to send to
                     //TODO use client id as index into the bucket, give every bucket a base offset
@@ -222,20 +272,34 @@ namespace Network {
                         }
                         break;
                     }
-                    // universal event->packet encoding, for POD events
                     uint8_t* data_buffer = data_buffer_base;
-                    int write_len = event_size(&e);
-                    if (write_len > base_buffer_size) {
-                        data_buffer = (uint8_t*)malloc(write_len);
+                    int write_len;
+                    if (e.base.type == EVENT_TYPE_NETWORK_INTERNAL_SEND_SERIALIZED) {
+                        // already serialized once for all recipients, only encrypt for this connection
+                        data_buffer = (uint8_t*)e.send_serialized.buf->data;
+                        write_len = e.send_serialized.buf->size;
+                    } else {
+                        // universal event->packet encoding, for POD events
+                        write_len = event_size(&e);
+                        if (write_len > base_buffer_size) {
+                            data_buffer = (uint8_t*)malloc(write_len);
+                        }
+                        event_serialize(&e, data_buffer);
                     }
-                    event_serialize(&e, data_buffer);
                     int wrote_len = SSL_write(target_client->ssl_session, data_buffer, write_len);
                     if (wrote_len != write_len) {
                         printf("[WARN] > ssl write failed\n");
                     } else {
                         printf("[----] > ssl wrote event, type %d, len %d\n", e.base.type, write_len);
+                        if (metrics) {
+                            metrics->count(metrics->events_out);
+                        }
                     }
-                    if (data_buffer != data_buffer_base) {
+                    if (e.base.type == EVENT_TYPE_NETWORK_PROTOCOL_DISCONNECT) {
+                        // server side drop, nothing but the close is expected from this client anymore
+                        set_state(target_client, PROTOCOL_CONNECTION_STATE_PRECLOSE);
+                    }
+                    if (data_buffer != data_buffer_base && e.base.type != EVENT_TYPE_NETWORK_INTERNAL_SEND_SERIALIZED) {
                         free(data_buffer);
                     }
                 } /* fallthrough */
@@ -259,33 +323,81 @@ namespace Network {
                         }
                     }
 
-                    while (true) {
-                        int pend_len = BIO_ctrl_pending(target_client->send_bio);
-                        printf("[----] > pending to send: %i bytes\n", pend_len);
-                        if (pend_len == 0) {
-                            // nothing pending to send
-                            break;
-                        }
-                        int send_len = BIO_read(target_client->send_bio, data_buffer_base, base_buffer_size);
-                        printf("[----] > ssl outputs %i bytes for sending\n", send_len);
-                        if (send_len == 0) {
-                            // empty read, can this happen?
-                            break;
-                        }
-                        int sent_len = SDLNet_TCP_Send(target_client->socket, data_buffer_base, send_len);
-                        if (sent_len != send_len) {
-                            printf("[WARN] > packet sending failed\n");
-                        } else {
-                            printf("[----] > sent %d bytes of data to client id %d\n", sent_len, e.base.client_id);
-                        }
-                    }
+                    send_pending(target_client, data_buffer_base, base_buffer_size);
                 } break;
             }
+            if (e.base.type == EVENT_TYPE_NETWORK_PROTOCOL_DISCONNECT) {
+                // server side drop, sent or not, the connection goes away now instead of whenever the peer closes it
+                close_m.lock();
+                close_requests.push_back(e.base.client_id);
+                close_m.unlock();
+            }
+            event_destroy(&e);
         }
 
         free(data_buffer_base);
     }
 
+    void NetworkServer::send_pending(connection* conn, uint8_t* buf, uint32_t buf_size)
+    {
+        while (true) {
+            int pend_len = BIO_ctrl_pending(conn->send_bio);
+            printf("[----] > pending to send: %i bytes\n", pend_len);
+            if (pend_len == 0) {
+                // nothing pending to send
+                break;
+            }
+            int send_len = BIO_read(conn->send_bio, buf, buf_size);
+            printf("[----] > ssl outputs %i bytes for sending\n", send_len);
+            if (send_len == 0) {
+                // empty read, can this happen?
+                break;
+            }
+            int sent_len = SDLNet_TCP_Send(conn->socket, buf, send_len);
+            if (sent_len != send_len) {
+                printf("[WARN] > packet sending failed\n");
+            } else {
+                printf("[----] > sent %d bytes of data to client id %d\n", sent_len, conn->client_id);
+            }
+        }
+    }
+
+    void NetworkServer::close_connection(connection* conn)
+    {
+        SDLNet_TCP_DelSocket(client_socketset, conn->socket);
+        SDLNet_TCP_Close(conn->socket);
+        switch (conn->state) {
+            default:
+            case PROTOCOL_CONNECTION_STATE_NONE: {
+                printf("[WARN] < client id %d connection closed before initialization\n", conn->client_id);
+            } break;
+            case PROTOCOL_CONNECTION_STATE_INITIALIZING: {
+                printf("[WARN] < client id %d connection closed while initializing\n", conn->client_id);
+            } break;
+            case PROTOCOL_CONNECTION_STATE_WARNHELD:
+            case PROTOCOL_CONNECTION_STATE_ACCEPTED: // both closed unexpectedly
+            case PROTOCOL_CONNECTION_STATE_PRECLOSE: {
+                // pass, everything fine
+                if (conn->state == PROTOCOL_CONNECTION_STATE_PRECLOSE) {
+                    printf("[INFO] < client id %d connection closed\n", conn->client_id);
+                } else {
+                    printf("[WARN] < client id %d connection closed unexpectedly\n", conn->client_id);
+                }
+                event_any es;
+                event_create_type_client(&es, EVENT_TYPE_NETWORK_ADAPTER_CLIENT_DISCONNECTED, conn->client_id);
+                event_queue_push(recv_queue, &es);
+            } break;
+        }
+        if (metrics) {
+            metrics->state_leave(conn->state);
+            if (conn->state == PROTOCOL_CONNECTION_STATE_NONE || conn->state == PROTOCOL_CONNECTION_STATE_INITIALIZING) {
+                metrics->count(metrics->tls_handshakes_failed);
+            }
+        }
+        util_ssl_session_free(conn);
+        conn->reset(); // sets everything 0/NULL/NONE
+    }
+
     void NetworkServer::recv_loop()
     {
         uint32_t buffer_size = 16384;
@@ -297,6 +409,22 @@ namespace Network {
             if (ready == -1) {
                 break;
             }
+            close_m.lock();
+            std::vector<uint32_t> closing;
+            closing.swap(close_requests);
+            close_m.unlock();
+            for (uint32_t client_id : closing) {
+                for (uint32_t i = 0; i < client_connection_bucket_size; i++) {
+                    if (client_connections[i].socket != NULL && client_connections[i].client_id == client_id) {
+                        if (SDLNet_SocketReady(client_connections[i].socket)) {
+                            // would be served below otherwise, the closed slot is not ready anymore
+                            ready--;
+                        }
+                        close_connection(&client_connections[i]);
+                        break;
+                    }
+                }
+            }
             connection* ready_client = NULL;
             for (uint32_t i = 0; i < client_connection_bucket_size; i++) {
                 //TODO traverse clients in order of activity
@@ -313,32 +441,7 @@ namespace Network {
                 int recv_len = SDLNet_TCP_Recv(ready_client->socket, data_buffer, buffer_size);
                 if (recv_len <= 0) {
                     // connection closed
-                    SDLNet_TCP_DelSocket(client_socketset, ready_client->socket);
-                    SDLNet_TCP_Close(ready_client->socket);
-                    switch (ready_client->state) {
-                        default:
-                        case PROTOCOL_CONNECTION_STATE_NONE: {
-                            printf("[WARN] < client id %d connection closed before initialization\n", ready_client->client_id);
-                        } break;
-                        case PROTOCOL_CONNECTION_STATE_INITIALIZING: {
-                            printf("[WARN] < client id %d connection closed while initializing\n", ready_client->client_id);
-                        } break;
-                        case PROTOCOL_CONNECTION_STATE_WARNHELD:
-                        case PROTOCOL_CONNECTION_STATE_ACCEPTED: // both closed unexpectedly
-                        case PROTOCOL_CONNECTION_STATE_PRECLOSE: {
-                            // pass, everything fine
-                            if (ready_client->state == PROTOCOL_CONNECTION_STATE_PRECLOSE) {
-                                printf("[INFO] < client id %d connection closed\n", ready_client->client_id);
-                            } else {
-                                printf("[WARN] < client id %d connection closed unexpectedly\n", ready_client->client_id);
-                            }
-                            event_any es;
-                            event_create_type_client(&es, EVENT_TYPE_NETWORK_ADAPTER_CLIENT_DISCONNECTED, ready_client->client_id);
-                            event_queue_push(recv_queue, &es);
-                        } break;
-                    }
-                    util_ssl_session_free(ready_client);
-                    ready_client->reset(); // sets everything 0/NULL/NONE
+                    close_connection(ready_client);
                     continue;
                 }
                 printf("[----] < tcp received %i bytes\n", recv_len);
@@ -351,7 +454,7 @@ namespace Network {
                 if (ready_client->state == PROTOCOL_CONNECTION_STATE_NONE) {
                     // first client response after connection established
                     printf("[----] < client id %d connection initializing\n", ready_client->client_id);
-                    ready_client->state = PROTOCOL_CONNECTION_STATE_INITIALIZING;
+                    set_state(ready_client, PROTOCOL_CONNECTION_STATE_INITIALIZING);
                 }
 
                 // forward tcp->ssl
@@ -379,7 +482,10 @@ namespace Network {
                     }
                     // handshake is finished, promote connection state if possible
                     // no verification necessary on server side
-                    ready_client->state = PROTOCOL_CONNECTION_STATE_ACCEPTED;
+                    set_state(ready_client, PROTOCOL_CONNECTION_STATE_ACCEPTED);
+                    if (metrics) {
+                        metrics->count(metrics->tls_handshakes_completed);
+                    }
                     printf("[INFO] < client %d connection accepted\n", ready_client->client_id);
                     //REWORK this never reaches the client at the right point in time, it is sent before the adapter is installed
                     // somehow make sure we only USE the client when has authenticated, i.e. installed its adapter
@@ -462,7 +568,7 @@ namespace Network {
                             break; // drop null events
                         case EVENT_TYPE_NETWORK_PROTOCOL_DISCONNECT: {
                             //REWORK need more?
-                            ready_client->state = PROTOCOL_CONNECTION_STATE_PRECLOSE;
+                            set_state(ready_client, PROTOCOL_CONNECTION_STATE_PRECLOSE);
                         } break;
                         case EVENT_TYPE_NETWORK_PROTOCOL_PING: {
                             printf("[INFO] < ping from client sending pong\n");
@@ -471,8 +577,16 @@ namespace Network {
                             event_queue_push(&send_queue, &es);
                         } break;
                         default: {
+                            if (!client_event_allowed(recv_event.base.type)) {
+                                printf("[WARN] < dropping internal event type %d from client id %d\n", recv_event.base.type, ready_client->client_id);
+                                event_destroy(&recv_event);
+                                break;
+                            }
                             printf("[----] < received event from client id %d, type: %d\n", ready_client->client_id, recv_event.base.type);
                             event_queue_push(recv_queue, &recv_event);
+                            if (metrics) {
+                                metrics->count(metrics->events_in);
+                            }
                         } break;
                     }
                 }
@@ -1,12 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 #include "SDL_net.h"
 #include <openssl/ssl.h>
 
 #include "mirabel/event_queue.h"
+#include "control/server_metrics.hpp"
 #include "network/util.hpp"
 
 namespace Network {
@@ -39,10 +42,19 @@ namespace Network {
 
         //TODO doubly linked list for client activity + client counter per bucket
 
+        // client ids the send_runner is done with, the recv_runner owns the sockets and closes them
+        std::mutex close_m;
+        std::vector<uint32_t> close_requests;
+
+        void set_state(connection* conn, PROTOCOL_CONNECTION_STATE state); // keeps the per state client counts in the metrics
+        void close_connection(connection* conn); // recv_runner only, frees the slot and reports the disconnect once
+        void send_pending(connection* conn, uint8_t* buf, uint32_t buf_size); // forward everything ssl has pending for conn to its socket, buf is scratch space
+
       public:
 
         event_queue send_queue;
         event_queue* recv_queue;
+        Control::server_metrics* metrics = NULL; // set before open, if any
 
         NetworkServer();
         ~NetworkServer();
@@ -50,6 +62,9 @@ namespace Network {
         bool open(const char* host_address, uint16_t host_port);
         void close();
 
+        // threadsafe, the client is told to disconnect, then its connection is closed without waiting for the peer
+        void drop_client(uint32_t client_id);
+
         void server_loop();
         void send_loop();
         void recv_loop();
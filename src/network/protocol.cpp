@@ -6,4 +6,30 @@ namespace Network {
 
     const size_t SHA256_LEN = 32; // sha256 produces 32bytes by definition
 
+    bool client_event_allowed(EVENT_TYPE type)
+    {
+        switch (type) {
+            case EVENT_TYPE_GAME_LOAD:
+            case EVENT_TYPE_GAME_UNLOAD:
+            case EVENT_TYPE_GAME_STATE:
+            case EVENT_TYPE_GAME_MOVE:
+            case EVENT_TYPE_GAME_TIMECTL:
+            case EVENT_TYPE_USER_AUTHINFO:
+            case EVENT_TYPE_USER_AUTHN:
+            case EVENT_TYPE_USER_REGISTER:
+            case EVENT_TYPE_USER_AUTHFAIL: // logout
+            case EVENT_TYPE_LOBBY_JOIN:
+            case EVENT_TYPE_LOBBY_LEAVE:
+            case EVENT_TYPE_LOBBY_CHAT_MSG:
+            case EVENT_TYPE_LOBBY_CHAT_DEL:
+            case EVENT_TYPE_LOBBY_SEEK_ADD:
+            case EVENT_TYPE_LOBBY_SEEK_REMOVE:
+            case EVENT_TYPE_LOBBY_SEEK_SUBSCRIBE:
+            case EVENT_TYPE_LOBBY_SEEK_UNSUBSCRIBE:
+                return true;
+            default:
+                return false;
+        }
+    }
+
 }; // namespace Network
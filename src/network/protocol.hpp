@@ -3,6 +3,8 @@
 #include <cstddef>
 #include <cstdint>
 
+#include "mirabel/event.h"
+
 namespace Network {
 
     //will hold info for the state machine driven by EVENT_TYPE_NETWORK_PROTOCOL_*
@@ -15,6 +17,10 @@ namespace Network {
         PROTOCOL_CONNECTION_STATE_INITIALIZING, // doing ssl handshake
         PROTOCOL_CONNECTION_STATE_WARNHELD, // ssl handshake done, verify failed
         PROTOCOL_CONNECTION_STATE_ACCEPTED, // ssl handshake done, either verify passed or user accepted warning
+        PROTOCOL_CONNECTION_STATE_COUNT,
     };
 
+    // true for the event types a client may send to the server, everything else is internal and dropped at the network boundary
+    bool client_event_allowed(EVENT_TYPE type);
+
 } // namespace Network